@@ -0,0 +1,373 @@
+﻿#include "JobSystem.h"
+
+struct Job
+{
+	JobSystem::JobFunc	func;
+	JobCounter*			counter = nullptr;
+};
+
+static thread_local int32 G_WorkerIndex = -1;
+
+// ---------------------------------------- JobDeque ----------------------------------------
+
+JobDeque::JobDeque()
+	: m_Top(0)
+	, m_Bottom(0)
+{
+	for (int32 i = 0; i < Capacity; ++i) {
+		m_Buffer[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+bool JobDeque::Push(Job* job)
+{
+	int64 bottom = m_Bottom.load(std::memory_order_relaxed);
+	int64 top    = m_Top.load(std::memory_order_acquire);
+	if (bottom - top >= Capacity) {
+		return false;
+	}
+
+	m_Buffer[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* JobDeque::Pop()
+{
+	int64 bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+	m_Bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 top = m_Top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = m_Buffer[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		// 最后一个，和steal抢
+		if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			job = nullptr;
+		}
+		m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* JobDeque::Steal()
+{
+	int64 top = m_Top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 bottom = m_Bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom) {
+		return nullptr;
+	}
+
+	Job* job = m_Buffer[top & (Capacity - 1)].load(std::memory_order_relaxed);
+	if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+		return nullptr;
+	}
+
+	return job;
+}
+
+// ---------------------------------------- JobSystem ----------------------------------------
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+int32 JobSystem::GetWorkerIndex()
+{
+	return G_WorkerIndex;
+}
+
+JobSystem::JobSystem()
+	: m_GlobalCount(0)
+	, m_NumSleeping(0)
+	, m_TimeToDie(false)
+{
+	// 主线程也会在Wait里执行job，工作线程少开一个
+	int32 numThreads = std::thread::hardware_concurrency();
+	numThreads = numThreads > 1 ? numThreads - 1 : 1;
+
+	for (int32 i = 0; i < numThreads; ++i) {
+		m_Deques.push_back(new JobDeque());
+	}
+
+	for (int32 i = 0; i < numThreads; ++i) {
+		m_Workers.push_back(std::thread(&JobSystem::WorkerMain, this, i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lockGuard(m_SleepMutex);
+		m_TimeToDie.store(true);
+	}
+	m_SleepCondition.notify_all();
+
+	for (int32 i = 0; i < m_Workers.size(); ++i) {
+		m_Workers[i].join();
+	}
+
+	for (int32 i = 0; i < m_Deques.size(); ++i) {
+		delete m_Deques[i];
+	}
+	m_Deques.clear();
+}
+
+void JobSystem::Run(const JobFunc& func, JobCounter* counter)
+{
+	if (counter) {
+		counter->m_Count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job* job = new Job();
+	job->func    = func;
+	job->counter = counter;
+	Submit(job);
+}
+
+void JobSystem::RunAfter(JobCounter* dependency, const JobFunc& func, JobCounter* counter)
+{
+	if (counter) {
+		counter->m_Count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job* job = new Job();
+	job->func    = func;
+	job->counter = counter;
+
+	{
+		std::lock_guard<std::mutex> lockGuard(dependency->m_Mutex);
+		if (!dependency->IsDone())
+		{
+			dependency->m_Continuations.push_back(job);
+			return;
+		}
+	}
+
+	Submit(job);
+}
+
+void JobSystem::ParallelFor(int32 count, int32 grainSize, const RangeFunc& func, JobCounter* counter)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	grainSize = grainSize > 0 ? grainSize : 1;
+
+	JobCounter localCounter;
+	JobCounter* waitCounter = counter ? counter : &localCounter;
+
+	// 子job共享同一个函数对象，调用方返回后依然有效
+	std::shared_ptr<RangeFunc> shared = std::make_shared<RangeFunc>(func);
+	waitCounter->m_Count.fetch_add(1, std::memory_order_relaxed);
+	Job* job = new Job();
+	job->counter = waitCounter;
+	job->func = [this, count, grainSize, shared, waitCounter]() {
+		SplitRange(0, count, grainSize, shared, waitCounter);
+	};
+	Submit(job);
+
+	if (counter == nullptr) {
+		Wait(&localCounter);
+	}
+}
+
+void JobSystem::SplitRange(int32 begin, int32 end, int32 grainSize, const std::shared_ptr<RangeFunc>& func, JobCounter* counter)
+{
+	// 后一半交出去，前一半继续拆，最大的块留在deque顶部最先被偷走
+	while (end - begin > grainSize)
+	{
+		int32 middle = begin + (end - begin) / 2;
+
+		counter->m_Count.fetch_add(1, std::memory_order_relaxed);
+		Job* job = new Job();
+		job->counter = counter;
+		job->func = [this, middle, end, grainSize, func, counter]() {
+			SplitRange(middle, end, grainSize, func, counter);
+		};
+		Submit(job);
+
+		end = middle;
+	}
+
+	(*func)(begin, end);
+}
+
+void JobSystem::Submit(Job* job)
+{
+	int32 workerIndex = G_WorkerIndex;
+	if (workerIndex < 0 || !m_Deques[workerIndex]->Push(job))
+	{
+		std::lock_guard<std::mutex> lockGuard(m_GlobalMutex);
+		m_GlobalQueue.push_back(job);
+		m_GlobalCount.fetch_add(1, std::memory_order_seq_cst);
+	}
+
+	// 和WorkerMain里的m_NumSleeping/HasPendingJob配对，保证不会丢失唤醒
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_NumSleeping.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lockGuard(m_SleepMutex);
+		m_SleepCondition.notify_one();
+	}
+}
+
+Job* JobSystem::FindJob()
+{
+	int32 workerIndex = G_WorkerIndex;
+
+	// 自己的deque
+	if (workerIndex >= 0)
+	{
+		Job* job = m_Deques[workerIndex]->Pop();
+		if (job) {
+			return job;
+		}
+	}
+
+	// 全局队列
+	if (m_GlobalCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lockGuard(m_GlobalMutex);
+		if (m_GlobalQueue.size() > 0)
+		{
+			Job* job = m_GlobalQueue.front();
+			m_GlobalQueue.pop_front();
+			m_GlobalCount.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	// 从其他线程偷，起点错开避免大家都挤在第一个deque上
+	int32 numDeques = m_Deques.size();
+	int32 start = workerIndex >= 0 ? workerIndex + 1 : 0;
+	for (int32 i = 0; i < numDeques; ++i)
+	{
+		int32 victim = (start + i) % numDeques;
+		if (victim == workerIndex) {
+			continue;
+		}
+		Job* job = m_Deques[victim]->Steal();
+		if (job) {
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+bool JobSystem::HasPendingJob()
+{
+	if (m_GlobalCount.load(std::memory_order_seq_cst) > 0) {
+		return true;
+	}
+	for (int32 i = 0; i < m_Deques.size(); ++i)
+	{
+		if (!m_Deques[i]->IsEmpty()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::TryRunJob()
+{
+	Job* job = FindJob();
+	if (job == nullptr) {
+		return false;
+	}
+
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->func();
+
+	JobCounter* counter = job->counter;
+	delete job;
+
+	if (counter) {
+		FinishJob(counter);
+	}
+}
+
+void JobSystem::FinishJob(JobCounter* counter)
+{
+	int32 value = counter->m_Count.load(std::memory_order_relaxed);
+	while (value > 1)
+	{
+		if (counter->m_Count.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			return;
+		}
+	}
+
+	// 可能是最后一个，归零必须在锁内，否则等待方看到归零后销毁计数器，这里再加锁就访问了无效内存
+	std::vector<Job*> continuations;
+	{
+		std::lock_guard<std::mutex> lockGuard(counter->m_Mutex);
+		if (counter->m_Count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			continuations.swap(counter->m_Continuations);
+		}
+	}
+
+	for (int32 i = 0; i < continuations.size(); ++i) {
+		Submit(continuations[i]);
+	}
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	while (!counter->IsDone())
+	{
+		if (!TryRunJob()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::WorkerMain(int32 index)
+{
+	G_WorkerIndex = index;
+
+	while (!m_TimeToDie.load(std::memory_order_relaxed))
+	{
+		if (TryRunJob()) {
+			continue;
+		}
+
+		// 短暂自旋，job通常是成批提交的
+		bool found = false;
+		for (int32 i = 0; i < 64 && !found; ++i)
+		{
+			std::this_thread::yield();
+			found = TryRunJob();
+		}
+		if (found) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lockGuard(m_SleepMutex);
+		m_NumSleeping.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!m_TimeToDie.load(std::memory_order_relaxed) && !HasPendingJob()) {
+			m_SleepCondition.wait(lockGuard);
+		}
+		m_NumSleeping.fetch_sub(1, std::memory_order_seq_cst);
+	}
+}
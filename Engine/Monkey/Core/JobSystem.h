@@ -0,0 +1,147 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+struct Job;
+
+// 一组job共用一个计数器，Run时加一，job执行完减一，归零表示全部完成。
+// 归零时会调度通过RunAfter挂在上面的job。
+class JobCounter
+{
+public:
+	JobCounter()
+		: m_Count(0)
+	{
+
+	}
+
+	~JobCounter()
+	{
+		// 等最后一个完成的job放开锁，Wait返回后计数器可能马上就被销毁
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+	}
+
+	inline bool IsDone() const
+	{
+		return m_Count.load(std::memory_order_acquire) == 0;
+	}
+
+	inline int32 GetValue() const
+	{
+		return m_Count.load(std::memory_order_acquire);
+	}
+
+private:
+	friend class JobSystem;
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	std::atomic<int32>	m_Count;
+	std::mutex			m_Mutex;
+	std::vector<Job*>	m_Continuations;
+};
+
+/**
+ * Chase-Lev work stealing deque. The owning worker pushes and pops at the bottom, any other
+ * thread steals from the top. Fixed capacity, Push returns false when full.
+ */
+class JobDeque
+{
+public:
+	JobDeque();
+
+	bool Push(Job* job);
+
+	Job* Pop();
+
+	Job* Steal();
+
+	inline bool IsEmpty() const
+	{
+		return m_Bottom.load(std::memory_order_relaxed) <= m_Top.load(std::memory_order_relaxed);
+	}
+
+private:
+	enum { Capacity = 4096 };
+
+	std::atomic<int64>	m_Top;
+	std::atomic<int64>	m_Bottom;
+	std::atomic<Job*>	m_Buffer[Capacity];
+};
+
+/**
+ * 进程内共享的job线程池，第一次Get()时按CPU核数创建工作线程。
+ * 每个工作线程有自己的deque，job里再Run的子job压进自己的deque，空闲的线程从别的deque偷取。
+ * 非工作线程提交的job进入全局队列。没有工作时线程睡眠，有新job时唤醒。
+ * Wait()不会阻塞调用线程，等待期间调用线程也会执行job，所以job里面再Run/Wait子job也不会死锁。
+ */
+class JobSystem
+{
+public:
+	typedef std::function<void()> JobFunc;
+	typedef std::function<void(int32 begin, int32 end)> RangeFunc;
+
+	static JobSystem& Get();
+
+	void Run(const JobFunc& func, JobCounter* counter = nullptr);
+
+	// dependency归零后才开始执行
+	void RunAfter(JobCounter* dependency, const JobFunc& func, JobCounter* counter = nullptr);
+
+	// [0, count)按grainSize递归二分，子区间可以被其他线程偷走。counter为空时等待全部完成再返回。
+	void ParallelFor(int32 count, int32 grainSize, const RangeFunc& func, JobCounter* counter = nullptr);
+
+	void Wait(JobCounter* counter);
+
+	inline int32 GetNumWorkers() const
+	{
+		return m_Workers.size();
+	}
+
+	// 当前线程是第几个工作线程，非工作线程返回-1
+	static int32 GetWorkerIndex();
+
+private:
+	JobSystem();
+
+	~JobSystem();
+
+	void Submit(Job* job);
+
+	Job* FindJob();
+
+	bool HasPendingJob();
+
+	bool TryRunJob();
+
+	void Execute(Job* job);
+
+	void FinishJob(JobCounter* counter);
+
+	void SplitRange(int32 begin, int32 end, int32 grainSize, const std::shared_ptr<RangeFunc>& func, JobCounter* counter);
+
+	void WorkerMain(int32 index);
+
+private:
+	std::vector<std::thread>	m_Workers;
+	std::vector<JobDeque*>		m_Deques;
+
+	// 非工作线程提交的job
+	std::mutex					m_GlobalMutex;
+	std::deque<Job*>			m_GlobalQueue;
+	std::atomic<int32>			m_GlobalCount;
+
+	std::mutex					m_SleepMutex;
+	std::condition_variable		m_SleepCondition;
+	std::atomic<int32>			m_NumSleeping;
+	std::atomic<bool>			m_TimeToDie;
+};
@@ -0,0 +1,305 @@
+﻿#include "DVKAnimCompression.h"
+#include "DVKModel.h"
+
+namespace vk_demo
+{
+	// 1 / sqrt(2)，smallest-three剩下的三个分量一定在[-kQuatRange, kQuatRange]之间
+	static const float kQuatRange = 0.70710678f;
+
+	static void EncodeVector3(const Vector3& value, const Vector3& rangeMin, const Vector3& rangeExtent, uint16* outData)
+	{
+		for (int32 i = 0; i < 3; ++i)
+		{
+			float normalized = rangeExtent[i] > 0.0f ? (value[i] - rangeMin[i]) / rangeExtent[i] : 0.0f;
+			outData[i] = (uint16)MMath::Clamp(MMath::RoundToInt(normalized * 65535.0f), 0, 65535);
+		}
+	}
+
+	static Vector3 DecodeVector3(const uint16* data, const Vector3& rangeMin, const Vector3& rangeExtent)
+	{
+		const float scale = 1.0f / 65535.0f;
+		return Vector3(
+			rangeMin.x + data[0] * scale * rangeExtent.x,
+			rangeMin.y + data[1] * scale * rangeExtent.y,
+			rangeMin.z + data[2] * scale * rangeExtent.z
+		);
+	}
+
+	// 最大分量的序号占2位，分别放在前两个uint16的最高位，其余三个分量各15位
+	static void EncodeQuat(const Quat& value, uint16* outData)
+	{
+		Quat quat = value.GetNormalized();
+		float comps[4] = { quat.x, quat.y, quat.z, quat.w };
+
+		int32 largest = 0;
+		for (int32 i = 1; i < 4; ++i) {
+			if (MMath::Abs(comps[i]) > MMath::Abs(comps[largest])) {
+				largest = i;
+			}
+		}
+
+		// q和-q是同一个旋转，翻转到最大分量为正，解码时就不需要符号位
+		float sign = comps[largest] < 0.0f ? -1.0f : 1.0f;
+
+		int32 index = 0;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (i == largest) {
+				continue;
+			}
+			float normalized = (comps[i] * sign / kQuatRange) * 0.5f + 0.5f;
+			outData[index++] = (uint16)MMath::Clamp(MMath::RoundToInt(normalized * 32767.0f), 0, 32767);
+		}
+
+		outData[0] |= (largest & 1) << 15;
+		outData[1] |= (largest >> 1) << 15;
+	}
+
+	static Quat DecodeQuat(const uint16* data)
+	{
+		int32 largest = (data[0] >> 15) | ((data[1] >> 15) << 1);
+
+		float comps[4];
+		float sum   = 0.0f;
+		int32 index = 0;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (i == largest) {
+				continue;
+			}
+			float normalized = (data[index++] & 0x7FFF) / 32767.0f;
+			comps[i] = (normalized * 2.0f - 1.0f) * kQuatRange;
+			sum += comps[i] * comps[i];
+		}
+		comps[largest] = MMath::Sqrt(MMath::Max(0.0f, 1.0f - sum));
+
+		return Quat(comps[0], comps[1], comps[2], comps[3]);
+	}
+
+	// 均匀分布的key，直接算出时间落在哪两个key之间
+	static void GetKeyIndex(const DVKCompressedTrack& track, float time, float duration, int32& outIndex, float& outAlpha)
+	{
+		if (track.numKeys <= 1 || duration <= 0.0f)
+		{
+			outIndex = 0;
+			outAlpha = 0.0f;
+			return;
+		}
+
+		float position = time / duration * (track.numKeys - 1);
+		outIndex = MMath::Clamp(MMath::FloorToInt(position), 0, (int32)track.numKeys - 2);
+		outAlpha = MMath::Clamp(position - outIndex, 0.0f, 1.0f);
+	}
+
+	static Vector3 SampleVector3(const DVKCompressedTrack& track, const uint16* data, float time, float duration)
+	{
+		int32 index = 0;
+		float alpha = 0.0f;
+		GetKeyIndex(track, time, duration, index, alpha);
+
+		const uint16* key = data + track.offset + index * 3;
+		Vector3 prev = DecodeVector3(key, track.rangeMin, track.rangeExtent);
+		if (alpha == 0.0f) {
+			return prev;
+		}
+
+		Vector3 next = DecodeVector3(key + 3, track.rangeMin, track.rangeExtent);
+		return MMath::Lerp(prev, next, alpha);
+	}
+
+	static Quat SampleQuat(const DVKCompressedTrack& track, const uint16* data, float time, float duration)
+	{
+		int32 index = 0;
+		float alpha = 0.0f;
+		GetKeyIndex(track, time, duration, index, alpha);
+
+		const uint16* key = data + track.offset + index * 3;
+		Quat prev = DecodeQuat(key);
+		if (alpha == 0.0f) {
+			return prev;
+		}
+
+		Quat next = DecodeQuat(key + 3);
+		return MMath::Lerp(prev, next, alpha);
+	}
+
+	void DVKCompressedClip::Sample(float time, Vector3& outPosition, Quat& outRotation, Vector3& outScale) const
+	{
+		time = MMath::Clamp(time, 0.0f, duration);
+
+		outPosition = positions.numKeys > 0 ? SampleVector3(positions, data.data(), time, duration) : Vector3(0, 0, 0);
+		outScale    = scales.numKeys    > 0 ? SampleVector3(scales,    data.data(), time, duration) : Vector3(1, 1, 1);
+		outRotation = rotations.numKeys > 0 ? SampleQuat(rotations,    data.data(), time, duration) : Quat(0, 0, 0, 1);
+	}
+
+	uint32 DVKCompressedClip::GetMemorySize() const
+	{
+		return sizeof(DVKCompressedClip) + data.size() * sizeof(uint16);
+	}
+
+	uint32 DVKCompressedClip::GetRawMemorySize(const DVKAnimationClip& clip)
+	{
+		uint32 size = sizeof(DVKAnimationClip);
+		size += clip.positions.keys.size() * (sizeof(float) + sizeof(Vector3));
+		size += clip.scales.keys.size()    * (sizeof(float) + sizeof(Vector3));
+		size += clip.rotations.keys.size() * (sizeof(float) + sizeof(Quat));
+		return size;
+	}
+
+	// 原始数据按以前的方式插值
+	static Vector3 SampleRaw(const DVKAnimChannel<Vector3>& channel, float time)
+	{
+		float alpha = 0.0f;
+		Vector3 prev(0, 0, 0);
+		Vector3 next(0, 0, 0);
+		channel.GetValue(time, prev, next, alpha);
+		return MMath::Lerp(prev, next, alpha);
+	}
+
+	static Quat SampleRaw(const DVKAnimChannel<Quat>& channel, float time)
+	{
+		float alpha = 0.0f;
+		Quat prev(0, 0, 0, 1);
+		Quat next(0, 0, 0, 1);
+		channel.GetValue(time, prev, next, alpha);
+		return MMath::Lerp(prev, next, alpha);
+	}
+
+	static float GetError(const Vector3& a, const Vector3& b)
+	{
+		return (a - b).Size();
+	}
+
+	// 两个旋转之间的夹角。角度很小时acos(dot)受float精度限制，用弦长算
+	static float GetError(const Quat& a, const Quat& b)
+	{
+		float sign  = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f ? -1.0f : 1.0f;
+		float dx    = a.x - b.x * sign;
+		float dy    = a.y - b.y * sign;
+		float dz    = a.z - b.z * sign;
+		float dw    = a.w - b.w * sign;
+		float chord = MMath::Sqrt(dx * dx + dy * dy + dz * dz + dw * dw);
+		return MMath::RadiansToDegrees(4.0f * MMath::Asin(MMath::Min(chord * 0.5f, 1.0f)));
+	}
+
+	static void EncodeTrack(const std::vector<Vector3>& values, DVKCompressedTrack& track, uint16* outData)
+	{
+		Vector3 rangeMax = values[0];
+		track.rangeMin   = values[0];
+		for (int32 i = 1; i < values.size(); ++i)
+		{
+			track.rangeMin = Vector3::Min(track.rangeMin, values[i]);
+			rangeMax       = Vector3::Max(rangeMax, values[i]);
+		}
+		track.rangeExtent = rangeMax - track.rangeMin;
+
+		for (int32 i = 0; i < values.size(); ++i) {
+			EncodeVector3(values[i], track.rangeMin, track.rangeExtent, outData + i * 3);
+		}
+	}
+
+	static void EncodeTrack(const std::vector<Quat>& values, DVKCompressedTrack& track, uint16* outData)
+	{
+		for (int32 i = 0; i < values.size(); ++i) {
+			EncodeQuat(values[i], outData + i * 3);
+		}
+	}
+
+	static void SampleTrack(const DVKCompressedTrack& track, const uint16* data, float time, float duration, Vector3& outValue)
+	{
+		outValue = SampleVector3(track, data, time, duration);
+	}
+
+	static void SampleTrack(const DVKCompressedTrack& track, const uint16* data, float time, float duration, Quat& outValue)
+	{
+		outValue = SampleQuat(track, data, time, duration);
+	}
+
+	/**
+	 * 从1个key开始，每次key的间隔减半，找到满足误差的最少key数量。先尝试到sampleRate，
+	 * 原始数据在帧之间还有key(FBX曲线烘焙出来的很常见)时继续加密，最多到maxSampleRate，
+	 * 仍然不满足时误差如实记录。
+	 */
+	template<class ValueType>
+	static void CompressTrack(const DVKAnimChannel<ValueType>& channel, float duration, const DVKAnimCompressSettings& settings, float tolerance, DVKCompressedTrack& outTrack, std::vector<uint16>& outData, float& outMaxError)
+	{
+		outTrack    = DVKCompressedTrack();
+		outMaxError = 0.0f;
+
+		if (channel.keys.size() == 0) {
+			return;
+		}
+
+		int32 numFrames = MMath::Max(2, MMath::CeilToInt(duration * settings.sampleRate) + 1);
+		int32 maxFrames = MMath::Max(numFrames, MMath::CeilToInt(duration * settings.maxSampleRate) + 1);
+
+		// 固定帧率的时间点、原始key以及它们的中点，中点是两边插值结果相差最大的位置
+		std::vector<float> checkTimes;
+		for (int32 i = 0; i < numFrames * 2 - 1; ++i) {
+			checkTimes.push_back(duration * i / (numFrames * 2 - 2));
+		}
+		for (int32 i = 0; i < channel.keys.size(); ++i)
+		{
+			checkTimes.push_back(MMath::Clamp(channel.keys[i], 0.0f, duration));
+			if (i + 1 < channel.keys.size()) {
+				checkTimes.push_back(MMath::Clamp((channel.keys[i] + channel.keys[i + 1]) * 0.5f, 0.0f, duration));
+			}
+		}
+
+		std::vector<ValueType> reference(checkTimes.size());
+		for (int32 i = 0; i < checkTimes.size(); ++i) {
+			reference[i] = SampleRaw(channel, checkTimes[i]);
+		}
+
+		std::vector<ValueType> values;
+		std::vector<uint16> encoded;
+
+		for (int32 numKeys = 1; ; )
+		{
+
+			values.resize(numKeys);
+			for (int32 i = 0; i < numKeys; ++i) {
+				values[i] = SampleRaw(channel, numKeys > 1 ? duration * i / (numKeys - 1) : 0.0f);
+			}
+
+			DVKCompressedTrack track;
+			track.numKeys = numKeys;
+			encoded.resize(numKeys * 3);
+			EncodeTrack(values, track, encoded.data());
+
+			float maxError = 0.0f;
+			for (int32 i = 0; i < checkTimes.size(); ++i) {
+				ValueType value;
+				SampleTrack(track, encoded.data(), checkTimes[i], duration, value);
+				maxError = MMath::Max(maxError, GetError(value, reference[i]));
+			}
+
+			if (maxError <= tolerance || numKeys >= maxFrames)
+			{
+				outTrack        = track;
+				outTrack.offset = outData.size();
+				outData.insert(outData.end(), encoded.begin(), encoded.end());
+				outMaxError     = maxError;
+				return;
+			}
+
+			// 1, 2, 3, 5, 9...，中间一定会经过numFrames
+			int32 nextKeys = numKeys == 1 ? 2 : numKeys * 2 - 1;
+			if (numKeys < numFrames) {
+				nextKeys = MMath::Min(nextKeys, numFrames);
+			}
+			numKeys = MMath::Min(nextKeys, maxFrames);
+		}
+	}
+
+	void DVKCompressedClip::Compress(const DVKAnimationClip& clip, const DVKAnimCompressSettings& settings, DVKCompressedClip& outClip)
+	{
+		outClip = DVKCompressedClip();
+		outClip.duration = clip.duration;
+
+		CompressTrack(clip.positions, clip.duration, settings, settings.positionTolerance, outClip.positions, outClip.data, outClip.maxPositionError);
+		CompressTrack(clip.scales,    clip.duration, settings, settings.scaleTolerance,    outClip.scales,    outClip.data, outClip.maxScaleError);
+		CompressTrack(clip.rotations, clip.duration, settings, settings.rotationTolerance, outClip.rotations, outClip.data, outClip.maxRotationError);
+	}
+
+};
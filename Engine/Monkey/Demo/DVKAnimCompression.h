@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Quat.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+	struct DVKAnimationClip;
+
+	struct DVKAnimCompressSettings
+	{
+		float	sampleRate = 30.0f;			// 重采样的帧率
+		float	maxSampleRate = 120.0f;		// sampleRate误差超出时，单个通道最多加密到这个帧率
+		float	positionTolerance = 0.001f;	// 模型空间单位
+		float	rotationTolerance = 0.05f;	// 角度
+		float	scaleTolerance = 0.001f;
+	};
+
+	// 一个通道的key在时间上均匀分布，numKeys为1时是常量
+	struct DVKCompressedTrack
+	{
+		uint32	offset = 0;		// 在DVKCompressedClip::data中的起始位置，单位uint16，每个key 3个
+		uint32	numKeys = 0;	// 为0时使用默认值
+		Vector3	rangeMin;		// position/scale按这个范围量化到16位，rotation不使用
+		Vector3	rangeExtent;
+	};
+
+	/**
+	 * Compressed copy of one DVKAnimationClip. Every channel is resampled at a fixed rate, then
+	 * the smallest key count that stays within the tolerance is kept, so a channel that barely
+	 * moves ends up with 1 or 2 keys and only channels with sub-frame detail go above sampleRate. Keys are uniformly spaced over [0, duration], sampling is
+	 * index math only. Rotations use smallest-three with 15 bits per component, positions and
+	 * scales 16 bits per component against the channel's range, 6 bytes per key.
+	 */
+	struct DVKCompressedClip
+	{
+		float				duration = 0.0f;
+		DVKCompressedTrack	positions;
+		DVKCompressedTrack	scales;
+		DVKCompressedTrack	rotations;
+		std::vector<uint16>	data;
+
+		// 和原始数据对比的最大误差，rotation为角度
+		float				maxPositionError = 0.0f;
+		float				maxRotationError = 0.0f;
+		float				maxScaleError = 0.0f;
+
+		inline bool IsValid() const
+		{
+			return data.size() > 0;
+		}
+
+		void Sample(float time, Vector3& outPosition, Quat& outRotation, Vector3& outScale) const;
+
+		uint32 GetMemorySize() const;
+
+		// 原始的key和value占用的字节数
+		static uint32 GetRawMemorySize(const DVKAnimationClip& clip);
+
+		static void Compress(const DVKAnimationClip& clip, const DVKAnimCompressSettings& settings, DVKCompressedClip& outClip);
+	};
+
+};
@@ -0,0 +1,260 @@
+﻿#include "DVKAnimTexture.h"
+
+#include "Core/JobSystem.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#include <algorithm>
+
+namespace vk_demo
+{
+	// 舍入到最近的half，超出范围的截断到最大值，不处理NaN
+	static uint16 FloatToHalf(float value)
+	{
+		uint32 bits = 0;
+		memcpy(&bits, &value, sizeof(float));
+
+		uint32 sign = (bits >> 16) & 0x8000;
+		int32 exponent = (int32)((bits >> 23) & 0xFF) - 127 + 15;
+		uint32 mantissa = bits & 0x007FFFFF;
+
+		if (exponent <= 0)
+		{
+			if (exponent < -10) {
+				return sign;
+			}
+			mantissa = (mantissa | 0x00800000) >> (1 - exponent);
+			return sign | ((mantissa + 0x00001000) >> 13);
+		}
+
+		uint32 half = sign | (exponent << 10) | (mantissa >> 13);
+		// 进位可能会溢出到指数位，结果依然正确
+		half += (mantissa >> 12) & 1;
+
+		if ((half & 0x7FFF) >= 0x7C00) {
+			return sign | 0x7BFF;
+		}
+
+		return half;
+	}
+
+	static float HalfToFloat(uint16 value)
+	{
+		uint32 sign = (value & 0x8000) << 16;
+		uint32 exponent = (value >> 10) & 0x1F;
+		uint32 mantissa = value & 0x03FF;
+
+		if (exponent == 0)
+		{
+			float result = mantissa / 1024.0f / 16384.0f;
+			return sign ? -result : result;
+		}
+
+		uint32 bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		float result = 0.0f;
+		memcpy(&result, &bits, sizeof(float));
+		return result;
+	}
+
+	// 和29_SkinInTexture以及shader中的DualQuatTransformPosition一致
+	static void ToDualQuat(const Matrix4x4& transform, float* outData)
+	{
+		Quat quat   = transform.ToQuat();
+		Vector3 pos = transform.GetOrigin();
+
+		outData[0] = quat.x;
+		outData[1] = quat.y;
+		outData[2] = quat.z;
+		outData[3] = quat.w;
+		outData[4] = (+0.5f) * ( pos.x * quat.w + pos.y * quat.z - pos.z * quat.y);
+		outData[5] = (+0.5f) * (-pos.x * quat.z + pos.y * quat.w + pos.z * quat.x);
+		outData[6] = (+0.5f) * ( pos.x * quat.y - pos.y * quat.x + pos.z * quat.w);
+		outData[7] = (-0.5f) * ( pos.x * quat.x + pos.y * quat.y + pos.z * quat.z);
+	}
+
+	static Vector3 DualQuatTranslation(const float* data)
+	{
+		Vector3 real(data[0], data[1], data[2]);
+		Vector3 dual(data[4], data[5], data[6]);
+		float len = MMath::Sqrt(data[0] * data[0] + data[1] * data[1] + data[2] * data[2] + data[3] * data[3]);
+		Vector3 result = (dual * data[3] - real * data[7] + Vector3::CrossProduct(real, dual)) * 2.0f;
+		return len > 0.0f ? result / (len * len) : result;
+	}
+
+	DVKAnimTexture::~DVKAnimTexture()
+	{
+		delete m_Texture;
+		m_Texture = nullptr;
+		m_Model = nullptr;
+	}
+
+	Vector4 DVKAnimTexture::GetClipParam(int32 animIndex, float time) const
+	{
+		const DVKAnimTextureClip& clip = m_Clips[animIndex];
+		return Vector4(clip.startFrame, clip.numFrames, clip.frameRate, MMath::Clamp(time, 0.0f, clip.duration));
+	}
+
+	Vector4 DVKAnimTexture::GetMeshParam(int32 meshIndex) const
+	{
+		const DVKAnimTextureMesh& mesh = m_Meshes[meshIndex];
+		return Vector4(mesh.column, mesh.numBones, 0, 0);
+	}
+
+	void DVKAnimTexture::BakeFrames(int32 begin, int32 end, std::vector<float>& frameErrors)
+	{
+		const int32 texelSize = m_HalfFloat ? sizeof(uint16) * 4 : sizeof(float) * 4;
+
+		DVKAnimPose pose;
+		int32 clipIndex = -1;
+		std::vector<float> dualQuats(m_Width * 4);
+
+		for (int32 frame = begin; frame < end; ++frame)
+		{
+			// 找到帧所在的动画，同一个range里通常只有一个
+			while (clipIndex + 1 < m_Clips.size() && m_Clips[clipIndex + 1].startFrame <= frame)
+			{
+				clipIndex += 1;
+				m_Model->InitPose(pose, clipIndex);
+			}
+
+			const DVKAnimTextureClip& clip = m_Clips[clipIndex];
+			float time = MMath::Min((frame - clip.startFrame) / clip.frameRate, clip.duration);
+			m_Model->EvaluatePose(pose, time);
+
+			for (int32 i = 0; i < m_Meshes.size(); ++i)
+			{
+				const DVKAnimTextureMesh& bakeMesh = m_Meshes[i];
+				DVKMesh* mesh = m_Model->meshes[i];
+
+				if (bakeMesh.numBones == 0)
+				{
+					ToDualQuat(pose.globalMatrices[m_MeshNodes[i]], &dualQuats[bakeMesh.column * 4]);
+					continue;
+				}
+
+				for (int32 j = 0; j < bakeMesh.numBones; ++j) {
+					ToDualQuat(pose.boneMatrices[mesh->bones[j]], &dualQuats[(bakeMesh.column + j * 2) * 4]);
+				}
+			}
+
+			// 一帧一行，所有层连续存放
+			uint8* row = m_Data.data() + (uint64)frame * m_Width * texelSize;
+			if (!m_HalfFloat)
+			{
+				memcpy(row, dualQuats.data(), dualQuats.size() * sizeof(float));
+				continue;
+			}
+
+			uint16* halfs = (uint16*)row;
+			float maxError = 0.0f;
+			for (int32 i = 0; i < m_Width; i += 2)
+			{
+				float decoded[8];
+				for (int32 k = 0; k < 8; ++k)
+				{
+					halfs[i * 4 + k] = FloatToHalf(dualQuats[i * 4 + k]);
+					decoded[k] = HalfToFloat(halfs[i * 4 + k]);
+				}
+				Vector3 delta = DualQuatTranslation(decoded) - DualQuatTranslation(&dualQuats[i * 4]);
+				maxError = MMath::Max(maxError, delta.Size());
+			}
+			frameErrors[frame] = maxError;
+		}
+	}
+
+	bool DVKAnimTexture::Bake(DVKModel* model, const DVKAnimTextureSettings& settings)
+	{
+		m_Model     = model;
+		m_HalfFloat = settings.halfFloat;
+
+		if (model->animations.size() == 0) 
+		{
+			MLOGE("Model has no animation to bake.");
+			return false;
+		}
+
+		// 列
+		m_Width = 0;
+		m_Meshes.resize(model->meshes.size());
+		m_MeshNodes.resize(model->meshes.size());
+		for (int32 i = 0; i < model->meshes.size(); ++i)
+		{
+			DVKMesh* mesh = model->meshes[i];
+			m_Meshes[i].column   = m_Width;
+			m_Meshes[i].numBones = mesh->isSkin ? mesh->bones.size() : 0;
+			m_Width += MMath::Max(m_Meshes[i].numBones, 1) * 2;
+
+			auto it = std::find(model->linearNodes.begin(), model->linearNodes.end(), mesh->linkNode);
+			m_MeshNodes[i] = it == model->linearNodes.end() ? 0 : it - model->linearNodes.begin();
+		}
+
+		// 行
+		m_NumFrames = 0;
+		m_Clips.resize(model->animations.size());
+		for (int32 i = 0; i < model->animations.size(); ++i)
+		{
+			DVKAnimTextureClip& clip = m_Clips[i];
+			clip.duration   = model->animations[i].duration;
+			clip.startFrame = m_NumFrames;
+			clip.numFrames  = MMath::Max(MMath::CeilToInt(clip.duration * settings.sampleRate) + 1, 2);
+			clip.frameRate  = clip.duration > 0.0f ? (clip.numFrames - 1) / clip.duration : settings.sampleRate;
+			m_NumFrames += clip.numFrames;
+		}
+
+		m_LayerHeight = MMath::Min(m_NumFrames, MMath::Max(settings.maxLayerHeight, 1));
+		m_NumLayers   = (m_NumFrames + m_LayerHeight - 1) / m_LayerHeight;
+
+		const int32 texelSize = m_HalfFloat ? sizeof(uint16) * 4 : sizeof(float) * 4;
+		m_Data.resize((uint64)m_NumLayers * m_LayerHeight * m_Width * texelSize, 0);
+
+		double bakeTime = GenericPlatformTime::Seconds();
+
+		std::vector<float> frameErrors(m_NumFrames, 0.0f);
+		JobSystem::Get().ParallelFor(m_NumFrames, 16, [this, &frameErrors](int32 begin, int32 end) {
+			BakeFrames(begin, end, frameErrors);
+		});
+
+		m_BakeTime = GenericPlatformTime::Seconds() - bakeTime;
+
+		m_MaxTranslationError = 0.0f;
+		for (int32 i = 0; i < frameErrors.size(); ++i) {
+			m_MaxTranslationError = MMath::Max(m_MaxTranslationError, frameErrors[i]);
+		}
+
+		MLOG("Anim texture: %d clips, %d frames, %dx%dx%d, %.2fKB, bake %.2fms, max translation error %f", (int32)m_Clips.size(), m_NumFrames, m_Width, m_LayerHeight, m_NumLayers, m_Data.size() / 1024.0f, m_BakeTime * 1000.0f, m_MaxTranslationError);
+
+		return true;
+	}
+
+	DVKAnimTexture* DVKAnimTexture::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, DVKModel* model, const DVKAnimTextureSettings& settings)
+	{
+		DVKAnimTexture* animTexture = new DVKAnimTexture();
+		if (!animTexture->Bake(model, settings))
+		{
+			delete animTexture;
+			return nullptr;
+		}
+
+		const int32 texelSize = animTexture->m_HalfFloat ? sizeof(uint16) * 4 : sizeof(float) * 4;
+		animTexture->m_Texture = DVKTexture::Create2DArray(
+			animTexture->m_Data.data(),
+			animTexture->m_LayerHeight * animTexture->m_Width * texelSize,
+			animTexture->m_NumLayers,
+			animTexture->m_HalfFloat ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT,
+			animTexture->m_Width,
+			animTexture->m_LayerHeight,
+			vulkanDevice,
+			cmdBuffer
+		);
+		animTexture->m_Texture->UpdateSampler(
+			VK_FILTER_NEAREST, 
+			VK_FILTER_NEAREST,
+			VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
+		);
+
+		return animTexture;
+	}
+
+};
@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include "DVKModel.h"
+#include "DVKTexture.h"
+#include "DVKCommand.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+	struct DVKAnimTextureSettings
+	{
+		float	sampleRate = 30.0f;		// 烘焙的帧率，每个动画会微调到整数帧，首尾两帧正好落在0和duration
+		int32	maxLayerHeight = 1024;	// 每一层最多存放的帧数，超出后放到下一层
+		bool	halfFloat = true;		// RGBA16F，否则RGBA32F
+	};
+
+	// 一个动画在纹理中占用的帧，帧在所有层中连续编号
+	struct DVKAnimTextureClip
+	{
+		int32	startFrame = 0;
+		int32	numFrames = 0;
+		float	frameRate = 0.0f;
+		float	duration = 0.0f;
+	};
+
+	// 一个mesh在每一帧中占用的列，每个骨骼两个texel，real + dual。
+	// 没有骨骼的mesh按一个骨骼烘焙它挂接节点的global矩阵。
+	struct DVKAnimTextureMesh
+	{
+		int32	column = 0;
+		int32	numBones = 0;	// 0表示非蒙皮mesh
+	};
+
+	/**
+	 * Bakes all animations of a DVKModel into a 2D array texture of dual quaternions. Every
+	 * animation is sampled at a fixed rate, each frame is one row and each skinned mesh owns
+	 * two texels per bone in that row, in the mesh's own bone order so the packed skin indices
+	 * can be used directly. Rows continue across layers, see GetClip() for where an animation
+	 * starts. Dual quaternions are in the model root space, the per instance transform is the
+	 * only thing left for the draw, so instances can play any animation at any time without
+	 * CPU animation work. Scale is not baked.
+	 *
+	 * Frames are evaluated in parallel with DVKAnimPose, the model itself is not modified.
+	 */
+	class DVKAnimTexture
+	{
+	private:
+		DVKAnimTexture()
+		{
+
+		}
+
+	public:
+		~DVKAnimTexture();
+
+		static DVKAnimTexture* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, DVKModel* model, const DVKAnimTextureSettings& settings = DVKAnimTextureSettings());
+
+		// x: startFrame y: numFrames z: frameRate w: time，shader据此计算前后两帧
+		Vector4 GetClipParam(int32 animIndex, float time) const;
+
+		// x: column y: numBones
+		Vector4 GetMeshParam(int32 meshIndex) const;
+
+		inline DVKTexture* GetTexture() const
+		{
+			return m_Texture;
+		}
+
+		inline const DVKAnimTextureClip& GetClip(int32 animIndex) const
+		{
+			return m_Clips[animIndex];
+		}
+
+		inline int32 GetNumClips() const
+		{
+			return m_Clips.size();
+		}
+
+		inline const DVKAnimTextureMesh& GetMesh(int32 meshIndex) const
+		{
+			return m_Meshes[meshIndex];
+		}
+
+		inline int32 GetWidth() const
+		{
+			return m_Width;
+		}
+
+		inline int32 GetLayerHeight() const
+		{
+			return m_LayerHeight;
+		}
+
+		inline int32 GetNumLayers() const
+		{
+			return m_NumLayers;
+		}
+
+		inline int32 GetNumFrames() const
+		{
+			return m_NumFrames;
+		}
+
+		inline uint32 GetMemorySize() const
+		{
+			return m_Data.size();
+		}
+
+		// 秒
+		inline float GetBakeTime() const
+		{
+			return m_BakeTime;
+		}
+
+		// 量化后还原出的位移与原始位移的最大距离
+		inline float GetMaxTranslationError() const
+		{
+			return m_MaxTranslationError;
+		}
+
+	private:
+
+		bool Bake(DVKModel* model, const DVKAnimTextureSettings& settings);
+
+		void BakeFrames(int32 begin, int32 end, std::vector<float>& frameErrors);
+
+	private:
+
+		DVKModel*							m_Model = nullptr;
+		DVKTexture*							m_Texture = nullptr;
+
+		std::vector<DVKAnimTextureClip>		m_Clips;
+		std::vector<DVKAnimTextureMesh>		m_Meshes;
+		std::vector<int32>					m_MeshNodes;
+		std::vector<uint8>					m_Data;
+
+		bool								m_HalfFloat = true;
+		int32								m_Width = 0;
+		int32								m_LayerHeight = 0;
+		int32								m_NumLayers = 0;
+		int32								m_NumFrames = 0;
+		float								m_BakeTime = 0.0f;
+		float								m_MaxTranslationError = 0.0f;
+	};
+
+};
@@ -0,0 +1,261 @@
+﻿#include "DVKAssetLoader.h"
+#include "FileManager.h"
+
+#include "Loader/ImageLoader.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+
+namespace vk_demo
+{
+
+	DVKAssetLoader* DVKAssetLoader::Create(std::shared_ptr<VulkanDevice> vulkanDevice)
+	{
+		DVKAssetLoader* loader = new DVKAssetLoader();
+		loader->vulkanDevice = vulkanDevice;
+		loader->uploadQueue  = DVKUploadQueue::Create(vulkanDevice, 32 * 1024 * 1024);
+		loader->startTime    = GenericPlatformTime::Seconds();
+		return loader;
+	}
+
+	DVKAssetLoader::~DVKAssetLoader()
+	{
+		// job里引用了asset，必须先等它们结束
+		for (int32 i = 0; i < assets.size(); ++i) {
+			JobSystem::Get().Wait(&(assets[i]->counter));
+		}
+
+		uploadQueue->WaitIdle();
+		delete uploadQueue;
+		uploadQueue = nullptr;
+
+		for (int32 i = 0; i < assets.size(); ++i)
+		{
+			Asset* asset = assets[i];
+			for (int32 j = 0; j < asset->images.size(); ++j) 
+			{
+				if (asset->images[j].data) {
+					StbImage::Free(asset->images[j].data);
+				}
+			}
+
+			if (!asset->fetched)
+			{
+				delete asset->model;
+				delete asset->texture;
+				delete asset->shader;
+			}
+
+			delete asset;
+		}
+		assets.clear();
+	}
+
+	DVKAssetHandle DVKAssetLoader::AddAsset(Asset* asset)
+	{
+		assets.push_back(asset);
+		return assets.size() - 1;
+	}
+
+	DVKAssetHandle DVKAssetLoader::LoadModel(const std::string& filename, const std::vector<VertexAttribute>& attributes, bool upload)
+	{
+		Asset* asset = new Asset();
+		asset->type       = AssetType::Model;
+		asset->filenames  = { filename };
+		asset->attributes = attributes;
+		asset->upload     = upload;
+
+		std::shared_ptr<VulkanDevice> device = vulkanDevice;
+		JobSystem::Get().Run([asset, device]() {
+			asset->model = DVKModel::LoadFromFile(asset->filenames[0], device, nullptr, asset->attributes);
+		}, &(asset->counter));
+
+		return AddAsset(asset);
+	}
+
+	DVKAssetHandle DVKAssetLoader::LoadTexture2D(const std::string& filename, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
+	{
+		Asset* asset = new Asset();
+		asset->type      = AssetType::Texture2D;
+		asset->filenames = { filename };
+		asset->usage     = imageUsageFlags;
+		asset->layout    = imageLayout;
+		asset->images.resize(1);
+
+		JobSystem::Get().Run([asset]() {
+			FileViewRef view = FileManager::MapFile(asset->filenames[0]);
+			if (view) 
+			{
+				int32 comp = 0;
+				ImageData& image = asset->images[0];
+				image.data = StbImage::LoadFromMemory(view->GetData(), view->GetSize(), &image.width, &image.height, &comp, 4);
+			}
+		}, &(asset->counter));
+
+		return AddAsset(asset);
+	}
+
+	DVKAssetHandle DVKAssetLoader::LoadTextureCube(const std::vector<std::string>& filenames, ImageLayoutBarrier imageLayout)
+	{
+		Asset* asset = new Asset();
+		asset->type      = AssetType::TextureCube;
+		asset->filenames = filenames;
+		asset->layout    = imageLayout;
+		asset->images.resize(filenames.size());
+
+		for (int32 i = 0; i < filenames.size(); ++i)
+		{
+			JobSystem::Get().Run([asset, i]() {
+				FileViewRef view = FileManager::MapFile(asset->filenames[i]);
+				if (view) 
+				{
+					int32 comp = 0;
+					ImageData& image = asset->images[i];
+					image.data = (uint8*)StbImage::LoadFloatFromMemory(view->GetData(), view->GetSize(), &image.width, &image.height, &comp, 4);
+				}
+			}, &(asset->counter));
+		}
+
+		return AddAsset(asset);
+	}
+
+	DVKAssetHandle DVKAssetLoader::LoadShader(bool dynamicUBO, const char* vert, const char* frag, const char* geom, const char* comp, const char* tesc, const char* tese)
+	{
+		Asset* asset = new Asset();
+		asset->type       = AssetType::Shader;
+		asset->dynamicUBO = dynamicUBO;
+		asset->upload     = false;
+
+		const char* stages[6] = { vert, frag, geom, comp, tesc, tese };
+		for (int32 i = 0; i < 6; ++i) {
+			asset->filenames.push_back(stages[i] ? stages[i] : "");
+		}
+
+		// shader module和layout的创建都是线程安全的，直接在工作线程里完成
+		std::shared_ptr<VulkanDevice> device = vulkanDevice;
+		JobSystem::Get().Run([asset, device]() {
+			const char* files[6];
+			for (int32 i = 0; i < 6; ++i) {
+				files[i] = asset->filenames[i].empty() ? nullptr : asset->filenames[i].c_str();
+			}
+			asset->shader = DVKShader::Create(device, asset->dynamicUBO, files[0], files[1], files[2], files[3], files[4], files[5]);
+		}, &(asset->counter));
+
+		return AddAsset(asset);
+	}
+
+	bool DVKAssetLoader::IsReady(DVKAssetHandle handle) const
+	{
+		return assets[handle]->counter.IsDone();
+	}
+
+	void DVKAssetLoader::CreateAsset(Asset* asset)
+	{
+		asset->created = true;
+
+		if (asset->type == AssetType::Model)
+		{
+			if (asset->model && asset->upload) {
+				asset->model->Upload(uploadQueue);
+			}
+		}
+		else if (asset->type == AssetType::Texture2D)
+		{
+			ImageData& image = asset->images[0];
+			if (image.data)
+			{
+				asset->texture = DVKTexture::Create2D(image.data, image.width * image.height * 4, VK_FORMAT_R8G8B8A8_UNORM, image.width, image.height, vulkanDevice, uploadQueue, asset->usage, asset->layout);
+			}
+			else 
+			{
+				MLOGE("Failed load image : %s", asset->filenames[0].c_str());
+			}
+		}
+		else if (asset->type == AssetType::TextureCube)
+		{
+			std::vector<const uint8*> faces;
+			for (int32 i = 0; i < asset->images.size(); ++i)
+			{
+				ImageData& image = asset->images[i];
+				if (image.data == nullptr || image.width != asset->images[0].width || image.height != asset->images[0].height) 
+				{
+					MLOGE("Failed load image : %s", asset->filenames[i].c_str());
+					break;
+				}
+				faces.push_back(image.data);
+			}
+
+			if (faces.size() == asset->images.size())
+			{
+				int32 width  = asset->images[0].width;
+				int32 height = asset->images[0].height;
+				asset->texture = DVKTexture::CreateCube(faces, width * height * 4 * sizeof(float), VK_FORMAT_R32G32B32A32_SFLOAT, width, height, vulkanDevice, uploadQueue, asset->layout);
+			}
+		}
+
+		// 解码后的像素已经拷贝到staging
+		for (int32 i = 0; i < asset->images.size(); ++i) 
+		{
+			if (asset->images[i].data) {
+				StbImage::Free(asset->images[i].data);
+				asset->images[i].data = nullptr;
+			}
+		}
+
+		asset->uploadHandle = asset->upload ? uploadQueue->GetRecordingHandle() : 0;
+	}
+
+	void DVKAssetLoader::CreateReadyAssets()
+	{
+		// 已经解码完的资源一起记录，尽量合并到同一个上传批次里
+		for (int32 i = 0; i < assets.size(); ++i)
+		{
+			Asset* asset = assets[i];
+			if (!asset->created && asset->counter.IsDone()) {
+				CreateAsset(asset);
+			}
+		}
+	}
+
+	void DVKAssetLoader::Wait(DVKAssetHandle handle)
+	{
+		Asset* asset = assets[handle];
+		if (!asset->created)
+		{
+			JobSystem::Get().Wait(&(asset->counter));
+			CreateReadyAssets();
+		}
+		uploadQueue->Wait(asset->uploadHandle);
+	}
+
+	void DVKAssetLoader::WaitAll()
+	{
+		for (int32 i = 0; i < assets.size(); ++i) {
+			JobSystem::Get().Wait(&(assets[i]->counter));
+		}
+		CreateReadyAssets();
+		uploadQueue->WaitIdle();
+
+		MLOG("Loaded %d assets in %.2fms on %d workers, %d upload submits", (int32)assets.size(), (GenericPlatformTime::Seconds() - startTime) * 1000.0, JobSystem::Get().GetNumWorkers(), uploadQueue->GetStats().numSubmits);
+	}
+
+	DVKModel* DVKAssetLoader::GetModel(DVKAssetHandle handle)
+	{
+		Wait(handle);
+		assets[handle]->fetched = true;
+		return assets[handle]->model;
+	}
+
+	DVKTexture* DVKAssetLoader::GetTexture(DVKAssetHandle handle)
+	{
+		Wait(handle);
+		assets[handle]->fetched = true;
+		return assets[handle]->texture;
+	}
+
+	DVKShader* DVKAssetLoader::GetShader(DVKAssetHandle handle)
+	{
+		Wait(handle);
+		assets[handle]->fetched = true;
+		return assets[handle]->shader;
+	}
+
+};
@@ -0,0 +1,127 @@
+﻿#pragma once
+
+#include "Engine.h"
+#include "DVKModel.h"
+#include "DVKTexture.h"
+#include "DVKShader.h"
+#include "DVKUploadQueue.h"
+
+#include "Common/Common.h"
+#include "Core/JobSystem.h"
+
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+	// Load*返回的句柄，-1表示无效
+	typedef int32 DVKAssetHandle;
+
+	/**
+	 * Fans asset decoding out to the JobSystem: Assimp import, stb_image decode and SPIR-V
+	 * reflection run on worker threads as soon as a Load* call is made. GPU resources are
+	 * created on the calling thread when an asset is waited on, all of them recorded into one
+	 * shared DVKUploadQueue so a whole LoadAssets() ends up in a single upload batch.
+	 *
+	 * Get* waits for the asset and hands ownership of the object to the caller. Assets that
+	 * were never fetched are released with the loader.
+	 */
+	class DVKAssetLoader
+	{
+	private:
+		enum class AssetType
+		{
+			Model,
+			Texture2D,
+			TextureCube,
+			Shader,
+		};
+
+		struct ImageData
+		{
+			uint8*	data   = nullptr;
+			int32	width  = 0;
+			int32	height = 0;
+		};
+
+		struct Asset
+		{
+			AssetType						type;
+			std::vector<std::string>		filenames;
+			std::vector<VertexAttribute>	attributes;
+			bool							upload = true;
+			bool							dynamicUBO = true;
+			VkImageUsageFlags				usage = 0;
+			ImageLayoutBarrier				layout = ImageLayoutBarrier::PixelShaderRead;
+
+			JobCounter						counter;
+			std::vector<ImageData>			images;
+
+			DVKModel*						model = nullptr;
+			DVKTexture*						texture = nullptr;
+			DVKShader*						shader = nullptr;
+
+			bool							created = false;
+			bool							fetched = false;
+			DVKUploadHandle					uploadHandle = 0;
+		};
+
+		DVKAssetLoader()
+		{
+
+		}
+
+	public:
+		~DVKAssetLoader();
+
+		static DVKAssetLoader* Create(std::shared_ptr<VulkanDevice> vulkanDevice);
+
+		// upload为false时只加载CPU端数据，和LoadFromFile传nullptr的cmdBuffer一致
+		DVKAssetHandle LoadModel(const std::string& filename, const std::vector<VertexAttribute>& attributes, bool upload = true);
+
+		DVKAssetHandle LoadTexture2D(
+			const std::string& filename, 
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
+
+		// 6个面各自一个job解码为float
+		DVKAssetHandle LoadTextureCube(const std::vector<std::string>& filenames, ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead);
+
+		DVKAssetHandle LoadShader(bool dynamicUBO, const char* vert, const char* frag, const char* geom = nullptr, const char* comp = nullptr, const char* tesc = nullptr, const char* tese = nullptr);
+
+		// CPU端的工作是否已经完成
+		bool IsReady(DVKAssetHandle handle) const;
+
+		// 等待资源可用，包括GPU上传
+		void Wait(DVKAssetHandle handle);
+
+		void WaitAll();
+
+		DVKModel* GetModel(DVKAssetHandle handle);
+
+		DVKTexture* GetTexture(DVKAssetHandle handle);
+
+		DVKShader* GetShader(DVKAssetHandle handle);
+
+	private:
+
+		DVKAssetHandle AddAsset(Asset* asset);
+
+		void CreateReadyAssets();
+
+		void CreateAsset(Asset* asset);
+
+	public:
+		std::shared_ptr<VulkanDevice>	vulkanDevice = nullptr;
+
+	private:
+		DVKUploadQueue*					uploadQueue = nullptr;
+		std::vector<Asset*>				assets;
+		double							startTime = 0.0;
+	};
+
+};
@@ -0,0 +1,1023 @@
+﻿#include "DVKBVH.h"
+
+#include "Core/JobSystem.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#include <atomic>
+#include <algorithm>
+
+#define BVH_NUM_BINS			16
+#define BVH_PARALLEL_BINNING	32768	// 超过这个数量的节点分块并行统计bin
+#define BVH_PARALLEL_SUBTREE	4096	// 超过这个数量的子树作为job构建
+#define BVH_MEDIAN_DEPTH		48		// 超过这个深度只做中位数划分，保证遍历栈够用
+#define BVH_STACK_SIZE			128
+#define BVH_TRIANGLE_LEAF_SIZE	4		// 和TriangleSoA一组的数量一致
+#define BVH_PARALLEL_REFIT		4096	// 超过这个数量的节点拆成子树并行refit
+#define BVH_REFIT_SUBTREES		64
+#define BVH_SKIN_GRAIN			2048
+
+namespace vk_demo
+{
+	struct BVHBounds
+	{
+		Vector3		min;
+		Vector3		max;
+
+		BVHBounds()
+			: min(MAX_flt, MAX_flt, MAX_flt)
+			, max(-MAX_flt, -MAX_flt, -MAX_flt)
+		{
+
+		}
+
+		inline void Grow(const Vector3& point)
+		{
+			min = Vector3::Min(min, point);
+			max = Vector3::Max(max, point);
+		}
+
+		inline void Grow(const BVHBounds& bounds)
+		{
+			min = Vector3::Min(min, bounds.min);
+			max = Vector3::Max(max, bounds.max);
+		}
+
+		// 表面积的一半，SAH只比较相对大小
+		inline float HalfArea() const
+		{
+			return HalfArea(min, max);
+		}
+
+		static inline float HalfArea(const Vector3& min, const Vector3& max)
+		{
+			Vector3 extent = max - min;
+			if (extent.x < 0.0f) {
+				return 0.0f;
+			}
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+	};
+
+	struct BVHBin
+	{
+		BVHBounds	bounds;
+		BVHBounds	centroids;
+		int32		count = 0;
+	};
+
+	/**
+	 * Binned SAH builder shared by the mesh and the top level BVH. Takes one box per primitive,
+	 * outputs the nodes and the primitive order, leaf.leftFirst points into that order.
+	 * Children are allocated in pairs from an atomic counter, so subtrees can be built by any thread.
+	 */
+	class BVHBuilder
+	{
+	public:
+		BVHBuilder(const BVHBounds* bounds, int32 count, int32 maxLeafSize)
+			: m_Bounds(bounds)
+			, m_Count(count)
+			, m_MaxLeafSize(maxLeafSize)
+			, m_Nodes(nullptr)
+			, m_Indices(nullptr)
+			, m_NodeCount(0)
+		{
+
+		}
+
+		void Build(std::vector<DVKBVHNode>& outNodes, std::vector<int32>& outIndices)
+		{
+			m_Centers.resize(m_Count);
+			outIndices.resize(m_Count);
+
+			BVHBounds bounds;
+			BVHBounds centroids;
+			for (int32 i = 0; i < m_Count; ++i)
+			{
+				m_Centers[i]  = (m_Bounds[i].min + m_Bounds[i].max) * 0.5f;
+				outIndices[i] = i;
+				bounds.Grow(m_Bounds[i]);
+				centroids.Grow(m_Centers[i]);
+			}
+
+			// 每个叶子至少一个图元，节点不会超过2n - 1
+			outNodes.resize(MMath::Max(2 * m_Count - 1, 1));
+
+			m_Nodes   = outNodes.data();
+			m_Indices = outIndices.data();
+			m_NodeCount.store(1);
+
+			Subdivide(0, 0, m_Count, bounds, centroids, 0);
+			JobSystem::Get().Wait(&m_Counter);
+
+			outNodes.resize(m_NodeCount.load());
+		}
+
+	private:
+
+		inline int32 GetBin(float center, float minValue, float scale) const
+		{
+			int32 bin = (int32)((center - minValue) * scale);
+			return MMath::Clamp(bin, 0, BVH_NUM_BINS - 1);
+		}
+
+		void BinRange(int32 begin, int32 end, const BVHBounds& centroids, const float* scale, BVHBin* bins) const
+		{
+			for (int32 i = begin; i < end; ++i)
+			{
+				int32 index = m_Indices[i];
+				const Vector3& center = m_Centers[index];
+
+				for (int32 axis = 0; axis < 3; ++axis)
+				{
+					if (scale[axis] <= 0.0f) {
+						continue;
+					}
+
+					BVHBin& bin = bins[axis * BVH_NUM_BINS + GetBin(center[axis], centroids.min[axis], scale[axis])];
+					bin.bounds.Grow(m_Bounds[index]);
+					bin.centroids.Grow(center);
+					bin.count += 1;
+				}
+			}
+		}
+
+		// 返回划分位置，找不到合适的划分返回-1
+		int32 SplitSAH(int32 begin, int32 end, const BVHBounds& centroids, BVHBounds* childBounds, BVHBounds* childCentroids)
+		{
+			const int32 count = end - begin;
+
+			float scale[3];
+			for (int32 axis = 0; axis < 3; ++axis)
+			{
+				float extent = centroids.max[axis] - centroids.min[axis];
+				scale[axis]  = extent > 1e-20f ? BVH_NUM_BINS / extent : 0.0f;
+			}
+
+			BVHBin bins[3 * BVH_NUM_BINS];
+
+			if (count >= BVH_PARALLEL_BINNING)
+			{
+				// 每块单独统计再合并，块之间没有共享的写
+				const int32 numChunks = MMath::Min(count / (BVH_PARALLEL_BINNING / 4), 64);
+				std::vector<BVHBin> chunkBins(numChunks * 3 * BVH_NUM_BINS);
+
+				JobSystem::Get().ParallelFor(numChunks, 1, [&](int32 chunkBegin, int32 chunkEnd) {
+					for (int32 chunk = chunkBegin; chunk < chunkEnd; ++chunk)
+					{
+						int32 rangeBegin = begin + (int64)count * chunk / numChunks;
+						int32 rangeEnd   = begin + (int64)count * (chunk + 1) / numChunks;
+						BinRange(rangeBegin, rangeEnd, centroids, scale, &chunkBins[chunk * 3 * BVH_NUM_BINS]);
+					}
+				});
+
+				for (int32 chunk = 0; chunk < numChunks; ++chunk)
+				{
+					for (int32 i = 0; i < 3 * BVH_NUM_BINS; ++i)
+					{
+						const BVHBin& src = chunkBins[chunk * 3 * BVH_NUM_BINS + i];
+						bins[i].bounds.Grow(src.bounds);
+						bins[i].centroids.Grow(src.centroids);
+						bins[i].count += src.count;
+					}
+				}
+			}
+			else
+			{
+				BinRange(begin, end, centroids, scale, bins);
+			}
+
+			int32 bestAxis  = -1;
+			int32 bestSplit = -1;
+			float bestCost  = MAX_flt;
+
+			for (int32 axis = 0; axis < 3; ++axis)
+			{
+				if (scale[axis] <= 0.0f) {
+					continue;
+				}
+
+				const BVHBin* axisBins = &bins[axis * BVH_NUM_BINS];
+
+				// 从右往左累积，rightCost[i]为[i, BVH_NUM_BINS)的代价
+				float rightCost[BVH_NUM_BINS];
+				BVHBounds rightBounds;
+				int32 rightCount = 0;
+				for (int32 i = BVH_NUM_BINS - 1; i > 0; --i)
+				{
+					rightBounds.Grow(axisBins[i].bounds);
+					rightCount  += axisBins[i].count;
+					rightCost[i] = rightCount > 0 ? rightBounds.HalfArea() * rightCount : MAX_flt;
+				}
+
+				BVHBounds leftBounds;
+				int32 leftCount = 0;
+				for (int32 i = 1; i < BVH_NUM_BINS; ++i)
+				{
+					leftBounds.Grow(axisBins[i - 1].bounds);
+					leftCount += axisBins[i - 1].count;
+
+					if (leftCount == 0 || leftCount == count) {
+						continue;
+					}
+
+					float cost = leftBounds.HalfArea() * leftCount + rightCost[i];
+					if (cost < bestCost)
+					{
+						bestCost  = cost;
+						bestAxis  = axis;
+						bestSplit = i;
+					}
+				}
+			}
+
+			if (bestAxis < 0) {
+				return -1;
+			}
+
+			const float minValue = centroids.min[bestAxis];
+			const float axisScale = scale[bestAxis];
+
+			int32* middle = std::partition(m_Indices + begin, m_Indices + end, [&](int32 index) {
+				return GetBin(m_Centers[index][bestAxis], minValue, axisScale) < bestSplit;
+			});
+
+			for (int32 i = 0; i < BVH_NUM_BINS; ++i)
+			{
+				const BVHBin& bin = bins[bestAxis * BVH_NUM_BINS + i];
+				int32 side = i < bestSplit ? 0 : 1;
+				childBounds[side].Grow(bin.bounds);
+				childCentroids[side].Grow(bin.centroids);
+			}
+
+			return middle - m_Indices;
+		}
+
+		// 按最长轴的中位数平分，中心点重合或者树太深时使用
+		int32 SplitMedian(int32 begin, int32 end, const BVHBounds& centroids, BVHBounds* childBounds, BVHBounds* childCentroids)
+		{
+			Vector3 extent = centroids.max - centroids.min;
+			int32 axis = 0;
+			if (extent.y > extent[axis]) {
+				axis = 1;
+			}
+			if (extent.z > extent[axis]) {
+				axis = 2;
+			}
+
+			int32 mid = begin + (end - begin) / 2;
+			std::nth_element(m_Indices + begin, m_Indices + mid, m_Indices + end, [&](int32 a, int32 b) {
+				return m_Centers[a][axis] < m_Centers[b][axis];
+			});
+
+			for (int32 i = begin; i < end; ++i)
+			{
+				int32 side = i < mid ? 0 : 1;
+				childBounds[side].Grow(m_Bounds[m_Indices[i]]);
+				childCentroids[side].Grow(m_Centers[m_Indices[i]]);
+			}
+
+			return mid;
+		}
+
+		void Subdivide(int32 nodeIndex, int32 begin, int32 end, const BVHBounds& bounds, const BVHBounds& centroids, int32 depth)
+		{
+			DVKBVHNode& node = m_Nodes[nodeIndex];
+			node.min = bounds.min;
+			node.max = bounds.max;
+
+			const int32 count = end - begin;
+			if (count <= m_MaxLeafSize)
+			{
+				node.leftFirst = begin;
+				node.count     = count;
+				return;
+			}
+
+			BVHBounds childBounds[2];
+			BVHBounds childCentroids[2];
+
+			int32 mid = -1;
+			if (depth < BVH_MEDIAN_DEPTH) {
+				mid = SplitSAH(begin, end, centroids, childBounds, childCentroids);
+			}
+
+			if (mid <= begin || mid >= end)
+			{
+				childBounds[0]    = childBounds[1]    = BVHBounds();
+				childCentroids[0] = childCentroids[1] = BVHBounds();
+				mid = SplitMedian(begin, end, centroids, childBounds, childCentroids);
+			}
+
+			const int32 left = m_NodeCount.fetch_add(2);
+			node.leftFirst = left;
+			node.count     = 0;
+
+			if (count >= BVH_PARALLEL_SUBTREE)
+			{
+				BVHBounds leftBounds    = childBounds[0];
+				BVHBounds leftCentroids = childCentroids[0];
+				JobSystem::Get().Run([=]() {
+					Subdivide(left, begin, mid, leftBounds, leftCentroids, depth + 1);
+				}, &m_Counter);
+			}
+			else
+			{
+				Subdivide(left, begin, mid, childBounds[0], childCentroids[0], depth + 1);
+			}
+
+			Subdivide(left + 1, mid, end, childBounds[1], childCentroids[1], depth + 1);
+		}
+
+	private:
+		const BVHBounds*		m_Bounds;
+		int32					m_Count;
+		int32					m_MaxLeafSize;
+
+		std::vector<Vector3>	m_Centers;
+		DVKBVHNode*				m_Nodes;
+		int32*					m_Indices;
+		std::atomic<int32>		m_NodeCount;
+		JobCounter				m_Counter;
+	};
+
+	void BuildBVHNodes(const Vector3* boundsMin, const Vector3* boundsMax, int32 count, int32 maxLeafSize, std::vector<DVKBVHNode>& outNodes, std::vector<int32>& outIndices)
+	{
+		outNodes.clear();
+		outIndices.clear();
+
+		if (count == 0) {
+			return;
+		}
+
+		std::vector<BVHBounds> bounds(count);
+		for (int32 i = 0; i < count; ++i)
+		{
+			bounds[i].min = boundsMin[i];
+			bounds[i].max = boundsMax[i];
+		}
+
+		BVHBuilder builder(bounds.data(), count, maxLeafSize);
+		builder.Build(outNodes, outIndices);
+	}
+
+	// 方向分量为0时1/0=inf，和0相乘会得到NaN，换成一个很大的有限值
+	static FORCEINLINE float SafeInverse(float value)
+	{
+		return MMath::Abs(value) > 1e-20f ? 1.0f / value : (value >= 0.0f ? 1e20f : -1e20f);
+	}
+
+	// 返回进入点的t，没有相交返回MAX_flt
+	static FORCEINLINE float IntersectNode(const DVKBVHNode& node, const Vector3& origin, const Vector3& invDir, float tMin, float tMax)
+	{
+		float tx1 = (node.min.x - origin.x) * invDir.x;
+		float tx2 = (node.max.x - origin.x) * invDir.x;
+		float ty1 = (node.min.y - origin.y) * invDir.y;
+		float ty2 = (node.max.y - origin.y) * invDir.y;
+		float tz1 = (node.min.z - origin.z) * invDir.z;
+		float tz2 = (node.max.z - origin.z) * invDir.z;
+
+		float tNear = MMath::Max(MMath::Max(MMath::Min(tx1, tx2), MMath::Min(ty1, ty2)), MMath::Min(tz1, tz2));
+		float tFar  = MMath::Min(MMath::Min(MMath::Max(tx1, tx2), MMath::Max(ty1, ty2)), MMath::Max(tz1, tz2));
+
+		if (tFar < tNear || tFar <= tMin || tNear >= tMax) {
+			return MAX_flt;
+		}
+
+		return tNear;
+	}
+
+	/**
+	 * Front to back traversal with a fixed size stack. leafFunc(leaf, tMax) tests the leaf, shrinks
+	 * tMax and returns true on a hit. AnyHit returns on the first hit.
+	 */
+	template<bool AnyHit, typename LeafFunc>
+	static bool TraverseBVH(const std::vector<DVKBVHNode>& nodes, const Vector3& origin, const Vector3& direction, float tMin, float& tMax, const LeafFunc& leafFunc)
+	{
+		if (nodes.size() == 0) {
+			return false;
+		}
+
+		const Vector3 invDir(SafeInverse(direction.x), SafeInverse(direction.y), SafeInverse(direction.z));
+
+		if (IntersectNode(nodes[0], origin, invDir, tMin, tMax) == MAX_flt) {
+			return false;
+		}
+
+		struct StackEntry
+		{
+			const DVKBVHNode*	node;
+			float				dist;
+		};
+
+		StackEntry stack[BVH_STACK_SIZE];
+		int32 stackSize = 0;
+
+		const DVKBVHNode* node = &nodes[0];
+		bool hit = false;
+
+		while (true)
+		{
+			if (node->IsLeaf())
+			{
+				if (leafFunc(*node, tMax))
+				{
+					hit = true;
+					if (AnyHit) {
+						return true;
+					}
+				}
+
+				node = nullptr;
+			}
+			else
+			{
+				const DVKBVHNode* child0 = &nodes[node->leftFirst];
+				const DVKBVHNode* child1 = child0 + 1;
+				float dist0 = IntersectNode(*child0, origin, invDir, tMin, tMax);
+				float dist1 = IntersectNode(*child1, origin, invDir, tMin, tMax);
+
+				if (dist1 < dist0)
+				{
+					std::swap(dist0,  dist1);
+					std::swap(child0, child1);
+				}
+
+				node = nullptr;
+				if (dist0 != MAX_flt)
+				{
+					node = child0;
+					if (dist1 != MAX_flt)
+					{
+						stack[stackSize].node = child1;
+						stack[stackSize].dist = dist1;
+						stackSize += 1;
+					}
+				}
+			}
+
+			// 出栈时跳过比当前交点更远的节点
+			while (node == nullptr)
+			{
+				if (stackSize == 0) {
+					return hit;
+				}
+
+				stackSize -= 1;
+				if (stack[stackSize].dist < tMax) {
+					node = stack[stackSize].node;
+				}
+			}
+		}
+	}
+
+	static int32 GetPrimitiveTriangleCount(const DVKPrimitive* primitive)
+	{
+		if (primitive->vertexCount == 0) {
+			return 0;
+		}
+		return primitive->indices.size() > 0 ? primitive->indices.size() / 3 : primitive->vertexCount / 3;
+	}
+
+	// primitive里第triangle个三角形的顶点序号
+	static void GetPrimitiveIndices(const DVKPrimitive* primitive, int32 triangle, int32* outIndices)
+	{
+		for (int32 i = 0; i < 3; ++i)
+		{
+			int32 index = triangle * 3 + i;
+			outIndices[i] = primitive->indices.size() > 0 ? primitive->indices[index] : index;
+		}
+	}
+
+	DVKMeshBVH* DVKMeshBVH::Create(const DVKMesh* mesh)
+	{
+		DVKMeshBVH* bvh = Load(mesh);
+		if (bvh) {
+			bvh->Rebuild();
+		}
+		return bvh;
+	}
+
+	DVKMeshBVH* DVKMeshBVH::Load(const DVKMesh* mesh)
+	{
+		DVKMeshBVH* bvh = new DVKMeshBVH();
+		bvh->m_Mesh = mesh;
+
+		for (int32 i = 0; i < mesh->primitives.size(); ++i)
+		{
+			const DVKPrimitive* primitive = mesh->primitives[i];
+			const int32 base = bvh->m_Positions.size();
+			bvh->m_PrimitiveBases.push_back(base);
+
+			if (primitive->vertexCount == 0) {
+				continue;
+			}
+
+			const int32 stride = primitive->vertices.size() / primitive->vertexCount;
+			const float* vertices = primitive->vertices.data();
+			for (int32 j = 0; j < primitive->vertexCount; ++j) {
+				bvh->m_Positions.push_back(Vector3(vertices[j * stride + 0], vertices[j * stride + 1], vertices[j * stride + 2]));
+			}
+
+			const int32 numTriangles = GetPrimitiveTriangleCount(primitive);
+			for (int32 j = 0; j < numTriangles; ++j)
+			{
+				int32 indices[3];
+				GetPrimitiveIndices(primitive, j, indices);
+				bvh->m_VertexIds.push_back(base + indices[0]);
+				bvh->m_VertexIds.push_back(base + indices[1]);
+				bvh->m_VertexIds.push_back(base + indices[2]);
+				bvh->m_PrimitiveIds.push_back(i);
+				bvh->m_TriangleIds.push_back(j);
+			}
+		}
+
+		if (bvh->m_PrimitiveIds.size() == 0)
+		{
+			delete bvh;
+			return nullptr;
+		}
+
+		return bvh;
+	}
+
+	void DVKMeshBVH::Rebuild()
+	{
+		// 当前的三角形，去掉上次构建补齐的位置
+		std::vector<int32> vertexIds;
+		std::vector<int32> primitiveIds;
+		std::vector<int32> triangleIds;
+
+		for (int32 i = 0; i < m_PrimitiveIds.size(); ++i)
+		{
+			if (m_PrimitiveIds[i] < 0) {
+				continue;
+			}
+			vertexIds.insert(vertexIds.end(), &m_VertexIds[i * 3], &m_VertexIds[i * 3] + 3);
+			primitiveIds.push_back(m_PrimitiveIds[i]);
+			triangleIds.push_back(m_TriangleIds[i]);
+		}
+
+		const int32 numTriangles = primitiveIds.size();
+
+		std::vector<BVHBounds> bounds(numTriangles);
+		for (int32 i = 0; i < numTriangles; ++i)
+		{
+			bounds[i].Grow(m_Positions[vertexIds[i * 3 + 0]]);
+			bounds[i].Grow(m_Positions[vertexIds[i * 3 + 1]]);
+			bounds[i].Grow(m_Positions[vertexIds[i * 3 + 2]]);
+		}
+
+		std::vector<int32> order;
+		BVHBuilder builder(bounds.data(), numTriangles, BVH_TRIANGLE_LEAF_SIZE);
+		builder.Build(m_Nodes, order);
+
+		m_Triangles.Clear();
+		m_PrimitiveIds.clear();
+		m_TriangleIds.clear();
+		m_VertexIds.clear();
+
+		// 按节点顺序把每个叶子的三角形放进一个4对齐的组
+		for (int32 i = 0; i < m_Nodes.size(); ++i)
+		{
+			DVKBVHNode& node = m_Nodes[i];
+			if (!node.IsLeaf()) {
+				continue;
+			}
+
+			int32 first = m_Triangles.PaddedCount();
+			for (int32 j = 0; j < node.count; ++j)
+			{
+				int32 index = order[node.leftFirst + j];
+				const int32* ids = &vertexIds[index * 3];
+				m_Triangles.Add(m_Positions[ids[0]], m_Positions[ids[1]], m_Positions[ids[2]]);
+				m_PrimitiveIds.push_back(primitiveIds[index]);
+				m_TriangleIds.push_back(triangleIds[index]);
+				m_VertexIds.insert(m_VertexIds.end(), ids, ids + 3);
+			}
+
+			m_Triangles.Finalize();
+			m_PrimitiveIds.resize(m_Triangles.PaddedCount(), -1);
+			m_TriangleIds.resize(m_Triangles.PaddedCount(), -1);
+			m_VertexIds.resize(m_Triangles.PaddedCount() * 3, -1);
+
+			node.leftFirst = first;
+		}
+
+		UpdateBounds();
+
+		// 子节点的序号总是比父节点大，按广度优先拆出足够多的子树
+		m_RefitRoots.clear();
+		m_RefitTop.clear();
+
+		std::vector<int32> queue(1, 0);
+		int32 head = 0;
+		while (m_Nodes.size() >= BVH_PARALLEL_REFIT && head < queue.size() && queue.size() - head < BVH_REFIT_SUBTREES)
+		{
+			const DVKBVHNode& node = m_Nodes[queue[head]];
+			if (node.IsLeaf())
+			{
+				m_RefitRoots.push_back(queue[head++]);
+				continue;
+			}
+
+			m_RefitTop.push_back(queue[head++]);
+			queue.push_back(node.leftFirst);
+			queue.push_back(node.leftFirst + 1);
+		}
+		m_RefitRoots.insert(m_RefitRoots.end(), queue.begin() + head, queue.end());
+
+		m_BuildCost = ComputeCost();
+		m_Cost      = m_BuildCost;
+	}
+
+	void DVKMeshBVH::Refit()
+	{
+		JobSystem::Get().ParallelFor(m_RefitRoots.size(), 1, [this](int32 begin, int32 end) {
+			for (int32 i = begin; i < end; ++i) {
+				RefitNode(m_RefitRoots[i]);
+			}
+		});
+
+		for (int32 i = m_RefitTop.size() - 1; i >= 0; --i)
+		{
+			DVKBVHNode& node = m_Nodes[m_RefitTop[i]];
+			const DVKBVHNode& left  = m_Nodes[node.leftFirst + 0];
+			const DVKBVHNode& right = m_Nodes[node.leftFirst + 1];
+			node.min = Vector3::Min(left.min, right.min);
+			node.max = Vector3::Max(left.max, right.max);
+		}
+
+		UpdateBounds();
+
+		m_Cost = ComputeCost();
+	}
+
+	void DVKMeshBVH::RefitNode(int32 index)
+	{
+		DVKBVHNode& node = m_Nodes[index];
+		BVHBounds bounds;
+
+		if (node.IsLeaf())
+		{
+			for (int32 i = 0; i < node.count; ++i)
+			{
+				const int32 slot = node.leftFirst + i;
+				const Vector3& v0 = m_Positions[m_VertexIds[slot * 3 + 0]];
+				const Vector3& v1 = m_Positions[m_VertexIds[slot * 3 + 1]];
+				const Vector3& v2 = m_Positions[m_VertexIds[slot * 3 + 2]];
+				m_Triangles.Set(slot, v0, v1, v2);
+				bounds.Grow(v0);
+				bounds.Grow(v1);
+				bounds.Grow(v2);
+			}
+		}
+		else
+		{
+			RefitNode(node.leftFirst + 0);
+			RefitNode(node.leftFirst + 1);
+
+			const DVKBVHNode& left  = m_Nodes[node.leftFirst + 0];
+			const DVKBVHNode& right = m_Nodes[node.leftFirst + 1];
+			bounds.min = Vector3::Min(left.min, right.min);
+			bounds.max = Vector3::Max(left.max, right.max);
+		}
+
+		node.min = bounds.min;
+		node.max = bounds.max;
+	}
+
+	// 和构建时一样，内部节点代价为1，叶子为三角形数量，按根节点的面积归一化
+	float DVKMeshBVH::ComputeCost() const
+	{
+		float rootArea = BVHBounds::HalfArea(m_Nodes[0].min, m_Nodes[0].max);
+		if (rootArea <= 0.0f) {
+			return 0.0f;
+		}
+
+		double cost = 0.0;
+		for (int32 i = 0; i < m_Nodes.size(); ++i)
+		{
+			const DVKBVHNode& node = m_Nodes[i];
+			cost += BVHBounds::HalfArea(node.min, node.max) * (node.IsLeaf() ? node.count : 1);
+		}
+
+		return cost / rootArea;
+	}
+
+	void DVKMeshBVH::UpdateBounds()
+	{
+		m_Bounds.min = m_Nodes[0].min;
+		m_Bounds.max = m_Nodes[0].max;
+		m_Bounds.UpdateCorners();
+	}
+
+	bool DVKMeshBVH::Intersect(const Vector3& origin, const Vector3& direction, float tMin, DVKRayHit& hit) const
+	{
+		return TraverseBVH<false>(m_Nodes, origin, direction, tMin, hit.dist, [&](const DVKBVHNode& leaf, float& tMax) {
+			float u = 0.0f;
+			float v = 0.0f;
+			int32 index = RayIntersection::IntersectTriangles(m_Triangles, leaf.leftFirst, leaf.leftFirst + BVH_TRIANGLE_LEAF_SIZE, origin, direction, tMin, tMax, u, v);
+			if (index < 0) {
+				return false;
+			}
+
+			hit.u         = u;
+			hit.v         = v;
+			hit.primitive = m_PrimitiveIds[index];
+			hit.triangle  = m_TriangleIds[index];
+			return true;
+		});
+	}
+
+	bool DVKMeshBVH::IntersectAny(const Vector3& origin, const Vector3& direction, float tMin, float tMax) const
+	{
+		return TraverseBVH<true>(m_Nodes, origin, direction, tMin, tMax, [&](const DVKBVHNode& leaf, float& maxDist) {
+			float u = 0.0f;
+			float v = 0.0f;
+			return RayIntersection::IntersectTriangles(m_Triangles, leaf.leftFirst, leaf.leftFirst + BVH_TRIANGLE_LEAF_SIZE, origin, direction, tMin, maxDist, u, v) >= 0;
+		});
+	}
+
+	void DVKMeshBVH::GetTriangle(int32 primitive, int32 triangle, Vector3& v0, Vector3& v1, Vector3& v2) const
+	{
+		int32 indices[3];
+		GetPrimitiveIndices(m_Mesh->primitives[primitive], triangle, indices);
+
+		const Vector3* positions = &m_Positions[m_PrimitiveBases[primitive]];
+		v0 = positions[indices[0]];
+		v1 = positions[indices[1]];
+		v2 = positions[indices[2]];
+	}
+
+	DVKBVH::~DVKBVH()
+	{
+		for (int32 i = 0; i < m_Instances.size(); ++i) {
+			delete m_Instances[i].bvh;
+		}
+		m_Instances.clear();
+	}
+
+	DVKBVH* DVKBVH::Create(DVKModel* model)
+	{
+		double buildTime = GenericPlatformTime::Seconds();
+
+		DVKBVH* bvh = new DVKBVH();
+		bvh->m_Model = model;
+		bvh->m_Instances.resize(model->meshes.size());
+
+		// 每个mesh一个job，大的mesh内部还会继续拆分。蒙皮的mesh按当前的骨骼蒙皮之后再构建
+		JobCounter counter;
+		for (int32 i = 0; i < model->meshes.size(); ++i)
+		{
+			Instance* instance = &bvh->m_Instances[i];
+			instance->mesh = model->meshes[i];
+			Matrix4x4 invGlobal;
+			if (instance->mesh->linkNode) {
+				invGlobal = instance->mesh->linkNode->GetGlobalMatrix().Inverse();
+			}
+
+			JobSystem::Get().Run([bvh, instance, model, invGlobal]() {
+				instance->bvh = DVKMeshBVH::Load(instance->mesh);
+				if (!instance->bvh) {
+					return;
+				}
+
+				if (model->LoadVertexSkins(instance->mesh, instance->skins))
+				{
+					instance->bindPositions = instance->bvh->GetPositions();
+					bvh->SkinInstance(*instance, invGlobal);
+				}
+
+				instance->bvh->Rebuild();
+			}, &counter);
+		}
+		JobSystem::Get().Wait(&counter);
+
+		for (int32 i = 0; i < bvh->m_Instances.size(); ++i) {
+			bvh->m_HasSkin = bvh->m_HasSkin || bvh->m_Instances[i].skins.size() > 0;
+		}
+
+		bvh->UpdateTransforms();
+		bvh->m_BuildTime = GenericPlatformTime::Seconds() - buildTime;
+
+		return bvh;
+	}
+
+	void DVKBVH::SkinInstance(Instance& instance, const Matrix4x4& invGlobal)
+	{
+		// 骨骼的finalTransform是到模型根节点的变换，和shader一样乘上mesh全局矩阵的逆回到object space
+		const DVKMesh* mesh = instance.mesh;
+
+		std::vector<Matrix4x4> boneMatrices(mesh->bones.size());
+		for (int32 i = 0; i < mesh->bones.size(); ++i)
+		{
+			boneMatrices[i] = m_Model->bones[mesh->bones[i]]->finalTransform;
+			boneMatrices[i].Append(invGlobal);
+		}
+
+		const DVKVertexSkin* skins = instance.skins.data();
+		const Vector3* bindPositions = instance.bindPositions.data();
+		Vector3* positions = instance.bvh->GetPositions().data();
+
+		JobSystem::Get().ParallelFor(instance.skins.size(), BVH_SKIN_GRAIN, [&](int32 begin, int32 end) {
+			for (int32 i = begin; i < end; ++i)
+			{
+				const DVKVertexSkin& skin = skins[i];
+				Vector3 position(0, 0, 0);
+				float weight = 0.0f;
+				for (int32 j = 0; j < 4; ++j)
+				{
+					if (skin.weights[j] <= 0.0f) {
+						continue;
+					}
+					position += Vector3(boneMatrices[skin.indices[j]].TransformPosition(bindPositions[i])) * skin.weights[j];
+					weight   += skin.weights[j];
+				}
+				positions[i] = weight > 0.0f ? position / weight : bindPositions[i];
+			}
+		});
+	}
+
+	void DVKBVH::Refit(float maxCostRatio)
+	{
+		double refitTime = GenericPlatformTime::Seconds();
+
+		std::atomic<int32> numRebuilds(0);
+
+		JobCounter counter;
+		for (int32 i = 0; i < m_Instances.size(); ++i)
+		{
+			Instance* instance = &m_Instances[i];
+			if (instance->skins.size() == 0) {
+				continue;
+			}
+
+			Matrix4x4 invGlobal;
+			if (instance->mesh->linkNode) {
+				invGlobal = instance->mesh->linkNode->GetGlobalMatrix().Inverse();
+			}
+
+			JobSystem::Get().Run([this, instance, invGlobal, maxCostRatio, &numRebuilds]() {
+				SkinInstance(*instance, invGlobal);
+				instance->bvh->Refit();
+				if (instance->bvh->GetCostRatio() > maxCostRatio)
+				{
+					instance->bvh->Rebuild();
+					numRebuilds.fetch_add(1, std::memory_order_relaxed);
+				}
+			}, &counter);
+		}
+		JobSystem::Get().Wait(&counter);
+
+		UpdateTransforms();
+
+		m_NumRebuilds = numRebuilds.load();
+		m_RefitTime   = GenericPlatformTime::Seconds() - refitTime;
+	}
+
+	float DVKBVH::GetCostRatio() const
+	{
+		float costRatio = 1.0f;
+		for (int32 i = 0; i < m_Instances.size(); ++i)
+		{
+			if (m_Instances[i].skins.size() > 0) {
+				costRatio = MMath::Max(costRatio, m_Instances[i].bvh->GetCostRatio());
+			}
+		}
+		return costRatio;
+	}
+
+	void DVKBVH::UpdateTransforms()
+	{
+		std::vector<BVHBounds> bounds;
+		std::vector<int32> instances;
+
+		for (int32 i = 0; i < m_Instances.size(); ++i)
+		{
+			Instance& instance = m_Instances[i];
+			if (!instance.bvh) {
+				continue;
+			}
+
+			if (instance.mesh->linkNode) {
+				instance.transform = instance.mesh->linkNode->GetGlobalMatrix();
+			}
+			else {
+				instance.transform.SetIdentity();
+			}
+			instance.invTransform = instance.transform.Inverse();
+
+			const DVKBoundingBox& localBounds = instance.bvh->GetBounds();
+
+			BVHBounds worldBounds;
+			for (int32 j = 0; j < 8; ++j) {
+				worldBounds.Grow(instance.transform.TransformPosition(localBounds.corners[j]));
+			}
+
+			bounds.push_back(worldBounds);
+			instances.push_back(i);
+		}
+
+		m_Nodes.clear();
+		m_Indices.clear();
+
+		if (bounds.size() == 0) {
+			return;
+		}
+
+		std::vector<int32> order;
+		BVHBuilder builder(bounds.data(), bounds.size(), 1);
+		builder.Build(m_Nodes, order);
+
+		m_Indices.resize(order.size());
+		for (int32 i = 0; i < order.size(); ++i) {
+			m_Indices[i] = instances[order[i]];
+		}
+	}
+
+	bool DVKBVH::Intersect(const Vector3& origin, const Vector3& direction, float tMin, DVKRayHit& hit) const
+	{
+		return TraverseBVH<false>(m_Nodes, origin, direction, tMin, hit.dist, [&](const DVKBVHNode& leaf, float& tMax) {
+			bool found = false;
+			for (int32 i = 0; i < leaf.count; ++i)
+			{
+				int32 index = m_Indices[leaf.leftFirst + i];
+				const Instance& instance = m_Instances[index];
+
+				// 方向不归一化，object space里的t和世界空间相同
+				Vector3 localOrigin    = instance.invTransform.TransformPosition(origin);
+				Vector3 localDirection = instance.invTransform.DeltaTransformVector(direction);
+
+				if (instance.bvh->Intersect(localOrigin, localDirection, tMin, hit))
+				{
+					hit.mesh = index;
+					found = true;
+				}
+			}
+			return found;
+		});
+	}
+
+	bool DVKBVH::IntersectAny(const Vector3& origin, const Vector3& direction, float tMin, float tMax) const
+	{
+		return TraverseBVH<true>(m_Nodes, origin, direction, tMin, tMax, [&](const DVKBVHNode& leaf, float& maxDist) {
+			for (int32 i = 0; i < leaf.count; ++i)
+			{
+				const Instance& instance = m_Instances[m_Indices[leaf.leftFirst + i]];
+
+				Vector3 localOrigin    = instance.invTransform.TransformPosition(origin);
+				Vector3 localDirection = instance.invTransform.DeltaTransformVector(direction);
+
+				if (instance.bvh->IntersectAny(localOrigin, localDirection, tMin, maxDist)) {
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+
+	void DVKBVH::GetTriangle(const DVKRayHit& hit, Vector3& v0, Vector3& v1, Vector3& v2) const
+	{
+		const Instance& instance = m_Instances[hit.mesh];
+		instance.bvh->GetTriangle(hit.primitive, hit.triangle, v0, v1, v2);
+
+		v0 = instance.transform.TransformPosition(v0);
+		v1 = instance.transform.TransformPosition(v1);
+		v2 = instance.transform.TransformPosition(v2);
+	}
+
+	Vector3 DVKBVH::GetNormal(const DVKRayHit& hit) const
+	{
+		Vector3 v0, v1, v2;
+		GetTriangle(hit, v0, v1, v2);
+
+		Vector3 normal = Vector3::CrossProduct(v1 - v0, v2 - v0);
+		normal.Normalize();
+		return normal;
+	}
+
+	int32 DVKBVH::GetNumNodes() const
+	{
+		int32 numNodes = m_Nodes.size();
+		for (int32 i = 0; i < m_Instances.size(); ++i)
+		{
+			if (m_Instances[i].bvh) {
+				numNodes += m_Instances[i].bvh->GetNumNodes();
+			}
+		}
+		return numNodes;
+	}
+
+	int32 DVKBVH::GetNumTriangles() const
+	{
+		int32 numTriangles = 0;
+		for (int32 i = 0; i < m_Instances.size(); ++i)
+		{
+			if (m_Instances[i].bvh) {
+				numTriangles += m_Instances[i].bvh->GetNumTriangles();
+			}
+		}
+		return numTriangles;
+	}
+
+};
@@ -0,0 +1,226 @@
+﻿#pragma once
+
+#include "DVKModel.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Matrix4x4.h"
+#include "Math/RayIntersection.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+	// 32字节，两个子节点连续存放，遍历时一次读取一对
+	struct DVKBVHNode
+	{
+		Vector3		min;
+		int32		leftFirst;	// 内部节点为左子节点的序号，右子节点为leftFirst + 1；叶子为第一个图元的位置
+		Vector3		max;
+		int32		count;		// 叶子里的图元数量，内部节点为0
+
+		inline bool IsLeaf() const
+		{
+			return count > 0;
+		}
+	};
+
+	// 通用的binned SAH构建，每个图元一个包围盒，叶子的leftFirst指向outIndices。DVKBVH和DVKSceneGraph共用
+	void BuildBVHNodes(const Vector3* boundsMin, const Vector3* boundsMax, int32 count, int32 maxLeafSize, std::vector<DVKBVHNode>& outNodes, std::vector<int32>& outIndices);
+
+	struct DVKRayHit
+	{
+		float		dist = MAX_flt;	// 光线参数t，方向没有归一化时不是距离
+		float		u = 0.0f;		// 重心坐标，命中点为v0 + u * (v1 - v0) + v * (v2 - v0)
+		float		v = 0.0f;
+		int32		mesh = -1;		// DVKModel::meshes的序号
+		int32		primitive = -1;	// DVKMesh::primitives的序号
+		int32		triangle = -1;	// primitive里的第几个三角形
+	};
+
+	/**
+	 * BVH over the triangles of one DVKMesh, in the mesh's object space. Binned SAH build, large
+	 * nodes are binned with ParallelFor and large subtrees are built as jobs. Every leaf holds at
+	 * most 4 triangles in its own TriangleSoA block, so a leaf is a single SIMD test.
+	 * Keeps a copy of the vertex positions (position must be the first vertex attribute), after
+	 * they are changed Refit() updates the boxes with the same topology and Rebuild() builds a new
+	 * tree. The mesh has to outlive the BVH.
+	 */
+	class DVKMeshBVH
+	{
+	public:
+		// mesh没有三角形时返回nullptr
+		static DVKMeshBVH* Create(const DVKMesh* mesh);
+
+		// 最近的交点，hit.dist为输入的最大距离，命中时更新hit
+		bool Intersect(const Vector3& origin, const Vector3& direction, float tMin, DVKRayHit& hit) const;
+
+		// (tMin, tMax)之间有任意交点就返回，用于阴影这类只需要知道是否遮挡的查询
+		bool IntersectAny(const Vector3& origin, const Vector3& direction, float tMin, float tMax) const;
+
+		// 当前顶点位置的三角形
+		void GetTriangle(int32 primitive, int32 triangle, Vector3& v0, Vector3& v1, Vector3& v2) const;
+
+		// 所有primitive的顶点按顺序拼接，修改之后调用Refit或者Rebuild
+		inline std::vector<Vector3>& GetPositions()
+		{
+			return m_Positions;
+		}
+
+		// 自底向上重新计算包围盒，树的结构不变。节点多时顶部拆成子树并行
+		void Refit();
+
+		// 用当前的顶点重新构建
+		void Rebuild();
+
+		// 当前的SAH代价和上次构建时的比值，refit之后变大说明树的质量变差
+		inline float GetCostRatio() const
+		{
+			return m_BuildCost > 0.0f ? m_Cost / m_BuildCost : 1.0f;
+		}
+
+		inline const DVKBoundingBox& GetBounds() const
+		{
+			return m_Bounds;
+		}
+
+		inline int32 GetNumNodes() const
+		{
+			return m_Nodes.size();
+		}
+
+		inline int32 GetNumTriangles() const
+		{
+			return m_Triangles.count;
+		}
+
+	private:
+		friend class DVKBVH;
+
+		DVKMeshBVH()
+		{
+
+		}
+
+		// 只读取顶点和三角形，还需要Rebuild。mesh没有三角形时返回nullptr
+		static DVKMeshBVH* Load(const DVKMesh* mesh);
+
+		void RefitNode(int32 index);
+
+		float ComputeCost() const;
+
+		void UpdateBounds();
+
+		const DVKMesh*				m_Mesh = nullptr;
+		DVKBoundingBox				m_Bounds;
+		std::vector<DVKBVHNode>		m_Nodes;
+		TriangleSoA					m_Triangles;
+		std::vector<int32>			m_PrimitiveIds;	// 和m_Triangles一一对应，补齐的位置为-1
+		std::vector<int32>			m_TriangleIds;
+		std::vector<int32>			m_VertexIds;	// 每个三角形3个
+
+		std::vector<Vector3>		m_Positions;
+		std::vector<int32>			m_PrimitiveBases;	// 每个primitive第一个顶点在m_Positions里的位置
+
+		std::vector<int32>			m_RefitRoots;	// 并行refit的子树
+		std::vector<int32>			m_RefitTop;		// 子树之上的节点，从上到下
+		float						m_BuildCost = 0.0f;
+		float						m_Cost = 0.0f;
+	};
+
+	/**
+	 * Two level BVH for a DVKModel: one DVKMeshBVH per mesh in object space, built in parallel, and
+	 * a top level BVH over the meshes' world bounds. Rays are moved into each mesh's object space
+	 * with the inverse of its linkNode global matrix, moving nodes only needs UpdateTransforms().
+	 * Skinned meshes (loaded with VA_SkinIndex/VA_SkinWeight or VA_SkinPack) are skinned on the CPU
+	 * by Refit() and their BVH refit, or rebuilt once refitting made it too slow.
+	 * Queries are const and can run from any number of threads, but not during an update.
+	 */
+	class DVKBVH
+	{
+	public:
+		~DVKBVH();
+
+		static DVKBVH* Create(DVKModel* model);
+
+		// 重新读取每个mesh的linkNode变换，重建顶层BVH
+		void UpdateTransforms();
+
+		// DVKModel::Update/GotoAnimation之后调用。蒙皮的mesh用当前的骨骼重新蒙皮并refit，
+		// SAH代价超过构建时maxCostRatio倍的重建，最后调用UpdateTransforms
+		void Refit(float maxCostRatio = 1.5f);
+
+		inline bool HasSkin() const
+		{
+			return m_HasSkin;
+		}
+
+		// 世界空间的光线，direction不需要归一化
+		bool Intersect(const Vector3& origin, const Vector3& direction, float tMin, DVKRayHit& hit) const;
+
+		bool IntersectAny(const Vector3& origin, const Vector3& direction, float tMin, float tMax) const;
+
+		// 命中的三角形，世界空间
+		void GetTriangle(const DVKRayHit& hit, Vector3& v0, Vector3& v1, Vector3& v2) const;
+
+		// 世界空间的几何法线，已经归一化，朝向由三角形的绕序决定
+		Vector3 GetNormal(const DVKRayHit& hit) const;
+
+		int32 GetNumNodes() const;
+
+		int32 GetNumTriangles() const;
+
+		// Create的耗时，单位秒
+		inline double GetBuildTime() const
+		{
+			return m_BuildTime;
+		}
+
+		// 上一次Refit的耗时，包括蒙皮
+		inline double GetRefitTime() const
+		{
+			return m_RefitTime;
+		}
+
+		// 上一次Refit里重建的mesh数量
+		inline int32 GetNumRebuilds() const
+		{
+			return m_NumRebuilds;
+		}
+
+		// 蒙皮mesh里最大的SAH代价比值
+		float GetCostRatio() const;
+
+	private:
+		DVKBVH()
+		{
+
+		}
+
+		struct Instance
+		{
+			DVKMeshBVH*		bvh = nullptr;
+			DVKMesh*		mesh = nullptr;
+			Matrix4x4		transform;
+			Matrix4x4		invTransform;
+
+			// 只有蒙皮的mesh有，和DVKMeshBVH::GetPositions一一对应
+			std::vector<DVKVertexSkin>	skins;
+			std::vector<Vector3>		bindPositions;
+		};
+
+		// invGlobal为mesh全局矩阵的逆，需要在调用线程算好：GetGlobalMatrix会写父节点，不能在job里调用
+		void SkinInstance(Instance& instance, const Matrix4x4& invGlobal);
+
+		DVKModel*					m_Model = nullptr;
+		std::vector<Instance>		m_Instances;	// 和DVKModel::meshes一一对应
+		std::vector<DVKBVHNode>		m_Nodes;
+		std::vector<int32>			m_Indices;		// 叶子里的instance
+		bool						m_HasSkin = false;
+		double						m_BuildTime = 0.0;
+		double						m_RefitTime = 0.0;
+		int32						m_NumRebuilds = 0;
+	};
+
+};
@@ -3,6 +3,9 @@
 #include "DVKBuffer.h"
 #include "DVKUtils.h"
 
+#include "Math/Math.h"
+#include "Utils/Alignment.h"
+
 namespace vk_demo
 {
 	DVKBuffer* DVKBuffer::CreateBuffer(std::shared_ptr<VulkanDevice> vulkanDevice, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, void *data)
@@ -12,10 +15,7 @@ namespace vk_demo
 		
 		VkDevice vkDevice = vulkanDevice->GetInstanceHandle();
 		
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAlloc;
-		ZeroVulkanStruct(memAlloc, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 		
 		VkBufferCreateInfo bufferCreateInfo;
 		ZeroVulkanStruct(bufferCreateInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
@@ -24,13 +24,22 @@ namespace vk_demo
 		vkCreateBuffer(vkDevice, &bufferCreateInfo, nullptr, &(dvkBuffer->buffer));
 
 		vkGetBufferMemoryRequirements(vkDevice, dvkBuffer->buffer, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, memoryPropertyFlags, &memoryTypeIndex);
-		memAlloc.allocationSize  = memReqs.size;
-		memAlloc.memoryTypeIndex = memoryTypeIndex;
-		
-		vkAllocateMemory(vkDevice, &memAlloc, nullptr, &dvkBuffer->memory);
 
-		dvkBuffer->size       = memAlloc.allocationSize;
+		// non coherent memory is flushed in nonCoherentAtomSize units, keep them inside this allocation.
+		bool hostVisible  = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)  != 0;
+		bool hostCoherent = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		if (hostVisible && !hostCoherent)
+		{
+			VkDeviceSize atomSize = vulkanDevice->GetLimits().nonCoherentAtomSize;
+			memReqs.alignment = MMath::Max(memReqs.alignment, atomSize);
+			memReqs.size      = Align(memReqs.size, atomSize);
+		}
+
+		dvkBuffer->allocation = vulkanDevice->GetResourceHeapManager().AllocateBufferMemory(memReqs, memoryPropertyFlags, __FILE__, __LINE__);
+		dvkBuffer->allocation->AddRef();
+		dvkBuffer->memory     = dvkBuffer->allocation->GetHandle();
+
+		dvkBuffer->size       = memReqs.size;
 		dvkBuffer->alignment  = memReqs.alignment;
 		dvkBuffer->usageFlags = usageFlags;
 		dvkBuffer->memoryPropertyFlags = memoryPropertyFlags;
@@ -56,7 +65,12 @@ namespace vk_demo
 		if (mapped) {
 			return VK_SUCCESS;
 		}
-		return vkMapMemory(device, memory, offset, size, 0, &mapped);
+		// host visible pages stay mapped for their whole lifetime.
+		if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) {
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+		mapped = (uint8*)allocation->GetMappedPointer() + offset;
+		return VK_SUCCESS;
 	}
 
 	void DVKBuffer::UnMap()
@@ -64,13 +78,12 @@ namespace vk_demo
 		if (!mapped) {
 			return;
 		}
-		vkUnmapMemory(device, memory);
 		mapped = nullptr;
 	}
 
 	VkResult DVKBuffer::Bind(VkDeviceSize offset)
 	{
-		return vkBindBufferMemory(device, buffer, memory, offset);
+		return vkBindBufferMemory(device, buffer, memory, allocation->GetOffset() + offset);
 	}
 
 	void DVKBuffer::SetupDescriptor(VkDeviceSize size, VkDeviceSize offset)
@@ -88,13 +101,24 @@ namespace vk_demo
 		memcpy(mapped, data, size);
 	}
 
+	VkDeviceSize DVKBuffer::GetMappedRangeSize(VkDeviceSize size, VkDeviceSize offset)
+	{
+		// 起点向下、终点向上对齐到nonCoherentAtomSize，覆盖[offset, offset + size)且不超出buffer
+		VkDeviceSize start = AlignDown(offset, alignment);
+		if (size == VK_WHOLE_SIZE) {
+			return this->size - start;
+		}
+		VkDeviceSize end = MMath::Min(Align(offset + size, alignment), this->size);
+		return end - start;
+	}
+
 	VkResult DVKBuffer::Flush(VkDeviceSize size, VkDeviceSize offset)
 	{
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size   = size;
+		mappedRange.offset = allocation->GetOffset() + AlignDown(offset, alignment);
+		mappedRange.size   = GetMappedRangeSize(size, offset);
 		return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
 	}
 
@@ -103,8 +127,8 @@ namespace vk_demo
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size   = size;
+		mappedRange.offset = allocation->GetOffset() + AlignDown(offset, alignment);
+		mappedRange.size   = GetMappedRangeSize(size, offset);
 		return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
 	}
 
@@ -29,10 +29,11 @@ namespace vk_demo
 				vkDestroyBuffer(device, buffer, nullptr);
 				buffer = VK_NULL_HANDLE;
 			}
-			if (memory != VK_NULL_HANDLE) {
-				vkFreeMemory(device, memory, nullptr);
-				memory = VK_NULL_HANDLE;
+			if (allocation) {
+				allocation->Release();
+				allocation = nullptr;
 			}
+			memory = VK_NULL_HANDLE;
 		}
 	public:
 
@@ -40,6 +41,7 @@ namespace vk_demo
 
 		VkBuffer				buffer = VK_NULL_HANDLE;
 		VkDeviceMemory			memory = VK_NULL_HANDLE;
+		VulkanResourceAllocation*	allocation = nullptr;
 
 		VkDescriptorBufferInfo	descriptor;
 
@@ -68,6 +70,10 @@ namespace vk_demo
 		VkResult Flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
 		VkResult Invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+	private:
+
+		VkDeviceSize GetMappedRangeSize(VkDeviceSize size, VkDeviceSize offset);
 	};
 
 };
\ No newline at end of file
@@ -15,5 +15,14 @@
 #include "DVKCamera.h"
 #include "DVKRenderTarget.h"
 #include "DVKCompute.h"
+#include "DVKUploadQueue.h"
+#include "DVKAssetLoader.h"
+#include "DVKBVH.h"
+#include "DVKSkinCompute.h"
+#include "DVKAnimTexture.h"
+#include "DVKGPUCulling.h"
+#include "DVKOcclusionQuery.h"
+#include "DVKSceneGraph.h"
+#include "DVKGPUProfiler.h"
 #include "FileManager.h"
 #include "ImageGUIContext.h"
\ No newline at end of file
@@ -1,5 +1,7 @@
 ﻿#include "DVKCompute.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 namespace vk_demo
 {
     
@@ -8,18 +10,12 @@ namespace vk_demo
     
     void DVKCompute::InitRingBuffer(std::shared_ptr<VulkanDevice> vulkanDevice)
     {
-        ringBuffer = new DVKRingBuffer();
-        ringBuffer->device       = vulkanDevice->GetInstanceHandle();
-        ringBuffer->bufferSize   = 8 * 1024 * 1024; // 8MB
-        ringBuffer->bufferOffset = ringBuffer->bufferSize;
-        ringBuffer->minAlignment = vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
-        ringBuffer->realBuffer   = vk_demo::DVKBuffer::CreateBuffer(
+        ringBuffer = DVKRingBuffer::Create(
             vulkanDevice,
             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            ringBuffer->bufferSize
+            2 * 1024 * 1024, // 2MB per block
+            4
         );
-        ringBuffer->realBuffer->Map();
         ringBufferRefCount = 0;
     }
     
@@ -29,10 +25,28 @@ namespace vk_demo
         ringBuffer = nullptr;
         ringBufferRefCount = 0;
     }
+
+    void DVKCompute::SubmitFrame(VkFence fence)
+    {
+        if (ringBuffer) {
+            ringBuffer->SubmitFrame(fence);
+        }
+    }
+
+    DVKRingBufferStats DVKCompute::GetRingBufferStats()
+    {
+        if (ringBuffer) {
+            return ringBuffer->GetStats();
+        }
+        return DVKRingBufferStats();
+    }
     
     DVKCompute::~DVKCompute()
     {
-        delete descriptorSet;
+        for (int32 i = 0; i < blockDescriptorSets.size(); ++i) {
+            delete blockDescriptorSets[i];
+        }
+        blockDescriptorSets.clear();
         descriptorSet = nullptr;
         
         textures.clear();
@@ -84,7 +98,7 @@ namespace vk_demo
             uboBuffer.stageFlags     = it->second.stageFlags;
             uboBuffer.dataSize       = it->second.bufferSize;
             uboBuffer.bufferInfo     = {};
-            uboBuffer.bufferInfo.buffer = ringBuffer->realBuffer->buffer;
+            uboBuffer.bufferInfo.buffer = ringBuffer->GetBuffer(0);
             uboBuffer.bufferInfo.offset = 0;
             uboBuffer.bufferInfo.range  = uboBuffer.dataSize;
 
@@ -97,9 +111,13 @@ namespace vk_demo
 			else if (it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
 				it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
 			{
+				uboBuffer.bufferInfo.buffer = VK_NULL_HANDLE;
 				storageBuffers.insert(std::make_pair(it->first, uboBuffer));
 			}
         }
+
+        // descriptorSet always points at the first block of the ring buffer
+        blockDescriptorSets.push_back(descriptorSet);
         
         // 设置Offset的索引,DynamicOffset的顺序跟set和binding顺序相关
         dynamicOffsetCount = 0;
@@ -152,7 +170,9 @@ namespace vk_demo
         ZeroVulkanStruct(computeCreateInfo, VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO);
         computeCreateInfo.layout = shader->pipelineLayout;
         computeCreateInfo.stage  = shader->shaderStageCreateInfos[0];
+        double beginTime = GenericPlatformTime::Seconds();
         VERIFYVULKANRESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computeCreateInfo, VULKAN_CPU_ALLOCATOR, &pipeline));
+        DVKPipelineStats::AddCreateTime(GenericPlatformTime::Seconds() - beginTime);
     }
 
 	void DVKCompute::BindDispatch(VkCommandBuffer commandBuffer, int groupX, int groupY, int groupZ)
@@ -165,16 +185,96 @@ namespace vk_demo
     void DVKCompute::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint)
     {
         uint32* dynOffsets = dynamicOffsets.data();
+        DVKDescriptorSet* blockSet = GetBlockDescriptorSet(uniformBlock);
         
         vkCmdBindDescriptorSets(
             commandBuffer,
             bindPoint,
             GetPipelineLayout(),
-            0, GetDescriptorSets().size(), GetDescriptorSets().data(),
+            0, blockSet->descriptorSets.size(), blockSet->descriptorSets.data(),
             dynamicOffsetCount, dynOffsets
         );
     }
 
+    DVKDescriptorSet* DVKCompute::GetBlockDescriptorSet(uint32 blockID)
+    {
+        if (blockID < blockDescriptorSets.size() && blockDescriptorSets[blockID]) {
+            return blockDescriptorSets[blockID];
+        }
+        
+        if (blockID >= blockDescriptorSets.size()) {
+            blockDescriptorSets.resize(blockID + 1, nullptr);
+        }
+        
+        // a chained ring buffer block needs its own descriptor set, replay everything written so far.
+        DVKDescriptorSet* blockSet = shader->AllocateDescriptorSet();
+        
+        for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+        {
+            VkDescriptorBufferInfo bufferInfo = it->second.bufferInfo;
+            bufferInfo.buffer = ringBuffer->GetBuffer(blockID);
+            blockSet->WriteBuffer(it->first, &bufferInfo);
+        }
+        
+        for (auto it = storageBuffers.begin(); it != storageBuffers.end(); ++it)
+        {
+            if (it->second.bufferInfo.buffer != VK_NULL_HANDLE) {
+                blockSet->WriteBuffer(it->first, &(it->second.bufferInfo));
+            }
+        }
+        
+        for (auto it = textures.begin(); it != textures.end(); ++it)
+        {
+            if (it->second.texture) {
+                blockSet->WriteImage(it->first, it->second.texture);
+            }
+        }
+        
+        blockDescriptorSets[blockID] = blockSet;
+        return blockSet;
+    }
+    
+    void DVKCompute::EmitUniforms()
+    {
+        // 所有Uniform需要位于同一个block，分配途中换了block就整体重新拷贝一次
+        bool restart = true;
+        while (restart)
+        {
+            restart = false;
+            bool first = true;
+            
+            for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+            {
+                if (it->second.dataContent.size() == 0) {
+                    continue;
+                }
+                
+                uint32 blockID    = 0;
+                uint64 ringOffset = 0;
+                if (!ringBuffer->AllocateMemory(it->second.dataSize, blockID, ringOffset))
+                {
+                    // 分配失败不写入数据，Offset退回到block起始位置
+                    memset(dynamicOffsets.data(), 0, sizeof(uint32) * dynamicOffsets.size());
+                    return;
+                }
+
+                if (first) 
+                {
+                    first = false;
+                    uniformBlock = blockID;
+                }
+                else if (blockID != uniformBlock)
+                {
+                    restart = true;
+                    break;
+                }
+                
+                memcpy(ringBuffer->GetMappedPointer(blockID) + ringOffset, it->second.dataContent.data(), it->second.dataSize);
+                dynamicOffsets[it->second.dynamicIndex] = ringOffset;
+            }
+        }
+    }
+
 	void DVKCompute::SetStorageBuffer(const std::string& name, DVKBuffer* buffer)
 	{
 		auto it = storageBuffers.find(name);
@@ -196,7 +296,11 @@ namespace vk_demo
 			it->second.bufferInfo.buffer = buffer->buffer;
 			it->second.bufferInfo.offset = 0;
 			it->second.bufferInfo.range  = buffer->size;
-			descriptorSet->WriteBuffer(name, buffer);
+			for (int32 i = 0; i < blockDescriptorSets.size(); ++i) {
+				if (blockDescriptorSets[i]) {
+					blockDescriptorSets[i]->WriteBuffer(name, buffer);
+				}
+			}
 		}
 	}
     
@@ -215,11 +319,28 @@ namespace vk_demo
             return;
         }
         
+        // 保留一份数据，换block时需要重新拷贝
+        if (it->second.dataContent.size() != size) {
+            it->second.dataContent.resize(size);
+        }
+        memcpy(it->second.dataContent.data(), dataPtr, size);
+        
         // 拷贝数据至ringbuffer
-        uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
-        uint64 ringOffset  = ringBuffer->AllocateMemory(it->second.dataSize);
+        uint32 blockID     = 0;
+        uint64 ringOffset  = 0;
+        if (!ringBuffer->AllocateMemory(it->second.dataSize, blockID, ringOffset)) {
+            return;
+        }
+        uint8* ringCPUData = ringBuffer->GetMappedPointer(blockID);
         uint64 bufferSize  = it->second.dataSize;
         
+        // 其余的Uniform还在之前的block中
+        if (blockID != uniformBlock)
+        {
+            EmitUniforms();
+            return;
+        }
+        
         // 拷贝数据
         memcpy(ringCPUData + ringOffset, dataPtr, bufferSize);
         
@@ -250,7 +371,11 @@ namespace vk_demo
         if (it->second.texture != texture) 
 		{
             it->second.texture = texture;
-            descriptorSet->WriteImage(name, texture);
+            for (int32 i = 0; i < blockDescriptorSets.size(); ++i) {
+                if (blockDescriptorSets[i]) {
+                    blockDescriptorSets[i]->WriteImage(name, texture);
+                }
+            }
         }
     }
     
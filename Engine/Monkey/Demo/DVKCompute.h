@@ -34,6 +34,10 @@ namespace vk_demo
         virtual ~DVKCompute();
         
         static DVKCompute* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkPipelineCache pipelineCache, DVKShader* shader);
+
+        static void SubmitFrame(VkFence fence);
+
+        static DVKRingBufferStats GetRingBufferStats();
         
         void BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint);
 
@@ -71,6 +75,10 @@ namespace vk_demo
         
         void PreparePipeline();
 
+        void EmitUniforms();
+
+        DVKDescriptorSet* GetBlockDescriptorSet(uint32 blockID);
+
     private:
         
         static DVKRingBuffer*   ringBuffer;
@@ -85,9 +93,11 @@ namespace vk_demo
         VkPipeline                  pipeline = VK_NULL_HANDLE;
         
         DVKDescriptorSet*           descriptorSet = nullptr;
+        std::vector<DVKDescriptorSet*>  blockDescriptorSets;
         
         uint32                      dynamicOffsetCount;
         std::vector<uint32>         dynamicOffsets;
+        uint32                      uniformBlock = 0;
         
 		BuffersMap					uniformBuffers;
 		BuffersMap					storageBuffers;
@@ -0,0 +1,477 @@
+﻿#include "DVKGPUCulling.h"
+#include "DVKUploadQueue.h"
+
+#define CULL_GROUP_SIZE 64
+#define HIZ_GROUP_SIZE  8
+#define HIZ_MAX_LEVELS  16
+
+namespace vk_demo
+{
+	DVKCullInstance::DVKCullInstance(const DVKBoundingBox& bounds, const Matrix4x4& transform, int32 inDrawIndex)
+	{
+		DVKBoundingBox box(bounds.min, bounds.max);
+		box.UpdateCorners();
+
+		boundsMin = Vector3(MAX_flt, MAX_flt, MAX_flt);
+		boundsMax = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+		for (int32 i = 0; i < 8; ++i)
+		{
+			Vector3 corner = transform.TransformPosition(box.corners[i]);
+			boundsMin = Vector3::Min(boundsMin, corner);
+			boundsMax = Vector3::Max(boundsMax, corner);
+		}
+
+		drawIndex = inDrawIndex;
+		padding   = 0.0f;
+	}
+
+	DVKGPUCulling::~DVKGPUCulling()
+	{
+		delete m_Compute;
+		delete m_HiZBuild;
+		delete m_HiZCull;
+		m_Compute  = nullptr;
+		m_HiZBuild = nullptr;
+		m_HiZCull  = nullptr;
+
+		delete m_HiZTexture;
+		delete m_HistoryBuffer;
+		m_HiZTexture    = nullptr;
+		m_HistoryBuffer = nullptr;
+
+		delete m_InstanceBuffer;
+		delete m_PayloadBuffer;
+		delete m_CommandTemplate;
+		delete m_IndirectBuffer;
+		delete m_VisibleBuffer;
+		delete m_StatBuffer;
+
+		m_InstanceBuffer  = nullptr;
+		m_PayloadBuffer   = nullptr;
+		m_CommandTemplate = nullptr;
+		m_IndirectBuffer  = nullptr;
+		m_VisibleBuffer   = nullptr;
+		m_StatBuffer      = nullptr;
+
+		m_VulkanDevice = nullptr;
+	}
+
+	void DVKGPUCulling::ExtractFrustumPlanes(const Matrix4x4& viewProjection, Vector4* outPlanes)
+	{
+		const Matrix4x4& matrix = viewProjection;
+
+		// left
+		outPlanes[0].x = matrix.m[0][3] + matrix.m[0][0];
+		outPlanes[0].y = matrix.m[1][3] + matrix.m[1][0];
+		outPlanes[0].z = matrix.m[2][3] + matrix.m[2][0];
+		outPlanes[0].w = matrix.m[3][3] + matrix.m[3][0];
+
+		// right
+		outPlanes[1].x = matrix.m[0][3] - matrix.m[0][0];
+		outPlanes[1].y = matrix.m[1][3] - matrix.m[1][0];
+		outPlanes[1].z = matrix.m[2][3] - matrix.m[2][0];
+		outPlanes[1].w = matrix.m[3][3] - matrix.m[3][0];
+
+		// top
+		outPlanes[2].x = matrix.m[0][3] + matrix.m[0][1];
+		outPlanes[2].y = matrix.m[1][3] + matrix.m[1][1];
+		outPlanes[2].z = matrix.m[2][3] + matrix.m[2][1];
+		outPlanes[2].w = matrix.m[3][3] + matrix.m[3][1];
+
+		// bottom
+		outPlanes[3].x = matrix.m[0][3] - matrix.m[0][1];
+		outPlanes[3].y = matrix.m[1][3] - matrix.m[1][1];
+		outPlanes[3].z = matrix.m[2][3] - matrix.m[2][1];
+		outPlanes[3].w = matrix.m[3][3] - matrix.m[3][1];
+
+		// near
+		outPlanes[4].x = matrix.m[0][2];
+		outPlanes[4].y = matrix.m[1][2];
+		outPlanes[4].z = matrix.m[2][2];
+		outPlanes[4].w = matrix.m[3][2];
+
+		// far
+		outPlanes[5].x = matrix.m[0][3] - matrix.m[0][2];
+		outPlanes[5].y = matrix.m[1][3] - matrix.m[1][2];
+		outPlanes[5].z = matrix.m[2][3] - matrix.m[2][2];
+		outPlanes[5].w = matrix.m[3][3] - matrix.m[3][2];
+
+		for (int32 i = 0; i < 6; ++i)
+		{
+			float length = MMath::Sqrt(outPlanes[i].x * outPlanes[i].x + outPlanes[i].y * outPlanes[i].y + outPlanes[i].z * outPlanes[i].z);
+			outPlanes[i].x /= length;
+			outPlanes[i].y /= length;
+			outPlanes[i].z /= length;
+			outPlanes[i].w /= length;
+		}
+	}
+
+	DVKGPUCulling* DVKGPUCulling::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkPipelineCache pipelineCache, DVKShader* shader, const std::vector<DVKCullDraw>& draws, const std::vector<DVKCullInstance>& instances, const void* payloads, int32 payloadStride, int32 framesInFlight)
+	{
+		if (draws.size() == 0 || instances.size() == 0) 
+		{
+			MLOGE("GPU culling needs at least one draw and one instance.");
+			return nullptr;
+		}
+
+		if (payloadStride <= 0 || payloadStride % 16 != 0) 
+		{
+			MLOGE("Payload stride must be a multiple of 16 bytes : %d", payloadStride);
+			return nullptr;
+		}
+
+		// 每个draw在输出buffer里预留它全部实例的空间
+		std::vector<VkDrawIndexedIndirectCommand> commands(draws.size());
+		for (int32 i = 0; i < draws.size(); ++i)
+		{
+			commands[i] = {};
+			commands[i].indexCount   = draws[i].indexCount;
+			commands[i].firstIndex   = draws[i].firstIndex;
+			commands[i].vertexOffset = draws[i].vertexOffset;
+		}
+
+		for (int32 i = 0; i < instances.size(); ++i)
+		{
+			int32 drawIndex = (int32)instances[i].drawIndex;
+			if (drawIndex < 0 || drawIndex >= draws.size()) 
+			{
+				MLOGE("Instance %d has invalid draw index %d.", i, drawIndex);
+				return nullptr;
+			}
+			commands[drawIndex].firstInstance += 1;
+		}
+
+		uint32 firstInstance = 0;
+		for (int32 i = 0; i < commands.size(); ++i)
+		{
+			uint32 count = commands[i].firstInstance;
+			commands[i].firstInstance = firstInstance;
+			firstInstance += count;
+		}
+
+		DVKGPUCulling* culling = new DVKGPUCulling();
+		culling->m_VulkanDevice   = vulkanDevice;
+		culling->m_NumInstances   = instances.size();
+		culling->m_NumDraws       = draws.size();
+		culling->m_PayloadStride  = payloadStride;
+		culling->m_FramesInFlight = MMath::Max(framesInFlight, 1);
+
+		uint64 instanceSize = instances.size() * sizeof(DVKCullInstance);
+		uint64 payloadSize  = (uint64)instances.size() * payloadStride;
+		uint64 commandSize  = commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+		culling->m_InstanceBuffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			instanceSize
+		);
+
+		culling->m_PayloadBuffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			payloadSize
+		);
+
+		// 每帧从这里恢复instanceCount为0的命令
+		culling->m_CommandTemplate = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			commandSize
+		);
+
+		culling->m_IndirectBuffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			commandSize
+		);
+
+		culling->m_VisibleBuffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			payloadSize
+		);
+
+		// 每个slot两个计数，两阶段剔除的第一阶段和最终结果，CPU在slot的fence之后读取
+		culling->m_StatBuffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			culling->m_FramesInFlight * sizeof(uint32) * 2
+		);
+		culling->m_StatBuffer->Map();
+		memset(culling->m_StatBuffer->mapped, 0, culling->m_FramesInFlight * sizeof(uint32) * 2);
+
+		DVKUploadQueue* uploadQueue = DVKUploadQueue::Create(vulkanDevice, instanceSize + payloadSize + commandSize);
+		uploadQueue->UploadBuffer(culling->m_InstanceBuffer,  instances.data(), instanceSize);
+		uploadQueue->UploadBuffer(culling->m_PayloadBuffer,   payloads,         payloadSize);
+		uploadQueue->UploadBuffer(culling->m_CommandTemplate, commands.data(),  commandSize);
+		uploadQueue->Flush();
+		uploadQueue->WaitIdle();
+		delete uploadQueue;
+
+		culling->m_Compute = DVKCompute::Create(vulkanDevice, pipelineCache, shader);
+		culling->m_Compute->SetStorageBuffer("instanceData", culling->m_InstanceBuffer);
+		culling->m_Compute->SetStorageBuffer("payloadData",  culling->m_PayloadBuffer);
+		culling->m_Compute->SetStorageBuffer("drawData",     culling->m_IndirectBuffer);
+		culling->m_Compute->SetStorageBuffer("visibleData",  culling->m_VisibleBuffer);
+		culling->m_Compute->SetStorageBuffer("statData",     culling->m_StatBuffer);
+
+		return culling;
+	}
+
+	void DVKGPUCulling::InsertBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+	{
+		VkMemoryBarrier memoryBarrier;
+		ZeroVulkanStruct(memoryBarrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+		memoryBarrier.srcAccessMask = srcAccess;
+		memoryBarrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			srcStage,
+			dstStage,
+			0,
+			1, &memoryBarrier,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
+	bool DVKGPUCulling::CreateHiZ(DVKCommandBuffer* cmdBuffer, VkPipelineCache pipelineCache, DVKShader* buildShader, DVKShader* cullShader, DVKTexture* depthImage)
+	{
+		if (m_HiZTexture) 
+		{
+			MLOGE("Hi-Z already created.");
+			return false;
+		}
+
+		// 每层宽高减半，奇数尺寸时最后一行/列覆盖多出来的texel
+		int32 width   = depthImage->width;
+		int32 height  = depthImage->height;
+		int32 offsetY = 0;
+
+		m_HiZLevels.clear();
+		m_HiZLevels.push_back({ 0, 0, width, height });
+		while ((width > 1 || height > 1) && m_HiZLevels.size() < HIZ_MAX_LEVELS)
+		{
+			width  = MMath::Max(width  >> 1, 1);
+			height = MMath::Max(height >> 1, 1);
+			m_HiZLevels.push_back({ depthImage->width, offsetY, width, height });
+			offsetY += height;
+		}
+
+		int32 atlasWidth  = depthImage->width + m_HiZLevels[1 % m_HiZLevels.size()].width;
+		int32 atlasHeight = MMath::Max(depthImage->height, offsetY);
+
+		m_HiZTexture = DVKTexture::Create2D(
+			m_VulkanDevice,
+			cmdBuffer,
+			VK_FORMAT_R32_SFLOAT,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			atlasWidth, atlasHeight,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			VK_SAMPLE_COUNT_1_BIT,
+			ImageLayoutBarrier::ComputeGeneralRW
+		);
+
+		// 初始都认为可见，第一帧的第一阶段会绘制所有实例
+		std::vector<uint32> history(m_NumInstances, 1);
+		m_HistoryBuffer = DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			history.size() * sizeof(uint32)
+		);
+
+		DVKUploadQueue* uploadQueue = DVKUploadQueue::Create(m_VulkanDevice, m_HistoryBuffer->size);
+		uploadQueue->UploadBuffer(m_HistoryBuffer, history.data(), m_HistoryBuffer->size);
+		uploadQueue->Flush();
+		uploadQueue->WaitIdle();
+		delete uploadQueue;
+
+		m_HiZBuild = DVKCompute::Create(m_VulkanDevice, pipelineCache, buildShader);
+		m_HiZBuild->SetStorageTexture("depthImage", depthImage);
+		m_HiZBuild->SetStorageTexture("hizImage",   m_HiZTexture);
+
+		m_HiZCull = DVKCompute::Create(m_VulkanDevice, pipelineCache, cullShader);
+		m_HiZCull->SetStorageBuffer("instanceData", m_InstanceBuffer);
+		m_HiZCull->SetStorageBuffer("payloadData",  m_PayloadBuffer);
+		m_HiZCull->SetStorageBuffer("drawData",     m_IndirectBuffer);
+		m_HiZCull->SetStorageBuffer("visibleData",  m_VisibleBuffer);
+		m_HiZCull->SetStorageBuffer("statData",     m_StatBuffer);
+		m_HiZCull->SetStorageBuffer("historyData",  m_HistoryBuffer);
+		m_HiZCull->SetStorageTexture("hizImage",    m_HiZTexture);
+
+		m_HiZValid = false;
+
+		return true;
+	}
+
+	void DVKGPUCulling::BuildHiZ(VkCommandBuffer commandBuffer, const Matrix4x4& viewProjection)
+	{
+		if (!m_HiZTexture) {
+			return;
+		}
+
+		// 上一次的剔除读取完之后才能覆盖
+		InsertBarrier(
+			commandBuffer,
+			VK_ACCESS_SHADER_READ_BIT,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		);
+
+		HiZBuildParamBlock params;
+		for (int32 i = 0; i < m_HiZLevels.size(); ++i)
+		{
+			const HiZLevel& src = m_HiZLevels[MMath::Max(i - 1, 0)];
+			const HiZLevel& dst = m_HiZLevels[i];
+
+			params.src[0]  = src.x;
+			params.src[1]  = src.y;
+			params.src[2]  = src.width;
+			params.src[3]  = src.height;
+			params.dst[0]  = dst.x;
+			params.dst[1]  = dst.y;
+			params.dst[2]  = dst.width;
+			params.dst[3]  = dst.height;
+			params.mode[0] = i;
+			params.mode[1] = 0;
+			params.mode[2] = 0;
+			params.mode[3] = 0;
+
+			int32 groupX = (dst.width  + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE;
+			int32 groupY = (dst.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE;
+			m_HiZBuild->SetUniform("param", &params, sizeof(HiZBuildParamBlock));
+			m_HiZBuild->BindDispatch(commandBuffer, groupX, groupY, 1);
+
+			InsertBarrier(
+				commandBuffer,
+				VK_ACCESS_SHADER_WRITE_BIT,
+				VK_ACCESS_SHADER_READ_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+			);
+		}
+
+		m_HiZViewProj = viewProjection;
+		m_HiZValid    = true;
+	}
+
+	void DVKGPUCulling::Cull(VkCommandBuffer commandBuffer, const Matrix4x4& viewProjection, int32 frameIndex, DVKCullMode mode)
+	{
+		if (mode != DVKCullMode::Frustum && !m_HiZCull) 
+		{
+			MLOGE("Hi-Z culling needs CreateHiZ(), fallback to frustum culling.");
+			mode = DVKCullMode::Frustum;
+		}
+
+		int32 slot = frameIndex % m_FramesInFlight;
+		int32 statIndex = slot * 2 + (mode == DVKCullMode::HiZFirstPhase ? 0 : 1);
+
+		// 这个slot上一次的结果已经完成
+		if (mode == DVKCullMode::HiZFirstPhase) {
+			m_NumFirstPhase = ((uint32*)m_StatBuffer->mapped)[statIndex];
+		}
+		else {
+			m_NumVisible = ((uint32*)m_StatBuffer->mapped)[statIndex];
+		}
+
+		// 上一次的indirect和实例数据读取完之后才能覆盖
+		InsertBarrier(
+			commandBuffer,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		);
+
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = m_NumDraws * sizeof(VkDrawIndexedIndirectCommand);
+		vkCmdCopyBuffer(commandBuffer, m_CommandTemplate->buffer, m_IndirectBuffer->buffer, 1, &copyRegion);
+		vkCmdFillBuffer(commandBuffer, m_StatBuffer->buffer, statIndex * sizeof(uint32), sizeof(uint32), 0);
+
+		InsertBarrier(
+			commandBuffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		);
+
+		int32 groupX = (m_NumInstances + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+
+		if (mode == DVKCullMode::Frustum)
+		{
+			ExtractFrustumPlanes(viewProjection, m_Params.frustumPlanes);
+			m_Params.counts[0] = m_NumInstances;
+			m_Params.counts[1] = m_PayloadStride / sizeof(Vector4);
+			m_Params.counts[2] = statIndex;
+			m_Params.counts[3] = 0;
+			m_Compute->SetUniform("param", &m_Params, sizeof(CullParamBlock));
+			m_Compute->BindDispatch(commandBuffer, groupX, 1, 1);
+		}
+		else
+		{
+			ExtractFrustumPlanes(viewProjection, m_HiZParams.frustumPlanes);
+			m_HiZParams.counts[0] = m_NumInstances;
+			m_HiZParams.counts[1] = m_PayloadStride / sizeof(Vector4);
+			m_HiZParams.counts[2] = statIndex;
+			// shader里w: 0为Hi-Z 1为第一阶段 2为第二阶段，比DVKCullMode少了Frustum
+			m_HiZParams.counts[3] = (uint32)mode - (uint32)DVKCullMode::HiZ;
+
+			// 两阶段时第二阶段的Hi-Z刚刚用同一个矩阵重建过
+			m_HiZParams.hizViewProj = m_HiZViewProj;
+			m_HiZParams.hizInfo[0]  = m_HiZLevels[0].width;
+			m_HiZParams.hizInfo[1]  = m_HiZLevels[0].height;
+			m_HiZParams.hizInfo[2]  = m_HiZLevels.size();
+			m_HiZParams.hizInfo[3]  = m_HiZValid ? 1 : 0;
+			for (int32 i = 0; i < m_HiZLevels.size(); ++i)
+			{
+				m_HiZParams.levels[i][0] = m_HiZLevels[i].x;
+				m_HiZParams.levels[i][1] = m_HiZLevels[i].y;
+				m_HiZParams.levels[i][2] = m_HiZLevels[i].width;
+				m_HiZParams.levels[i][3] = m_HiZLevels[i].height;
+			}
+
+			m_HiZCull->SetUniform("param", &m_HiZParams, sizeof(HiZCullParamBlock));
+			m_HiZCull->BindDispatch(commandBuffer, groupX, 1, 1);
+		}
+
+		// 统计数据给CPU读取
+		InsertBarrier(
+			commandBuffer,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT
+		);
+	}
+
+	void DVKGPUCulling::BindInstanceBuffer(VkCommandBuffer commandBuffer, uint32 binding)
+	{
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, binding, 1, &(m_VisibleBuffer->buffer), &offset);
+	}
+
+	void DVKGPUCulling::DrawIndirect(VkCommandBuffer commandBuffer, int32 firstDraw, int32 drawCount)
+	{
+		const uint32 stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		if (m_VulkanDevice->GetPhysicalFeatures().multiDrawIndirect) {
+			vkCmdDrawIndexedIndirect(commandBuffer, m_IndirectBuffer->buffer, firstDraw * stride, drawCount, stride);
+		}
+		else
+		{
+			for (int32 i = 0; i < drawCount; ++i) {
+				vkCmdDrawIndexedIndirect(commandBuffer, m_IndirectBuffer->buffer, (firstDraw + i) * stride, 1, stride);
+			}
+		}
+	}
+
+};
@@ -0,0 +1,218 @@
+﻿#pragma once
+
+#include "DVKCompute.h"
+#include "DVKShader.h"
+#include "DVKBuffer.h"
+#include "DVKTexture.h"
+#include "DVKModel.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+	// 一个indirect draw，所有实例共享同一份index/vertex数据
+	struct DVKCullDraw
+	{
+		uint32	indexCount = 0;
+		uint32	firstIndex = 0;
+		int32	vertexOffset = 0;
+	};
+
+	// 世界空间的包围盒，和Cull.comp的CullInstance一致
+	struct DVKCullInstance
+	{
+		Vector3	boundsMin;
+		float	drawIndex = 0.0f;
+		Vector3	boundsMax;
+		float	padding = 0.0f;
+
+		DVKCullInstance()
+		{
+
+		}
+
+		// 局部空间的包围盒，例如DVKMesh::bounding，变换之后重新计算AABB
+		DVKCullInstance(const DVKBoundingBox& bounds, const Matrix4x4& transform, int32 inDrawIndex);
+	};
+
+	enum class DVKCullMode
+	{
+		Frustum = 0,
+		// 使用上一次BuildHiZ的结果
+		HiZ,
+		// 两阶段：先绘制上一帧可见的实例，重建Hi-Z之后再测试所有实例
+		HiZFirstPhase,
+		HiZSecondPhase,
+	};
+
+	/**
+	 * GPU driven frustum culling for many static instances. Every frame Cull() resets the indirect
+	 * commands, tests every instance's world bounds against the frustum in a compute shader and
+	 * compacts the payload of the survivors into one instance buffer, grouped by draw. The draws
+	 * then read the instance buffer as per instance vertex data (binding 1) and take their instance
+	 * counts from the indirect buffer, so there is no readback and no per object descriptor set.
+	 *
+	 * The payload is opaque to the culling, payloadStride bytes per instance, a multiple of 16.
+	 * The shader is Cull.comp with the blocks instanceData, payloadData, drawData, visibleData,
+	 * statData and param.
+	 *
+	 * After CreateHiZ() the instances can also be tested against a Hi-Z pyramid built from a R32
+	 * depth image (HiZBuild.comp, CullHiZ.comp). The pyramid is a single atlas, level 0 on the
+	 * left and the smaller levels stacked on the right, so one storage image holds all levels.
+	 */
+	class DVKGPUCulling
+	{
+	private:
+		DVKGPUCulling()
+		{
+
+		}
+
+	public:
+		~DVKGPUCulling();
+
+		static DVKGPUCulling* Create(
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			VkPipelineCache pipelineCache, 
+			DVKShader* shader, 
+			const std::vector<DVKCullDraw>& draws, 
+			const std::vector<DVKCullInstance>& instances, 
+			const void* payloads, 
+			int32 payloadStride, 
+			int32 framesInFlight
+		);
+
+		// 归一化的六个平面，left right top bottom near far，法线朝内
+		static void ExtractFrustumPlanes(const Matrix4x4& viewProjection, Vector4* outPlanes);
+
+		// depthImage为R32格式的storage image，布局为ComputeGeneralRW，内容为非线性深度
+		bool CreateHiZ(DVKCommandBuffer* cmdBuffer, VkPipelineCache pipelineCache, DVKShader* buildShader, DVKShader* cullShader, DVKTexture* depthImage);
+
+		// viewProjection为绘制depthImage时使用的矩阵，Hi-Z测试时用它投影包围盒
+		void BuildHiZ(VkCommandBuffer commandBuffer, const Matrix4x4& viewProjection);
+
+		// 需要在render pass之外录制，frameIndex为当前帧的slot，它的fence必须已经等待过
+		void Cull(VkCommandBuffer commandBuffer, const Matrix4x4& viewProjection, int32 frameIndex, DVKCullMode mode = DVKCullMode::Frustum);
+
+		void BindInstanceBuffer(VkCommandBuffer commandBuffer, uint32 binding = 1);
+
+		// 不支持multiDrawIndirect时逐个draw提交
+		void DrawIndirect(VkCommandBuffer commandBuffer, int32 firstDraw, int32 drawCount);
+
+		inline DVKBuffer* GetInstanceBuffer() const
+		{
+			return m_VisibleBuffer;
+		}
+
+		inline DVKBuffer* GetIndirectBuffer() const
+		{
+			return m_IndirectBuffer;
+		}
+
+		inline int32 GetNumInstances() const
+		{
+			return m_NumInstances;
+		}
+
+		inline int32 GetNumDraws() const
+		{
+			return m_NumDraws;
+		}
+
+		// framesInFlight帧之前的可见实例数量，只用于统计
+		inline int32 GetNumVisible() const
+		{
+			return m_NumVisible;
+		}
+
+		// 两阶段剔除第一阶段绘制的实例数量
+		inline int32 GetNumFirstPhase() const
+		{
+			return m_NumFirstPhase;
+		}
+
+		inline DVKTexture* GetHiZTexture() const
+		{
+			return m_HiZTexture;
+		}
+
+		inline int32 GetNumHiZLevels() const
+		{
+			return m_HiZLevels.size();
+		}
+
+	private:
+
+		// counts x: 实例数 y: payload大小，单位vec4 z: 统计数据的slot
+		struct CullParamBlock
+		{
+			Vector4	frustumPlanes[6];
+			uint32	counts[4];
+		};
+
+		// hizInfo x: 宽 y: 高 z: 层数 w: Hi-Z是否有效，levels为每层在atlas中的位置和大小
+		struct HiZCullParamBlock
+		{
+			Vector4		frustumPlanes[6];
+			uint32		counts[4];
+			Matrix4x4	hizViewProj;
+			uint32		hizInfo[4];
+			uint32		levels[16][4];
+		};
+
+		// mode x: 0为从深度拷贝
+		struct HiZBuildParamBlock
+		{
+			int32	src[4];
+			int32	dst[4];
+			int32	mode[4];
+		};
+
+		struct HiZLevel
+		{
+			int32	x;
+			int32	y;
+			int32	width;
+			int32	height;
+		};
+
+		void InsertBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage);
+
+	private:
+
+		std::shared_ptr<VulkanDevice>	m_VulkanDevice = nullptr;
+		DVKCompute*						m_Compute = nullptr;
+
+		DVKBuffer*						m_InstanceBuffer = nullptr;
+		DVKBuffer*						m_PayloadBuffer = nullptr;
+		DVKBuffer*						m_CommandTemplate = nullptr;
+		DVKBuffer*						m_IndirectBuffer = nullptr;
+		DVKBuffer*						m_VisibleBuffer = nullptr;
+		DVKBuffer*						m_StatBuffer = nullptr;
+
+		int32							m_NumInstances = 0;
+		int32							m_NumDraws = 0;
+		int32							m_PayloadStride = 0;
+		int32							m_FramesInFlight = 1;
+		int32							m_NumVisible = 0;
+		int32							m_NumFirstPhase = 0;
+		CullParamBlock					m_Params;
+
+		DVKCompute*						m_HiZBuild = nullptr;
+		DVKCompute*						m_HiZCull = nullptr;
+		DVKTexture*						m_HiZTexture = nullptr;
+		DVKBuffer*						m_HistoryBuffer = nullptr;
+		std::vector<HiZLevel>			m_HiZLevels;
+		Matrix4x4						m_HiZViewProj;
+		bool							m_HiZValid = false;
+		HiZCullParamBlock				m_HiZParams;
+	};
+
+};
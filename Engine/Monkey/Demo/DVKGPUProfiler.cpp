@@ -0,0 +1,423 @@
+﻿#include "DVKGPUProfiler.h"
+#include "FileManager.h"
+
+#include "imgui.h"
+
+#include <functional>
+
+// 每个query的结果和availability
+#define QUERY_RESULT_STRIDE (sizeof(uint64) * 2)
+
+namespace vk_demo
+{
+	DVKGPUProfiler::~DVKGPUProfiler()
+	{
+		for (int32 i = 0; i < m_QueryPools.size(); ++i) {
+			vkDestroyQueryPool(m_Device, m_QueryPools[i], VULKAN_CPU_ALLOCATOR);
+		}
+		m_QueryPools.clear();
+
+		m_VulkanDevice = nullptr;
+	}
+
+	DVKGPUProfiler* DVKGPUProfiler::Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 framesInFlight, int32 maxScopes)
+	{
+		DVKGPUProfiler* profiler = new DVKGPUProfiler();
+		profiler->m_VulkanDevice    = vulkanDevice;
+		profiler->m_Device          = vulkanDevice->GetInstanceHandle();
+		profiler->m_FramesInFlight  = MMath::Max(framesInFlight, 1);
+		profiler->m_MaxQueries      = MMath::Max(maxScopes, 1) * 2;
+		profiler->m_TimestampPeriod = vulkanDevice->GetLimits().timestampPeriod;
+
+		// 队列不支持timestamp时validBits为0
+		uint32 familyIndex = vulkanDevice->GetGraphicsQueue()->GetFamilyIndex();
+		uint32 validBits   = vulkanDevice->GetQueueFamilyProperties()[familyIndex].timestampValidBits;
+		if (validBits == 0) 
+		{
+			MLOG("Graphics queue does not support timestamps, gpu profiler disabled.");
+			return profiler;
+		}
+
+		profiler->m_Supported     = true;
+		profiler->m_TimestampMask = validBits >= 64 ? MAX_uint64 : ((uint64)1 << validBits) - 1;
+
+		profiler->m_QueryPools.resize(profiler->m_FramesInFlight);
+		for (int32 i = 0; i < profiler->m_FramesInFlight; ++i)
+		{
+			VkQueryPoolCreateInfo queryPoolCreateInfo;
+			ZeroVulkanStruct(queryPoolCreateInfo, VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO);
+			queryPoolCreateInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCreateInfo.queryCount = profiler->m_MaxQueries;
+			VERIFYVULKANRESULT(vkCreateQueryPool(profiler->m_Device, &queryPoolCreateInfo, VULKAN_CPU_ALLOCATOR, &(profiler->m_QueryPools[i])));
+		}
+
+		profiler->m_Records.resize(profiler->m_FramesInFlight);
+		profiler->m_ReadBack.resize(profiler->m_MaxQueries * 2);
+
+		return profiler;
+	}
+
+	int32 DVKGPUProfiler::FindOrAddStat(const char* name, int32 parent)
+	{
+		std::string path = parent >= 0 ? m_Stats[parent].path + "/" + name : std::string(name);
+
+		auto it = m_StatIndices.find(path);
+		if (it != m_StatIndices.end()) {
+			return it->second;
+		}
+
+		int32 index = m_Stats.size();
+		m_Stats.push_back(DVKGPUProfileStat());
+
+		DVKGPUProfileStat& stat = m_Stats.back();
+		stat.name   = name;
+		stat.path   = path;
+		stat.parent = parent;
+		stat.depth  = parent >= 0 ? m_Stats[parent].depth + 1 : 0;
+
+		if (parent >= 0) {
+			m_Stats[parent].children.push_back(index);
+		}
+
+		m_StatIndices.insert(std::make_pair(path, index));
+
+		return index;
+	}
+
+	void DVKGPUProfiler::ResolveSlot(int32 slot)
+	{
+		const std::vector<ScopeRecord>& records = m_Records[slot];
+		if (records.size() == 0) {
+			return;
+		}
+
+		const int32 numQueries = records.size() * 2;
+		VkResult result = vkGetQueryPoolResults(
+			m_Device,
+			m_QueryPools[slot],
+			0, numQueries,
+			numQueries * QUERY_RESULT_STRIDE, m_ReadBack.data(), QUERY_RESULT_STRIDE,
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+		);
+
+		if (result != VK_SUCCESS && result != VK_NOT_READY) {
+			return;
+		}
+
+		// 第一个record为根节点，所有的start都相对于它
+		const uint64 frameBegin = m_ReadBack[0];
+		const bool hasFrameBegin = m_ReadBack[1] != 0;
+		const double tickToMS = m_TimestampPeriod * 1e-6;
+
+		for (int32 i = 0; i < records.size(); ++i)
+		{
+			const ScopeRecord& record = records[i];
+			const uint64* begin = &m_ReadBack[record.query * 2];
+			const uint64* end   = &m_ReadBack[record.query * 2 + 2];
+
+			// 还没有结果的scope这一帧不统计
+			if (begin[1] == 0 || end[1] == 0) {
+				continue;
+			}
+
+			DVKGPUProfileStat& stat = m_Stats[record.stat];
+			stat.lastTime  = ((end[0] - begin[0]) & m_TimestampMask) * tickToMS;
+			stat.lastStart = hasFrameBegin ? ((begin[0] - frameBegin) & m_TimestampMask) * tickToMS : 0.0f;
+			stat.lastFrame = m_NumFrames;
+
+			stat.history[stat.numSamples % PROFILER_HISTORY] = stat.lastTime;
+			stat.numSamples += 1;
+
+			const int32 count = MMath::Min(stat.numSamples, PROFILER_HISTORY);
+			float total = 0.0f;
+			stat.minTime = MAX_flt;
+			stat.maxTime = 0.0f;
+			for (int32 j = 0; j < count; ++j)
+			{
+				total += stat.history[j];
+				stat.minTime = MMath::Min(stat.minTime, stat.history[j]);
+				stat.maxTime = MMath::Max(stat.maxTime, stat.history[j]);
+			}
+			stat.avgTime = total / count;
+		}
+
+		m_NumFrames += 1;
+	}
+
+	void DVKGPUProfiler::BeginFrame(VkCommandBuffer commandBuffer, int32 frameIndex)
+	{
+		if (!m_Supported) {
+			return;
+		}
+
+		if (m_ScopeStack.size() > 0) 
+		{
+			MLOGE("GPU profiler frame begins with %d open scopes, missing EndFrame.", (int32)m_ScopeStack.size());
+			m_ScopeStack.clear();
+		}
+
+		m_FrameIndex = frameIndex % m_FramesInFlight;
+
+		// 这个slot的fence已经等待过，结果基本都已经可用，但是依然不等待
+		ResolveSlot(m_FrameIndex);
+
+		m_Records[m_FrameIndex].clear();
+		m_Overflow = false;
+
+		vkCmdResetQueryPool(commandBuffer, m_QueryPools[m_FrameIndex], 0, m_MaxQueries);
+
+		BeginScope(commandBuffer, "Frame");
+	}
+
+	void DVKGPUProfiler::EndFrame(VkCommandBuffer commandBuffer)
+	{
+		if (!m_Supported) {
+			return;
+		}
+
+		if (m_ScopeStack.size() > 1) {
+			MLOGE("GPU profiler frame ends with %d unclosed scopes.", (int32)m_ScopeStack.size() - 1);
+		}
+
+		while (m_ScopeStack.size() > 0) {
+			EndScope(commandBuffer);
+		}
+	}
+
+	void DVKGPUProfiler::BeginScope(VkCommandBuffer commandBuffer, const char* name, VkPipelineStageFlagBits stage)
+	{
+		if (!m_Supported) {
+			return;
+		}
+
+		std::vector<ScopeRecord>& records = m_Records[m_FrameIndex];
+
+		// 超出的scope也要入栈，保证EndScope配对
+		if ((records.size() + 1) * 2 > m_MaxQueries)
+		{
+			if (!m_Overflow) {
+				MLOGE("GPU profiler overflow, max scopes : %d", m_MaxQueries / 2);
+			}
+			m_Overflow = true;
+			m_ScopeStack.push_back(-1);
+			return;
+		}
+
+		int32 parent = -1;
+		for (int32 i = m_ScopeStack.size() - 1; i >= 0; --i)
+		{
+			if (m_ScopeStack[i] >= 0) 
+			{
+				parent = records[m_ScopeStack[i]].stat;
+				break;
+			}
+		}
+
+		ScopeRecord record;
+		record.stat  = FindOrAddStat(name, parent);
+		record.query = records.size() * 2;
+
+		vkCmdWriteTimestamp(commandBuffer, stage, m_QueryPools[m_FrameIndex], record.query);
+
+		m_ScopeStack.push_back(records.size());
+		records.push_back(record);
+	}
+
+	void DVKGPUProfiler::EndScope(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage)
+	{
+		if (!m_Supported) {
+			return;
+		}
+
+		if (m_ScopeStack.size() == 0) 
+		{
+			MLOGE("GPU profiler EndScope without BeginScope.");
+			return;
+		}
+
+		int32 recordIndex = m_ScopeStack.back();
+		m_ScopeStack.pop_back();
+
+		if (recordIndex < 0) {
+			return;
+		}
+
+		const ScopeRecord& record = m_Records[m_FrameIndex][recordIndex];
+		vkCmdWriteTimestamp(commandBuffer, stage, m_QueryPools[m_FrameIndex], record.query + 1);
+	}
+
+	const DVKGPUProfileStat* DVKGPUProfiler::FindStat(const std::string& path) const
+	{
+		auto it = m_StatIndices.find(path);
+		return it != m_StatIndices.end() ? &m_Stats[it->second] : nullptr;
+	}
+
+	void DVKGPUProfiler::DrawStatRow(int32 index) const
+	{
+		const DVKGPUProfileStat& stat = m_Stats[index];
+
+		ImGui::Text("%*s%s", stat.depth * 2, "", stat.name.c_str());
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", stat.avgTime);
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", stat.minTime);
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", stat.maxTime);
+		ImGui::NextColumn();
+
+		for (int32 i = 0; i < stat.children.size(); ++i) {
+			DrawStatRow(stat.children[i]);
+		}
+	}
+
+	void DVKGPUProfiler::DrawGUI(float minWidth)
+	{
+		if (!ImGui::CollapsingHeader("GPU Profiler", ImGuiTreeNodeFlags_DefaultOpen)) {
+			return;
+		}
+
+		if (!m_Supported) 
+		{
+			ImGui::Text("Timestamps not supported.");
+			return;
+		}
+
+		if (m_Stats.size() == 0 || m_Stats[0].lastFrame < 0) 
+		{
+			ImGui::Text("Waiting for results...");
+			return;
+		}
+
+		// 上一帧的时间线，一层一行
+		const DVKGPUProfileStat& root = m_Stats[0];
+		const float width     = MMath::Max(ImGui::GetContentRegionAvailWidth(), minWidth);
+		const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+		const float scale     = root.lastTime > 0.0f ? width / root.lastTime : 0.0f;
+		const int32 lastFrame = root.lastFrame;
+
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		int32 maxDepth = 0;
+
+		for (int32 i = 0; i < m_Stats.size(); ++i)
+		{
+			const DVKGPUProfileStat& stat = m_Stats[i];
+			if (stat.lastFrame != lastFrame) {
+				continue;
+			}
+
+			maxDepth = MMath::Max(maxDepth, stat.depth);
+
+			ImVec2 rectMin(origin.x + stat.lastStart * scale, origin.y + stat.depth * rowHeight);
+			ImVec2 rectMax(rectMin.x + MMath::Max(stat.lastTime * scale, 1.0f), rectMin.y + rowHeight - 1.0f);
+
+			// 同名的scope颜色固定
+			float hue = (std::hash<std::string>()(stat.name) % 360) / 360.0f;
+			drawList->AddRectFilled(rectMin, rectMax, ImColor::HSV(hue, 0.5f, 0.7f));
+
+			if (rectMax.x - rectMin.x > ImGui::CalcTextSize(stat.name.c_str()).x + 4.0f) 
+			{
+				drawList->PushClipRect(rectMin, rectMax, true);
+				drawList->AddText(ImVec2(rectMin.x + 2.0f, rectMin.y + 2.0f), IM_COL32_WHITE, stat.name.c_str());
+				drawList->PopClipRect();
+			}
+
+			if (ImGui::IsMouseHoveringRect(rectMin, rectMax)) {
+				ImGui::SetTooltip("%s\n%.3f ms", stat.path.c_str(), stat.lastTime);
+			}
+		}
+
+		ImGui::Dummy(ImVec2(width, (maxDepth + 1) * rowHeight));
+
+		// 最近PROFILER_HISTORY帧的统计
+		ImGui::Columns(4, "GPUProfilerStats");
+		ImGui::Text("Scope");
+		ImGui::NextColumn();
+		ImGui::Text("Avg ms");
+		ImGui::NextColumn();
+		ImGui::Text("Min ms");
+		ImGui::NextColumn();
+		ImGui::Text("Max ms");
+		ImGui::NextColumn();
+		ImGui::Separator();
+
+		for (int32 i = 0; i < m_Stats.size(); ++i)
+		{
+			if (m_Stats[i].parent < 0) {
+				DrawStatRow(i);
+			}
+		}
+
+		ImGui::Columns(1);
+
+		if (ImGui::Button("Dump CSV")) {
+			DumpCSV("GPUProfile.csv");
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Dump JSON")) {
+			DumpJSON("GPUProfile.json");
+		}
+	}
+
+	bool DVKGPUProfiler::DumpCSV(const std::string& filename) const
+	{
+		std::string text = "path,depth,avg_ms,min_ms,max_ms,last_ms,samples\n";
+
+		char line[512];
+		for (int32 i = 0; i < m_Stats.size(); ++i)
+		{
+			const DVKGPUProfileStat& stat = m_Stats[i];
+			snprintf(line, sizeof(line), ",%d,%.4f,%.4f,%.4f,%.4f,%d\n", stat.depth, stat.avgTime, stat.minTime, stat.maxTime, stat.lastTime, MMath::Min(stat.numSamples, PROFILER_HISTORY));
+			text += "\"" + stat.path + "\"" + line;
+		}
+
+		if (!FileManager::WriteCacheFile(filename, (const uint8*)text.data(), text.size())) {
+			return false;
+		}
+
+		MLOG("GPU profile saved : %s", FileManager::GetCachePath(filename).c_str());
+		return true;
+	}
+
+	bool DVKGPUProfiler::DumpJSON(const std::string& filename) const
+	{
+		auto escape = [](const std::string& value) -> std::string {
+			std::string result;
+			for (int32 i = 0; i < value.size(); ++i)
+			{
+				if (value[i] == '"' || value[i] == '\\') {
+					result += '\\';
+				}
+				result += value[i];
+			}
+			return result;
+		};
+
+		// 名字和路径长度不定，直接拼到string里，snprintf只格式化数值部分
+		std::string text = "{\n\t\"device\": \"" + escape(m_VulkanDevice->GetDeviceProperties().deviceName) + "\",\n";
+		text += "\t\"frames\": " + std::to_string(m_NumFrames) + ",\n\t\"scopes\": [\n";
+
+		char line[512];
+		for (int32 i = 0; i < m_Stats.size(); ++i)
+		{
+			const DVKGPUProfileStat& stat = m_Stats[i];
+			snprintf(
+				line, sizeof(line), 
+				"\", \"depth\": %d, \"avg_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f, \"last_ms\": %.4f, \"samples\": %d }%s\n",
+				stat.depth, stat.avgTime, stat.minTime, stat.maxTime, stat.lastTime, MMath::Min(stat.numSamples, PROFILER_HISTORY),
+				i + 1 < m_Stats.size() ? "," : ""
+			);
+			text += "\t\t{ \"path\": \"" + escape(stat.path) + line;
+		}
+
+		text += "\t]\n}\n";
+
+		if (!FileManager::WriteCacheFile(filename, (const uint8*)text.data(), text.size())) {
+			return false;
+		}
+
+		MLOG("GPU profile saved : %s", FileManager::GetCachePath(filename).c_str());
+		return true;
+	}
+
+};
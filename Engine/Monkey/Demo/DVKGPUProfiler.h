@@ -0,0 +1,168 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#define PROFILER_HISTORY 64
+
+namespace vk_demo
+{
+	// 一个scope的统计，时间单位为毫秒
+	struct DVKGPUProfileStat
+	{
+		std::string			name;
+		std::string			path;			// 父节点的path + "/" + name，用来在帧之间对应同一个scope
+		int32				parent = -1;
+		int32				depth = 0;
+		std::vector<int32>	children;
+
+		// 最近一次有结果的帧，start为相对于帧开始的时间
+		float				lastStart = 0.0f;
+		float				lastTime = 0.0f;
+		int32				lastFrame = -1;
+
+		// 最近PROFILER_HISTORY个结果
+		float				avgTime = 0.0f;
+		float				minTime = 0.0f;
+		float				maxTime = 0.0f;
+		float				history[PROFILER_HISTORY];
+		int32				numSamples = 0;
+	};
+
+	/**
+	 * GPU timestamp profiler. Scopes are pairs of vkCmdWriteTimestamp and nest like a stack; the
+	 * same name under the same parent is the same scope in every frame. There is one query pool
+	 * per frame in flight, BeginFrame() of a slot reads what that slot recorded framesInFlight
+	 * frames ago without VK_QUERY_RESULT_WAIT_BIT, so the profiler never stalls. Timestamps are
+	 * converted with timestampPeriod and timestampValidBits of the graphics queue family.
+	 * BeginFrame() opens the root scope "Frame" and has to be recorded outside a render pass.
+	 */
+	class DVKGPUProfiler
+	{
+	private:
+		DVKGPUProfiler()
+		{
+
+		}
+
+	public:
+		~DVKGPUProfiler();
+
+		// 不支持timestamp时依然返回对象，所有的scope都是空操作
+		static DVKGPUProfiler* Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 framesInFlight, int32 maxScopes = 256);
+
+		// frameIndex为当前帧的slot，它的fence必须已经等待过
+		void BeginFrame(VkCommandBuffer commandBuffer, int32 frameIndex);
+
+		// 关闭所有还没有结束的scope
+		void EndFrame(VkCommandBuffer commandBuffer);
+
+		// render pass或者dispatch之前，默认等待之前的命令都开始执行
+		void BeginScope(VkCommandBuffer commandBuffer, const char* name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+		// 默认等待之前的命令全部执行完成
+		void EndScope(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		// 在当前的ImGui窗口里绘制上一帧的时间线和每个scope的统计
+		void DrawGUI(float minWidth = 400.0f);
+
+		// 写到FileManager::GetCachePath的目录下，用于离线对比
+		bool DumpCSV(const std::string& filename) const;
+
+		bool DumpJSON(const std::string& filename) const;
+
+		// path为"Frame/Scene"这样的完整路径，找不到时返回nullptr
+		const DVKGPUProfileStat* FindStat(const std::string& path) const;
+
+		inline bool IsSupported() const
+		{
+			return m_Supported;
+		}
+
+		inline const std::vector<DVKGPUProfileStat>& GetStats() const
+		{
+			return m_Stats;
+		}
+
+		// 根节点"Frame"的平均时间
+		inline float GetFrameTime() const
+		{
+			return m_Stats.size() > 0 ? m_Stats[0].avgTime : 0.0f;
+		}
+
+		inline int32 GetLatency() const
+		{
+			return m_FramesInFlight;
+		}
+
+		// 已经读取到结果的帧数
+		inline int32 GetNumFrames() const
+		{
+			return m_NumFrames;
+		}
+
+	private:
+
+		struct ScopeRecord
+		{
+			int32	stat;
+			int32	query;	// 开始的query，结束为query + 1
+		};
+
+		int32 FindOrAddStat(const char* name, int32 parent);
+
+		void ResolveSlot(int32 slot);
+
+		void DrawStatRow(int32 index) const;
+
+	private:
+
+		std::shared_ptr<VulkanDevice>				m_VulkanDevice = nullptr;
+		VkDevice									m_Device = VK_NULL_HANDLE;
+		bool										m_Supported = false;
+
+		std::vector<VkQueryPool>					m_QueryPools;
+		std::vector<std::vector<ScopeRecord>>		m_Records;	// 每个slot录制的scope
+		std::vector<uint64>							m_ReadBack;
+
+		int32										m_MaxQueries = 0;
+		int32										m_FramesInFlight = 1;
+		int32										m_FrameIndex = 0;
+		int32										m_NumFrames = 0;
+		float										m_TimestampPeriod = 1.0f;	// 每个tick的纳秒数
+		uint64										m_TimestampMask = MAX_uint64;
+		bool										m_Overflow = false;
+
+		std::vector<int32>							m_ScopeStack;	// m_Records里的序号
+		std::vector<DVKGPUProfileStat>				m_Stats;
+		std::unordered_map<std::string, int32>		m_StatIndices;
+	};
+
+	// 作用域结束时自动EndScope
+	class DVKGPUScope
+	{
+	public:
+		DVKGPUScope(DVKGPUProfiler* profiler, VkCommandBuffer commandBuffer, const char* name)
+			: m_Profiler(profiler)
+			, m_CommandBuffer(commandBuffer)
+		{
+			m_Profiler->BeginScope(m_CommandBuffer, name);
+		}
+
+		~DVKGPUScope()
+		{
+			m_Profiler->EndScope(m_CommandBuffer);
+		}
+
+	private:
+		DVKGPUProfiler*		m_Profiler;
+		VkCommandBuffer		m_CommandBuffer;
+	};
+
+};
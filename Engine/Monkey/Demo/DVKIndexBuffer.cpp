@@ -81,4 +81,42 @@ namespace vk_demo
 
 		return indexBuffer;
 	}
+
+	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, const std::vector<uint32>& indices)
+	{
+		DVKIndexBuffer* indexBuffer = new DVKIndexBuffer();
+		indexBuffer->device = vulkanDevice->GetInstanceHandle();
+		indexBuffer->indexCount = indices.size();
+		indexBuffer->indexType = VK_INDEX_TYPE_UINT32;
+
+		indexBuffer->dvkBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			vulkanDevice, 
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+			indices.size() * sizeof(uint32)
+		);
+
+		uploadQueue->UploadBuffer(indexBuffer->dvkBuffer, indices.data(), indices.size() * sizeof(uint32));
+
+		return indexBuffer;
+	}
+
+	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, const std::vector<uint16>& indices)
+	{
+		DVKIndexBuffer* indexBuffer = new DVKIndexBuffer();
+		indexBuffer->device = vulkanDevice->GetInstanceHandle();
+		indexBuffer->indexCount = indices.size();
+		indexBuffer->indexType = VK_INDEX_TYPE_UINT16;
+
+		indexBuffer->dvkBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			vulkanDevice, 
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+			indices.size() * sizeof(uint16)
+		);
+
+		uploadQueue->UploadBuffer(indexBuffer->dvkBuffer, indices.data(), indices.size() * sizeof(uint16));
+
+		return indexBuffer;
+	}
 };
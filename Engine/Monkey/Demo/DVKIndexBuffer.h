@@ -3,6 +3,7 @@
 #include "Engine.h"
 #include "DVKBuffer.h"
 #include "DVKCommand.h"
+#include "DVKUploadQueue.h"
 
 #include "Common/Common.h"
 #include "Math/Math.h"
@@ -43,6 +44,10 @@ namespace vk_demo
 
 		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, std::vector<uint32> indices);
 
+		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, const std::vector<uint16>& indices);
+
+		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, const std::vector<uint32>& indices);
+
 	public:
 		VkDevice		device = VK_NULL_HANDLE;
 		DVKBuffer*		dvkBuffer = nullptr;
@@ -4,24 +4,234 @@
 namespace vk_demo
 {
 
+	DVKRingBuffer::~DVKRingBuffer()
+	{
+		for (int32 i = 0; i < numBlocks; ++i)
+		{
+			blocks[i]->buffer->UnMap();
+			delete blocks[i]->buffer;
+			delete blocks[i];
+		}
+
+		numBlocks = 0;
+		ringOrder.clear();
+		slices.clear();
+		pendingFrames.clear();
+		vulkanDevice = nullptr;
+	}
+
+	DVKRingBuffer* DVKRingBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkBufferUsageFlags usage, uint64 blockSize, uint32 maxBlocks)
+	{
+		DVKRingBuffer* ringBuffer = new DVKRingBuffer();
+		ringBuffer->vulkanDevice = vulkanDevice;
+		ringBuffer->device       = vulkanDevice->GetInstanceHandle();
+		ringBuffer->usage        = usage;
+		ringBuffer->blockSize    = blockSize;
+		ringBuffer->maxBlocks    = MMath::Clamp<uint32>(maxBlocks, 1, MaxBlocks);
+		ringBuffer->minAlignment = vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
+		ringBuffer->AddBlock(blockSize);
+		ringBuffer->SetNumSlices(1);
+		return ringBuffer;
+	}
+
+	void DVKRingBuffer::SetNumSlices(int32 count)
+	{
+		slices.resize(MMath::Max(count, 1));
+		for (int32 i = 0; i < slices.size(); ++i) {
+			slices[i].frame = 0;
+		}
+	}
+
+	void DVKRingBuffer::AddBlock(uint64 size)
+	{
+		Block* block  = new Block();
+		block->size   = size;
+		block->buffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			usage,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			size
+		);
+		block->buffer->Map();
+
+		uint32 blockID = numBlocks;
+		blocks[blockID] = block;
+		numBlocks += 1;
+
+		// chain the new block right after the current one and make it current.
+		if (ringOrder.size() == 0) {
+			ringIndex = 0;
+			ringOrder.push_back(blockID);
+		}
+		else {
+			ringIndex += 1;
+			ringOrder.insert(ringOrder.begin() + ringIndex, blockID);
+		}
+
+		generation += 1;
+		head.store(PackHead(blockID, generation, 0));
+
+		stats.capacity += size;
+		stats.numBlocks = numBlocks;
+
+		if (numBlocks > 1) {
+			MLOG("RingBuffer grows to %d blocks, %llu bytes.", numBlocks, (unsigned long long)stats.capacity);
+		}
+	}
+
+	void DVKRingBuffer::RetireFrames(bool waitOldest)
+	{
+		if (waitOldest && pendingFrames.size() > 0) 
+		{
+			vkWaitForFences(device, 1, &(pendingFrames.front().fence), VK_TRUE, MAX_uint64);
+			stats.stallCount += 1;
+		}
+
+		while (pendingFrames.size() > 0)
+		{
+			const FrameFence& frameFence = pendingFrames.front();
+			if (frameFence.fence != VK_NULL_HANDLE && vkGetFenceStatus(device, frameFence.fence) != VK_SUCCESS) {
+				break;
+			}
+			retiredFrame   = frameFence.frame;
+			bytesInFlight -= frameFence.bytes;
+			pendingFrames.pop_front();
+		}
+	}
+
+	bool DVKRingBuffer::NextBlock(uint64 size)
+	{
+		// everything handed out from the current block so far belongs to this frame at the latest.
+		Block* currBlock = blocks[ringOrder[ringIndex]];
+		currBlock->lastFrame = frameIndex;
+
+		RetireFrames(false);
+
+		while (true)
+		{
+			uint32 nextIndex = (ringIndex + 1) % ringOrder.size();
+			Block* nextBlock = blocks[ringOrder[nextIndex]];
+			bool inFlight    = nextBlock->lastFrame > retiredFrame;
+			bool tooSmall    = nextBlock->size < size;
+
+			if (!inFlight && !tooSmall) 
+			{
+				ringIndex   = nextIndex;
+				generation += 1;
+				head.store(PackHead(ringOrder[ringIndex], generation, 0));
+				return true;
+			}
+
+			// the current frame can never be retired by waiting, same for an undersized block.
+			bool usedByThisFrame = nextBlock->lastFrame == frameIndex;
+			if (numBlocks < MaxBlocks && (tooSmall || usedByThisFrame || numBlocks < maxBlocks || pendingFrames.size() == 0)) 
+			{
+				AddBlock(MMath::Max<uint64>(blockSize, Align<uint64>(size, minAlignment)));
+				return true;
+			}
+
+			// every block is written by the current frame, waiting can't free anything.
+			if (pendingFrames.size() == 0) 
+			{
+				MLOGE("RingBuffer out of blocks, %llu bytes requested.", (unsigned long long)size);
+				return false;
+			}
+
+			RetireFrames(true);
+		}
+	}
+
+	bool DVKRingBuffer::AllocateMemory(uint64 size, uint32& blockID, uint64& offset)
+	{
+		while (true)
+		{
+			uint64 currHead   = head.load(std::memory_order_acquire);
+			uint32 currBlock  = HeadBlock(currHead);
+			uint64 currOffset = HeadOffset(currHead);
+			uint64 allocationOffset = Align<uint64>(currOffset, minAlignment);
+
+			if (allocationOffset + size <= blocks[currBlock]->size)
+			{
+				uint64 newHead = (currHead & ~0xFFFFFFFFFFULL) | (allocationOffset + size);
+				if (head.compare_exchange_weak(currHead, newHead, std::memory_order_acq_rel))
+				{
+					uint64 allocationSize = allocationOffset + size - currOffset;
+					frameBytes    += allocationSize;
+					bytesInFlight += allocationSize;
+					blockID = currBlock;
+					offset  = allocationOffset;
+					return true;
+				}
+				continue;
+			}
+
+			// out of space, only one thread moves the head to the next block.
+			std::lock_guard<std::mutex> lockGuard(growMutex);
+			if (head.load(std::memory_order_acquire) == currHead && !NextBlock(size)) {
+				return false;
+			}
+		}
+	}
+
+	bool DVKRingBuffer::AllocateMemory(int32 slice, uint64 size, uint32& blockID, uint64& offset)
+	{
+		DVKRingBufferSlice& ringSlice = slices[slice];
+
+		// big allocations go straight to the ring, they would waste most of a chunk.
+		if (size * 4 > chunkSize) {
+			return AllocateMemory(size, blockID, offset);
+		}
+
+		uint64 allocationOffset = Align<uint64>(ringSlice.offset, minAlignment);
+		if (ringSlice.frame != frameIndex.load(std::memory_order_relaxed) || allocationOffset + size > ringSlice.end)
+		{
+			if (!AllocateMemory(chunkSize, ringSlice.blockID, ringSlice.offset)) 
+			{
+				ringSlice.frame = 0;
+				return false;
+			}
+			ringSlice.end    = ringSlice.offset + chunkSize;
+			ringSlice.frame  = frameIndex.load(std::memory_order_relaxed);
+			allocationOffset = ringSlice.offset;
+		}
+
+		ringSlice.offset = allocationOffset + size;
+		blockID = ringSlice.blockID;
+		offset  = allocationOffset;
+		return true;
+	}
+
+	void DVKRingBuffer::SubmitFrame(VkFence fence)
+	{
+		std::lock_guard<std::mutex> lockGuard(growMutex);
+
+		FrameFence frameFence;
+		frameFence.frame = frameIndex;
+		frameFence.bytes = frameBytes;
+		frameFence.fence = fence;
+		pendingFrames.push_back(frameFence);
+
+		stats.bytesPerFrame = frameBytes;
+		stats.highWaterMark = MMath::Max<uint64>(stats.highWaterMark, bytesInFlight);
+
+		frameIndex += 1;
+		frameBytes  = 0;
+
+		RetireFrames(false);
+	}
+
 	DVKRingBuffer*	DVKMaterial::ringBuffer = nullptr;
 	int32			DVKMaterial::ringBufferRefCount = 0;
+	std::mutex		DVKMaterial::descriptorMutex;
     
 	void DVKMaterial::InitRingBuffer(std::shared_ptr<VulkanDevice> vulkanDevice)
 	{
-		ringBuffer = new DVKRingBuffer();
-		ringBuffer->device		 = vulkanDevice->GetInstanceHandle();
-		ringBuffer->bufferSize   = 32 * 1024 * 1024; // 32MB
-		ringBuffer->bufferOffset = ringBuffer->bufferSize;
-		ringBuffer->minAlignment = vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
-		ringBuffer->realBuffer   = vk_demo::DVKBuffer::CreateBuffer(
+		ringBuffer = DVKRingBuffer::Create(
 			vulkanDevice,
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			ringBuffer->bufferSize
+			8 * 1024 * 1024, // 8MB per block
+			8
 		);
-		ringBuffer->realBuffer->Map();
-
 		ringBufferRefCount = 0;
 	}
 
@@ -32,12 +242,32 @@ namespace vk_demo
 		ringBufferRefCount = 0;
 	}
 
+	void DVKMaterial::SubmitFrame(VkFence fence)
+	{
+		if (ringBuffer) {
+			ringBuffer->SubmitFrame(fence);
+		}
+	}
+
+	DVKRingBufferStats DVKMaterial::GetRingBufferStats()
+	{
+		if (ringBuffer) {
+			return ringBuffer->GetStats();
+		}
+		return DVKRingBufferStats();
+	}
+
 	DVKMaterial::~DVKMaterial()
 	{
 		shader = nullptr;
 
-		delete descriptorSet;
+		for (int32 i = 0; i < DVKRingBuffer::MaxBlocks; ++i) 
+		{
+			delete blockDescriptorSets[i].load();
+			blockDescriptorSets[i] = nullptr;
+		}
 		descriptorSet = nullptr;
+		recordContexts.clear();
 
 		textures.clear();
 		uniformBuffers.clear();
@@ -111,7 +341,7 @@ namespace vk_demo
 			uboBuffer.stageFlags     = it->second.stageFlags;
 			uboBuffer.dataSize       = it->second.bufferSize;
 			uboBuffer.bufferInfo     = {};
-			uboBuffer.bufferInfo.buffer = ringBuffer->realBuffer->buffer;
+			uboBuffer.bufferInfo.buffer = ringBuffer->GetBuffer(0);
 			uboBuffer.bufferInfo.offset = 0;
 			uboBuffer.bufferInfo.range  = uboBuffer.dataSize;
 
@@ -125,9 +355,13 @@ namespace vk_demo
 			else if (it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
 					 it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
 			{
+				uboBuffer.bufferInfo.buffer = VK_NULL_HANDLE;
 				storageBuffers.insert(std::make_pair(it->first, uboBuffer));
 			}
         }
+
+		// descriptorSet always points at the first block of the ring buffer
+		blockDescriptorSets[0] = descriptorSet;
         
         // 设置Offset的索引,DynamicOffset的顺序跟set和binding顺序相关
 		dynamicOffsetCount = 0;
@@ -152,7 +386,9 @@ namespace vk_demo
                 }
             }
         }
-		globalOffsets.resize(dynamicOffsetCount);
+		localOffsets.resize(dynamicOffsetCount);
+		UpdateLocalLayout();
+		SetRecordContexts(1);
         
 		// 从Shader中获取Texture信息，包含attachment信息
         for (auto it = shader->imageParams.begin(); it != shader->imageParams.end(); ++it)
@@ -188,104 +424,232 @@ namespace vk_demo
         );
     }
 
-	void DVKMaterial::BeginFrame()
+	void DVKMaterial::SetRecordContexts(int32 count)
 	{
-		if (actived) {
-			return;
+		count = MMath::Max(count, 1);
+		recordContexts.resize(count);
+		for (int32 i = 0; i < recordContexts.size(); ++i) {
+			recordContexts[i].globalOffsets.resize(dynamicOffsetCount);
 		}
-		actived = true;
-		perObjectIndexes.clear();
 
-		// 重置GlobalOffsets数据
-		memset(globalOffsets.data(), MAX_uint32, sizeof(uint32) * globalOffsets.size());
+		// slices are shared by all materials, one per recording thread
+		if (ringBuffer->GetNumSlices() < count) {
+			ringBuffer->SetNumSlices(count);
+		}
+	}
+
+	DVKDescriptorSet* DVKMaterial::GetBlockDescriptorSet(uint32 blockID)
+	{
+		DVKDescriptorSet* blockSet = blockDescriptorSets[blockID].load(std::memory_order_acquire);
+		if (blockSet) {
+			return blockSet;
+		}
+
+		// a chained ring buffer block needs its own descriptor set, replay everything written so far.
+		std::lock_guard<std::mutex> lockGuard(descriptorMutex);
+
+		blockSet = blockDescriptorSets[blockID].load(std::memory_order_acquire);
+		if (blockSet) {
+			return blockSet;
+		}
+
+		blockSet = shader->AllocateDescriptorSet();
+
+		for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+		{
+			VkDescriptorBufferInfo bufferInfo = it->second.bufferInfo;
+			bufferInfo.buffer = ringBuffer->GetBuffer(blockID);
+			blockSet->WriteBuffer(it->first, &bufferInfo);
+		}
+
+		for (auto it = storageBuffers.begin(); it != storageBuffers.end(); ++it)
+		{
+			if (it->second.bufferInfo.buffer != VK_NULL_HANDLE) {
+				blockSet->WriteBuffer(it->first, &(it->second.bufferInfo));
+			}
+		}
+
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			if (it->second.texture) {
+				blockSet->WriteImage(it->first, it->second.texture);
+			}
+		}
+
+		blockDescriptorSets[blockID].store(blockSet, std::memory_order_release);
+		return blockSet;
+	}
+
+	void DVKMaterial::UpdateLocalLayout()
+	{
+		// 每个Object的局部Uniform在一次分配中连续存放，保证它们位于同一个block
+		localSize = 0;
+		for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+		{
+			if (it->second.global) {
+				localOffsets[it->second.dynamicIndex] = MAX_uint32;
+				continue;
+			}
+			localOffsets[it->second.dynamicIndex] = localSize;
+			localSize += Align<uint32>(it->second.dataSize, ringBuffer->minAlignment);
+		}
+	}
+
+	bool DVKMaterial::EmitGlobalUniforms(int32 context)
+	{
+		DVKMaterialRecordContext& recordContext = recordContexts[context];
+		uint32 minAlignment = ringBuffer->minAlignment;
+
+		uint32 globalSize = 0;
+		for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+		{
+			if (it->second.global) {
+				globalSize += Align<uint32>(it->second.dataSize, minAlignment);
+			}
+		}
+
+		// 所有的全局Uniform放在同一个block中
+		uint64 ringOffset = 0;
+		if (!ringBuffer->AllocateMemory(context, globalSize, recordContext.globalBlock, ringOffset))
+		{
+			// 分配失败不写入任何数据，绑定时退回到block起始位置
+			memset(recordContext.globalOffsets.data(), 0, sizeof(uint32) * recordContext.globalOffsets.size());
+			return false;
+		}
+		uint8* ringCPUData = ringBuffer->GetMappedPointer(recordContext.globalBlock);
 
-		// 拷贝UniformBuffer
 		for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
 		{
 			if (!it->second.global) {
 				continue;
 			}
-			// 拷贝数据至ringbuffer
-			uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
-			uint64 ringOffset  = ringBuffer->AllocateMemory(it->second.dataSize);
-			uint64 bufferSize  = it->second.dataSize;
 			// 拷贝数据
-			memcpy(ringCPUData + ringOffset, it->second.dataContent.data(), bufferSize);
+			memcpy(ringCPUData + ringOffset, it->second.dataContent.data(), it->second.dataSize);
 			// 记录Offset
-			globalOffsets[it->second.dynamicIndex] = ringOffset;
+			recordContext.globalOffsets[it->second.dynamicIndex] = ringOffset;
+			ringOffset += Align<uint32>(it->second.dataSize, minAlignment);
+		}
+
+		return true;
+	}
+
+	void DVKMaterial::BeginFrame(int32 context)
+	{
+		DVKMaterialRecordContext& recordContext = recordContexts[context];
+		if (recordContext.actived) {
+			return;
 		}
+		recordContext.actived    = true;
+		recordContext.numObjects = 0;
+
+		// 重置GlobalOffsets数据
+		memset(recordContext.globalOffsets.data(), MAX_uint32, sizeof(uint32) * recordContext.globalOffsets.size());
+
+		// 拷贝全局UniformBuffer至ringbuffer
+		EmitGlobalUniforms(context);
 	}
 
-	void DVKMaterial::EndFrame()
+	void DVKMaterial::EndFrame(int32 context)
 	{
-		actived = false;
+		recordContexts[context].actived = false;
 	}
     
-	void DVKMaterial::BeginObject()
+	void DVKMaterial::BeginObject(int32 context)
 	{
-		int32 index = perObjectIndexes.size();
-		perObjectIndexes.push_back(index);
+		DVKMaterialRecordContext& recordContext = recordContexts[context];
+
+		int32 index = recordContext.numObjects;
+		recordContext.numObjects += 1;
 
 		int32 offsetStart = index * dynamicOffsetCount;
 		
 		// 扩充dynamicOffsets尺寸以便能够保持每个Object的参数
-		if (offsetStart + dynamicOffsetCount > dynamicOffsets.size()) {
+		if (offsetStart + dynamicOffsetCount > recordContext.dynamicOffsets.size()) {
+			recordContext.dynamicOffsets.resize(offsetStart + dynamicOffsetCount);
+		}
+		if (index >= recordContext.perObjectBlocks.size()) {
+			recordContext.perObjectBlocks.resize(index + 1);
+		}
+
+		// Object的数据必须与全局数据位于同一个block，换block之后需要重新拷贝全局数据
+		uint32 objectBlock = 0;
+		bool allocated = ringBuffer->AllocateMemory(context, localSize, objectBlock, recordContext.localOffset);
+		while (allocated && objectBlock != recordContext.globalBlock)
+		{
+			allocated = EmitGlobalUniforms(context) && ringBuffer->AllocateMemory(context, localSize, objectBlock, recordContext.localOffset);
+		}
+
+		// 分配失败时SetLocalUniform不写入数据，Offset退回到block起始位置
+		if (!allocated) 
+		{
+			recordContext.localOffset = MAX_uint64;
+			recordContext.perObjectBlocks[index] = recordContext.globalBlock;
 			for (int32 i = 0; i < dynamicOffsetCount; ++i) {
-				dynamicOffsets.push_back(0);
+				recordContext.dynamicOffsets[offsetStart + i] = 0;
 			}
+			return;
 		}
+		recordContext.perObjectBlocks[index] = objectBlock;
 		
-		// 拷贝GlobalOffsets
-		for (int32 offsetIndex = offsetStart; offsetIndex < dynamicOffsetCount; ++offsetIndex) {
-			dynamicOffsets[offsetIndex] = globalOffsets[offsetIndex - offsetStart];
+		// 拷贝GlobalOffsets，局部Uniform等待SetLocalUniform设置
+		for (int32 i = 0; i < dynamicOffsetCount; ++i) {
+			recordContext.dynamicOffsets[offsetStart + i] = recordContext.globalOffsets[i];
 		}
 	}
 
-	void DVKMaterial::EndObject()
+	void DVKMaterial::EndObject(int32 context)
 	{
+		DVKMaterialRecordContext& recordContext = recordContexts[context];
+
 		// 检查是否所有的Uniform数据都设置完成
-		for (int32 i = 0; i < perObjectIndexes.size(); ++i) 
+		for (int32 i = 0; i < recordContext.numObjects; ++i) 
 		{
 			int32 offsetStart = i * dynamicOffsetCount;
-			for (int32 offsetIndex = offsetStart; offsetIndex < dynamicOffsetCount; ++offsetIndex) {
-				if (dynamicOffsets[offsetIndex] == MAX_uint32) {
+			for (int32 offsetIndex = offsetStart; offsetIndex < offsetStart + dynamicOffsetCount; ++offsetIndex) {
+				if (recordContext.dynamicOffsets[offsetIndex] == MAX_uint32) {
 					MLOGE("Uniform not set\n");
 				}
 			}
 		}
 
-		if (perObjectIndexes.size() == 0)
+		if (recordContext.numObjects == 0)
 		{
 			for (int32 i = 0; i < dynamicOffsetCount; ++i) {
-				if (globalOffsets[i] == MAX_uint32) {
+				if (recordContext.globalOffsets[i] == MAX_uint32) {
 					MLOGE("Uniform not set\n");
 				}
 			}
 		}
 	}
 
-	void DVKMaterial::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex)
+	void DVKMaterial::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex, int32 context)
 	{
+		DVKMaterialRecordContext& recordContext = recordContexts[context];
+
 		uint32* dynOffsets = nullptr;
-		if (objIndex < perObjectIndexes.size())
+		uint32  blockID    = recordContext.globalBlock;
+		if (objIndex < recordContext.numObjects)
 		{
-			dynOffsets  = dynamicOffsets.data() + perObjectIndexes[objIndex] * dynamicOffsetCount;;;
+			dynOffsets  = recordContext.dynamicOffsets.data() + objIndex * dynamicOffsetCount;
+			blockID     = recordContext.perObjectBlocks[objIndex];
 		}
-		else if (globalOffsets.size() > 0) 
+		else if (recordContext.globalOffsets.size() > 0) 
 		{
-			dynOffsets  = globalOffsets.data();
+			dynOffsets  = recordContext.globalOffsets.data();
 		}
+
+		DVKDescriptorSet* blockSet = GetBlockDescriptorSet(blockID);
 		
 		vkCmdBindDescriptorSets(
 			commandBuffer, 
 			bindPoint, 
 			GetPipelineLayout(), 
-			0, GetDescriptorSets().size(), GetDescriptorSets().data(), 
+			0, blockSet->descriptorSets.size(), blockSet->descriptorSets.data(), 
 			dynamicOffsetCount, dynOffsets
 		);
 	}
 
-    void DVKMaterial::SetLocalUniform(const std::string& name, void* dataPtr, uint32 size)
+    void DVKMaterial::SetLocalUniform(const std::string& name, void* dataPtr, uint32 size, int32 context)
     {
         auto it = uniformBuffers.find(name);
         if (it == uniformBuffers.end()) 
@@ -300,14 +664,27 @@ namespace vk_demo
             return;
         }
 
+		if (localOffsets[it->second.dynamicIndex] == MAX_uint32)
+		{
+			MLOGE("Uniform %s has been set as global.", name.c_str());
+			return;
+		}
+
+		DVKMaterialRecordContext& recordContext = recordContexts[context];
+
+		// BeginObject时RingBuffer分配失败
+		if (recordContext.localOffset == MAX_uint64) {
+			return;
+		}
+
 		// 获取Object的起始位置以及DynamicOffset的起始位置
-		int32 objIndex     = perObjectIndexes.back();
+		int32 objIndex     = recordContext.numObjects - 1;
 		int32 offsetStart  = objIndex * dynamicOffsetCount;
-		uint32* dynOffsets = dynamicOffsets.data() + offsetStart;
+		uint32* dynOffsets = recordContext.dynamicOffsets.data() + offsetStart;
 
-		// 拷贝数据至ringbuffer
-		uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
-		uint64 ringOffset  = ringBuffer->AllocateMemory(it->second.dataSize);
+		// 数据位于BeginObject时分配的区域内
+		uint8* ringCPUData = ringBuffer->GetMappedPointer(recordContext.perObjectBlocks[objIndex]);
+		uint64 ringOffset  = recordContext.localOffset + localOffsets[it->second.dynamicIndex];
 		uint64 bufferSize  = it->second.dataSize;
 		
 		// 拷贝数据
@@ -336,8 +713,13 @@ namespace vk_demo
 			it->second.dataContent.resize(size);
 		}
 
-		it->second.global = true;
 		memcpy(it->second.dataContent.data(), dataPtr, size);
+
+		if (!it->second.global) 
+		{
+			it->second.global = true;
+			UpdateLocalLayout();
+		}
 	}
     
     void DVKMaterial::SetTexture(const std::string& name, DVKTexture* texture)
@@ -358,7 +740,11 @@ namespace vk_demo
         if (it->second.texture != texture) 
 		{
             it->second.texture = texture;
-            descriptorSet->WriteImage(name, texture);
+			for (int32 i = 0; i < DVKRingBuffer::MaxBlocks; ++i) {
+				if (blockDescriptorSets[i]) {
+					blockDescriptorSets[i].load()->WriteImage(name, texture);
+				}
+			}
         }
     }
     
@@ -388,7 +774,11 @@ namespace vk_demo
 			it->second.bufferInfo.buffer = buffer->buffer;
 			it->second.bufferInfo.offset = 0;
 			it->second.bufferInfo.range  = buffer->size;
-			descriptorSet->WriteBuffer(name, buffer);
+			for (int32 i = 0; i < DVKRingBuffer::MaxBlocks; ++i) {
+				if (blockDescriptorSets[i]) {
+					blockDescriptorSets[i].load()->WriteBuffer(name, buffer);
+				}
+			}
 		}
 	}
 
@@ -2,6 +2,9 @@
 
 #include <string>
 #include <cstring>
+#include <deque>
+#include <mutex>
+#include <atomic>
 #include <memory>
 #include <unordered_map>
 
@@ -42,48 +45,182 @@ namespace vk_demo
         DVKTexture*         texture = nullptr;
     };
     
+	struct DVKRingBufferStats
+	{
+		uint64	bytesPerFrame = 0;	// bytes reserved by the last submitted frame
+		uint64	bytesInFlight = 0;	// bytes of frames the gpu has not retired yet
+		uint64	highWaterMark = 0;	// peak of bytesInFlight
+		uint64	capacity = 0;		// total size of all backing blocks
+		uint32	numBlocks = 0;
+		uint32	stallCount = 0;		// allocations that had to wait for the gpu
+	};
+
+	/**
+	 * Thread private part of a ring buffer block. Filled by a single thread with a plain bump
+	 * pointer and refilled in chunks, only the refill touches the shared ring buffer.
+	 */
+	struct DVKRingBufferSlice
+	{
+		uint32	blockID = 0;
+		uint64	offset = 0;
+		uint64	end = 0;
+		uint64	frame = 0;
+		uint8	padding[32];		// keep slices of different threads on different cache lines
+	};
+
+	/**
+	 * Uniform ring buffer made of chained host visible blocks. Allocations are tagged with the
+	 * current frame, a block is only reused after every frame that wrote into it has signaled
+	 * its fence. When the next block is still in flight a new one is chained in after the
+	 * current one, up to maxBlocks, after that the allocation stalls on the oldest frame.
+	 * If no frame is left to wait for the allocation fails, a range in use is never handed out.
+	 *
+	 * AllocateMemory may be called from several threads at once, SubmitFrame and SetNumSlices
+	 * must not overlap with any allocation.
+	 */
 	class DVKRingBuffer
 	{
 	public:
+		enum
+		{
+			MaxBlocks = 64,
+		};
+
+	private:
+		struct Block
+		{
+			DVKBuffer*	buffer = nullptr;
+			uint64		size = 0;
+			uint64		lastFrame = 0;
+		};
+
+		struct FrameFence
+		{
+			uint64		frame = 0;
+			uint64		bytes = 0;
+			VkFence		fence = VK_NULL_HANDLE;
+		};
+
 		DVKRingBuffer()
+			: head(0)
+			, frameIndex(1)
+			, frameBytes(0)
+			, bytesInFlight(0)
 		{
 
 		}
 
-		virtual ~DVKRingBuffer()
+	public:
+		virtual ~DVKRingBuffer();
+
+		static DVKRingBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkBufferUsageFlags usage, uint64 blockSize, uint32 maxBlocks);
+
+		/** Thread safe, offset is inside block blockID. Returns false when every block is used by the current frame. */
+		bool AllocateMemory(uint64 size, uint32& blockID, uint64& offset);
+
+		/** Allocates from the slice owned by the calling thread, lock free unless the slice runs dry. */
+		bool AllocateMemory(int32 slice, uint64 size, uint32& blockID, uint64& offset);
+
+		/** Marks the end of the frame, everything allocated so far is retired once fence signals. */
+		void SubmitFrame(VkFence fence);
+
+		void SetNumSlices(int32 count);
+
+		inline int32 GetNumSlices() const
+		{
+			return slices.size();
+		}
+
+		inline uint32 GetNumBlocks() const
 		{
-			realBuffer->UnMap();
-			delete realBuffer;
-			realBuffer = nullptr;
+			return numBlocks;
 		}
 
-		void* GetMappedPointer()
+		inline uint8* GetMappedPointer(uint32 blockID) const
 		{
-			return realBuffer->mapped;
+			return (uint8*)(blocks[blockID]->buffer->mapped);
 		}
 
-		uint64 AllocateMemory(uint64 size)
+		inline VkBuffer GetBuffer(uint32 blockID) const
 		{
-			uint64 allocationOffset = Align<uint64>(bufferOffset, minAlignment);
-            
-			if (allocationOffset + size <= bufferSize) 
-			{
-				bufferOffset = allocationOffset + size;
-				return allocationOffset;
-			}
+			return blocks[blockID]->buffer->buffer;
+		}
 
-			bufferOffset = 0;
-			return bufferOffset;
+		inline DVKRingBufferStats GetStats() const
+		{
+			DVKRingBufferStats result = stats;
+			result.bytesInFlight = bytesInFlight;
+			return result;
 		}
-        
+
+	private:
+
+		// head packs the current block, a generation counter against ABA and the offset inside the block.
+		static inline uint64 PackHead(uint64 blockID, uint64 generation, uint64 offset)
+		{
+			return (blockID << 56) | ((generation & 0xFFFF) << 40) | offset;
+		}
+
+		static inline uint32 HeadBlock(uint64 head)
+		{
+			return (uint32)(head >> 56);
+		}
+
+		static inline uint64 HeadOffset(uint64 head)
+		{
+			return head & 0xFFFFFFFFFFULL;
+		}
+
+		void AddBlock(uint64 size);
+
+		void RetireFrames(bool waitOldest);
+
+		bool NextBlock(uint64 size);
+
 	public:
-		VkDevice		device = VK_NULL_HANDLE;
-		uint64			bufferSize = 0;
-		uint64			bufferOffset = 0;
-		uint32			minAlignment = 0;
-		DVKBuffer*		realBuffer = nullptr;
+		std::shared_ptr<VulkanDevice>	vulkanDevice = nullptr;
+		VkDevice						device = VK_NULL_HANDLE;
+		VkBufferUsageFlags				usage = 0;
+		uint64							blockSize = 0;
+		uint64							chunkSize = 256 * 1024;
+		uint32							maxBlocks = 0;
+		uint32							minAlignment = 0;
+
+	private:
+		Block*							blocks[MaxBlocks];	// indexed by block id, never moves
+		uint32							numBlocks = 0;
+		std::vector<uint32>				ringOrder;			// block ids in the order they are cycled
+		uint32							ringIndex = 0;
+		uint64							generation = 0;
+		std::atomic<uint64>				head;
+		std::mutex						growMutex;
+
+		std::vector<DVKRingBufferSlice>	slices;
+
+		std::deque<FrameFence>			pendingFrames;
+		std::atomic<uint64>				frameIndex;
+		std::atomic<uint64>				frameBytes;
+		std::atomic<uint64>				bytesInFlight;
+		uint64							retiredFrame = 0;
+
+		DVKRingBufferStats				stats;
 	};
     
+	/**
+	 * Per object dynamic offsets recorded by one thread. Every recording thread uses its own
+	 * context index so several threads can record draws with the same material without locking.
+	 */
+	struct DVKMaterialRecordContext
+	{
+		std::vector<uint32>		globalOffsets;
+		std::vector<uint32>		dynamicOffsets;
+		std::vector<uint32>		perObjectBlocks;
+		uint32					numObjects = 0;
+		uint64					localOffset = 0;
+		uint32					globalBlock = 0;
+		bool					actived = false;
+	};
+
 	class DVKMaterial
 	{
 	private:
@@ -94,7 +231,9 @@ namespace vk_demo
 
 		DVKMaterial()
 		{
-            
+			for (int32 i = 0; i < DVKRingBuffer::MaxBlocks; ++i) {
+				blockDescriptorSets[i] = nullptr;
+			}
 		}
         
 	public:
@@ -104,19 +243,26 @@ namespace vk_demo
         
 		static DVKMaterial* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKRenderTarget* renderTarget, VkPipelineCache pipelineCache, DVKShader* shader);
 
+		static void SubmitFrame(VkFence fence);
+
+		static DVKRingBufferStats GetRingBufferStats();
+
         void PreparePipeline();
 
-		void BeginObject();
+		/** Must be called while nothing is recording, context indices go from 0 to count - 1. */
+		void SetRecordContexts(int32 count);
+
+		void BeginObject(int32 context = 0);
 
-		void EndObject();
+		void EndObject(int32 context = 0);
 
-		void BeginFrame();
+		void BeginFrame(int32 context = 0);
 
-		void EndFrame();
+		void EndFrame(int32 context = 0);
 
-		void BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex);
+		void BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex, int32 context = 0);
 
-        void SetLocalUniform(const std::string& name, void* dataPtr, uint32 size);
+        void SetLocalUniform(const std::string& name, void* dataPtr, uint32 size, int32 context = 0);
         
         void SetTexture(const std::string& name, DVKTexture* texture);
 
@@ -148,10 +294,17 @@ namespace vk_demo
 
 		void Prepare();
 
+		void UpdateLocalLayout();
+
+		bool EmitGlobalUniforms(int32 context);
+
+		DVKDescriptorSet* GetBlockDescriptorSet(uint32 blockID);
+
 	private:
 
 		static DVKRingBuffer*	ringBuffer;
 		static int32			ringBufferRefCount;
+		static std::mutex		descriptorMutex;
 
 	public:
 
@@ -165,16 +318,17 @@ namespace vk_demo
         DVKGfxPipeline*         pipeline = nullptr;
         DVKDescriptorSet*		descriptorSet = nullptr;
 
+		std::atomic<DVKDescriptorSet*>	blockDescriptorSets[DVKRingBuffer::MaxBlocks];
+
 		uint32					dynamicOffsetCount;
-		std::vector<uint32>		globalOffsets;
-        std::vector<uint32>     dynamicOffsets;
-		std::vector<uint32>		perObjectIndexes;
+		std::vector<uint32>		localOffsets;
+		uint32					localSize = 0;
+
+		std::vector<DVKMaterialRecordContext>	recordContexts;
         
 		BuffersMap				uniformBuffers;
 		BuffersMap				storageBuffers;
 		TexturesMap				textures;
-
-		bool                    actived = false;
 	};
 
 }
@@ -1,7 +1,11 @@
 ﻿#include "DVKModel.h"
 
 #include "FileManager.h"
+#include "GenericPlatform/GenericPlatformTime.h"
 #include "Math/Matrix4x4.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
 
 #include <assimp/Importer.hpp> 
 #include <assimp/scene.h>     
@@ -145,24 +149,112 @@ namespace vk_demo
 			}
         }
         
-        uint32 dataSize = 0;
-        uint8* dataPtr  = nullptr;
-        if (!FileManager::ReadFile(filename, dataPtr, dataSize)) {
+        FileViewRef source = FileManager::MapFile(filename);
+        if (!source) {
             return model;
         }
         
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFileFromMemory(dataPtr, dataSize, assimpFlags);
+        uint32 deviceAllocations   = vulkanDevice->GetMemoryManager().GetTotalAllocateCalls();
+        uint32 resourceAllocations = vulkanDevice->GetResourceHeapManager().GetTotalResourceAllocations();
+        uint32 pageAllocations     = vulkanDevice->GetResourceHeapManager().GetTotalPageAllocations();
+        double loadTime = GenericPlatformTime::Seconds();
         
-		model->LoadBones(scene);
-		model->LoadNode(scene->mRootNode, scene);
-        model->LoadAnim(scene);
+        // 所有primitive的拷贝合并到一次提交里，最后只等待一次。
+        if (cmdBuffer) {
+            model->uploadQueue = DVKUploadQueue::Create(vulkanDevice, 16 * 1024 * 1024);
+        }
+
+        // 源文件和顶点布局都没变的话直接读取缓存，跳过Assimp
+        uint64 sourceHash = HashCacheKey(source->GetData(), source->GetSize(), 0);
+        std::string cacheName = GetCacheName(filename, attributes);
+        bool fromCache = false;
+        bool cacheRead = false;
+        {
+            FileViewRef cache = FileManager::MapCacheFile(cacheName);
+            if (cache)
+            {
+                cacheRead = true;
+                fromCache = model->LoadCache(cache->GetData(), cache->GetSize(), sourceHash);
+            }
+        }
+
+        if (!fromCache && cacheRead)
+        {
+            // 缓存损坏或者过期，丢掉读了一半的数据
+            DVKModel* fresh   = new DVKModel();
+            fresh->device     = model->device;
+            fresh->attributes = model->attributes;
+            fresh->cmdBuffer  = model->cmdBuffer;
+            fresh->loadSkin   = model->loadSkin;
+            fresh->uploadQueue = model->uploadQueue;
+            model->uploadQueue = nullptr;
+            delete model;
+            model = fresh;
+        }
+
+        if (fromCache)
+        {
+            if (model->uploadQueue) {
+                model->Upload(model->uploadQueue);
+            }
+        }
+        else
+        {
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFileFromMemory(source->GetData(), source->GetSize(), assimpFlags);
+
+            model->LoadBones(scene);
+            model->LoadNode(scene->mRootNode, scene);
+            model->LoadAnim(scene);
 
-		delete[] dataPtr;
+            model->SaveCache(cacheName, sourceHash);
+        }
+
+		model->PrepareAnimation();
+
+		source.reset();
+
+        uint32 uploadSubmits = 0;
+        if (model->uploadQueue)
+        {
+            model->uploadQueue->WaitIdle();
+            uploadSubmits = model->uploadQueue->GetStats().numSubmits;
+            delete model->uploadQueue;
+            model->uploadQueue = nullptr;
+        }
+        
+        deviceAllocations   = vulkanDevice->GetMemoryManager().GetTotalAllocateCalls() - deviceAllocations;
+        resourceAllocations = vulkanDevice->GetResourceHeapManager().GetTotalResourceAllocations() - resourceAllocations;
+        pageAllocations     = vulkanDevice->GetResourceHeapManager().GetTotalPageAllocations() - pageAllocations;
+        loadTime = (GenericPlatformTime::Seconds() - loadTime) * 1000.0;
+        MLOG("Load %s from %s in %.2fms: %d meshes, %d resource allocations, %d device allocations, %d upload submits", filename.c_str(), fromCache ? "cache" : "assimp", loadTime, (int32)model->meshes.size(), resourceAllocations, deviceAllocations, uploadSubmits);
+        
+        // 每次vkAllocateMemory都应该对应一个新的page，多出来的说明有资源绕过了heap直接分配
+        if (deviceAllocations > pageAllocations) {
+            MLOGE("Load %s: %d device allocations but only %d new pages, resources bypass the resource heaps.", filename.c_str(), deviceAllocations, pageAllocations);
+        }
         
         return model;
     }
 
+	void DVKModel::Upload(DVKUploadQueue* queue)
+	{
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			DVKMesh* mesh = meshes[i];
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = mesh->primitives[j];
+				if (primitive->vertexBuffer == nullptr) {
+					primitive->vertexBuffer = DVKVertexBuffer::Create(device, queue, primitive->vertices, attributes);
+				}
+				if (primitive->indexBuffer == nullptr) {
+					primitive->indexBuffer  = DVKIndexBuffer::Create(device, queue, primitive->indices);
+				}
+			}
+		}
+	}
+
 	void DVKModel::LoadBones(const aiScene* aiScene)
 	{
 		std::unordered_map<std::string, int32> boneIndexMap;
@@ -464,13 +556,13 @@ namespace vk_demo
                 }
             }
             
-            if (cmdBuffer)
+            if (uploadQueue)
             {
                 for (int32 i = 0; i < mesh->primitives.size(); ++i)
                 {
                     primitive = mesh->primitives[i];
-                    primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
-                    primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices);
+                    primitive->vertexBuffer = DVKVertexBuffer::Create(device, uploadQueue, primitive->vertices, attributes);
+                    primitive->indexBuffer  = DVKIndexBuffer::Create(device, uploadQueue, primitive->indices);
                 }
             }
         }
@@ -483,10 +575,10 @@ namespace vk_demo
             }
             mesh->primitives.push_back(primitive);
             
-            if (cmdBuffer)
+            if (uploadQueue)
             {
-                primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
-                primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices);
+                primitive->vertexBuffer = DVKVertexBuffer::Create(device, uploadQueue, primitive->vertices, attributes);
+                primitive->indexBuffer  = DVKIndexBuffer::Create(device, uploadQueue, primitive->indices);
             }
         }
         
@@ -645,58 +737,251 @@ namespace vk_demo
         }
     }
 
-	void DVKModel::GotoAnimation(float time)
+	// cursors为clip的3个关键帧游标，压缩数据直接按下标采样，不需要游标
+	static void EvaluateClip(const DVKAnimationClip& clip, float time, int32* cursors, bool useCompressed, Matrix4x4& outMatrix)
 	{
-		if (animIndex == -1) {
-			return;
+		Quat retRot;
+		Vector3 retPos;
+		Vector3 retScale;
+
+		if (useCompressed && clip.compressed.IsValid())
+		{
+			clip.compressed.Sample(time, retPos, retRot, retScale);
 		}
-        
-		DVKAnimation& animation = animations[animIndex];
-        animation.time = MMath::Clamp(time, 0.0f, animation.duration);
-        
-		// update nodes animation
-		for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+		else
 		{
-			vk_demo::DVKAnimationClip& clip = it->second;
-			vk_demo::DVKNode* node = nodesMap[clip.nodeName];
-            
 			float alpha = 0.0f;
             
 			// rotation
 			Quat prevRot(0, 0, 0, 1);
 			Quat nextRot(0, 0, 0, 1);
-			clip.rotations.GetValue(animation.time, prevRot, nextRot, alpha);
-			Quat retRot = MMath::Lerp(prevRot, nextRot, alpha);
+			clip.rotations.GetValue(time, cursors[2], prevRot, nextRot, alpha);
+			retRot = MMath::Lerp(prevRot, nextRot, alpha);
             
 			// position
 			Vector3 prevPos(0, 0, 0);
 			Vector3 nextPos(0, 0, 0);
-			clip.positions.GetValue(animation.time, prevPos, nextPos, alpha);
-			Vector3 retPos = MMath::Lerp(prevPos, nextPos, alpha);
+			clip.positions.GetValue(time, cursors[0], prevPos, nextPos, alpha);
+			retPos = MMath::Lerp(prevPos, nextPos, alpha);
             
 			// scale
 			Vector3 prevScale(1, 1, 1);
 			Vector3 nextScale(1, 1, 1);
-			clip.scales.GetValue(animation.time, prevScale, nextScale, alpha);
-			Vector3 retScale = MMath::Lerp(prevScale, nextScale, alpha);
+			clip.scales.GetValue(time, cursors[1], prevScale, nextScale, alpha);
+			retScale = MMath::Lerp(prevScale, nextScale, alpha);
+		}
             
-			node->localMatrix.SetIdentity();
-			node->localMatrix.AppendScale(retScale);
-			node->localMatrix.Append(retRot.ToMatrix());
-			node->localMatrix.AppendTranslation(retPos);
+		// 等同于SetIdentity、AppendScale、Append(rot)、AppendTranslation，省掉两次矩阵乘法
+		retRot.ToMatrix(outMatrix);
+		for (int32 i = 0; i < 3; ++i)
+		{
+			outMatrix.m[0][i] *= retScale.x;
+			outMatrix.m[1][i] *= retScale.y;
+			outMatrix.m[2][i] *= retScale.z;
+		}
+		outMatrix.m[3][0] = retPos.x;
+		outMatrix.m[3][1] = retPos.y;
+		outMatrix.m[3][2] = retPos.z;
+	}
+
+	void DVKModel::PrepareAnimation()
+	{
+		std::unordered_map<DVKNode*, int32> nodeIndices;
+		for (int32 i = 0; i < linearNodes.size(); ++i) {
+			nodeIndices.insert(std::make_pair(linearNodes[i], i));
+		}
+
+		nodeParents.resize(linearNodes.size());
+		for (int32 i = 0; i < linearNodes.size(); ++i)
+		{
+			DVKNode* parent = linearNodes[i]->parent;
+			nodeParents[i]  = parent ? nodeIndices[parent] : -1;
+			if (nodeParents[i] >= i) {
+				MLOGE("Node %s is not in topological order.", linearNodes[i]->name.c_str());
+			}
+		}
+
+		boneNodes.resize(bones.size());
+		for (int32 i = 0; i < bones.size(); ++i)
+		{
+			auto it = nodesMap.find(bones[i]->name);
+			boneNodes[i] = it != nodesMap.end() ? nodeIndices[it->second] : -1;
+		}
+
+		for (int32 i = 0; i < animations.size(); ++i)
+		{
+			DVKAnimation& animation = animations[i];
+			animation.linearClips.clear();
+
+			for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+			{
+				DVKAnimationClip& clip = it->second;
+				auto nodeIt = nodesMap.find(clip.nodeName);
+				clip.nodeIndex = nodeIt != nodesMap.end() ? nodeIndices[nodeIt->second] : -1;
+				if (clip.nodeIndex != -1) {
+					animation.linearClips.push_back(&clip);
+				}
+			}
+
+			std::sort(animation.linearClips.begin(), animation.linearClips.end(), [](const DVKAnimationClip* a, const DVKAnimationClip* b) {
+				return a->nodeIndex < b->nodeIndex;
+			});
+
+			animation.cursors.clear();
+			animation.cursors.resize(animation.linearClips.size() * 3, 0);
+		}
+	}
+
+	void DVKModel::GotoAnimation(float time)
+	{
+		if (animIndex == -1) {
+			return;
+		}
+        
+		DVKAnimation& animation = animations[animIndex];
+        animation.time = MMath::Clamp(time, 0.0f, animation.duration);
+        
+		// update nodes animation
+		for (int32 i = 0; i < animation.linearClips.size(); ++i)
+		{
+			DVKAnimationClip* clip = animation.linearClips[i];
+			EvaluateClip(*clip, animation.time, &animation.cursors[i * 3], useCompressedAnimation, linearNodes[clip->nodeIndex]->localMatrix);
+		}
+
+		// 父节点在前，globalMatrix顺序算一遍
+		for (int32 i = 0; i < linearNodes.size(); ++i)
+		{
+			DVKNode* node = linearNodes[i];
+			node->globalMatrix = node->localMatrix;
+			if (nodeParents[i] != -1) {
+				node->globalMatrix.Append(linearNodes[nodeParents[i]]->globalMatrix);
+			}
 		}
 
 		// update bones
 		for (int32 i = 0; i < bones.size(); ++i)
 		{
 			DVKBone* bone = bones[i];
-			DVKNode* node = nodesMap[bone->name];
 			// 注意行列矩阵的区别
 			bone->finalTransform = bone->inverseBindPose;
-			bone->finalTransform.Append(node->GetGlobalMatrix());
+			bone->finalTransform.Append(linearNodes[boneNodes[i]]->globalMatrix);
 		}
 	}
+
+	void DVKModel::InitPose(DVKAnimPose& pose, int32 index) const
+	{
+		pose.animIndex = animations.size() > 0 ? MMath::Clamp(index, 0, (int32)animations.size() - 1) : -1;
+		pose.time      = 0.0f;
+
+		pose.localMatrices.resize(linearNodes.size());
+		for (int32 i = 0; i < linearNodes.size(); ++i) {
+			pose.localMatrices[i] = linearNodes[i]->localMatrix;
+		}
+		pose.globalMatrices.resize(linearNodes.size());
+		pose.boneMatrices.resize(bones.size());
+
+		pose.cursors.clear();
+		if (pose.animIndex >= 0) {
+			pose.cursors.resize(animations[pose.animIndex].linearClips.size() * 3, 0);
+		}
+	}
+
+	void DVKModel::EvaluatePose(DVKAnimPose& pose, float time) const
+	{
+		if (pose.animIndex < 0) {
+			return;
+		}
+
+		const DVKAnimation& animation = animations[pose.animIndex];
+		pose.time = MMath::Clamp(time, 0.0f, animation.duration);
+
+		for (int32 i = 0; i < animation.linearClips.size(); ++i)
+		{
+			DVKAnimationClip* clip = animation.linearClips[i];
+			EvaluateClip(*clip, pose.time, &pose.cursors[i * 3], useCompressedAnimation, pose.localMatrices[clip->nodeIndex]);
+		}
+
+		for (int32 i = 0; i < pose.localMatrices.size(); ++i)
+		{
+			pose.globalMatrices[i] = pose.localMatrices[i];
+			if (nodeParents[i] != -1) {
+				pose.globalMatrices[i].Append(pose.globalMatrices[nodeParents[i]]);
+			}
+		}
+
+		for (int32 i = 0; i < bones.size(); ++i)
+		{
+			pose.boneMatrices[i] = bones[i]->inverseBindPose;
+			pose.boneMatrices[i].Append(pose.globalMatrices[boneNodes[i]]);
+		}
+	}
+
+	void DVKModel::UpdatePose(DVKAnimPose& pose, float delta) const
+	{
+		if (pose.animIndex < 0) {
+			return;
+		}
+
+		const DVKAnimation& animation = animations[pose.animIndex];
+		pose.time += delta * pose.speed;
+
+		if (pose.time >= animation.duration) {
+			pose.time = pose.time - animation.duration;
+		}
+
+		EvaluatePose(pose, pose.time);
+	}
+
+	void DVKModel::UpdatePoses(DVKAnimPose* poses, int32 count, float delta) const
+	{
+		// 一个实例几十到上百根骨骼，8个一组足够摊平调度的开销
+		JobSystem::Get().ParallelFor(count, 8, [this, poses, delta](int32 begin, int32 end) {
+			for (int32 i = begin; i < end; ++i) {
+				UpdatePose(poses[i], delta);
+			}
+		});
+	}
     
+	float DVKModel::CompressAnimations(const DVKAnimCompressSettings& settings)
+	{
+		uint32 totalRaw = 0;
+		uint32 totalCompressed = 0;
+
+		for (int32 i = 0; i < animations.size(); ++i)
+		{
+			DVKAnimation& animation = animations[i];
+			uint32 animRaw = 0;
+			uint32 animCompressed = 0;
+
+			for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+			{
+				DVKAnimationClip& clip = it->second;
+				DVKCompressedClip::Compress(clip, settings, clip.compressed);
+
+				uint32 rawSize        = DVKCompressedClip::GetRawMemorySize(clip);
+				uint32 compressedSize = clip.compressed.GetMemorySize();
+				animRaw        += rawSize;
+				animCompressed += compressedSize;
+
+				MLOG("Compress clip %s: %d/%d/%d keys, %d -> %d bytes (%.1f%%), max error position %f rotation %f scale %f", 
+					clip.nodeName.c_str(), 
+					clip.compressed.positions.numKeys, clip.compressed.rotations.numKeys, clip.compressed.scales.numKeys, 
+					rawSize, compressedSize, compressedSize * 100.0f / rawSize, 
+					clip.compressed.maxPositionError, clip.compressed.maxRotationError, clip.compressed.maxScaleError
+				);
+			}
+
+			MLOG("Compress animation %d: %d clips, %d -> %d bytes (%.1f%%)", i, (int32)animation.clips.size(), animRaw, animCompressed, animCompressed * 100.0f / MMath::Max(animRaw, 1u));
+
+			totalRaw        += animRaw;
+			totalCompressed += animCompressed;
+		}
+
+		useCompressedAnimation = true;
+
+		return totalRaw > 0 ? (float)totalCompressed / totalRaw : 1.0f;
+	}
+
 	void DVKModel::Update(float time, float delta)
 	{
 		if (animIndex == -1) {
@@ -732,6 +1017,84 @@ namespace vk_demo
 		return animations[index];
 	}
 
+	bool DVKModel::LoadVertexSkins(const DVKMesh* mesh, std::vector<DVKVertexSkin>& outSkins) const
+	{
+		if (!mesh->isSkin || mesh->bones.size() == 0) {
+			return false;
+		}
+
+		int32 indexOffset  = -1;
+		int32 weightOffset = -1;
+		int32 packOffset   = -1;
+		int32 offset = 0;
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			if (attributes[i] == VertexAttribute::VA_SkinIndex) {
+				indexOffset = offset;
+			}
+			else if (attributes[i] == VertexAttribute::VA_SkinWeight) {
+				weightOffset = offset;
+			}
+			else if (attributes[i] == VertexAttribute::VA_SkinPack) {
+				packOffset = offset;
+			}
+			offset += VertexAttributeToSize(attributes[i]) / sizeof(float);
+		}
+
+		if (packOffset < 0 && (indexOffset < 0 || weightOffset < 0)) {
+			return false;
+		}
+
+		const int32 numBones = mesh->bones.size();
+
+		for (int32 i = 0; i < mesh->primitives.size(); ++i)
+		{
+			const DVKPrimitive* primitive = mesh->primitives[i];
+			if (primitive->vertexCount == 0) {
+				continue;
+			}
+
+			const int32 stride = primitive->vertices.size() / primitive->vertexCount;
+			for (int32 j = 0; j < primitive->vertexCount; ++j)
+			{
+				const float* vertex = &primitive->vertices[j * stride];
+
+				DVKVertexSkin skin;
+				skin.used = 4;
+				if (packOffset >= 0)
+				{
+					uint32 packIndex   = (uint32)vertex[packOffset + 0];
+					uint32 packWeight0 = (uint32)vertex[packOffset + 1];
+					uint32 packWeight1 = (uint32)vertex[packOffset + 2];
+					skin.indices[0] = (packIndex >> 24) & 0xFF;
+					skin.indices[1] = (packIndex >> 16) & 0xFF;
+					skin.indices[2] = (packIndex >> 8)  & 0xFF;
+					skin.indices[3] = (packIndex >> 0)  & 0xFF;
+					skin.weights[0] = ((packWeight0 >> 16) & 0xFFFF) / 65535.0f;
+					skin.weights[1] = ((packWeight0 >> 0)  & 0xFFFF) / 65535.0f;
+					skin.weights[2] = ((packWeight1 >> 16) & 0xFFFF) / 65535.0f;
+					skin.weights[3] = ((packWeight1 >> 0)  & 0xFFFF) / 65535.0f;
+				}
+				else
+				{
+					for (int32 k = 0; k < 4; ++k)
+					{
+						skin.indices[k] = (int32)vertex[indexOffset + k];
+						skin.weights[k] = vertex[weightOffset + k];
+					}
+				}
+
+				for (int32 k = 0; k < 4; ++k) {
+					skin.indices[k] = MMath::Clamp(skin.indices[k], 0, numBones - 1);
+				}
+
+				outSkins.push_back(skin);
+			}
+		}
+
+		return true;
+	}
+
 	VkVertexInputBindingDescription DVKModel::GetInputBinding()
 	{
 		int32 stride = 0;
@@ -6,6 +6,8 @@
 #include "DVKBuffer.h"
 #include "DVKIndexBuffer.h"
 #include "DVKVertexBuffer.h"
+#include "DVKUploadQueue.h"
+#include "DVKAnimCompression.h"
 
 #include "Common/Common.h"
 #include "Math/Math.h"
@@ -176,7 +178,15 @@ namespace vk_demo
 		std::vector<float>	   keys;
 		std::vector<ValueType> values;
 
-		void GetValue(float key, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha)
+		void GetValue(float key, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha) const
+		{
+			int32 cursor = 0;
+			GetValue(key, cursor, outPrevValue, outNextValue, outAlpha);
+		}
+
+		// cursor为上次所在的关键帧，时间往前走时从cursor接着往后找，不用每次从头扫描。
+		// 时间倒退(循环播放回到开头)时从0重新开始，结果和从头扫描完全一致。
+		void GetValue(float key, int32& cursor, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha) const
 		{
 			outAlpha = 0.0f;
 
@@ -200,14 +210,15 @@ namespace vk_demo
 				return;
 			}
 
-			int32 frameIndex = 0;
-			for (int32 i = 0; i < keys.size() - 1; ++i) {
-				if (key <= keys[i + 1]) 
-				{
-					frameIndex = i;
-					break;
-				}
+			int32 lastIndex = keys.size() - 2;
+			if (cursor < 0 || cursor > lastIndex || key <= keys[cursor]) {
+				cursor = 0;
+			}
+			while (cursor < lastIndex && key > keys[cursor + 1]) {
+				cursor += 1;
 			}
+
+			int32 frameIndex = cursor;
             
 			outPrevValue = values[frameIndex + 0];
 			outNextValue = values[frameIndex + 1];
@@ -225,6 +236,10 @@ namespace vk_demo
 		DVKAnimChannel<Vector3>		positions;
 		DVKAnimChannel<Vector3>		scales;
 		DVKAnimChannel<Quat>		rotations;
+		// linearNodes里的下标，PrepareAnimation时填充，-1表示找不到对应的节点
+		int32						nodeIndex = -1;
+		// CompressAnimations生成，原始数据保留用于对比
+		DVKCompressedClip			compressed;
 	};
 
 	struct DVKAnimation
@@ -234,6 +249,29 @@ namespace vk_demo
 		float       duration = 0.0f;
 		float		speed = 1.0f;
 		std::unordered_map<std::string, DVKAnimationClip> clips;
+
+		// PrepareAnimation生成，按nodeIndex排序的clips，逐帧更新时顺序访问，不再查表
+		std::vector<DVKAnimationClip*>	linearClips;
+		// 每个linearClip的关键帧游标，position/scale/rotation各一个
+		std::vector<int32>				cursors;
+	};
+
+	/**
+	 * 一个动画实例的状态。多个实例共用同一个DVKModel的节点、骨骼和动画数据，
+	 * 每个实例只保存自己的时间、关键帧游标以及算出来的矩阵，因此不同实例可以在不同的线程里同时更新。
+	 */
+	struct DVKAnimPose
+	{
+		int32					animIndex = 0;
+		float					time = 0.0f;
+		float					speed = 1.0f;
+
+		std::vector<int32>		cursors;
+		// 和DVKModel::linearNodes一一对应
+		std::vector<Matrix4x4>	localMatrices;
+		std::vector<Matrix4x4>	globalMatrices;
+		// 和DVKModel::bones一一对应，等同于DVKBone::finalTransform
+		std::vector<Matrix4x4>	boneMatrices;
 	};
     
     struct DVKMesh
@@ -330,15 +368,18 @@ namespace vk_demo
 		{
 			if (meshes.size() > 0) 
 			{
+				// 有旋转时只变换min、max两个角点得到的不是AABB，需要变换全部8个角点
 				const Matrix4x4& matrix = GetGlobalMatrix();
 				for (int32 i = 0; i < meshes.size(); ++i)
 				{
-					Vector3 mmin = matrix.TransformPosition(meshes[i]->bounding.min);
-					Vector3 mmax = matrix.TransformPosition(meshes[i]->bounding.max);
-					outBounds.min = Vector3::Min(outBounds.min, mmin);
-					outBounds.min = Vector3::Min(outBounds.min, mmax);
-					outBounds.max = Vector3::Max(outBounds.max, mmin);
-					outBounds.max = Vector3::Max(outBounds.max, mmax);
+					DVKBoundingBox bounds(meshes[i]->bounding.min, meshes[i]->bounding.max);
+					bounds.UpdateCorners();
+					for (int32 j = 0; j < 8; ++j)
+					{
+						Vector3 corner = matrix.TransformPosition(bounds.corners[j]);
+						outBounds.min = Vector3::Min(outBounds.min, corner);
+						outBounds.max = Vector3::Max(outBounds.max, corner);
+					}
 				}
 			}
 
@@ -405,11 +446,36 @@ namespace vk_demo
 
 		void GotoAnimation(float time);
 
+		// 加载完成后调用一次，把按名字查找的节点、骨骼和动画clip编译成下标。
+		// linearNodes是先序遍历的顺序，子节点一定在父节点之后，local到global一次顺序遍历即可完成。
+		void PrepareAnimation();
+
+		// 节点没有动画的local矩阵在这里拷贝，之后修改了rootNode等节点的local矩阵需要重新InitPose
+		void InitPose(DVKAnimPose& pose, int32 index = 0) const;
+
+		// 只读模型数据，可以在多个线程里对不同的pose同时调用
+		void EvaluatePose(DVKAnimPose& pose, float time) const;
+
+		void UpdatePose(DVKAnimPose& pose, float delta) const;
+
+		// 用JobSystem并行更新多个实例，返回时全部完成
+		void UpdatePoses(DVKAnimPose* poses, int32 count, float delta) const;
+
+		// 压缩所有动画clip，之后useCompressedAnimation为true时从压缩数据采样。返回压缩后占原始数据的比例
+		float CompressAnimations(const DVKAnimCompressSettings& settings = DVKAnimCompressSettings());
+
+		// 从顶点数据里读出蒙皮信息，和shader的解码方式一致，骨骼序号为mesh->bones的下标。没有蒙皮属性时返回false
+		bool LoadVertexSkins(const DVKMesh* mesh, std::vector<DVKVertexSkin>& outSkins) const;
+
 		VkVertexInputBindingDescription GetInputBinding();
 
 		std::vector<VkVertexInputAttributeDescription> GetInputAttributes();
         
+        // cmdBuffer为空时只加载CPU端数据，可以在工作线程里调用，之后在主线程Upload
         static DVKModel* LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes);
+
+        // 为还没有顶点/索引buffer的primitive创建buffer，拷贝记录到uploadQueue
+        void Upload(DVKUploadQueue* queue);
         
         static DVKModel* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<uint16>& indices, const std::vector<VertexAttribute>& attributes);
         
@@ -430,6 +496,15 @@ namespace vk_demo
         void LoadPrimitives(std::vector<float>& vertices, std::vector<uint32>& indices, DVKMesh* mesh, const aiMesh* aiMesh, const aiScene* aiScene);
         
         void LoadAnim(const aiScene* aiScene);
+
+		// 二进制缓存，见DVKModelCache.cpp
+		bool LoadCache(const uint8* data, uint32 size, uint64 sourceHash);
+
+		void SaveCache(const std::string& cacheName, uint64 sourceHash);
+
+		static uint64 HashCacheKey(const uint8* data, uint32 size, uint64 seed);
+
+		static std::string GetCacheName(const std::string& filename, const std::vector<VertexAttribute>& attributes);
         
     public:
         typedef std::unordered_map<std::string, DVKNode*> NodesMap;
@@ -442,6 +517,10 @@ namespace vk_demo
         std::vector<DVKMesh*>			meshes;
 
 		NodesMap						nodesMap;
+		// linearNodes中父节点的下标，根节点为-1
+		std::vector<int32>				nodeParents;
+		// bones对应的linearNodes下标
+		std::vector<int32>				boneNodes;
 
 		std::vector<DVKBone*>			bones;
 		BonesMap						bonesMap;
@@ -449,10 +528,12 @@ namespace vk_demo
 		std::vector<VertexAttribute>	attributes;
 		std::vector<DVKAnimation>		animations;
 		int32							animIndex = -1;
+		bool							useCompressedAnimation = false;
 
 	private:
 
 		DVKCommandBuffer*				cmdBuffer = nullptr;
+		DVKUploadQueue*					uploadQueue = nullptr;
         bool                            loadSkin = false;
     };
     
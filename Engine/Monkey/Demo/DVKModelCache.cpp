@@ -0,0 +1,467 @@
+﻿#include "DVKModel.h"
+#include "FileManager.h"
+
+#include "Utils/Alignment.h"
+
+namespace vk_demo
+{
+	// 'DVKM'
+	static const uint32 MODEL_CACHE_MAGIC   = 0x4D4B5644;
+	// 缓存布局变化时加一，旧缓存自动失效
+	static const uint32 MODEL_CACHE_VERSION = 1;
+	// 顶点/索引数据按16字节对齐，方便直接映射后上传
+	static const uint32 MODEL_CACHE_BLOB_ALIGNMENT = 16;
+
+	class ModelCacheWriter
+	{
+	public:
+		template<typename T>
+		void Write(const T& value)
+		{
+			WriteBytes(&value, sizeof(T));
+		}
+
+		void WriteBytes(const void* src, uint32 count)
+		{
+			const uint8* bytes = (const uint8*)src;
+			buffer.insert(buffer.end(), bytes, bytes + count);
+		}
+
+		void WriteString(const std::string& value)
+		{
+			Write<uint32>(value.size());
+			WriteBytes(value.data(), value.size());
+		}
+
+		void WriteVector3(const Vector3& value)
+		{
+			Write<float>(value.x);
+			Write<float>(value.y);
+			Write<float>(value.z);
+		}
+
+		void WriteQuat(const Quat& value)
+		{
+			Write<float>(value.x);
+			Write<float>(value.y);
+			Write<float>(value.z);
+			Write<float>(value.w);
+		}
+
+		void WriteMatrix(const Matrix4x4& value)
+		{
+			WriteBytes(&(value.m[0][0]), sizeof(float) * 16);
+		}
+
+		void WriteBlob(const void* src, uint32 count)
+		{
+			buffer.resize(Align<uint64>(buffer.size(), MODEL_CACHE_BLOB_ALIGNMENT), 0);
+			WriteBytes(src, count);
+		}
+
+		template<typename ValueType>
+		void WriteChannel(const DVKAnimChannel<ValueType>& channel);
+
+	public:
+		std::vector<uint8> buffer;
+	};
+
+	template<>
+	void ModelCacheWriter::WriteChannel(const DVKAnimChannel<Vector3>& channel)
+	{
+		Write<uint32>(channel.keys.size());
+		for (int32 i = 0; i < channel.keys.size(); ++i)
+		{
+			Write<float>(channel.keys[i]);
+			WriteVector3(channel.values[i]);
+		}
+	}
+
+	template<>
+	void ModelCacheWriter::WriteChannel(const DVKAnimChannel<Quat>& channel)
+	{
+		Write<uint32>(channel.keys.size());
+		for (int32 i = 0; i < channel.keys.size(); ++i)
+		{
+			Write<float>(channel.keys[i]);
+			WriteQuat(channel.values[i]);
+		}
+	}
+
+	// 所有读取都做越界检查，文件被截断或者损坏时valid置为false
+	class ModelCacheReader
+	{
+	public:
+		ModelCacheReader(const uint8* inData, uint32 inSize)
+			: data(inData)
+			, size(inSize)
+			, offset(0)
+			, valid(true)
+		{
+
+		}
+
+		template<typename T>
+		T Read()
+		{
+			T value = T();
+			ReadBytes(&value, sizeof(T));
+			return value;
+		}
+
+		void ReadBytes(void* dst, uint32 count)
+		{
+			const uint8* src = Skip(count);
+			if (src) {
+				memcpy(dst, src, count);
+			}
+		}
+
+		std::string ReadString()
+		{
+			uint32 count = Read<uint32>();
+			const uint8* src = Skip(count);
+			return src ? std::string((const char*)src, count) : std::string();
+		}
+
+		Vector3 ReadVector3()
+		{
+			Vector3 value;
+			value.x = Read<float>();
+			value.y = Read<float>();
+			value.z = Read<float>();
+			return value;
+		}
+
+		Quat ReadQuat()
+		{
+			Quat value;
+			value.x = Read<float>();
+			value.y = Read<float>();
+			value.z = Read<float>();
+			value.w = Read<float>();
+			return value;
+		}
+
+		void ReadMatrix(Matrix4x4& value)
+		{
+			ReadBytes(&(value.m[0][0]), sizeof(float) * 16);
+		}
+
+		const uint8* ReadBlob(uint32 count)
+		{
+			offset = Align<uint64>(offset, MODEL_CACHE_BLOB_ALIGNMENT);
+			return Skip(count);
+		}
+
+		template<typename ValueType>
+		void ReadChannel(DVKAnimChannel<ValueType>& channel);
+
+		// 数组长度不可能超过剩余字节数，防止损坏的长度导致巨量分配
+		uint32 ReadCount(uint32 elementSize)
+		{
+			uint32 count = Read<uint32>();
+			if (valid && (uint64)count * elementSize > size - offset) {
+				valid = false;
+			}
+			return valid ? count : 0;
+		}
+
+	private:
+		const uint8* Skip(uint64 count)
+		{
+			if (!valid || offset + count > size)
+			{
+				valid = false;
+				return nullptr;
+			}
+			const uint8* src = data + offset;
+			offset += count;
+			return src;
+		}
+
+	public:
+		const uint8*	data;
+		uint64			size;
+		uint64			offset;
+		bool			valid;
+	};
+
+	template<>
+	void ModelCacheReader::ReadChannel(DVKAnimChannel<Vector3>& channel)
+	{
+		uint32 count = ReadCount(sizeof(float) * 4);
+		channel.keys.resize(count);
+		channel.values.resize(count);
+		for (int32 i = 0; i < count; ++i)
+		{
+			channel.keys[i]   = Read<float>();
+			channel.values[i] = ReadVector3();
+		}
+	}
+
+	template<>
+	void ModelCacheReader::ReadChannel(DVKAnimChannel<Quat>& channel)
+	{
+		uint32 count = ReadCount(sizeof(float) * 5);
+		channel.keys.resize(count);
+		channel.values.resize(count);
+		for (int32 i = 0; i < count; ++i)
+		{
+			channel.keys[i]   = Read<float>();
+			channel.values[i] = ReadQuat();
+		}
+	}
+
+	uint64 DVKModel::HashCacheKey(const uint8* data, uint32 size, uint64 seed)
+	{
+		// FNV-1a
+		uint64 hash = 0xcbf29ce484222325ULL ^ seed;
+		for (uint32 i = 0; i < size; ++i)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	std::string DVKModel::GetCacheName(const std::string& filename, const std::vector<VertexAttribute>& attributes)
+	{
+		std::vector<int32> layout(attributes.size());
+		for (int32 i = 0; i < attributes.size(); ++i) {
+			layout[i] = (int32)attributes[i];
+		}
+		uint64 layoutHash = HashCacheKey((const uint8*)layout.data(), layout.size() * sizeof(int32), MODEL_CACHE_VERSION);
+
+		char suffix[32];
+		sprintf(suffix, "_%016llx.mesh", (unsigned long long)layoutHash);
+
+		return FileManager::SanitizeFileName("Model_" + filename) + suffix;
+	}
+
+	void DVKModel::SaveCache(const std::string& cacheName, uint64 sourceHash)
+	{
+		ModelCacheWriter writer;
+
+		writer.Write<uint32>(MODEL_CACHE_MAGIC);
+		writer.Write<uint32>(MODEL_CACHE_VERSION);
+		writer.Write<uint64>(sourceHash);
+		writer.Write<uint32>(attributes.size());
+		for (int32 i = 0; i < attributes.size(); ++i) {
+			writer.Write<int32>((int32)attributes[i]);
+		}
+
+		// bones
+		writer.Write<uint32>(bones.size());
+		for (int32 i = 0; i < bones.size(); ++i)
+		{
+			DVKBone* bone = bones[i];
+			writer.WriteString(bone->name);
+			writer.Write<int32>(bone->index);
+			writer.Write<int32>(bone->parent);
+			writer.WriteMatrix(bone->inverseBindPose);
+		}
+
+		// nodes, linearNodes是先序遍历的顺序，子节点一定在父节点之后
+		std::unordered_map<DVKNode*, int32> nodeIndexMap;
+		writer.Write<uint32>(linearNodes.size());
+		for (int32 i = 0; i < linearNodes.size(); ++i)
+		{
+			DVKNode* node = linearNodes[i];
+			nodeIndexMap.insert(std::make_pair(node, i));
+
+			writer.WriteString(node->name);
+			writer.Write<int32>(node->parent ? nodeIndexMap[node->parent] : -1);
+			writer.WriteMatrix(node->localMatrix);
+
+			writer.Write<uint32>(node->meshes.size());
+			for (int32 j = 0; j < node->meshes.size(); ++j)
+			{
+				DVKMesh* mesh = node->meshes[j];
+				writer.WriteString(mesh->material.diffuse);
+				writer.WriteString(mesh->material.normalmap);
+				writer.WriteString(mesh->material.specular);
+				writer.WriteVector3(mesh->bounding.min);
+				writer.WriteVector3(mesh->bounding.max);
+				writer.Write<uint8>(mesh->isSkin ? 1 : 0);
+				writer.Write<int32>(mesh->vertexCount);
+				writer.Write<int32>(mesh->triangleCount);
+
+				writer.Write<uint32>(mesh->bones.size());
+				writer.WriteBytes(mesh->bones.data(), mesh->bones.size() * sizeof(int32));
+
+				writer.Write<uint32>(mesh->primitives.size());
+				for (int32 k = 0; k < mesh->primitives.size(); ++k)
+				{
+					DVKPrimitive* primitive = mesh->primitives[k];
+					writer.Write<int32>(primitive->vertexCount);
+					writer.Write<int32>(primitive->triangleNum);
+					writer.Write<uint32>(primitive->vertices.size());
+					writer.Write<uint32>(primitive->indices.size());
+					writer.WriteBlob(primitive->vertices.data(), primitive->vertices.size() * sizeof(float));
+					writer.WriteBlob(primitive->indices.data(), primitive->indices.size() * sizeof(uint16));
+				}
+			}
+		}
+
+		// animations
+		writer.Write<uint32>(animations.size());
+		for (int32 i = 0; i < animations.size(); ++i)
+		{
+			DVKAnimation& animation = animations[i];
+			writer.WriteString(animation.name);
+			writer.Write<float>(animation.duration);
+			writer.Write<uint32>(animation.clips.size());
+			for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+			{
+				DVKAnimationClip& clip = it->second;
+				writer.WriteString(clip.nodeName);
+				writer.Write<float>(clip.duration);
+				writer.WriteChannel(clip.positions);
+				writer.WriteChannel(clip.scales);
+				writer.WriteChannel(clip.rotations);
+			}
+		}
+
+		FileManager::WriteCacheFile(cacheName, writer.buffer.data(), writer.buffer.size());
+	}
+
+	bool DVKModel::LoadCache(const uint8* data, uint32 size, uint64 sourceHash)
+	{
+		ModelCacheReader reader(data, size);
+
+		if (reader.Read<uint32>() != MODEL_CACHE_MAGIC) {
+			return false;
+		}
+		if (reader.Read<uint32>() != MODEL_CACHE_VERSION) {
+			return false;
+		}
+		if (reader.Read<uint64>() != sourceHash) {
+			return false;
+		}
+		if (reader.Read<uint32>() != attributes.size()) {
+			return false;
+		}
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			if (reader.Read<int32>() != (int32)attributes[i]) {
+				return false;
+			}
+		}
+
+		int32 stride = 0;
+		for (int32 i = 0; i < attributes.size(); ++i) {
+			stride += VertexAttributeToSize(attributes[i]);
+		}
+
+		// bones
+		uint32 numBones = reader.ReadCount(sizeof(int32) * 3 + sizeof(float) * 16);
+		for (int32 i = 0; i < numBones && reader.valid; ++i)
+		{
+			DVKBone* bone = new DVKBone();
+			bone->name   = reader.ReadString();
+			bone->index  = reader.Read<int32>();
+			bone->parent = reader.Read<int32>();
+			reader.ReadMatrix(bone->inverseBindPose);
+			bones.push_back(bone);
+			bonesMap.insert(std::make_pair(bone->name, bone));
+		}
+
+		// nodes
+		uint32 numNodes = reader.ReadCount(sizeof(int32) * 3 + sizeof(float) * 16);
+		for (int32 i = 0; i < numNodes && reader.valid; ++i)
+		{
+			DVKNode* node = new DVKNode();
+			node->name = reader.ReadString();
+
+			int32 parentIndex = reader.Read<int32>();
+			if (parentIndex >= 0 && parentIndex < linearNodes.size())
+			{
+				node->parent = linearNodes[parentIndex];
+				node->parent->children.push_back(node);
+			}
+			else if (rootNode == nullptr) {
+				rootNode = node;
+			}
+			else
+			{
+				delete node;
+				return false;
+			}
+
+			reader.ReadMatrix(node->localMatrix);
+			nodesMap.insert(std::make_pair(node->name, node));
+			linearNodes.push_back(node);
+
+			uint32 numMeshes = reader.ReadCount(sizeof(uint32));
+			for (int32 j = 0; j < numMeshes && reader.valid; ++j)
+			{
+				DVKMesh* mesh = new DVKMesh();
+				mesh->linkNode = node;
+				node->meshes.push_back(mesh);
+				meshes.push_back(mesh);
+
+				mesh->material.diffuse   = reader.ReadString();
+				mesh->material.normalmap = reader.ReadString();
+				mesh->material.specular  = reader.ReadString();
+				mesh->bounding.min  = reader.ReadVector3();
+				mesh->bounding.max  = reader.ReadVector3();
+				mesh->bounding.UpdateCorners();
+				mesh->isSkin        = reader.Read<uint8>() != 0;
+				mesh->vertexCount   = reader.Read<int32>();
+				mesh->triangleCount = reader.Read<int32>();
+
+				uint32 numMeshBones = reader.ReadCount(sizeof(int32));
+				mesh->bones.resize(numMeshBones);
+				reader.ReadBytes(mesh->bones.data(), numMeshBones * sizeof(int32));
+
+				uint32 numPrimitives = reader.ReadCount(sizeof(int32) * 4);
+				for (int32 k = 0; k < numPrimitives && reader.valid; ++k)
+				{
+					DVKPrimitive* primitive = new DVKPrimitive();
+					mesh->primitives.push_back(primitive);
+
+					primitive->vertexCount = reader.Read<int32>();
+					primitive->triangleNum = reader.Read<int32>();
+					uint32 numFloats  = reader.ReadCount(sizeof(float));
+					uint32 numIndices = reader.ReadCount(sizeof(uint16));
+
+					const float* vertexBlob = (const float*)reader.ReadBlob(numFloats * sizeof(float));
+					const uint16* indexBlob = (const uint16*)reader.ReadBlob(numIndices * sizeof(uint16));
+					if (!reader.valid || numFloats != primitive->vertexCount * stride / sizeof(float)) {
+						return false;
+					}
+
+					// 拷贝一份：BVH、蒙皮和部分Demo会读写primitive->vertices，不能直接引用映射的文件
+					primitive->vertices.assign(vertexBlob, vertexBlob + numFloats);
+					primitive->indices.assign(indexBlob, indexBlob + numIndices);
+				}
+			}
+		}
+
+		// animations
+		uint32 numAnimations = reader.ReadCount(sizeof(uint32) * 3);
+		for (int32 i = 0; i < numAnimations && reader.valid; ++i)
+		{
+			animations.push_back(DVKAnimation());
+			DVKAnimation& animation = animations.back();
+			animation.name     = reader.ReadString();
+			animation.duration = reader.Read<float>();
+
+			uint32 numClips = reader.ReadCount(sizeof(uint32) * 4);
+			for (int32 j = 0; j < numClips && reader.valid; ++j)
+			{
+				std::string nodeName = reader.ReadString();
+				DVKAnimationClip& clip = animation.clips[nodeName];
+				clip.nodeName = nodeName;
+				clip.duration = reader.Read<float>();
+				reader.ReadChannel(clip.positions);
+				reader.ReadChannel(clip.scales);
+				reader.ReadChannel(clip.rotations);
+			}
+		}
+
+		return reader.valid && rootNode != nullptr;
+	}
+
+};
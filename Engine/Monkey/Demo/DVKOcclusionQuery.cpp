@@ -0,0 +1,241 @@
+﻿#include "DVKOcclusionQuery.h"
+
+// 和vkCmdCopyQueryPoolResults的布局一致，result + availability
+#define CONDITION_STRIDE (sizeof(uint32) * 2)
+
+namespace vk_demo
+{
+	DVKOcclusionQuery::~DVKOcclusionQuery()
+	{
+		for (int32 i = 0; i < m_QueryPools.size(); ++i) {
+			vkDestroyQueryPool(m_Device, m_QueryPools[i], VULKAN_CPU_ALLOCATOR);
+		}
+		m_QueryPools.clear();
+
+		delete m_ConditionBuffer;
+		m_ConditionBuffer = nullptr;
+
+		m_VulkanDevice = nullptr;
+	}
+
+	DVKOcclusionQuery* DVKOcclusionQuery::Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 maxQueries, int32 framesInFlight, bool precise)
+	{
+		if (maxQueries <= 0) 
+		{
+			MLOGE("Occlusion query needs at least one query.");
+			return nullptr;
+		}
+
+		DVKOcclusionQuery* occlusion = new DVKOcclusionQuery();
+		occlusion->m_VulkanDevice   = vulkanDevice;
+		occlusion->m_Device         = vulkanDevice->GetInstanceHandle();
+		occlusion->m_MaxQueries     = maxQueries;
+		occlusion->m_FramesInFlight = MMath::Max(framesInFlight, 1);
+		occlusion->m_Precise        = precise && vulkanDevice->GetPhysicalFeatures().occlusionQueryPrecise;
+
+		if (precise && !occlusion->m_Precise) {
+			MLOG("occlusionQueryPrecise not supported, fallback to binary occlusion query.");
+		}
+
+		occlusion->m_QueryPools.resize(occlusion->m_FramesInFlight);
+		for (int32 i = 0; i < occlusion->m_FramesInFlight; ++i)
+		{
+			VkQueryPoolCreateInfo queryPoolCreateInfo;
+			ZeroVulkanStruct(queryPoolCreateInfo, VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO);
+			queryPoolCreateInfo.queryType  = VK_QUERY_TYPE_OCCLUSION;
+			queryPoolCreateInfo.queryCount = maxQueries;
+			VERIFYVULKANRESULT(vkCreateQueryPool(occlusion->m_Device, &queryPoolCreateInfo, VULKAN_CPU_ALLOCATOR, &(occlusion->m_QueryPools[i])));
+		}
+
+		// 每个slot还没有录制过，也没有重置过，不能读取
+		occlusion->m_Issued.resize(occlusion->m_FramesInFlight * maxQueries, false);
+		occlusion->m_ReadBack.resize(maxQueries * 2);
+
+		occlusion->m_Parents.reserve(maxQueries);
+		occlusion->m_Visible.reserve(maxQueries);
+		occlusion->m_Samples.reserve(maxQueries);
+
+		if (vulkanDevice->IsExtensionEnabled(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME))
+		{
+			occlusion->m_CmdBeginConditionalRendering = reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(vkGetDeviceProcAddr(occlusion->m_Device, "vkCmdBeginConditionalRenderingEXT"));
+			occlusion->m_CmdEndConditionalRendering   = reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(vkGetDeviceProcAddr(occlusion->m_Device, "vkCmdEndConditionalRenderingEXT"));
+
+			if (occlusion->m_CmdBeginConditionalRendering == nullptr || occlusion->m_CmdEndConditionalRendering == nullptr)
+			{
+				occlusion->m_CmdBeginConditionalRendering = nullptr;
+				occlusion->m_CmdEndConditionalRendering   = nullptr;
+			}
+		}
+
+		if (occlusion->IsConditionalRenderingSupported())
+		{
+			// 每个slot一段，slot的fence等待过之后才会覆盖
+			occlusion->m_ConditionBuffer = DVKBuffer::CreateBuffer(
+				vulkanDevice,
+				VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				occlusion->m_FramesInFlight * maxQueries * CONDITION_STRIDE
+			);
+		}
+
+		return occlusion;
+	}
+
+	int32 DVKOcclusionQuery::AddQuery(int32 parent)
+	{
+		if (m_Parents.size() >= m_MaxQueries) 
+		{
+			MLOGE("Occlusion query overflow, max queries : %d", m_MaxQueries);
+			return -1;
+		}
+
+		if (parent >= (int32)m_Parents.size()) 
+		{
+			MLOGE("Occlusion query parent %d must be added before its children.", parent);
+			parent = -1;
+		}
+
+		m_Parents.push_back(parent);
+		m_Visible.push_back(true);
+		m_Samples.push_back(MAX_uint64);
+
+		return m_Parents.size() - 1;
+	}
+
+	void DVKOcclusionQuery::BeginFrame(VkCommandBuffer commandBuffer, int32 frameIndex)
+	{
+		m_FrameIndex = frameIndex % m_FramesInFlight;
+
+		int32 numQueries = m_Parents.size();
+		if (numQueries == 0) {
+			return;
+		}
+
+		VkQueryPool queryPool = m_QueryPools[m_FrameIndex];
+		std::vector<bool>::iterator issued = m_Issued.begin() + m_FrameIndex * m_MaxQueries;
+
+		// 这个slot的fence已经等待过，结果基本都已经可用，但是依然不等待
+		bool hasIssued = false;
+		for (int32 i = 0; i < numQueries; ++i) 
+		{
+			if (issued[i]) 
+			{
+				hasIssued = true;
+				break;
+			}
+		}
+
+		if (hasIssued)
+		{
+			vkGetQueryPoolResults(
+				m_Device,
+				queryPool,
+				0, numQueries,
+				numQueries * sizeof(uint64) * 2, m_ReadBack.data(), sizeof(uint64) * 2,
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+			);
+		}
+
+		m_NumOccluded = 0;
+		m_NumMissing  = 0;
+		for (int32 i = 0; i < numQueries; ++i)
+		{
+			// 没有数据时认为可见
+			if (!issued[i]) 
+			{
+				m_Visible[i] = true;
+				m_Samples[i] = MAX_uint64;
+				continue;
+			}
+
+			if (m_ReadBack[i * 2 + 1] == 0)
+			{
+				m_Visible[i] = true;
+				m_Samples[i] = MAX_uint64;
+				m_NumMissing += 1;
+				continue;
+			}
+
+			m_Samples[i] = m_ReadBack[i * 2 + 0];
+			m_Visible[i] = m_Samples[i] > m_SampleThreshold;
+			m_NumOccluded += m_Visible[i] ? 0 : 1;
+		}
+
+		if (m_ConditionBuffer)
+		{
+			// 没有结果的query保持为1，也就是可见
+			VkDeviceSize offset = m_FrameIndex * m_MaxQueries * CONDITION_STRIDE;
+			vkCmdFillBuffer(commandBuffer, m_ConditionBuffer->buffer, offset, numQueries * CONDITION_STRIDE, 1);
+
+			VkMemoryBarrier memoryBarrier;
+			ZeroVulkanStruct(memoryBarrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			if (hasIssued) {
+				vkCmdCopyQueryPoolResults(commandBuffer, queryPool, 0, numQueries, m_ConditionBuffer->buffer, offset, CONDITION_STRIDE, VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+			}
+
+			// 同时保证拷贝完成之后才重置query
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, m_MaxQueries);
+		for (int32 i = 0; i < numQueries; ++i) {
+			issued[i] = false;
+		}
+	}
+
+	void DVKOcclusionQuery::BeginQuery(VkCommandBuffer commandBuffer, int32 id)
+	{
+		m_Issued[m_FrameIndex * m_MaxQueries + id] = true;
+		vkCmdBeginQuery(commandBuffer, m_QueryPools[m_FrameIndex], id, m_Precise ? VK_QUERY_CONTROL_PRECISE_BIT : 0);
+	}
+
+	void DVKOcclusionQuery::EndQuery(VkCommandBuffer commandBuffer, int32 id)
+	{
+		vkCmdEndQuery(commandBuffer, m_QueryPools[m_FrameIndex], id);
+	}
+
+	bool DVKOcclusionQuery::IsVisible(int32 id) const
+	{
+		while (id >= 0)
+		{
+			if (!m_Visible[id]) {
+				return false;
+			}
+			id = m_Parents[id];
+		}
+		return true;
+	}
+
+	bool DVKOcclusionQuery::NeedsQuery(int32 id) const
+	{
+		return IsVisible(m_Parents[id]);
+	}
+
+	void DVKOcclusionQuery::BeginConditionalRendering(VkCommandBuffer commandBuffer, int32 id)
+	{
+		if (!m_CmdBeginConditionalRendering) {
+			return;
+		}
+
+		VkConditionalRenderingBeginInfoEXT beginInfo;
+		ZeroVulkanStruct(beginInfo, VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT);
+		beginInfo.buffer = m_ConditionBuffer->buffer;
+		beginInfo.offset = (m_FrameIndex * m_MaxQueries + id) * CONDITION_STRIDE;
+		m_CmdBeginConditionalRendering(commandBuffer, &beginInfo);
+	}
+
+	void DVKOcclusionQuery::EndConditionalRendering(VkCommandBuffer commandBuffer)
+	{
+		if (!m_CmdEndConditionalRendering) {
+			return;
+		}
+		m_CmdEndConditionalRendering(commandBuffer);
+	}
+
+};
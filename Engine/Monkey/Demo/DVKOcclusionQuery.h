@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+	/**
+	 * Occlusion queries that never stall the CPU. There is one query pool per frame in flight;
+	 * BeginFrame() of a slot reads the results that slot recorded framesInFlight frames ago,
+	 * after its fence has been waited, without VK_QUERY_RESULT_WAIT_BIT. Queries without a
+	 * result (not issued, not ready) count as visible.
+	 *
+	 * A query can have a parent, so one query can cover a cluster of objects: a node is visible
+	 * only if its parents are visible, and children only need to be queried while their parent
+	 * is visible. With VK_EXT_conditional_rendering the same results also gate draws on the GPU.
+	 */
+	class DVKOcclusionQuery
+	{
+	private:
+		DVKOcclusionQuery()
+		{
+
+		}
+
+	public:
+		~DVKOcclusionQuery();
+
+		static DVKOcclusionQuery* Create(std::shared_ptr<VulkanDevice> vulkanDevice, int32 maxQueries, int32 framesInFlight, bool precise = false);
+
+		// parent为-1时是根节点，parent必须先于子节点创建
+		int32 AddQuery(int32 parent = -1);
+
+		// 需要在render pass之外录制，frameIndex为当前帧的slot，它的fence必须已经等待过
+		void BeginFrame(VkCommandBuffer commandBuffer, int32 frameIndex);
+
+		void BeginQuery(VkCommandBuffer commandBuffer, int32 id);
+
+		void EndQuery(VkCommandBuffer commandBuffer, int32 id);
+
+		// 自身以及所有父节点都可见
+		bool IsVisible(int32 id) const;
+
+		// 父节点可见时才需要测试
+		bool NeedsQuery(int32 id) const;
+
+		// 只使用自身的结果，父节点的结果需要CPU端处理
+		void BeginConditionalRendering(VkCommandBuffer commandBuffer, int32 id);
+
+		void EndConditionalRendering(VkCommandBuffer commandBuffer);
+
+		inline bool IsConditionalRenderingSupported() const
+		{
+			return m_CmdBeginConditionalRendering != nullptr;
+		}
+
+		// 采样数不超过阈值时认为被遮挡，非precise的query只有0和非0
+		inline void SetSampleThreshold(uint64 threshold)
+		{
+			m_SampleThreshold = threshold;
+		}
+
+		inline int32 GetNumQueries() const
+		{
+			return m_Parents.size();
+		}
+
+		inline int32 GetLatency() const
+		{
+			return m_FramesInFlight;
+		}
+
+		inline uint64 GetSamples(int32 id) const
+		{
+			return m_Samples[id];
+		}
+
+		// 上一次读取的统计，missing为已经发出但还没有结果的query
+		inline int32 GetNumOccluded() const
+		{
+			return m_NumOccluded;
+		}
+
+		inline int32 GetNumMissing() const
+		{
+			return m_NumMissing;
+		}
+
+	private:
+
+		std::shared_ptr<VulkanDevice>	m_VulkanDevice = nullptr;
+		VkDevice						m_Device = VK_NULL_HANDLE;
+
+		std::vector<VkQueryPool>		m_QueryPools;
+		std::vector<bool>				m_Issued;
+		DVKBuffer*						m_ConditionBuffer = nullptr;
+
+		PFN_vkCmdBeginConditionalRenderingEXT	m_CmdBeginConditionalRendering = nullptr;
+		PFN_vkCmdEndConditionalRenderingEXT		m_CmdEndConditionalRendering = nullptr;
+
+		int32							m_MaxQueries = 0;
+		int32							m_FramesInFlight = 1;
+		int32							m_FrameIndex = 0;
+		bool							m_Precise = false;
+		uint64							m_SampleThreshold = 0;
+
+		std::vector<int32>				m_Parents;
+		std::vector<bool>				m_Visible;
+		std::vector<uint64>				m_Samples;
+		std::vector<uint64>				m_ReadBack;
+
+		int32							m_NumOccluded = 0;
+		int32							m_NumMissing = 0;
+	};
+
+};
@@ -1,8 +1,29 @@
 ﻿#include "DVKPipeline.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 namespace vk_demo
 {
 
+	std::atomic<uint64> DVKPipelineStats::createMicroseconds(0);
+	std::atomic<uint32> DVKPipelineStats::createCount(0);
+
+	void DVKPipelineStats::AddCreateTime(double seconds)
+	{
+		createMicroseconds += (uint64)(seconds * 1000000.0);
+		createCount += 1;
+	}
+
+	double DVKPipelineStats::GetCreateTime()
+	{
+		return createMicroseconds.load() / 1000.0;
+	}
+
+	uint32 DVKPipelineStats::GetCreateCount()
+	{
+		return createCount.load();
+	}
+
 	DVKGfxPipeline* DVKGfxPipeline::Create(
 		std::shared_ptr<VulkanDevice> vulkanDevice,
 		VkPipelineCache pipelineCache,
@@ -73,7 +94,9 @@ namespace vk_demo
 			pipelineCreateInfo.pTessellationState = &(pipelineInfo.tessellationState);
 		}
 
+		double beginTime = GenericPlatformTime::Seconds();
 		VERIFYVULKANRESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, VULKAN_CPU_ALLOCATOR, &(pipeline->pipeline)));
+		DVKPipelineStats::AddCreateTime(GenericPlatformTime::Seconds() - beginTime);
 		
 		return pipeline;
 	}
@@ -13,10 +13,27 @@
 #include <cstring>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 namespace vk_demo
 {
 
+	// vkCreate*Pipelines的累计耗时，用来对比PipelineCache冷启动和热启动。
+	class DVKPipelineStats
+	{
+	public:
+		static void AddCreateTime(double seconds);
+
+		// 单位毫秒
+		static double GetCreateTime();
+
+		static uint32 GetCreateCount();
+
+	private:
+		static std::atomic<uint64> createMicroseconds;
+		static std::atomic<uint32> createCount;
+	};
+
 	struct DVKGfxPipelineInfo
 	{
 		VkPipelineInputAssemblyStateCreateInfo		inputAssemblyState;
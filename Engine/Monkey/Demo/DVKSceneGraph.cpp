@@ -0,0 +1,413 @@
+﻿#include "DVKSceneGraph.h"
+#include "DVKGPUCulling.h"
+
+#include "Math/VectorRegister.h"
+
+#include <unordered_map>
+
+#define SCENE_LEAF_SIZE		4		// 和一组包围盒的数量一致
+#define SCENE_STACK_SIZE	128
+#define SCENE_ALL_PLANES	0x3F
+
+namespace vk_demo
+{
+	// 返回仍需测试的平面，完全在某个平面外返回-1。完全在平面内侧的不再传给子节点
+	static FORCEINLINE int32 TestNode(const DVKBVHNode& node, const Vector4* planes, int32 planeMask)
+	{
+		for (int32 i = 0; i < 6; ++i)
+		{
+			if ((planeMask & (1 << i)) == 0) {
+				continue;
+			}
+
+			const Vector4& plane = planes[i];
+
+			// 沿法线方向最远和最近的角点
+			float farthest = 
+				plane.x * (plane.x >= 0.0f ? node.max.x : node.min.x) + 
+				plane.y * (plane.y >= 0.0f ? node.max.y : node.min.y) + 
+				plane.z * (plane.z >= 0.0f ? node.max.z : node.min.z) + plane.w;
+			if (farthest < 0.0f) {
+				return -1;
+			}
+
+			float nearest = 
+				plane.x * (plane.x >= 0.0f ? node.min.x : node.max.x) + 
+				plane.y * (plane.y >= 0.0f ? node.min.y : node.max.y) + 
+				plane.z * (plane.z >= 0.0f ? node.min.z : node.max.z) + plane.w;
+			if (nearest >= 0.0f) {
+				planeMask &= ~(1 << i);
+			}
+		}
+
+		return planeMask;
+	}
+
+	// 一组4个包围盒对planeMask里的平面，返回可见的lane掩码
+	static FORCEINLINE int32 TestBlock(const float* block, const Vector4* planes, int32 planeMask)
+	{
+		const VectorRegister minX = VectorLoad(block + 0);
+		const VectorRegister minY = VectorLoad(block + 4);
+		const VectorRegister minZ = VectorLoad(block + 8);
+		const VectorRegister maxX = VectorLoad(block + 12);
+		const VectorRegister maxY = VectorLoad(block + 16);
+		const VectorRegister maxZ = VectorLoad(block + 20);
+		const VectorRegister zero = VectorZero();
+
+		VectorRegister outside = zero;
+		for (int32 i = 0; i < 6; ++i)
+		{
+			if ((planeMask & (1 << i)) == 0) {
+				continue;
+			}
+
+			// 平面的法线对4个包围盒相同，最远的角点只需要按法线的符号选min或max
+			const Vector4& plane = planes[i];
+			VectorRegister dist = VectorSetFloat1(plane.w);
+			dist = VectorAdd(dist, VectorMultiply(VectorSetFloat1(plane.x), plane.x >= 0.0f ? maxX : minX));
+			dist = VectorAdd(dist, VectorMultiply(VectorSetFloat1(plane.y), plane.y >= 0.0f ? maxY : minY));
+			dist = VectorAdd(dist, VectorMultiply(VectorSetFloat1(plane.z), plane.z >= 0.0f ? maxZ : minZ));
+			outside = VectorBitwiseOr(outside, VectorCompareLT(dist, zero));
+		}
+
+		return ~VectorMaskBits(outside) & 0xF;
+	}
+
+	DVKSceneGraph* DVKSceneGraph::Create(DVKModel* model)
+	{
+		std::unordered_map<DVKNode*, int32> nodeIndices;
+		for (int32 i = 0; i < model->linearNodes.size(); ++i) {
+			nodeIndices.insert(std::make_pair(model->linearNodes[i], i));
+		}
+
+		DVKSceneGraph* sceneGraph = new DVKSceneGraph();
+		sceneGraph->m_Model = model;
+		sceneGraph->m_Nodes = model->linearNodes;
+		sceneGraph->m_Parents.resize(model->linearNodes.size());
+		sceneGraph->m_GlobalMatrices.resize(model->linearNodes.size());
+		sceneGraph->m_Dirty.resize(model->linearNodes.size(), 1);
+		sceneGraph->m_AnyDirty = true;
+
+		for (int32 i = 0; i < model->linearNodes.size(); ++i)
+		{
+			DVKNode* parent = model->linearNodes[i]->parent;
+			sceneGraph->m_Parents[i] = parent ? nodeIndices[parent] : -1;
+			if (sceneGraph->m_Parents[i] >= i) 
+			{
+				MLOGE("Node %s is not in topological order.", model->linearNodes[i]->name.c_str());
+				delete sceneGraph;
+				return nullptr;
+			}
+		}
+
+		const int32 numMeshes = model->meshes.size();
+		sceneGraph->m_MeshNodes.resize(numMeshes);
+		sceneGraph->m_LocalCenters.resize(numMeshes);
+		sceneGraph->m_LocalExtents.resize(numMeshes);
+		sceneGraph->m_MeshSlots.resize(numMeshes, -1);
+		sceneGraph->m_Identity.SetIdentity();
+
+		for (int32 i = 0; i < numMeshes; ++i)
+		{
+			const DVKMesh* mesh = model->meshes[i];
+			auto it = nodeIndices.find(mesh->linkNode);
+			sceneGraph->m_MeshNodes[i] = it != nodeIndices.end() ? it->second : -1;
+
+			// 没有顶点的mesh当作一个点
+			const DVKBoundingBox& bounds = mesh->bounding;
+			if (bounds.min.x <= bounds.max.x && bounds.min.y <= bounds.max.y && bounds.min.z <= bounds.max.z)
+			{
+				sceneGraph->m_LocalCenters[i] = (bounds.min + bounds.max) * 0.5f;
+				sceneGraph->m_LocalExtents[i] = (bounds.max - bounds.min) * 0.5f;
+			}
+			else
+			{
+				sceneGraph->m_LocalCenters[i] = Vector3(0, 0, 0);
+				sceneGraph->m_LocalExtents[i] = Vector3(0, 0, 0);
+			}
+		}
+
+		sceneGraph->Update();
+		sceneGraph->Rebuild();
+
+		return sceneGraph;
+	}
+
+	void DVKSceneGraph::SetLocalMatrix(int32 nodeIndex, const Matrix4x4& matrix)
+	{
+		m_Nodes[nodeIndex]->localMatrix = matrix;
+		MarkDirty(nodeIndex);
+	}
+
+	void DVKSceneGraph::MarkDirty(int32 nodeIndex)
+	{
+		m_Dirty[nodeIndex] = 1;
+		m_AnyDirty = true;
+	}
+
+	void DVKSceneGraph::MarkAllDirty()
+	{
+		std::fill(m_Dirty.begin(), m_Dirty.end(), 1);
+		m_AnyDirty = true;
+	}
+
+	int32 DVKSceneGraph::Update()
+	{
+		if (!m_AnyDirty) {
+			return 0;
+		}
+
+		// 父节点一定在前面，脏标记顺着一次遍历传给所有子孙节点
+		int32 numUpdated = 0;
+		for (int32 i = 0; i < m_Nodes.size(); ++i)
+		{
+			const int32 parent = m_Parents[i];
+			if (parent >= 0 && m_Dirty[parent]) {
+				m_Dirty[i] = 1;
+			}
+
+			if (!m_Dirty[i]) {
+				continue;
+			}
+
+			m_GlobalMatrices[i] = m_Nodes[i]->localMatrix;
+			if (parent >= 0) {
+				m_GlobalMatrices[i].Append(m_GlobalMatrices[parent]);
+			}
+			m_Nodes[i]->globalMatrix = m_GlobalMatrices[i];
+
+			numUpdated += 1;
+		}
+
+		for (int32 i = 0; i < m_MeshNodes.size(); ++i)
+		{
+			if (m_MeshNodes[i] >= 0 && m_Dirty[m_MeshNodes[i]]) {
+				UpdateMeshBounds(i);
+			}
+		}
+
+		std::fill(m_Dirty.begin(), m_Dirty.end(), 0);
+		m_AnyDirty = false;
+
+		Refit();
+
+		return numUpdated;
+	}
+
+	const Matrix4x4& DVKSceneGraph::GetMeshMatrix(int32 meshIndex) const
+	{
+		const int32 node = m_MeshNodes[meshIndex];
+		return node >= 0 ? m_GlobalMatrices[node] : m_Identity;
+	}
+
+	void DVKSceneGraph::GetWorldBounds(int32 meshIndex, Vector3& outMin, Vector3& outMax) const
+	{
+		// 行向量，world[j] = sum(local[i] * m[i][j])，半长取绝对值之后就是8个角点的AABB
+		const Matrix4x4& matrix = GetMeshMatrix(meshIndex);
+		const Vector3& extent   = m_LocalExtents[meshIndex];
+		const Vector3 center    = matrix.TransformPosition(m_LocalCenters[meshIndex]);
+
+		Vector3 worldExtent;
+		for (int32 j = 0; j < 3; ++j)
+		{
+			worldExtent[j] = 
+				MMath::Abs(matrix.m[0][j]) * extent.x + 
+				MMath::Abs(matrix.m[1][j]) * extent.y + 
+				MMath::Abs(matrix.m[2][j]) * extent.z;
+		}
+
+		outMin = center - worldExtent;
+		outMax = center + worldExtent;
+	}
+
+	void DVKSceneGraph::UpdateMeshBounds(int32 meshIndex)
+	{
+		const int32 slot = m_MeshSlots[meshIndex];
+		if (slot < 0) {
+			return;
+		}
+
+		Vector3 worldMin;
+		Vector3 worldMax;
+		GetWorldBounds(meshIndex, worldMin, worldMax);
+
+		float* block = &m_Bounds[(slot >> 2) * BlockFloats];
+		const int32 lane = slot & 3;
+		block[0  + lane] = worldMin.x;
+		block[4  + lane] = worldMin.y;
+		block[8  + lane] = worldMin.z;
+		block[12 + lane] = worldMax.x;
+		block[16 + lane] = worldMax.y;
+		block[20 + lane] = worldMax.z;
+	}
+
+	void DVKSceneGraph::Rebuild()
+	{
+		const int32 numMeshes = m_MeshNodes.size();
+
+		std::vector<Vector3> mins(numMeshes);
+		std::vector<Vector3> maxs(numMeshes);
+		for (int32 i = 0; i < numMeshes; ++i) {
+			GetWorldBounds(i, mins[i], maxs[i]);
+		}
+
+		std::vector<int32> order;
+		BuildBVHNodes(mins.data(), maxs.data(), numMeshes, SCENE_LEAF_SIZE, m_BVHNodes, order);
+
+		// 每个叶子单独一组，补齐的位置永远测试失败
+		m_Bounds.clear();
+		m_SlotMeshes.clear();
+		std::fill(m_MeshSlots.begin(), m_MeshSlots.end(), -1);
+
+		for (int32 i = 0; i < m_BVHNodes.size(); ++i)
+		{
+			DVKBVHNode& node = m_BVHNodes[i];
+			if (!node.IsLeaf()) {
+				continue;
+			}
+
+			const int32 block = m_SlotMeshes.size() / 4;
+			m_SlotMeshes.resize(m_SlotMeshes.size() + 4, -1);
+			m_Bounds.resize(m_Bounds.size() + BlockFloats);
+
+			float* data = &m_Bounds[block * BlockFloats];
+			for (int32 lane = 0; lane < 4; ++lane)
+			{
+				data[0  + lane] = data[4  + lane] = data[8  + lane] =  MAX_flt;
+				data[12 + lane] = data[16 + lane] = data[20 + lane] = -MAX_flt;
+			}
+
+			for (int32 lane = 0; lane < node.count; ++lane)
+			{
+				const int32 mesh = order[node.leftFirst + lane];
+				m_SlotMeshes[block * 4 + lane] = mesh;
+				m_MeshSlots[mesh] = block * 4 + lane;
+				UpdateMeshBounds(mesh);
+			}
+
+			node.leftFirst = block;
+		}
+	}
+
+	void DVKSceneGraph::Refit()
+	{
+		// 子节点总是在父节点之后分配，倒序遍历即可自底向上
+		for (int32 i = (int32)m_BVHNodes.size() - 1; i >= 0; --i)
+		{
+			DVKBVHNode& node = m_BVHNodes[i];
+			if (node.IsLeaf())
+			{
+				// 补齐的位置不影响结果
+				const float* block = &m_Bounds[node.leftFirst * BlockFloats];
+				node.min = Vector3( MAX_flt,  MAX_flt,  MAX_flt);
+				node.max = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+				for (int32 lane = 0; lane < 4; ++lane)
+				{
+					node.min = Vector3::Min(node.min, Vector3(block[0  + lane], block[4  + lane], block[8  + lane]));
+					node.max = Vector3::Max(node.max, Vector3(block[12 + lane], block[16 + lane], block[20 + lane]));
+				}
+			}
+			else
+			{
+				const DVKBVHNode& left  = m_BVHNodes[node.leftFirst];
+				const DVKBVHNode& right = m_BVHNodes[node.leftFirst + 1];
+				node.min = Vector3::Min(left.min, right.min);
+				node.max = Vector3::Max(left.max, right.max);
+			}
+		}
+	}
+
+	void DVKSceneGraph::AppendSubtree(int32 bvhIndex, std::vector<int32>& outVisible) const
+	{
+		int32 stack[SCENE_STACK_SIZE];
+		int32 stackSize = 0;
+		stack[stackSize++] = bvhIndex;
+
+		while (stackSize > 0)
+		{
+			const DVKBVHNode& node = m_BVHNodes[stack[--stackSize]];
+			if (node.IsLeaf()) {
+				AppendBlock(node.leftFirst, (1 << node.count) - 1, outVisible);
+			}
+			else
+			{
+				stack[stackSize++] = node.leftFirst + 1;
+				stack[stackSize++] = node.leftFirst;
+			}
+		}
+	}
+
+	void DVKSceneGraph::Cull(const Matrix4x4& viewProjection, std::vector<int32>& outVisible) const
+	{
+		outVisible.clear();
+
+		if (m_BVHNodes.size() == 0) {
+			return;
+		}
+
+		Vector4 planes[6];
+		DVKGPUCulling::ExtractFrustumPlanes(viewProjection, planes);
+
+		struct StackEntry
+		{
+			int32	node;
+			int32	planeMask;
+		};
+
+		StackEntry stack[SCENE_STACK_SIZE];
+		int32 stackSize = 0;
+		stack[stackSize].node      = 0;
+		stack[stackSize].planeMask = SCENE_ALL_PLANES;
+		stackSize += 1;
+
+		while (stackSize > 0)
+		{
+			stackSize -= 1;
+			const int32 nodeIndex  = stack[stackSize].node;
+			const DVKBVHNode& node = m_BVHNodes[nodeIndex];
+
+			const int32 planeMask = TestNode(node, planes, stack[stackSize].planeMask);
+			if (planeMask < 0) {
+				continue;
+			}
+
+			// 整个子树都在视锥内
+			if (planeMask == 0) 
+			{
+				AppendSubtree(nodeIndex, outVisible);
+				continue;
+			}
+
+			if (node.IsLeaf()) 
+			{
+				AppendBlock(node.leftFirst, TestBlock(&m_Bounds[node.leftFirst * BlockFloats], planes, planeMask), outVisible);
+				continue;
+			}
+
+			stack[stackSize].node      = node.leftFirst + 1;
+			stack[stackSize].planeMask = planeMask;
+			stackSize += 1;
+			stack[stackSize].node      = node.leftFirst;
+			stack[stackSize].planeMask = planeMask;
+			stackSize += 1;
+		}
+	}
+
+	void DVKSceneGraph::CullLinear(const Matrix4x4& viewProjection, std::vector<int32>& outVisible) const
+	{
+		outVisible.clear();
+
+		Vector4 planes[6];
+		DVKGPUCulling::ExtractFrustumPlanes(viewProjection, planes);
+
+		const int32 numBlocks = m_SlotMeshes.size() / 4;
+		for (int32 block = 0; block < numBlocks; ++block)
+		{
+			const int32 laneMask = TestBlock(&m_Bounds[block * BlockFloats], planes, SCENE_ALL_PLANES);
+			if (laneMask) {
+				AppendBlock(block, laneMask, outVisible);
+			}
+		}
+	}
+
+};
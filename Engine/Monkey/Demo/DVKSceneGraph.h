@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include "DVKModel.h"
+#include "DVKBVH.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+	/**
+	 * Flattened scene for CPU culling of a DVKModel's meshes. The nodes are kept in linearNodes
+	 * order with contiguous global matrices; SetLocalMatrix/MarkDirty flag a node and Update()
+	 * recomputes the flagged nodes and their descendants in one forward pass, then the world
+	 * bounds of the affected meshes and refits the BVH.
+	 * World bounds are SoA blocks of 4 meshes (minX[4] minY[4] minZ[4] maxX[4] maxY[4] maxZ[4]),
+	 * every BVH leaf owns one block, so a leaf is tested against the frustum planes with one SIMD
+	 * pass. Outputs are indices into DVKModel::meshes. The model has to outlive the scene graph.
+	 */
+	class DVKSceneGraph
+	{
+	public:
+		~DVKSceneGraph()
+		{
+
+		}
+
+		// 模型加载完成后调用，节点顺序为linearNodes
+		static DVKSceneGraph* Create(DVKModel* model);
+
+		// 同时写入DVKNode::localMatrix
+		void SetLocalMatrix(int32 nodeIndex, const Matrix4x4& matrix);
+
+		// 直接修改了DVKNode::localMatrix之后调用，例如动画更新之后
+		void MarkDirty(int32 nodeIndex);
+
+		void MarkAllDirty();
+
+		// 更新脏节点的global矩阵和mesh的包围盒，返回更新的节点数量
+		int32 Update();
+
+		// 用当前的包围盒重新构建BVH，场景变化很大导致refit之后的树质量变差时调用
+		void Rebuild();
+
+		// 遍历BVH，完全在视锥内的子树不再测试。outVisible按BVH的顺序
+		void Cull(const Matrix4x4& viewProjection, std::vector<int32>& outVisible) const;
+
+		// 不使用BVH，顺序测试所有的包围盒，用来对比
+		void CullLinear(const Matrix4x4& viewProjection, std::vector<int32>& outVisible) const;
+
+		// 世界空间的包围盒，对所有角点变换之后的结果
+		void GetWorldBounds(int32 meshIndex, Vector3& outMin, Vector3& outMax) const;
+
+		// linkNode的global矩阵，没有linkNode时为单位矩阵
+		const Matrix4x4& GetMeshMatrix(int32 meshIndex) const;
+
+		inline const Matrix4x4& GetGlobalMatrix(int32 nodeIndex) const
+		{
+			return m_GlobalMatrices[nodeIndex];
+		}
+
+		inline int32 GetNumNodes() const
+		{
+			return m_Nodes.size();
+		}
+
+		inline int32 GetNumMeshes() const
+		{
+			return m_MeshNodes.size();
+		}
+
+		inline int32 GetNumBVHNodes() const
+		{
+			return m_BVHNodes.size();
+		}
+
+	private:
+		DVKSceneGraph()
+		{
+
+		}
+
+		// 所有角点变换之后的AABB，和对中心、半长变换的结果相同
+		void UpdateMeshBounds(int32 meshIndex);
+
+		void Refit();
+
+		void AppendSubtree(int32 bvhIndex, std::vector<int32>& outVisible) const;
+
+		inline void AppendBlock(int32 block, int32 laneMask, std::vector<int32>& outVisible) const
+		{
+			for (int32 lane = 0; lane < 4; ++lane)
+			{
+				// planeMask为0时补齐的位置也会通过
+				if ((laneMask & (1 << lane)) && m_SlotMeshes[block * 4 + lane] >= 0) {
+					outVisible.push_back(m_SlotMeshes[block * 4 + lane]);
+				}
+			}
+		}
+
+	private:
+		enum { BlockFloats = 24 };
+
+		DVKModel*					m_Model = nullptr;
+
+		std::vector<DVKNode*>		m_Nodes;
+		std::vector<int32>			m_Parents;
+		std::vector<Matrix4x4>		m_GlobalMatrices;
+		std::vector<uint8>			m_Dirty;
+		bool						m_AnyDirty = false;
+
+		// 和DVKModel::meshes一一对应，node为-1时使用m_Identity
+		std::vector<int32>			m_MeshNodes;
+		std::vector<Vector3>		m_LocalCenters;
+		std::vector<Vector3>		m_LocalExtents;
+		std::vector<int32>			m_MeshSlots;
+		Matrix4x4					m_Identity;
+
+		// 4个一组的世界空间包围盒，补齐的位置min为MAX_flt、max为-MAX_flt，任何平面都测试失败
+		std::vector<float>			m_Bounds;
+		std::vector<int32>			m_SlotMeshes;	// 补齐的位置为-1
+
+		// 叶子的leftFirst为m_Bounds里的组序号
+		std::vector<DVKBVHNode>		m_BVHNodes;
+	};
+
+};
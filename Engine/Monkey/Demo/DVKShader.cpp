@@ -8,9 +8,9 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint8* dataPtr  = nullptr;
-        uint32 dataSize = 0;
-        if (!FileManager::ReadFile(filename, dataPtr, dataSize))
+		// 映射的数据按页对齐，满足pCode的4字节对齐要求，反射也直接读映射的数据。
+		FileViewRef view = FileManager::MapFile(filename);
+		if (!view)
 		{
 			MLOGE("Failed load file:%s", filename);
 			return nullptr;
@@ -18,15 +18,16 @@ namespace vk_demo
         
         VkShaderModuleCreateInfo moduleCreateInfo;
         ZeroVulkanStruct(moduleCreateInfo, VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO);
-        moduleCreateInfo.codeSize = dataSize;
-        moduleCreateInfo.pCode    = (uint32_t*)dataPtr;
+        moduleCreateInfo.codeSize = view->GetSize();
+        moduleCreateInfo.pCode    = (const uint32_t*)view->GetData();
         
         VkShaderModule shaderModule = VK_NULL_HANDLE;
         VERIFYVULKANRESULT(vkCreateShaderModule(device, &moduleCreateInfo, VULKAN_CPU_ALLOCATOR, &shaderModule));
 
 		DVKShaderModule* dvkModule = new DVKShaderModule();
-		dvkModule->data   = dataPtr;
-		dvkModule->size   = dataSize;
+		dvkModule->view   = view;
+		dvkModule->data   = view->GetData();
+		dvkModule->size   = view->GetSize();
 		dvkModule->device = device;
 		dvkModule->handle = shaderModule;
 		dvkModule->stage  = stage;
@@ -327,7 +328,7 @@ namespace vk_demo
 		shaderStageCreateInfos.push_back(shaderCreateInfo);
 
 		// 反编译Shader获取相关信息
-		spirv_cross::Compiler compiler((uint32*)shaderModule->data, shaderModule->size / sizeof(uint32));
+		spirv_cross::Compiler compiler((const uint32*)shaderModule->data, shaderModule->size / sizeof(uint32));
 		spirv_cross::ShaderResources resources = compiler.get_shader_resources();
 		
         ProcessAttachments(compiler, resources, shaderModule->stage);
@@ -305,12 +305,6 @@ namespace vk_demo
 				vkDestroyShaderModule(device, handle, VULKAN_CPU_ALLOCATOR);
 				handle = VK_NULL_HANDLE;
 			}
-			
-			if (data) 
-			{
-				delete[] data;
-				data = nullptr;
-			}
 		}
 
 		static DVKShaderModule* Create(std::shared_ptr<VulkanDevice> vulkanDevice, const char* filename, VkShaderStageFlagBits stage);
@@ -320,7 +314,8 @@ namespace vk_demo
 		VkDevice				device;
 		VkShaderStageFlagBits	stage;
 		VkShaderModule			handle;
-		uint8*					data;
+		FileViewRef				view;
+		const uint8*			data;
 		uint32					size;
 	};
 
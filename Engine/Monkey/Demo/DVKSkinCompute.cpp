@@ -0,0 +1,261 @@
+﻿#include "DVKSkinCompute.h"
+#include "DVKUploadQueue.h"
+
+#define SKIN_GROUP_SIZE 64
+
+namespace vk_demo
+{
+	DVKSkinCompute::~DVKSkinCompute()
+	{
+		delete m_Compute;
+		m_Compute = nullptr;
+
+		delete m_SkinVertices;
+		m_SkinVertices = nullptr;
+
+		delete m_Palettes;
+		m_Palettes = nullptr;
+
+		delete m_Output;
+		m_Output = nullptr;
+
+		m_Model = nullptr;
+		m_VulkanDevice = nullptr;
+	}
+
+	bool DVKSkinCompute::LoadVertices(std::vector<SkinVertex>& outVertices)
+	{
+		int32 positionOffset = -1;
+		int32 normalOffset   = -1;
+		int32 offset = 0;
+		for (int32 i = 0; i < m_Model->attributes.size(); ++i)
+		{
+			if (m_Model->attributes[i] == VertexAttribute::VA_Position) {
+				positionOffset = offset;
+			}
+			else if (m_Model->attributes[i] == VertexAttribute::VA_Normal) {
+				normalOffset = offset;
+			}
+			offset += VertexAttributeToSize(m_Model->attributes[i]) / sizeof(float);
+		}
+
+		if (positionOffset < 0) 
+		{
+			MLOGE("Skin compute needs VA_Position.");
+			return false;
+		}
+
+		std::vector<DVKVertexSkin> skins;
+		for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+		{
+			DVKMesh* mesh = m_Model->meshes[i];
+
+			skins.clear();
+			if (!m_Model->LoadVertexSkins(mesh, skins)) 
+			{
+				MLOG("Mesh %d has no skin data, skipped by skin compute.", i);
+				continue;
+			}
+
+			int32 skinIndex = 0;
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = mesh->primitives[j];
+				if (primitive->vertexCount == 0) {
+					continue;
+				}
+
+				// 没有index buffer的primitive也要跳过它的skin数据
+				if (primitive->indexBuffer == nullptr) 
+				{
+					skinIndex += primitive->vertexCount;
+					continue;
+				}
+
+				DrawInfo drawInfo;
+				drawInfo.primitive    = primitive;
+				drawInfo.mesh         = i;
+				drawInfo.vertexOffset = outVertices.size();
+				m_Draws.push_back(drawInfo);
+
+				const int32 stride = primitive->vertices.size() / primitive->vertexCount;
+				for (int32 v = 0; v < primitive->vertexCount; ++v)
+				{
+					const float* vertex = &primitive->vertices[v * stride];
+					const DVKVertexSkin& skin = skins[skinIndex++];
+
+					SkinVertex skinVertex = {};
+					skinVertex.position[0] = vertex[positionOffset + 0];
+					skinVertex.position[1] = vertex[positionOffset + 1];
+					skinVertex.position[2] = vertex[positionOffset + 2];
+					skinVertex.position[3] = 1.0f;
+
+					if (normalOffset >= 0)
+					{
+						skinVertex.normal[0] = vertex[normalOffset + 0];
+						skinVertex.normal[1] = vertex[normalOffset + 1];
+						skinVertex.normal[2] = vertex[normalOffset + 2];
+					}
+					else
+					{
+						skinVertex.normal[2] = 1.0f;
+					}
+
+					// 换成模型的骨骼序号，所有mesh共用一份骨骼数据
+					// 打包的权重有量化误差，重新归一化
+					float weightSum = skin.weights[0] + skin.weights[1] + skin.weights[2] + skin.weights[3];
+					float weightScale = weightSum > 0.0f ? 1.0f / weightSum : 0.0f;
+					for (int32 k = 0; k < 4; ++k)
+					{
+						skinVertex.weights[k] = skin.weights[k] * weightScale;
+						skinVertex.indices[k] = mesh->bones[skin.indices[k]];
+					}
+
+					outVertices.push_back(skinVertex);
+				}
+			}
+		}
+
+		return outVertices.size() > 0;
+	}
+
+	DVKSkinCompute* DVKSkinCompute::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkPipelineCache pipelineCache, DVKShader* shader, DVKModel* model, int32 maxInstances, int32 framesInFlight)
+	{
+		DVKSkinCompute* skinCompute = new DVKSkinCompute();
+		skinCompute->m_VulkanDevice   = vulkanDevice;
+		skinCompute->m_Model          = model;
+		skinCompute->m_MaxInstances   = MMath::Max(maxInstances, 1);
+		skinCompute->m_FramesInFlight = MMath::Max(framesInFlight, 1);
+		skinCompute->m_NumBones       = MMath::Max((int32)model->bones.size(), 1);
+
+		std::vector<SkinVertex> vertices;
+		if (!skinCompute->LoadVertices(vertices))
+		{
+			MLOGE("Model has no skinned vertices.");
+			delete skinCompute;
+			return nullptr;
+		}
+		skinCompute->m_NumVertices = vertices.size();
+
+		// bind pose，只上传一次
+		skinCompute->m_SkinVertices = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertices.size() * sizeof(SkinVertex)
+		);
+
+		DVKUploadQueue* uploadQueue = DVKUploadQueue::Create(vulkanDevice, vertices.size() * sizeof(SkinVertex));
+		uploadQueue->UploadBuffer(skinCompute->m_SkinVertices, vertices.data(), vertices.size() * sizeof(SkinVertex));
+		uploadQueue->Flush();
+		uploadQueue->WaitIdle();
+		delete uploadQueue;
+
+		// 每帧CPU直接写入，一直保持映射
+		uint64 paletteSize = (uint64)skinCompute->m_FramesInFlight * skinCompute->m_MaxInstances * skinCompute->m_NumBones * sizeof(Matrix4x4);
+		skinCompute->m_Palettes = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			paletteSize
+		);
+		skinCompute->m_Palettes->Map();
+
+		uint64 outputSize = (uint64)skinCompute->m_MaxInstances * skinCompute->m_NumVertices * skinCompute->GetOutputStride();
+		skinCompute->m_Output = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			outputSize
+		);
+
+		skinCompute->m_Compute = DVKCompute::Create(vulkanDevice, pipelineCache, shader);
+		skinCompute->m_Compute->SetStorageBuffer("skinData",    skinCompute->m_SkinVertices);
+		skinCompute->m_Compute->SetStorageBuffer("paletteData", skinCompute->m_Palettes);
+		skinCompute->m_Compute->SetStorageBuffer("outData",     skinCompute->m_Output);
+
+		MLOG("Skin compute: %d vertices, %d bones, %d instances, output %.2fMB", skinCompute->m_NumVertices, skinCompute->m_NumBones, skinCompute->m_MaxInstances, outputSize / 1024.0f / 1024.0f);
+
+		return skinCompute;
+	}
+
+	void DVKSkinCompute::UpdateBones(const DVKAnimPose* poses, int32 numInstances, int32 frameIndex)
+	{
+		m_NumInstances = MMath::Clamp(numInstances, 0, m_MaxInstances);
+
+		uint32 paletteBase = (frameIndex % m_FramesInFlight) * m_MaxInstances * m_NumBones;
+		Matrix4x4* palettes = (Matrix4x4*)m_Palettes->mapped + paletteBase;
+
+		for (int32 i = 0; i < m_NumInstances; ++i)
+		{
+			const std::vector<Matrix4x4>& boneMatrices = poses[i].boneMatrices;
+			int32 count = MMath::Min((int32)boneMatrices.size(), m_NumBones);
+			memcpy(palettes + i * m_NumBones, boneMatrices.data(), count * sizeof(Matrix4x4));
+		}
+
+		m_Params.counts[0] = m_NumVertices;
+		m_Params.counts[1] = m_NumInstances;
+		m_Params.counts[2] = m_NumBones;
+		m_Params.counts[3] = paletteBase;
+		m_Compute->SetUniform("param", &m_Params, sizeof(SkinParamBlock));
+	}
+
+	void DVKSkinCompute::Dispatch(VkCommandBuffer commandBuffer)
+	{
+		if (m_NumInstances == 0) {
+			return;
+		}
+
+		VkBufferMemoryBarrier bufferBarrier;
+		ZeroVulkanStruct(bufferBarrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = m_Output->buffer;
+		bufferBarrier.offset = 0;
+		bufferBarrier.size   = m_Output->size;
+
+		// 上一帧的绘制读完之后才能覆盖
+		bufferBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			1, &bufferBarrier,
+			0, nullptr
+		);
+
+		// x方向为顶点，y方向为实例，实例再多也不会超过x方向的group数量限制
+		int32 groupX = (m_NumVertices + SKIN_GROUP_SIZE - 1) / SKIN_GROUP_SIZE;
+		m_Compute->BindDispatch(commandBuffer, groupX, m_NumInstances, 1);
+
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0,
+			0, nullptr,
+			1, &bufferBarrier,
+			0, nullptr
+		);
+	}
+
+	void DVKSkinCompute::BindDrawCmd(VkCommandBuffer commandBuffer, int32 instance)
+	{
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(m_Output->buffer), &offset);
+
+		int32 instanceBase = instance * m_NumVertices;
+		for (int32 i = 0; i < m_Draws.size(); ++i)
+		{
+			DVKIndexBuffer* indexBuffer = m_Draws[i].primitive->indexBuffer;
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->dvkBuffer->buffer, 0, indexBuffer->indexType);
+			vkCmdDrawIndexed(commandBuffer, indexBuffer->indexCount, 1, 0, instanceBase + m_Draws[i].vertexOffset, 0);
+		}
+	}
+
+};
@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include "DVKModel.h"
+#include "DVKCompute.h"
+#include "DVKShader.h"
+#include "DVKBuffer.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Matrix4x4.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+	/**
+	 * Compute shader skinning for many instances of one DVKModel. The bind pose positions, normals
+	 * and skin weights of every skinned primitive are uploaded once. Every frame UpdateBones() copies
+	 * the bone palettes of all instances and Dispatch() skins every instance into one output buffer,
+	 * position + normal in the model's root space, 6 floats per vertex. The output is bound as a plain
+	 * vertex buffer, so shadow, depth prepass and shading passes all reuse it instead of skinning again.
+	 *
+	 * The shader is Skinning.comp with the blocks skinData, paletteData, outData and param.
+	 * Meshes without skin data are skipped.
+	 */
+	class DVKSkinCompute
+	{
+	public:
+		// 一个输出primitive，vertexOffset为第0个实例在输出buffer里的起始顶点
+		struct DrawInfo
+		{
+			DVKPrimitive*	primitive = nullptr;
+			int32			mesh = -1;
+			int32			vertexOffset = 0;
+		};
+
+	private:
+		DVKSkinCompute()
+		{
+
+		}
+
+	public:
+		~DVKSkinCompute();
+
+		// framesInFlight份骨骼数据轮流使用，CPU写入时GPU可能还在读上一帧的
+		static DVKSkinCompute* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkPipelineCache pipelineCache, DVKShader* shader, DVKModel* model, int32 maxInstances, int32 framesInFlight);
+
+		// poses的boneMatrices即为每个实例的骨骼矩阵，frameIndex为当前帧的slot
+		void UpdateBones(const DVKAnimPose* poses, int32 numInstances, int32 frameIndex);
+
+		// 需要在render pass之外录制，之后的顶点读取通过barrier等待写入完成
+		void Dispatch(VkCommandBuffer commandBuffer);
+
+		// 绘制一个实例的所有primitive
+		void BindDrawCmd(VkCommandBuffer commandBuffer, int32 instance);
+
+		inline DVKBuffer* GetOutputBuffer() const
+		{
+			return m_Output;
+		}
+
+		inline const std::vector<DrawInfo>& GetDrawInfos() const
+		{
+			return m_Draws;
+		}
+
+		inline int32 GetNumInstances() const
+		{
+			return m_NumInstances;
+		}
+
+		inline int32 GetNumVertices() const
+		{
+			return m_NumVertices;
+		}
+
+		// 一个顶点6个float
+		inline uint32 GetOutputStride() const
+		{
+			return sizeof(float) * 6;
+		}
+
+	private:
+
+		// 和Skinning.comp的SkinVertex一致，std430
+		struct SkinVertex
+		{
+			float	position[4];
+			float	normal[4];
+			float	weights[4];
+			uint32	indices[4];
+		};
+
+		// x: 每个实例的顶点数 y: 实例数 z: 骨骼数 w: 本帧骨骼数据的起始矩阵
+		struct SkinParamBlock
+		{
+			uint32	counts[4];
+		};
+
+		bool LoadVertices(std::vector<SkinVertex>& outVertices);
+
+	private:
+
+		std::shared_ptr<VulkanDevice>	m_VulkanDevice = nullptr;
+		DVKModel*						m_Model = nullptr;
+		DVKCompute*						m_Compute = nullptr;
+
+		DVKBuffer*						m_SkinVertices = nullptr;
+		DVKBuffer*						m_Palettes = nullptr;
+		DVKBuffer*						m_Output = nullptr;
+
+		std::vector<DrawInfo>			m_Draws;
+
+		int32							m_MaxInstances = 0;
+		int32							m_FramesInFlight = 1;
+		int32							m_NumInstances = 0;
+		int32							m_NumVertices = 0;
+		int32							m_NumBones = 0;
+		SkinParamBlock					m_Params;
+	};
+
+};
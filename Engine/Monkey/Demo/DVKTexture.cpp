@@ -11,22 +11,85 @@ namespace vk_demo
     
 	DVKTexture* DVKTexture::Create2D(const uint8* rgbaData, uint32 size, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
 	{
-        int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
-        VkDevice device = vulkanDevice->GetInstanceHandle();
-        
         DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
         stagingBuffer->Map();
         stagingBuffer->CopyFrom((void*)rgbaData, size);
 		stagingBuffer->UnMap();
+
+		cmdBuffer->Begin();
+
+		DVKTexture* texture = CreateMipmapped2D(stagingBuffer->buffer, 0, cmdBuffer->cmdBuffer, format, width, height, vulkanDevice, imageUsageFlags, imageLayout);
+
+		cmdBuffer->End();
+		cmdBuffer->Submit();
+
+		delete stagingBuffer;
+
+		return texture;
+	}
+
+	DVKTexture* DVKTexture::Create2DArray(const uint8* data, uint32 layerSize, int32 numArray, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
+	{
+		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, layerSize * numArray);
+		stagingBuffer->Map();
+		stagingBuffer->CopyFrom((void*)data, layerSize * numArray);
+		stagingBuffer->UnMap();
+
+		cmdBuffer->Begin();
+
+		DVKTexture* texture = CreateMipmapped2D(stagingBuffer->buffer, 0, cmdBuffer->cmdBuffer, format, width, height, vulkanDevice, imageUsageFlags, imageLayout, numArray, layerSize, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+
+		cmdBuffer->End();
+		cmdBuffer->Submit();
+
+		delete stagingBuffer;
+
+		return texture;
+	}
+
+	DVKTexture* DVKTexture::Create2D(const uint8* rgbaData, uint32 size, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
+	{
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+		uint8* staging = uploadQueue->AllocateStaging(size, stagingBuffer, stagingOffset);
+		memcpy(staging, rgbaData, size);
+
+		return CreateMipmapped2D(stagingBuffer, stagingOffset, uploadQueue->GetCommandBuffer(), format, width, height, vulkanDevice, imageUsageFlags, imageLayout);
+	}
+
+	DVKTexture* DVKTexture::CreateCube(const std::vector<const uint8*>& faces, uint32 faceSize, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, ImageLayoutBarrier imageLayout)
+	{
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+		uint8* staging = uploadQueue->AllocateStaging(faceSize * faces.size(), stagingBuffer, stagingOffset);
+		for (int32 i = 0; i < faces.size(); ++i) {
+			memcpy(staging + faceSize * i, faces[i], faceSize);
+		}
+
+		return CreateMipmapped2D(stagingBuffer, stagingOffset, uploadQueue->GetCommandBuffer(), format, width, height, vulkanDevice, VK_IMAGE_USAGE_SAMPLED_BIT, imageLayout, faces.size(), faceSize, VK_IMAGE_VIEW_TYPE_CUBE);
+	}
+
+	DVKTexture* DVKTexture::Create2DArray(const uint8* data, uint32 layerSize, int32 numArray, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
+	{
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+		uint8* staging = uploadQueue->AllocateStaging(layerSize * numArray, stagingBuffer, stagingOffset);
+		memcpy(staging, data, layerSize * numArray);
+
+		return CreateMipmapped2D(stagingBuffer, stagingOffset, uploadQueue->GetCommandBuffer(), format, width, height, vulkanDevice, imageUsageFlags, imageLayout, numArray, layerSize, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+	}
+
+	DVKTexture* DVKTexture::CreateMipmapped2D(VkBuffer stagingBuffer, VkDeviceSize stagingOffset, VkCommandBuffer cmdBuffer, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout, int32 layerCount, VkDeviceSize layerSize, VkImageViewType viewType)
+	{
+        int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
+        VkDevice device = vulkanDevice->GetInstanceHandle();
         
-        uint32 memoryTypeIndex = 0;
         VkMemoryRequirements memReqs = {};
-        VkMemoryAllocateInfo memAllocInfo;
-        ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
         
         // image info
         VkImage                         image = VK_NULL_HANDLE;
         VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+        VulkanResourceAllocation*       imageAllocation = nullptr;
         VkImageView                     imageView = VK_NULL_HANDLE;
         VkSampler                       imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo           descriptorInfo = {};
@@ -45,50 +108,53 @@ namespace vk_demo
         imageCreateInfo.imageType       = VK_IMAGE_TYPE_2D;
         imageCreateInfo.format          = format;
         imageCreateInfo.mipLevels       = mipLevels;
-        imageCreateInfo.arrayLayers     = 1;
+        imageCreateInfo.arrayLayers     = layerCount;
         imageCreateInfo.samples         = VK_SAMPLE_COUNT_1_BIT;
         imageCreateInfo.tiling          = VK_IMAGE_TILING_OPTIMAL;
         imageCreateInfo.sharingMode     = VK_SHARING_MODE_EXCLUSIVE;
         imageCreateInfo.initialLayout   = VK_IMAGE_LAYOUT_UNDEFINED;
         imageCreateInfo.extent          = { (uint32_t)width, (uint32_t)height, 1 };
         imageCreateInfo.usage           = imageUsageFlags;
+        imageCreateInfo.flags           = viewType == VK_IMAGE_VIEW_TYPE_CUBE ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
         VERIFYVULKANRESULT(vkCreateImage(device, &imageCreateInfo, VULKAN_CPU_ALLOCATOR, &image));
         
         // bind image buffer
         vkGetImageMemoryRequirements(device, image, &memReqs);
-        vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-        memAllocInfo.allocationSize  = memReqs.size;
-        memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-        VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-        VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+        imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+        imageAllocation->AddRef();
+        imageAllocation->BindImage(vulkanDevice.get(), image);
+        imageMemory = imageAllocation->GetHandle();
         
-		// start record
-		cmdBuffer->Begin();
-
         VkImageSubresourceRange subresourceRange = {};
         subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
         subresourceRange.levelCount     = 1;
-        subresourceRange.layerCount     = 1;
+        subresourceRange.layerCount     = layerCount;
 		subresourceRange.baseArrayLayer = 0;
 		subresourceRange.baseMipLevel   = 0;
         
 		// undefined to TransferDest
-		vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, subresourceRange);
+		vk_demo::ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, subresourceRange);
         
-        VkBufferImageCopy bufferCopyRegion = {};
-        bufferCopyRegion.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        bufferCopyRegion.imageSubresource.mipLevel       = 0;
-        bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-        bufferCopyRegion.imageSubresource.layerCount     = 1;
-        bufferCopyRegion.imageExtent.width  = width;
-        bufferCopyRegion.imageExtent.height = height;
-        bufferCopyRegion.imageExtent.depth  = 1;
+		std::vector<VkBufferImageCopy> bufferCopyRegions(layerCount);
+		for (int32 i = 0; i < layerCount; ++i)
+		{
+			VkBufferImageCopy& bufferCopyRegion = bufferCopyRegions[i];
+			bufferCopyRegion = {};
+			bufferCopyRegion.bufferOffset = stagingOffset + layerSize * i;
+			bufferCopyRegion.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel       = 0;
+			bufferCopyRegion.imageSubresource.baseArrayLayer = i;
+			bufferCopyRegion.imageSubresource.layerCount     = 1;
+			bufferCopyRegion.imageExtent.width  = width;
+			bufferCopyRegion.imageExtent.height = height;
+			bufferCopyRegion.imageExtent.depth  = 1;
+		}
         
 		// copy buffer to image
-        vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+        vkCmdCopyBufferToImage(cmdBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyRegions.size(), bufferCopyRegions.data());
         
 		// TransferDest to TransferSrc
-		vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, subresourceRange);
+		vk_demo::ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, subresourceRange);
         
         // Generate the mip chain
         for (uint32_t i = 1; i < mipLevels; i++)
@@ -101,14 +167,14 @@ namespace vk_demo
 			int32 mip1Height = MMath::Max(height >> (i - 0), 1);
 
             imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBlit.srcSubresource.layerCount = 1;
+            imageBlit.srcSubresource.layerCount = layerCount;
             imageBlit.srcSubresource.mipLevel   = i - 1;
             imageBlit.srcOffsets[1].x = int32_t(mip0Width);
             imageBlit.srcOffsets[1].y = int32_t(mip0Height);
             imageBlit.srcOffsets[1].z = 1;
             
             imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBlit.dstSubresource.layerCount = 1;
+            imageBlit.dstSubresource.layerCount = layerCount;
             imageBlit.dstSubresource.mipLevel   = i;
             imageBlit.dstOffsets[1].x = int32_t(mip1Width);
             imageBlit.dstOffsets[1].y = int32_t(mip1Height);
@@ -118,28 +184,23 @@ namespace vk_demo
             mipSubRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
             mipSubRange.baseMipLevel   = i;
             mipSubRange.levelCount     = 1;
-            mipSubRange.layerCount     = 1;
+            mipSubRange.layerCount     = layerCount;
 			mipSubRange.baseArrayLayer = 0;
             
 			// undefined to dst
-			vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, mipSubRange);
+			vk_demo::ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, mipSubRange);
             
 			// blit image
-            vkCmdBlitImage(cmdBuffer->cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+            vkCmdBlitImage(cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
             
 			// dst to src
-			vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, mipSubRange);
+			vk_demo::ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, mipSubRange);
         }
 
 		subresourceRange.levelCount = mipLevels;
 
 		// dst to layout
-		vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferSource, imageLayout, subresourceRange);
-		
-		cmdBuffer->End();
-		cmdBuffer->Submit();
-
-		delete stagingBuffer;
+		vk_demo::ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::TransferSource, imageLayout, subresourceRange);
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -160,11 +221,11 @@ namespace vk_demo
 		VkImageViewCreateInfo viewInfo;
 		ZeroVulkanStruct(viewInfo, VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO);
 		viewInfo.image      = image;
-		viewInfo.viewType   = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.viewType   = viewType;
 		viewInfo.format     = format;
 		viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		viewInfo.subresourceRange.layerCount = 1;
+		viewInfo.subresourceRange.layerCount = layerCount;
 		viewInfo.subresourceRange.levelCount = mipLevels;
 		VERIFYVULKANRESULT(vkCreateImageView(device, &viewInfo, VULKAN_CPU_ALLOCATOR, &imageView));
 
@@ -179,21 +240,21 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
 		texture->width          = width;
 		texture->mipLevels		= mipLevels;
-		texture->layerCount		= 1;
+		texture->layerCount		= layerCount;
 
         return texture;
 	}
 
     DVKTexture* DVKTexture::Create2D(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
     {
-        uint32 dataSize = 0;
-        uint8* dataPtr  = nullptr;
-        if (!FileManager::ReadFile(filename, dataPtr, dataSize)) 
+        FileViewRef view = FileManager::MapFile(filename);
+        if (!view) 
 		{
             MLOGE("Failed load image : %s", filename.c_str());
             return nullptr;
@@ -202,10 +263,9 @@ namespace vk_demo
 		int32 comp   = 0;
         int32 width  = 0;
         int32 height = 0;
-        uint8* rgbaData = StbImage::LoadFromMemory(dataPtr, dataSize, &width, &height, &comp, 4);
+        uint8* rgbaData = StbImage::LoadFromMemory(view->GetData(), view->GetSize(), &width, &height, &comp, 4);
         
-		delete[] dataPtr;
-		dataPtr = nullptr;
+		view.reset();
 
         if (rgbaData == nullptr) 
 		{
@@ -219,6 +279,35 @@ namespace vk_demo
 
 		return texture;
     }
+
+    DVKTexture* DVKTexture::Create2D(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
+    {
+        FileViewRef view = FileManager::MapFile(filename);
+        if (!view) 
+		{
+            MLOGE("Failed load image : %s", filename.c_str());
+            return nullptr;
+        }
+
+		int32 comp   = 0;
+        int32 width  = 0;
+        int32 height = 0;
+        uint8* rgbaData = StbImage::LoadFromMemory(view->GetData(), view->GetSize(), &width, &height, &comp, 4);
+        
+		view.reset();
+
+        if (rgbaData == nullptr) 
+		{
+            MLOGE("Failed load image : %s", filename.c_str());
+            return nullptr;
+        }
+
+        DVKTexture* texture = Create2D(rgbaData, width * height * 4, VK_FORMAT_R8G8B8A8_UNORM, width, height, vulkanDevice, uploadQueue, imageUsageFlags, imageLayout);
+
+		StbImage::Free(rgbaData);
+
+		return texture;
+    }
     
     DVKTexture* DVKTexture::CreateCubeRenderTarget(std::shared_ptr<VulkanDevice> vulkanDevice, VkFormat format, VkImageAspectFlags aspect, int32 width, int32 height, VkImageUsageFlags usage, VkSampleCountFlagBits sampleCount)
     {
@@ -236,14 +325,12 @@ namespace vk_demo
 			mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
 		}
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		// image info
 		VkImage                         image = VK_NULL_HANDLE;
 		VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+		VulkanResourceAllocation*       imageAllocation = nullptr;
 		VkImageView                     imageView = VK_NULL_HANDLE;
 		VkSampler                       imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo           descriptorInfo = {};
@@ -266,11 +353,10 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		imageAllocation->AddRef();
+		imageAllocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = imageAllocation->GetHandle();
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -334,6 +420,7 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -377,16 +464,14 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		int32 mipLevels = 1;
 
 		// image info
 		VkImage                         image = VK_NULL_HANDLE;
 		VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+		VulkanResourceAllocation*       imageAllocation = nullptr;
 		VkImageView                     imageView = VK_NULL_HANDLE;
 		VkSampler                       imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo           descriptorInfo = {};
@@ -408,11 +493,10 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		imageAllocation->AddRef();
+		imageAllocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = imageAllocation->GetHandle();
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -476,6 +560,7 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -490,16 +575,14 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		int32 mipLevels = 1;
 
 		// image info
 		VkImage                         image = VK_NULL_HANDLE;
 		VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+		VulkanResourceAllocation*       imageAllocation = nullptr;
 		VkImageView                     imageView = VK_NULL_HANDLE;
 		VkSampler                       imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo           descriptorInfo = {};
@@ -521,11 +604,10 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		imageAllocation->AddRef();
+		imageAllocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = imageAllocation->GetHandle();
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -589,6 +671,7 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -644,21 +727,19 @@ namespace vk_demo
 		std::vector<ImageInfo> images(filenames.size());
 		for (int32 i = 0; i < filenames.size(); ++i) 
 		{
-			uint32 dataSize = 0;
-			uint8* dataPtr  = nullptr;
-			if (!FileManager::ReadFile(filenames[i], dataPtr, dataSize)) 
+			FileViewRef view = FileManager::MapFile(filenames[i]);
+			if (!view) 
 			{
 				MLOGE("Failed load image : %s", filenames[i].c_str());
 				return nullptr;
 			}
 
 			ImageInfo& imageInfo = images[i];
-			imageInfo.data = (uint8*)StbImage::LoadFloatFromMemory(dataPtr, dataSize, &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
+			imageInfo.data = (uint8*)StbImage::LoadFloatFromMemory(view->GetData(), view->GetSize(), &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
 			imageInfo.comp = 4;
 			imageInfo.size = imageInfo.width * imageInfo.height * imageInfo.comp * 4;
 
-			delete[] dataPtr;
-			dataPtr = nullptr;
+			view.reset();
 
 			if (!imageInfo.data) 
 			{
@@ -675,10 +756,7 @@ namespace vk_demo
 		int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		// 准备stagingBuffer
 		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
@@ -702,6 +780,7 @@ namespace vk_demo
 		// image info
 		VkImage                image = VK_NULL_HANDLE;
 		VkDeviceMemory         imageMemory = VK_NULL_HANDLE;
+		VulkanResourceAllocation*       imageAllocation = nullptr;
 		VkImageView            imageView = VK_NULL_HANDLE;
 		VkSampler              imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo  descriptorInfo = {};
@@ -724,11 +803,10 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		imageAllocation->AddRef();
+		imageAllocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = imageAllocation->GetHandle();
 
 		// start record
 		cmdBuffer->Begin();
@@ -844,6 +922,7 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -869,21 +948,19 @@ namespace vk_demo
 		std::vector<ImageInfo> images(filenames.size());
 		for (int32 i = 0; i < filenames.size(); ++i) 
 		{
-			uint32 dataSize = 0;
-			uint8* dataPtr  = nullptr;
-			if (!FileManager::ReadFile(filenames[i], dataPtr, dataSize)) 
+			FileViewRef view = FileManager::MapFile(filenames[i]);
+			if (!view) 
 			{
 				MLOGE("Failed load image : %s", filenames[i].c_str());
 				return nullptr;
 			}
 
             ImageInfo& imageInfo = images[i];
-			imageInfo.data = StbImage::LoadFromMemory(dataPtr, dataSize, &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
+			imageInfo.data = StbImage::LoadFromMemory(view->GetData(), view->GetSize(), &imageInfo.width, &imageInfo.height, &imageInfo.comp, 4);
 			imageInfo.comp = 4;
             imageInfo.size = imageInfo.width * imageInfo.height * imageInfo.comp;
             
-			delete[] dataPtr;
-			dataPtr = nullptr;
+			view.reset();
 
 			if (!imageInfo.data) 
 			{
@@ -900,10 +977,7 @@ namespace vk_demo
         int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
         VkDevice device = vulkanDevice->GetInstanceHandle();
         
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
         
 		// 准备stagingBuffer
 		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
@@ -927,6 +1001,7 @@ namespace vk_demo
 		// image info
         VkImage                image = VK_NULL_HANDLE;
         VkDeviceMemory         imageMemory = VK_NULL_HANDLE;
+        VulkanResourceAllocation*       imageAllocation = nullptr;
         VkImageView            imageView = VK_NULL_HANDLE;
         VkSampler              imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo  descriptorInfo = {};
@@ -948,11 +1023,10 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		imageAllocation->AddRef();
+		imageAllocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = imageAllocation->GetHandle();
 
 		// start record
 		cmdBuffer->Begin();
@@ -1068,6 +1142,7 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -1078,23 +1153,97 @@ namespace vk_demo
 		return texture;
 	}
     
-	DVKTexture* DVKTexture::Create3D(VkFormat format, const uint8* rgbaData, int32 size, int32 width, int32 height, int32 depth, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, ImageLayoutBarrier imageLayout)
+	DVKTexture* DVKTexture::Create2DArray(const std::vector<std::string> filenames, std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, ImageLayoutBarrier imageLayout)
 	{
-		VkDevice device = vulkanDevice->GetInstanceHandle();
+		int32 width    = 0;
+		int32 height   = 0;
+		int32 numArray = filenames.size();
+		uint8* staging = nullptr;
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+
+		// 逐张解码直接写入staging，尺寸以第一张为准
+		for (int32 i = 0; i < numArray; ++i) 
+		{
+			FileViewRef view = FileManager::MapFile(filenames[i]);
+			if (!view) 
+			{
+				MLOGE("Failed load image : %s", filenames[i].c_str());
+				return nullptr;
+			}
+
+			int32 comp = 0;
+			int32 w    = 0;
+			int32 h    = 0;
+			uint8* rgbaData = StbImage::LoadFromMemory(view->GetData(), view->GetSize(), &w, &h, &comp, 4);
+
+			view.reset();
 
+			if (!rgbaData) 
+			{
+				MLOGE("Failed load image : %s", filenames[i].c_str());
+				return nullptr;
+			}
+
+			if (i == 0) 
+			{
+				width   = w;
+				height  = h;
+				staging = uploadQueue->AllocateStaging(width * height * 4 * numArray, stagingBuffer, stagingOffset);
+			}
+			else if (w != width || h != height) 
+			{
+				MLOGE("Texture array size mismatch : %s", filenames[i].c_str());
+				StbImage::Free(rgbaData);
+				return nullptr;
+			}
+
+			memcpy(staging + width * height * 4 * i, rgbaData, width * height * 4);
+			StbImage::Free(rgbaData);
+		}
+
+		return CreateMipmapped2D(stagingBuffer, stagingOffset, uploadQueue->GetCommandBuffer(), VK_FORMAT_R8G8B8A8_UNORM, width, height, vulkanDevice, VK_IMAGE_USAGE_SAMPLED_BIT, imageLayout, numArray, width * height * 4, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+	}
+    
+	DVKTexture* DVKTexture::Create3D(VkFormat format, const uint8* rgbaData, int32 size, int32 width, int32 height, int32 depth, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, ImageLayoutBarrier imageLayout)
+	{
 		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
         stagingBuffer->Map();
         stagingBuffer->CopyFrom((void*)rgbaData, size);
 		stagingBuffer->UnMap();
+
+		cmdBuffer->Begin();
+
+		DVKTexture* texture = CreateVolume(stagingBuffer->buffer, 0, cmdBuffer->cmdBuffer, format, width, height, depth, vulkanDevice, imageLayout);
+
+		cmdBuffer->End();
+		cmdBuffer->Submit();
+
+		delete stagingBuffer;
+
+		return texture;
+	}
+
+	DVKTexture* DVKTexture::Create3D(VkFormat format, const uint8* rgbaData, int32 size, int32 width, int32 height, int32 depth, std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, ImageLayoutBarrier imageLayout)
+	{
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+		uint8* staging = uploadQueue->AllocateStaging(size, stagingBuffer, stagingOffset);
+		memcpy(staging, rgbaData, size);
+
+		return CreateVolume(stagingBuffer, stagingOffset, uploadQueue->GetCommandBuffer(), format, width, height, depth, vulkanDevice, imageLayout);
+	}
+
+	DVKTexture* DVKTexture::CreateVolume(VkBuffer stagingBuffer, VkDeviceSize stagingOffset, VkCommandBuffer cmdBuffer, VkFormat format, int32 width, int32 height, int32 depth, std::shared_ptr<VulkanDevice> vulkanDevice, ImageLayoutBarrier imageLayout)
+	{
+		VkDevice device = vulkanDevice->GetInstanceHandle();
         
-        uint32 memoryTypeIndex = 0;
         VkMemoryRequirements memReqs = {};
-        VkMemoryAllocateInfo memAllocInfo;
-        ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 		
 		// image info
         VkImage                         image = VK_NULL_HANDLE;
         VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+        VulkanResourceAllocation*       imageAllocation = nullptr;
         VkImageView                     imageView = VK_NULL_HANDLE;
         VkSampler                       imageSampler = VK_NULL_HANDLE;
 		VkDescriptorImageInfo           descriptorInfo = {};
@@ -1118,13 +1267,10 @@ namespace vk_demo
 		
 		// bind image buffer
         vkGetImageMemoryRequirements(device, image, &memReqs);
-        vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-        memAllocInfo.allocationSize  = memReqs.size;
-        memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-        VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-        VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
-        
-        cmdBuffer->Begin();
+        imageAllocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+        imageAllocation->AddRef();
+        imageAllocation->BindImage(vulkanDevice.get(), image);
+        imageMemory = imageAllocation->GetHandle();
         
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1133,9 +1279,10 @@ namespace vk_demo
 		subresourceRange.baseMipLevel   = 0;
 		subresourceRange.baseArrayLayer = 0;
         
-		ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, subresourceRange);
+		ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::Undefined, ImageLayoutBarrier::TransferDest, subresourceRange);
         
 		VkBufferImageCopy bufferCopyRegion = {};
+		bufferCopyRegion.bufferOffset                    = stagingOffset;
 		bufferCopyRegion.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
 		bufferCopyRegion.imageSubresource.mipLevel       = 0;
 		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
@@ -1144,14 +1291,9 @@ namespace vk_demo
 		bufferCopyRegion.imageExtent.height = height;
 		bufferCopyRegion.imageExtent.depth  = depth;
         
-		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+		vkCmdCopyBufferToImage(cmdBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
         
-		ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, imageLayout, subresourceRange);
-		
-		cmdBuffer->End();
-		cmdBuffer->Submit();
-
-		delete stagingBuffer;
+		ImagePipelineBarrier(cmdBuffer, image, ImageLayoutBarrier::TransferDest, imageLayout, subresourceRange);
 		
 		// Create sampler
 		VkSamplerCreateInfo samplerInfo;
@@ -1203,6 +1345,7 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = imageAllocation;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
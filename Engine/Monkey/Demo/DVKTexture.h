@@ -2,6 +2,7 @@
 
 #include "Engine.h"
 #include "DVKCommand.h"
+#include "DVKUploadQueue.h"
 
 #include "Common/Common.h"
 #include "Math/Math.h"
@@ -41,11 +42,12 @@ namespace vk_demo
                 imageSampler = VK_NULL_HANDLE;
             }
             
-            if (imageMemory != VK_NULL_HANDLE) 
+            if (allocation) 
 			{
-                vkFreeMemory(device, imageMemory, VULKAN_CPU_ALLOCATOR);
-                imageMemory = VK_NULL_HANDLE;
+                allocation->Release();
+                allocation = nullptr;
             }
+            imageMemory = VK_NULL_HANDLE;
         }
 
 		void UpdateSampler(
@@ -69,6 +71,19 @@ namespace vk_demo
 			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
 		); 
 
+		// 记录到uploadQueue的当前批次，批次完成之前不能使用
+		static DVKTexture* Create2D(
+			const uint8* rgbaData, 
+			uint32 size, 
+			VkFormat format, 
+			int32 width, 
+			int32 height, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKUploadQueue* uploadQueue, 
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		); 
+
         static DVKTexture* Create2D(
 			const std::string& filename,
 			std::shared_ptr<VulkanDevice> vulkanDevice, 
@@ -76,6 +91,14 @@ namespace vk_demo
 			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
 			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
 		);
+
+        static DVKTexture* Create2D(
+			const std::string& filename,
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKUploadQueue* uploadQueue, 
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
         
         static DVKTexture* CreateAttachment(
             std::shared_ptr<VulkanDevice> vulkanDevice,
@@ -127,6 +150,18 @@ namespace vk_demo
 			DVKCommandBuffer* cmdBuffer,
 			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
 		);
+
+		// faces为6个面解码好的数据，尺寸和格式必须一致，记录到uploadQueue的当前批次
+		static DVKTexture* CreateCube(
+			const std::vector<const uint8*>& faces,
+			uint32 faceSize,
+			VkFormat format,
+			int32 width,
+			int32 height,
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKUploadQueue* uploadQueue,
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
         
         static DVKTexture* CreateCubeRenderTarget(
             std::shared_ptr<VulkanDevice> vulkanDevice,
@@ -138,6 +173,34 @@ namespace vk_demo
             VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT
         );
         
+		// data为numArray层连续存放，每层layerSize字节
+		static DVKTexture* Create2DArray(
+			const uint8* data, 
+			uint32 layerSize, 
+			int32 numArray, 
+			VkFormat format, 
+			int32 width, 
+			int32 height, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKCommandBuffer* cmdBuffer, 
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
+
+		// 记录到uploadQueue的当前批次，由uploadQueue统一提交
+		static DVKTexture* Create2DArray(
+			const uint8* data, 
+			uint32 layerSize, 
+			int32 numArray, 
+			VkFormat format, 
+			int32 width, 
+			int32 height, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKUploadQueue* uploadQueue, 
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
+
         static DVKTexture* Create2DArray(
 			const std::vector<std::string> filenames, 
 			std::shared_ptr<VulkanDevice> vulkanDevice, 
@@ -145,6 +208,14 @@ namespace vk_demo
 			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
 		);
 
+		// 记录到uploadQueue的当前批次，图片尺寸必须一致
+		static DVKTexture* Create2DArray(
+			const std::vector<std::string> filenames, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKUploadQueue* uploadQueue,
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
+
 		static DVKTexture* Create2DArray(
 			std::shared_ptr<VulkanDevice> vulkanDevice,
 			DVKCommandBuffer* cmdBuffer,
@@ -169,6 +240,51 @@ namespace vk_demo
 			DVKCommandBuffer* cmdBuffer,
 			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
 		);
+
+		// 记录到uploadQueue的当前批次，由uploadQueue统一提交
+		static DVKTexture* Create3D(
+			VkFormat format, 
+			const uint8* rgbaData, 
+			int32 size, 
+			int32 width, 
+			int32 height, 
+			int32 depth, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			DVKUploadQueue* uploadQueue,
+			ImageLayoutBarrier imageLayout = ImageLayoutBarrier::PixelShaderRead
+		);
+
+	private:
+
+		// 创建3D image并把stagingBuffer的数据拷贝进去，命令记录到cmdBuffer，不提交
+		static DVKTexture* CreateVolume(
+			VkBuffer stagingBuffer,
+			VkDeviceSize stagingOffset,
+			VkCommandBuffer cmdBuffer,
+			VkFormat format, 
+			int32 width, 
+			int32 height, 
+			int32 depth, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			ImageLayoutBarrier imageLayout
+		);
+
+		// 创建image并把stagingBuffer的数据拷贝进去、生成mipmap，命令记录到cmdBuffer，不提交
+		// layerCount大于1时每层数据在stagingBuffer里按layerSize依次排列
+		static DVKTexture* CreateMipmapped2D(
+			VkBuffer stagingBuffer,
+			VkDeviceSize stagingOffset,
+			VkCommandBuffer cmdBuffer,
+			VkFormat format, 
+			int32 width, 
+			int32 height, 
+			std::shared_ptr<VulkanDevice> vulkanDevice, 
+			VkImageUsageFlags imageUsageFlags, 
+			ImageLayoutBarrier imageLayout,
+			int32 layerCount = 1,
+			VkDeviceSize layerSize = 0,
+			VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D
+		);
         
     public:
         VkDevice						device = nullptr;
@@ -176,6 +292,7 @@ namespace vk_demo
         VkImage                         image = VK_NULL_HANDLE;
         VkImageLayout                   imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+        VulkanResourceAllocation*       allocation = nullptr;
         VkImageView                     imageView = VK_NULL_HANDLE;
         VkSampler                       imageSampler = VK_NULL_HANDLE;
         VkDescriptorImageInfo           descriptorInfo;
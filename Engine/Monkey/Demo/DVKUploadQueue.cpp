@@ -0,0 +1,417 @@
+﻿#include "DVKUploadQueue.h"
+
+#include "Vulkan/VulkanCommon.h"
+#include "Utils/Alignment.h"
+
+namespace vk_demo
+{
+	// bufferOffset of vkCmdCopyBufferToImage must be a multiple of 4 and of the texel size.
+	static const uint64 STAGING_ALIGNMENT = 16;
+
+	DVKUploadQueue::~DVKUploadQueue()
+	{
+		WaitIdle();
+
+		VkDevice device = vulkanDevice->GetInstanceHandle();
+
+		for (int32 i = 0; i < allBatches.size(); ++i)
+		{
+			Batch* batch = allBatches[i];
+			if (batch->semaphore != VK_NULL_HANDLE) {
+				vkDestroySemaphore(device, batch->semaphore, VULKAN_CPU_ALLOCATOR);
+			}
+			vkDestroyFence(device, batch->fence, VULKAN_CPU_ALLOCATOR);
+			delete batch;
+		}
+		allBatches.clear();
+		freeBatches.clear();
+
+		if (transferPool != VK_NULL_HANDLE) {
+			vkDestroyCommandPool(device, transferPool, VULKAN_CPU_ALLOCATOR);
+			transferPool = VK_NULL_HANDLE;
+		}
+		if (graphicsPool != VK_NULL_HANDLE) {
+			vkDestroyCommandPool(device, graphicsPool, VULKAN_CPU_ALLOCATOR);
+			graphicsPool = VK_NULL_HANDLE;
+		}
+
+		delete arena;
+		arena = nullptr;
+		arenaMapped = nullptr;
+
+		vulkanDevice = nullptr;
+	}
+
+	DVKUploadQueue* DVKUploadQueue::Create(std::shared_ptr<VulkanDevice> vulkanDevice, uint64 arenaSize, bool useTransferQueue)
+	{
+		VkDevice device = vulkanDevice->GetInstanceHandle();
+
+		DVKUploadQueue* uploadQueue = new DVKUploadQueue();
+		uploadQueue->vulkanDevice  = vulkanDevice;
+		uploadQueue->graphicsQueue = vulkanDevice->GetGraphicsQueue();
+		uploadQueue->transferQueue = useTransferQueue ? vulkanDevice->GetTransferQueue() : vulkanDevice->GetGraphicsQueue();
+		uploadQueue->separateFamily = uploadQueue->transferQueue->GetFamilyIndex() != uploadQueue->graphicsQueue->GetFamilyIndex();
+
+		VkCommandPoolCreateInfo poolCreateInfo;
+		ZeroVulkanStruct(poolCreateInfo, VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO);
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolCreateInfo.queueFamilyIndex = uploadQueue->graphicsQueue->GetFamilyIndex();
+		VERIFYVULKANRESULT(vkCreateCommandPool(device, &poolCreateInfo, VULKAN_CPU_ALLOCATOR, &(uploadQueue->graphicsPool)));
+
+		if (uploadQueue->separateFamily)
+		{
+			poolCreateInfo.queueFamilyIndex = uploadQueue->transferQueue->GetFamilyIndex();
+			VERIFYVULKANRESULT(vkCreateCommandPool(device, &poolCreateInfo, VULKAN_CPU_ALLOCATOR, &(uploadQueue->transferPool)));
+		}
+
+		uploadQueue->arena = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			arenaSize
+		);
+		uploadQueue->arena->Map();
+		uploadQueue->arenaMapped = (uint8*)uploadQueue->arena->mapped;
+		uploadQueue->arenaSize   = arenaSize;
+
+		return uploadQueue;
+	}
+
+	DVKUploadQueue::Batch* DVKUploadQueue::BeginBatch()
+	{
+		if (current) {
+			return current;
+		}
+
+		VkDevice device = vulkanDevice->GetInstanceHandle();
+
+		// 尽量复用已经完成的批次
+		RetireBatches(false);
+
+		Batch* batch = nullptr;
+		if (freeBatches.size() > 0)
+		{
+			batch = freeBatches.back();
+			freeBatches.pop_back();
+			vkResetFences(device, 1, &(batch->fence));
+		}
+		else
+		{
+			batch = new Batch();
+			allBatches.push_back(batch);
+
+			VkCommandBufferAllocateInfo cmdBufferAllocateInfo;
+			ZeroVulkanStruct(cmdBufferAllocateInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO);
+			cmdBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			cmdBufferAllocateInfo.commandBufferCount = 1;
+			cmdBufferAllocateInfo.commandPool = graphicsPool;
+			VERIFYVULKANRESULT(vkAllocateCommandBuffers(device, &cmdBufferAllocateInfo, &(batch->graphicsCmd)));
+
+			if (separateFamily)
+			{
+				cmdBufferAllocateInfo.commandPool = transferPool;
+				VERIFYVULKANRESULT(vkAllocateCommandBuffers(device, &cmdBufferAllocateInfo, &(batch->transferCmd)));
+
+				VkSemaphoreCreateInfo semaphoreCreateInfo;
+				ZeroVulkanStruct(semaphoreCreateInfo, VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO);
+				VERIFYVULKANRESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, VULKAN_CPU_ALLOCATOR, &(batch->semaphore)));
+			}
+			else
+			{
+				batch->transferCmd = batch->graphicsCmd;
+			}
+
+			VkFenceCreateInfo fenceCreateInfo;
+			ZeroVulkanStruct(fenceCreateInfo, VK_STRUCTURE_TYPE_FENCE_CREATE_INFO);
+			VERIFYVULKANRESULT(vkCreateFence(device, &fenceCreateInfo, VULKAN_CPU_ALLOCATOR, &(batch->fence)));
+		}
+
+		batch->handle   = nextHandle;
+		batch->hasArena = false;
+
+		VkCommandBufferBeginInfo cmdBufBeginInfo;
+		ZeroVulkanStruct(cmdBufBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		cmdBufBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(batch->graphicsCmd, &cmdBufBeginInfo);
+		if (separateFamily) {
+			vkBeginCommandBuffer(batch->transferCmd, &cmdBufBeginInfo);
+		}
+
+		current = batch;
+		return batch;
+	}
+
+	bool DVKUploadQueue::AllocateArena(uint64 size, uint64& offset)
+	{
+		// [tail, head)是在用的区间，可能绕回。head追上tail之前必须留一个字节，否则分不清空和满。
+		uint64 alignedHead = Align(arenaHead, STAGING_ALIGNMENT);
+
+		if (arenaTail <= arenaHead)
+		{
+			if (alignedHead + size <= arenaSize)
+			{
+				offset    = alignedHead;
+				arenaHead = alignedHead + size;
+				return true;
+			}
+			if (size < arenaTail)
+			{
+				offset    = 0;
+				arenaHead = size;
+				return true;
+			}
+		}
+		else if (alignedHead + size < arenaTail)
+		{
+			offset    = alignedHead;
+			arenaHead = alignedHead + size;
+			return true;
+		}
+
+		return false;
+	}
+
+	uint8* DVKUploadQueue::AllocateStaging(uint64 size, VkBuffer& stagingBuffer, VkDeviceSize& stagingOffset)
+	{
+		Batch* batch = BeginBatch();
+
+		// 大块数据单独创建staging，批次完成后释放
+		if (size > arenaSize / 2)
+		{
+			DVKBuffer* dedicated = DVKBuffer::CreateBuffer(
+				vulkanDevice,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				size
+			);
+			dedicated->Map();
+			batch->dedicatedBuffers.push_back(dedicated);
+
+			stagingBuffer = dedicated->buffer;
+			stagingOffset = 0;
+			return (uint8*)dedicated->mapped;
+		}
+
+		uint64 offset = 0;
+		while (!AllocateArena(size, offset))
+		{
+			stats.stallCount += 1;
+
+			if (inflight.size() > 0) {
+				RetireBatches(true);
+			}
+			else
+			{
+				// arena is held by the recording batch only, submit it and start over.
+				Flush();
+				RetireBatches(true);
+				batch = BeginBatch();
+			}
+		}
+
+		if (!batch->hasArena)
+		{
+			batch->hasArena   = true;
+			batch->arenaBegin = offset;
+			UpdateArenaTail();
+		}
+
+		stagingBuffer = arena->buffer;
+		stagingOffset = offset;
+		return arenaMapped + offset;
+	}
+
+	VkCommandBuffer DVKUploadQueue::GetCommandBuffer()
+	{
+		return BeginBatch()->graphicsCmd;
+	}
+
+	DVKUploadHandle DVKUploadQueue::UploadBuffer(DVKBuffer* dstBuffer, const void* data, uint64 size, uint64 dstOffset)
+	{
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+		uint8* staging = AllocateStaging(size, stagingBuffer, stagingOffset);
+		memcpy(staging, data, size);
+
+		Batch* batch = current;
+
+		VkBufferCopy copyRegion = {};
+		copyRegion.srcOffset = stagingOffset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size      = size;
+		vkCmdCopyBuffer(batch->transferCmd, stagingBuffer, dstBuffer->buffer, 1, &copyRegion);
+
+		if (separateFamily)
+		{
+			VkBufferMemoryBarrier barrier;
+			ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+			barrier.srcQueueFamilyIndex = transferQueue->GetFamilyIndex();
+			barrier.dstQueueFamilyIndex = graphicsQueue->GetFamilyIndex();
+			barrier.buffer = dstBuffer->buffer;
+			barrier.offset = dstOffset;
+			barrier.size   = size;
+			batch->ownershipBarriers.push_back(barrier);
+		}
+
+		stats.numUploads    += 1;
+		stats.bytesUploaded += size;
+
+		return batch->handle;
+	}
+
+	DVKUploadHandle DVKUploadQueue::Flush()
+	{
+		if (!current) {
+			return nextHandle - 1;
+		}
+
+		Batch* batch = current;
+		current = nullptr;
+		nextHandle += 1;
+
+		std::vector<VkBufferMemoryBarrier>& barriers = batch->ownershipBarriers;
+
+		if (separateFamily)
+		{
+			// release on the transfer family
+			for (int32 i = 0; i < barriers.size(); ++i)
+			{
+				barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barriers[i].dstAccessMask = 0;
+			}
+			if (barriers.size() > 0) {
+				vkCmdPipelineBarrier(batch->transferCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+			}
+			vkEndCommandBuffer(batch->transferCmd);
+
+			VkSubmitInfo submitInfo;
+			ZeroVulkanStruct(submitInfo, VK_STRUCTURE_TYPE_SUBMIT_INFO);
+			submitInfo.commandBufferCount   = 1;
+			submitInfo.pCommandBuffers      = &(batch->transferCmd);
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores    = &(batch->semaphore);
+			VERIFYVULKANRESULT(vkQueueSubmit(transferQueue->GetHandle(), 1, &submitInfo, VK_NULL_HANDLE));
+
+			// acquire on the graphics family
+			for (int32 i = 0; i < barriers.size(); ++i)
+			{
+				barriers[i].srcAccessMask = 0;
+				barriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			}
+			if (barriers.size() > 0) {
+				vkCmdPipelineBarrier(batch->graphicsCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+			}
+		}
+
+		// 后续提交到graphics queue的命令都能看到拷贝结果
+		VkMemoryBarrier memoryBarrier;
+		ZeroVulkanStruct(memoryBarrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER);
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		vkCmdPipelineBarrier(batch->graphicsCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		vkEndCommandBuffer(batch->graphicsCmd);
+
+		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		VkSubmitInfo submitInfo;
+		ZeroVulkanStruct(submitInfo, VK_STRUCTURE_TYPE_SUBMIT_INFO);
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers    = &(batch->graphicsCmd);
+		if (separateFamily)
+		{
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores    = &(batch->semaphore);
+			submitInfo.pWaitDstStageMask  = &waitStageMask;
+		}
+		VERIFYVULKANRESULT(vkQueueSubmit(graphicsQueue->GetHandle(), 1, &submitInfo, batch->fence));
+
+		barriers.clear();
+		inflight.push_back(batch);
+		stats.numSubmits += 1;
+
+		return batch->handle;
+	}
+
+	void DVKUploadQueue::RetireBatches(bool waitOldest)
+	{
+		VkDevice device = vulkanDevice->GetInstanceHandle();
+
+		while (inflight.size() > 0)
+		{
+			Batch* batch = inflight.front();
+
+			if (waitOldest)
+			{
+				vkWaitForFences(device, 1, &(batch->fence), VK_TRUE, MAX_uint64);
+				waitOldest = false;
+			}
+			else if (vkGetFenceStatus(device, batch->fence) != VK_SUCCESS) {
+				break;
+			}
+
+			for (int32 i = 0; i < batch->dedicatedBuffers.size(); ++i) {
+				delete batch->dedicatedBuffers[i];
+			}
+			batch->dedicatedBuffers.clear();
+
+			completedHandle = batch->handle;
+			inflight.pop_front();
+			freeBatches.push_back(batch);
+		}
+
+		UpdateArenaTail();
+	}
+
+	void DVKUploadQueue::UpdateArenaTail()
+	{
+		for (int32 i = 0; i < inflight.size(); ++i)
+		{
+			if (inflight[i]->hasArena)
+			{
+				arenaTail = inflight[i]->arenaBegin;
+				return;
+			}
+		}
+
+		if (current && current->hasArena)
+		{
+			arenaTail = current->arenaBegin;
+			return;
+		}
+
+		// arena空闲，从头开始
+		arenaHead = 0;
+		arenaTail = 0;
+	}
+
+	bool DVKUploadQueue::IsComplete(DVKUploadHandle handle)
+	{
+		if (handle > completedHandle) {
+			RetireBatches(false);
+		}
+		return handle <= completedHandle;
+	}
+
+	void DVKUploadQueue::Wait(DVKUploadHandle handle)
+	{
+		if (current && handle >= current->handle) {
+			Flush();
+		}
+
+		while (handle > completedHandle && inflight.size() > 0) {
+			RetireBatches(true);
+		}
+	}
+
+	void DVKUploadQueue::WaitIdle()
+	{
+		Flush();
+
+		while (inflight.size() > 0) {
+			RetireBatches(true);
+		}
+	}
+
+};
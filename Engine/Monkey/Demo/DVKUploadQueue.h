@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include "Engine.h"
+#include "DVKBuffer.h"
+#include "DVKCommand.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <memory>
+
+namespace vk_demo
+{
+	// 上传批次的序号，批次的fence完成后即完成。0表示没有任何上传。
+	typedef uint64 DVKUploadHandle;
+
+	struct DVKUploadQueueStats
+	{
+		uint32	numSubmits = 0;
+		uint32	numUploads = 0;
+		uint64	bytesUploaded = 0;
+		uint32	stallCount = 0;
+	};
+
+	/**
+	 * Gathers staging copies into one host visible arena and submits them as a single batch.
+	 * Every upload returns the handle of the batch it was recorded into, the handle resolves
+	 * once the batch fence signals and its arena range is recycled at that point.
+	 *
+	 * Buffer copies may run on the transfer queue family, ownership of the destination ranges is
+	 * then released to the graphics family at the end of the batch. Image uploads need blits for
+	 * mipmaps, so GetCommandBuffer() always records on the graphics queue.
+	 *
+	 * Not thread safe: Flush() submits on the graphics queue.
+	 */
+	class DVKUploadQueue
+	{
+	private:
+		struct Batch
+		{
+			DVKUploadHandle						handle = 0;
+			VkCommandBuffer						transferCmd = VK_NULL_HANDLE;
+			VkCommandBuffer						graphicsCmd = VK_NULL_HANDLE;
+			VkSemaphore							semaphore = VK_NULL_HANDLE;
+			VkFence								fence = VK_NULL_HANDLE;
+			bool								hasArena = false;
+			uint64								arenaBegin = 0;
+			std::vector<DVKBuffer*>				dedicatedBuffers;
+			std::vector<VkBufferMemoryBarrier>	ownershipBarriers;
+		};
+
+		DVKUploadQueue()
+		{
+
+		}
+
+	public:
+		~DVKUploadQueue();
+
+		static DVKUploadQueue* Create(std::shared_ptr<VulkanDevice> vulkanDevice, uint64 arenaSize = 32 * 1024 * 1024, bool useTransferQueue = false);
+
+		// staging memory of the recording batch, valid until the batch is flushed.
+		uint8* AllocateStaging(uint64 size, VkBuffer& stagingBuffer, VkDeviceSize& stagingOffset);
+
+		// graphics command buffer of the recording batch, for image copies and layout transitions.
+		VkCommandBuffer GetCommandBuffer();
+
+		DVKUploadHandle UploadBuffer(DVKBuffer* dstBuffer, const void* data, uint64 size, uint64 dstOffset = 0);
+
+		DVKUploadHandle Flush();
+
+		bool IsComplete(DVKUploadHandle handle);
+
+		void Wait(DVKUploadHandle handle);
+
+		void WaitIdle();
+
+		// handle that uploads recorded right now will resolve with.
+		inline DVKUploadHandle GetRecordingHandle() const
+		{
+			return nextHandle;
+		}
+
+		inline const DVKUploadQueueStats& GetStats() const
+		{
+			return stats;
+		}
+
+	private:
+
+		Batch* BeginBatch();
+
+		bool AllocateArena(uint64 size, uint64& offset);
+
+		void RetireBatches(bool waitOldest);
+
+		void UpdateArenaTail();
+
+	public:
+		std::shared_ptr<VulkanDevice>	vulkanDevice = nullptr;
+		std::shared_ptr<VulkanQueue>	transferQueue = nullptr;
+		std::shared_ptr<VulkanQueue>	graphicsQueue = nullptr;
+		bool							separateFamily = false;
+
+	private:
+		VkCommandPool					transferPool = VK_NULL_HANDLE;
+		VkCommandPool					graphicsPool = VK_NULL_HANDLE;
+
+		DVKBuffer*						arena = nullptr;
+		uint8*							arenaMapped = nullptr;
+		uint64							arenaSize = 0;
+		uint64							arenaHead = 0;
+		uint64							arenaTail = 0;
+
+		Batch*							current = nullptr;
+		std::deque<Batch*>				inflight;
+		std::vector<Batch*>				freeBatches;
+		std::vector<Batch*>				allBatches;
+
+		DVKUploadHandle					nextHandle = 1;
+		DVKUploadHandle					completedHandle = 0;
+
+		DVKUploadQueueStats				stats;
+	};
+
+};
@@ -11,18 +11,15 @@ namespace vk_demo
 {
     inline VkShaderModule LoadSPIPVShader(VkDevice device, const std::string& filepath)
     {
-        uint8* dataPtr  = nullptr;
-        uint32 dataSize = 0;
-        FileManager::ReadFile(filepath, dataPtr, dataSize);
+        FileViewRef view = FileManager::MapFile(filepath);
         
         VkShaderModuleCreateInfo moduleCreateInfo;
         ZeroVulkanStruct(moduleCreateInfo, VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO);
-        moduleCreateInfo.codeSize = dataSize;
-        moduleCreateInfo.pCode    = (uint32_t*)dataPtr;
+        moduleCreateInfo.codeSize = view ? view->GetSize() : 0;
+        moduleCreateInfo.pCode    = view ? (const uint32_t*)view->GetData() : nullptr;
         
         VkShaderModule shaderModule;
         VERIFYVULKANRESULT(vkCreateShaderModule(device, &moduleCreateInfo, VULKAN_CPU_ALLOCATOR, &shaderModule));
-        delete[] dataPtr;
         
         return shaderModule;
     }
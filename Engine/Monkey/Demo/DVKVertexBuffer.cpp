@@ -40,6 +40,24 @@ namespace vk_demo
 		return vertexBuffer;
 	}
 
+	DVKVertexBuffer* DVKVertexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKUploadQueue* uploadQueue, const std::vector<float>& vertices, const std::vector<VertexAttribute>& attributes)
+	{
+		DVKVertexBuffer* vertexBuffer = new DVKVertexBuffer();
+		vertexBuffer->device	 = vulkanDevice->GetInstanceHandle();
+		vertexBuffer->attributes = attributes;
+
+		vertexBuffer->dvkBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			vulkanDevice, 
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+			vertices.size() * sizeof(float)
+		);
+
+		uploadQueue->UploadBuffer(vertexBuffer->dvkBuffer, vertices.data(), vertices.size() * sizeof(float));
+
+		return vertexBuffer;
+	}
+
 	std::vector<VkVertexInputAttributeDescription> DVKVertexBuffer::GetInputAttributes(const std::vector<VertexAttribute>& shaderInputs)
 	{
 		std::vector<VkVertexInputAttributeDescription> vertexInputAttributs;
@@ -3,6 +3,7 @@
 #include "Engine.h"
 #include "DVKCommand.h"
 #include "DVKBuffer.h"
+#include "DVKUploadQueue.h"
 
 #include "Common/Common.h"
 #include "Math/Math.h"
@@ -153,6 +154,8 @@ namespace vk_demo
 
 		static DVKVertexBuffer* Create(std::shared_ptr<VulkanDevice> device, DVKCommandBuffer* cmdBuffer, std::vector<float> vertices, const std::vector<VertexAttribute>& attributes);
 
+		static DVKVertexBuffer* Create(std::shared_ptr<VulkanDevice> device, DVKUploadQueue* uploadQueue, const std::vector<float>& vertices, const std::vector<VertexAttribute>& attributes);
+
 	public:
 		VkDevice						device = VK_NULL_HANDLE;
 		DVKBuffer*						dvkBuffer = nullptr;
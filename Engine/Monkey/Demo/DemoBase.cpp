@@ -1,6 +1,11 @@
 ﻿#include "DemoBase.h"
 #include "DVKDefaultRes.h"
 #include "DVKCommand.h"
+#include "DVKCompute.h"
+#include "DVKPipeline.h"
+#include "FileManager.h"
+
+#include "GenericPlatform/GenericPlatformTime.h"
 
 void DemoBase::Setup()
 {
@@ -20,7 +25,35 @@ void DemoBase::Setup()
 
 int32 DemoBase::AcquireBackbufferIndex()
 {
-	int32 backBufferIndex = m_SwapChain->AcquireImageIndex(&m_PresentComplete);
+	// Init()里的管线在第一帧之前都已经创建完了
+	if (!m_PipelineCacheReported)
+	{
+		m_PipelineCacheReported = true;
+		MLOG("Pipeline cache %s: %d pipelines created in %.2fms", m_PipelineCacheWarm ? "warm" : "cold", vk_demo::DVKPipelineStats::GetCreateCount(), vk_demo::DVKPipelineStats::GetCreateTime());
+	}
+
+	// wait until the frame slot about to be reused has been retired by the gpu.
+	double waitStart = GenericPlatformTime::Seconds();
+	vkWaitForFences(m_Device, 1, &(m_Fences[m_FrameIndex]), true, MAX_uint64);
+	double waitTime  = GenericPlatformTime::Seconds() - waitStart;
+
+	int32 backBufferIndex = m_SwapChain->AcquireImageIndex(&(m_PresentComplete[m_FrameIndex]));
+	if (backBufferIndex < 0) {
+		return backBufferIndex;
+	}
+
+	// command buffers are per backbuffer, the image may still be used by another frame slot.
+	VkFence imageFence = m_ImageFences[backBufferIndex];
+	if (imageFence != VK_NULL_HANDLE && imageFence != m_Fences[m_FrameIndex]) 
+	{
+		waitStart = GenericPlatformTime::Seconds();
+		vkWaitForFences(m_Device, 1, &imageFence, true, MAX_uint64);
+		waitTime += GenericPlatformTime::Seconds() - waitStart;
+	}
+	m_ImageFences[backBufferIndex] = m_Fences[m_FrameIndex];
+
+	m_FenceWaitTime += (float)(waitTime * 1000.0);
+
 	return backBufferIndex;
 }
 
@@ -29,20 +62,25 @@ void DemoBase::Present(int backBufferIndex)
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType 				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.pWaitDstStageMask 	= &m_WaitStageMask;									
-	submitInfo.pWaitSemaphores 		= &m_PresentComplete;
+	submitInfo.pWaitSemaphores 		= &(m_PresentComplete[m_FrameIndex]);
 	submitInfo.waitSemaphoreCount 	= 1;
-	submitInfo.pSignalSemaphores 	= &m_RenderComplete;
+	submitInfo.pSignalSemaphores 	= &(m_RenderComplete[m_FrameIndex]);
 	submitInfo.signalSemaphoreCount = 1;											
 	submitInfo.pCommandBuffers 		= &(m_CommandBuffers[backBufferIndex]);
 	submitInfo.commandBufferCount 	= 1;												
 	
-    vkResetFences(m_Device, 1, &(m_Fences[backBufferIndex]));
+    vkResetFences(m_Device, 1, &(m_Fences[m_FrameIndex]));
 
-	VERIFYVULKANRESULT(vkQueueSubmit(m_GfxQueue, 1, &submitInfo, m_Fences[backBufferIndex]));
-    vkWaitForFences(m_Device, 1, &(m_Fences[backBufferIndex]), true, MAX_uint64);
+	VERIFYVULKANRESULT(vkQueueSubmit(m_GfxQueue, 1, &submitInfo, m_Fences[m_FrameIndex]));
+
+	// uniform data written this frame is retired once the fence signals
+	vk_demo::DVKMaterial::SubmitFrame(m_Fences[m_FrameIndex]);
+	vk_demo::DVKCompute::SubmitFrame(m_Fences[m_FrameIndex]);
     
     // present
-    m_SwapChain->Present(m_VulkanDevice->GetGraphicsQueue(), m_VulkanDevice->GetPresentQueue(), &m_RenderComplete);
+    m_SwapChain->Present(m_VulkanDevice->GetGraphicsQueue(), m_VulkanDevice->GetPresentQueue(), &(m_RenderComplete[m_FrameIndex]));
+
+	m_FrameIndex = (m_FrameIndex + 1) % m_FramesInFlight;
 }
 
 uint32 DemoBase::GetMemoryTypeFromProperties(uint32 typeBits, VkMemoryPropertyFlags properties)
@@ -52,9 +90,54 @@ uint32 DemoBase::GetMemoryTypeFromProperties(uint32 typeBits, VkMemoryPropertyFl
 	return memoryTypeIndex;
 }
 
+std::string DemoBase::GetPipelineCacheName()
+{
+	return FileManager::SanitizeFileName("PipelineCache_" + m_Title + ".bin");
+}
+
+bool DemoBase::IsPipelineCacheCompatible(const uint8* data, uint32 size)
+{
+	// VkPipelineCacheHeaderVersionOne: headerSize, headerVersion, vendorID, deviceID, pipelineCacheUUID
+	const uint32 headerSize = 16 + VK_UUID_SIZE;
+	if (size < headerSize) {
+		return false;
+	}
+
+	uint32 header[4];
+	memcpy(header, data, sizeof(header));
+
+	const VkPhysicalDeviceProperties& properties = GetVulkanRHI()->GetDevice()->GetDeviceProperties();
+
+	if (header[0] < headerSize || header[0] > size) {
+		return false;
+	}
+	if (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+		return false;
+	}
+	if (header[2] != properties.vendorID || header[3] != properties.deviceID) {
+		return false;
+	}
+	if (memcmp(data + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		return false;
+	}
+
+	return true;
+}
+
 void DemoBase::DestroyPipelineCache()
 {
 	VkDevice device = GetVulkanRHI()->GetDevice()->GetInstanceHandle();
+
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, m_PipelineCache, &dataSize, nullptr) == VK_SUCCESS && dataSize > 0)
+	{
+		uint8* dataPtr = new uint8[dataSize];
+		if (vkGetPipelineCacheData(device, m_PipelineCache, &dataSize, dataPtr) == VK_SUCCESS) {
+			FileManager::WriteCacheFile(GetPipelineCacheName(), dataPtr, dataSize);
+		}
+		delete[] dataPtr;
+	}
+
 	vkDestroyPipelineCache(device, m_PipelineCache, VULKAN_CPU_ALLOCATOR);
 	m_PipelineCache = VK_NULL_HANDLE;
 }
@@ -63,39 +146,81 @@ void DemoBase::CreatePipelineCache()
 {
 	VkDevice device = GetVulkanRHI()->GetDevice()->GetInstanceHandle();
 
+	m_PipelineCacheWarm = false;
+
+	// 驱动或者设备变了缓存就作废，交给驱动去校验的话部分驱动会直接崩溃。
+	FileViewRef view = FileManager::MapCacheFile(GetPipelineCacheName());
+	if (view)
+	{
+		m_PipelineCacheWarm = IsPipelineCacheCompatible(view->GetData(), view->GetSize());
+		if (!m_PipelineCacheWarm) {
+			MLOG("Pipeline cache %s does not match this device, ignored.", GetPipelineCacheName().c_str());
+		}
+	}
+
 	VkPipelineCacheCreateInfo createInfo;
     ZeroVulkanStruct(createInfo, VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO);
-    VERIFYVULKANRESULT(vkCreatePipelineCache(device, &createInfo, VULKAN_CPU_ALLOCATOR, &m_PipelineCache));
+	if (m_PipelineCacheWarm)
+	{
+		createInfo.initialDataSize = view->GetSize();
+		createInfo.pInitialData    = view->GetData();
+	}
+
+	VkResult result = vkCreatePipelineCache(device, &createInfo, VULKAN_CPU_ALLOCATOR, &m_PipelineCache);
+	if (result != VK_SUCCESS && m_PipelineCacheWarm)
+	{
+		MLOG("Pipeline cache %s rejected by driver, ignored.", GetPipelineCacheName().c_str());
+		m_PipelineCacheWarm = false;
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData    = nullptr;
+		result = vkCreatePipelineCache(device, &createInfo, VULKAN_CPU_ALLOCATOR, &m_PipelineCache);
+	}
+	VERIFYVULKANRESULT(result);
 }
 
 void DemoBase::CreateFences()
 {
 	VkDevice device  = GetVulkanRHI()->GetDevice()->GetInstanceHandle();
     int32 frameCount = GetVulkanRHI()->GetSwapChain()->GetBackBufferCount();
+
+	m_FramesInFlight = MMath::Clamp(m_FramesInFlight, 1, frameCount);
+	m_FrameIndex     = 0;
         
 	VkFenceCreateInfo fenceCreateInfo;
 	ZeroVulkanStruct(fenceCreateInfo, VK_STRUCTURE_TYPE_FENCE_CREATE_INFO);
 	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	VkSemaphoreCreateInfo createInfo;
+	ZeroVulkanStruct(createInfo, VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO);
         
-    m_Fences.resize(frameCount);
-	for (int32 i = 0; i < m_Fences.size(); ++i) {
+    m_Fences.resize(m_FramesInFlight);
+	m_RenderComplete.resize(m_FramesInFlight);
+	m_PresentComplete.resize(m_FramesInFlight, VK_NULL_HANDLE);
+	for (int32 i = 0; i < m_FramesInFlight; ++i) 
+	{
 		VERIFYVULKANRESULT(vkCreateFence(device, &fenceCreateInfo, VULKAN_CPU_ALLOCATOR, &m_Fences[i]));
+		VERIFYVULKANRESULT(vkCreateSemaphore(device, &createInfo, VULKAN_CPU_ALLOCATOR, &m_RenderComplete[i]));
 	}
 
-	VkSemaphoreCreateInfo createInfo;
-	ZeroVulkanStruct(createInfo, VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO);
-	vkCreateSemaphore(device, &createInfo, VULKAN_CPU_ALLOCATOR, &m_RenderComplete);
+	m_ImageFences.resize(frameCount, VK_NULL_HANDLE);
 }
 
 void DemoBase::DestroyFences()
 {
 	VkDevice device = GetVulkanRHI()->GetDevice()->GetInstanceHandle();
 
-	for (int32 i = 0; i < m_Fences.size(); ++i) {
+	vkWaitForFences(device, m_Fences.size(), m_Fences.data(), true, MAX_uint64);
+
+	for (int32 i = 0; i < m_Fences.size(); ++i) 
+	{
 		vkDestroyFence(device, m_Fences[i], VULKAN_CPU_ALLOCATOR);
+		vkDestroySemaphore(device, m_RenderComplete[i], VULKAN_CPU_ALLOCATOR);
 	}
 
-	vkDestroySemaphore(device, m_RenderComplete, VULKAN_CPU_ALLOCATOR);
+	m_Fences.clear();
+	m_RenderComplete.clear();
+	m_PresentComplete.clear();
+	m_ImageFences.clear();
 }
 
 void DemoBase::CreateDefaultRes()
@@ -25,8 +25,10 @@ public:
 		, m_FrameWidth(0)
 		, m_FrameHeight(0)
 		, m_PipelineCache(VK_NULL_HANDLE)
-		, m_PresentComplete(VK_NULL_HANDLE)
-		, m_RenderComplete(VK_NULL_HANDLE)
+		, m_PipelineCacheWarm(false)
+		, m_PipelineCacheReported(false)
+		, m_FramesInFlight(1)
+		, m_FrameIndex(0)
 		, m_CommandPool(VK_NULL_HANDLE)
 		, m_WaitStageMask(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
 		, m_SwapChain(VK_NULL_HANDLE)
@@ -73,8 +75,10 @@ public:
         if (m_LastFrameTime >= 1.0f) 
 		{
             m_LastFPS = m_FrameCounter;
+            m_LastFenceWaitTime = m_FenceWaitTime / m_FrameCounter;
             m_FrameCounter  = 0;
             m_LastFrameTime = 0.0f;
+            m_FenceWaitTime = 0.0f;
         }
     }
     
@@ -102,6 +106,23 @@ public:
 
 	int32 AcquireBackbufferIndex();
 
+	// Defaults to 1, demos that keep per-frame copies of everything the cpu writes opt in before Prepare(). Clamped to the swapchain image count.
+	inline void SetFramesInFlight(int32 framesInFlight)
+	{
+		m_FramesInFlight = framesInFlight;
+	}
+
+	inline int32 GetFramesInFlight() const
+	{
+		return m_FramesInFlight;
+	}
+
+	// Average CPU time in ms spent waiting for a frame slot, refreshed once per second by UpdateFPS.
+	inline float GetFenceWaitTime() const
+	{
+		return m_LastFenceWaitTime;
+	}
+
 	uint32 GetMemoryTypeFromProperties(uint32 typeBits, VkMemoryPropertyFlags properties);
 
 private:
@@ -121,6 +142,10 @@ private:
 	void DestroyPipelineCache();
 
 	void CreatePipelineCache();
+
+	bool IsPipelineCacheCompatible(const uint8* data, uint32 size);
+
+	std::string GetPipelineCacheName();
     
 protected:
 
@@ -135,10 +160,15 @@ protected:
 	int32							m_FrameHeight;
     
 	VkPipelineCache                 m_PipelineCache;
+	bool							m_PipelineCacheWarm;
+	bool							m_PipelineCacheReported;
     
+	int32							m_FramesInFlight;
+	int32							m_FrameIndex;
 	std::vector<VkFence> 			m_Fences;
-	VkSemaphore 					m_PresentComplete;
-	VkSemaphore 					m_RenderComplete;
+	std::vector<VkFence> 			m_ImageFences;
+	std::vector<VkSemaphore>		m_PresentComplete;
+	std::vector<VkSemaphore>		m_RenderComplete;
 
 	VkCommandPool					m_CommandPool;
 	VkCommandPool					m_ComputeCommandPool;
@@ -151,4 +181,6 @@ protected:
     int32                           m_FrameCounter = 0;
     float                           m_LastFrameTime = 0.0f;
     float                           m_LastFPS = 0.0f;
+    float                           m_FenceWaitTime = 0.0f;
+    float                           m_LastFenceWaitTime = 0.0f;
 };
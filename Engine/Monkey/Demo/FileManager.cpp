@@ -4,7 +4,9 @@
 #include "FileManager.h"
 
 #if PLATFORM_WINDOWS
-
+	#include <windows.h>
+	#include <direct.h>
+	#include <io.h>
 #elif PLATFORM_MAC
 
 #elif PLATFORM_IOS
@@ -15,6 +17,25 @@
 	#include "Application/Android/AndroidWindow.h"
 #endif
 
+#if !PLATFORM_WINDOWS
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <dirent.h>
+#endif
+
+#if PLATFORM_LINUX || PLATFORM_MAC || PLATFORM_IOS
+	#define FILE_MAPPING_MMAP 1
+	#include <sys/mman.h>
+	#include <fcntl.h>
+#else
+	#define FILE_MAPPING_MMAP 0
+#endif
+
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <atomic>
+
 std::string FileManager::GetFilePath(const std::string& filepath)
 {
 #if defined(DEMO_RES_PATH)
@@ -24,41 +45,273 @@ std::string FileManager::GetFilePath(const std::string& filepath)
 #endif
 }
 
-bool FileManager::ReadFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize)
+std::string FileManager::GetCachePath(const std::string& filename)
 {
-	std::string finalPath = FileManager::GetFilePath(filepath);
-
 #if PLATFORM_ANDROID
+	std::string directory = std::string(g_AndroidApp->activity->internalDataPath) + "/cache/";
+#else
+	std::string directory = GetFilePath("cache/");
+#endif
 
-	AAsset* asset = AAssetManager_open(g_AndroidApp->activity->assetManager, finalPath.c_str(), AASSET_MODE_STREAMING);
-	dataSize = AAsset_getLength(asset);
-	dataPtr = new uint8[dataSize];
-	AAsset_read(asset, dataPtr, dataSize);
-	AAsset_close(asset);
+#if PLATFORM_WINDOWS
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
 
+	return directory + filename;
+}
+
+std::string FileManager::SanitizeFileName(const std::string& filename)
+{
+	std::string name = filename;
+	for (int32 i = 0; i < name.size(); ++i)
+	{
+		char c = name[i];
+		if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != '-') {
+			name[i] = '_';
+		}
+	}
+	return name;
+}
+
+bool FileManager::WriteCacheFile(const std::string& filename, const uint8* dataPtr, uint32 dataSize)
+{
+	// 临时文件名带上进程ID和进程内序号，多线程/多进程同时写同一个缓存时互不覆盖
+	static std::atomic<uint32> tempCounter(0);
+#if PLATFORM_WINDOWS
+	uint32 processID = GetCurrentProcessId();
 #else
+	uint32 processID = getpid();
+#endif
 
-	FILE* file = fopen(finalPath.c_str(), "rb");
+	std::string finalPath = GetCachePath(filename);
+	std::string tempPath  = finalPath + "." + std::to_string(processID) + "." + std::to_string(tempCounter++) + ".tmp";
+
+	FILE* file = fopen(tempPath.c_str(), "wb");
 	if (!file) {
-		MLOGE("File not found :%s", filepath.c_str());
+		MLOGE("Failed write cache :%s", filename.c_str());
 		return false;
 	}
 
+	bool written = fwrite(dataPtr, 1, dataSize, file) == dataSize;
+	written = written && fflush(file) == 0;
+
+#if PLATFORM_WINDOWS
+	written = written && _commit(_fileno(file)) == 0;
+#else
+	written = written && fsync(fileno(file)) == 0;
+#endif
+
+	fclose(file);
+
+	if (!written)
+	{
+		remove(tempPath.c_str());
+		MLOGE("Failed write cache :%s", filename.c_str());
+		return false;
+	}
+
+#if PLATFORM_WINDOWS
+	// rename() does not replace an existing file on windows.
+	bool replaced = MoveFileExA(tempPath.c_str(), finalPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool replaced = rename(tempPath.c_str(), finalPath.c_str()) == 0;
+#endif
+
+	if (!replaced)
+	{
+		remove(tempPath.c_str());
+		MLOGE("Failed write cache :%s", filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+FileView::~FileView()
+{
+	if (m_Data == nullptr) {
+		return;
+	}
+
+#if FILE_MAPPING_MMAP
+	if (m_Mapped) {
+		munmap(m_Data, m_Size);
+	}
+	else {
+		delete[] m_Data;
+	}
+#else
+	delete[] m_Data;
+#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+FileViewRef FileManager::MapAbsoluteFile(const std::string& finalPath, bool isAsset)
+{
+	FileViewRef view(new FileView());
+
+#if FILE_MAPPING_MMAP
+
+	int fd = open(finalPath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	void* address = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (address != MAP_FAILED)
+	{
+		// 加载器基本都是从头读到尾，让内核提前预读
+		madvise(address, fileStat.st_size, MADV_SEQUENTIAL);
+		madvise(address, fileStat.st_size, MADV_WILLNEED);
+
+		view->m_Data   = (uint8*)address;
+		view->m_Size   = (uint32)fileStat.st_size;
+		view->m_Mapped = true;
+		return view;
+	}
+
+#endif
+
+#if PLATFORM_ANDROID
+
+	if (isAsset)
+	{
+		AAsset* asset = AAssetManager_open(g_AndroidApp->activity->assetManager, finalPath.c_str(), AASSET_MODE_STREAMING);
+		if (!asset) {
+			return nullptr;
+		}
+		view->m_Size = AAsset_getLength(asset);
+		view->m_Data = new uint8[view->m_Size];
+		AAsset_read(asset, view->m_Data, view->m_Size);
+		AAsset_close(asset);
+		return view->m_Size > 0 ? view : nullptr;
+	}
+
+#endif
+
+	FILE* file = fopen(finalPath.c_str(), "rb");
+	if (!file) {
+		return nullptr;
+	}
+
 	fseek(file, 0, SEEK_END);
-	dataSize = (uint32)ftell(file);
+	uint32 dataSize = (uint32)ftell(file);
 	fseek(file, 0, SEEK_SET);
 
 	if (dataSize <= 0) {
 		fclose(file);
-		MLOGE("File has no data :%s", filepath.c_str());
-		return false;
+		return nullptr;
 	}
 
-	dataPtr = new uint8[dataSize];
-	fread(dataPtr, 1, dataSize, file);
+	view->m_Data = new uint8[dataSize];
+	view->m_Size = dataSize;
+	if (fread(view->m_Data, 1, dataSize, file) != dataSize) {
+		view = nullptr;
+	}
 	fclose(file);
 
-#endif
+	return view;
+}
+
+FileViewRef FileManager::MapFile(const std::string& filepath)
+{
+	FileViewRef view = MapAbsoluteFile(FileManager::GetFilePath(filepath), true);
+	if (!view) {
+		MLOGE("File not found or has no data :%s", filepath.c_str());
+	}
+	return view;
+}
+
+FileViewRef FileManager::MapCacheFile(const std::string& filename)
+{
+	return MapAbsoluteFile(GetCachePath(filename), false);
+}
+
+bool FileManager::ReadFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize)
+{
+	FileViewRef view = MapFile(filepath);
+	if (!view) {
+		return false;
+	}
+
+	dataSize = view->GetSize();
+	dataPtr  = new uint8[dataSize];
+	memcpy(dataPtr, view->GetData(), dataSize);
 
 	return true;
 }
+
+void FileManager::ListFiles(const std::string& directory, std::vector<std::string>& outFiles)
+{
+	std::string prefix = directory;
+	if (prefix.size() > 0 && prefix.back() != '/') {
+		prefix += "/";
+	}
+
+#if PLATFORM_WINDOWS
+
+	WIN32_FIND_DATAA findData;
+	HANDLE handle = FindFirstFileA((GetFilePath(prefix) + "*").c_str(), &findData);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	do
+	{
+		std::string name = findData.cFileName;
+		if (name == "." || name == "..") {
+			continue;
+		}
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			ListFiles(prefix + name, outFiles);
+		}
+		else {
+			outFiles.push_back(prefix + name);
+		}
+	} while (FindNextFileA(handle, &findData));
+	FindClose(handle);
+
+#elif PLATFORM_ANDROID
+
+	// apk里的asset没有目录信息，不支持
+
+#else
+
+	DIR* dir = opendir(GetFilePath(prefix).c_str());
+	if (!dir) {
+		return;
+	}
+	while (struct dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..") {
+			continue;
+		}
+
+		struct stat fileStat;
+		if (stat(GetFilePath(prefix + name).c_str(), &fileStat) != 0) {
+			continue;
+		}
+		if (S_ISDIR(fileStat.st_mode)) {
+			ListFiles(prefix + name, outFiles);
+		}
+		else if (S_ISREG(fileStat.st_mode)) {
+			outFiles.push_back(prefix + name);
+		}
+	}
+	closedir(dir);
+
+#endif
+}
@@ -3,11 +3,74 @@
 #include "Common/Common.h"
 
 #include <string>
+#include <vector>
+#include <memory>
+
+// 只读的文件数据，最后一个引用释放时解除映射。
+// Linux/Mac/iOS上直接mmap，数据从page cache按需换入，其他平台退化为读入内存。
+class FileView
+{
+public:
+	~FileView();
+
+	inline const uint8* GetData() const
+	{
+		return m_Data;
+	}
+
+	inline uint32 GetSize() const
+	{
+		return m_Size;
+	}
+
+	inline bool IsMapped() const
+	{
+		return m_Mapped;
+	}
+
+private:
+	friend class FileManager;
+
+	FileView()
+		: m_Data(nullptr)
+		, m_Size(0)
+		, m_Mapped(false)
+	{
+
+	}
+
+	uint8*	m_Data;
+	uint32	m_Size;
+	bool	m_Mapped;
+};
+
+typedef std::shared_ptr<FileView> FileViewRef;
 
 class FileManager
 {
 public:
+	// 会多一次拷贝，新代码用MapFile
 	static bool ReadFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize);
 
+	// 文件不存在或者为空时返回nullptr
+	static FileViewRef MapFile(const std::string& filepath);
+
+	static FileViewRef MapCacheFile(const std::string& filename);
+
+	// 递归列出目录下的所有文件，返回相对GetFilePath的路径
+	static void ListFiles(const std::string& directory, std::vector<std::string>& outFiles);
+
 	static std::string GetFilePath(const std::string& filepath);
+
+	// 可写的缓存目录，桌面平台在资源目录下的cache/，Android在internalDataPath下。
+	static std::string GetCachePath(const std::string& filename);
+
+	// 把路径分隔符等字符替换为'_'，用来生成缓存文件名
+	static std::string SanitizeFileName(const std::string& filename);
+
+	// 先写临时文件再rename替换，进程中途退出也不会留下写了一半的缓存。
+	static bool WriteCacheFile(const std::string& filename, const uint8* dataPtr, uint32 dataSize);
+
+private:
+	static FileViewRef MapAbsoluteFile(const std::string& finalPath, bool isAsset);
 };
\ No newline at end of file
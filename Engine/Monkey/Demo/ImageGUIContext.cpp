@@ -81,8 +81,7 @@ static uint32_t g__glsl_shader_frag_spv[] =
 
 ImageGUIContext::ImageGUIContext()
     : m_VulkanDevice(nullptr)
-    , m_VertexCount(0)
-    , m_IndexCount(0)
+    , m_BufferIndex(0)
     , m_Subpass(0)
     , m_DescriptorPool(VK_NULL_HANDLE)
     , m_DescriptorSetLayout(VK_NULL_HANDLE)
@@ -108,8 +107,16 @@ ImageGUIContext::~ImageGUIContext()
     
 }
 
-void ImageGUIContext::Init(const std::string& font)
+void ImageGUIContext::Init(const std::string& font, int32 framesInFlight)
 {
+	// 每个frame slot一套顶点/索引buffer，避免覆盖GPU还在读取的数据
+	int32 numBuffers = MMath::Max(framesInFlight, 1);
+	m_VertexBuffers.resize(numBuffers);
+	m_IndexBuffers.resize(numBuffers);
+	m_VertexCounts.resize(numBuffers, 0);
+	m_IndexCounts.resize(numBuffers, 0);
+	m_BufferIndex = 0;
+
 	ImGui::CreateContext();
 	ImGui::StyleColorsLight();
 
@@ -335,8 +342,11 @@ void ImageGUIContext::Destroy()
 {
 	VkDevice device = m_VulkanDevice->GetInstanceHandle();
     ImGui::DestroyContext();
-	m_VertexBuffer.Destroy();
-	m_IndexBuffer.Destroy();
+	for (size_t i = 0; i < m_VertexBuffers.size(); ++i) 
+	{
+		m_VertexBuffers[i].Destroy();
+		m_IndexBuffers[i].Destroy();
+	}
 	vkDestroyDescriptorPool(device, m_DescriptorPool, VULKAN_CPU_ALLOCATOR);
 	vkDestroyDescriptorSetLayout(device, m_DescriptorSetLayout, VULKAN_CPU_ALLOCATOR);
 	vkDestroyPipelineLayout(device, m_PipelineLayout, VULKAN_CPU_ALLOCATOR);
@@ -648,30 +658,53 @@ bool ImageGUIContext::Update()
 	if ((vertexBufferSize == 0) || (indexBufferSize == 0)) {
 		return false;
 	}
+
+	// the slot about to be written was last used framesInFlight frames ago and has been retired by AcquireBackbufferIndex.
+	if (m_VertexBuffers.size() > 1) 
+	{
+		m_BufferIndex = (m_BufferIndex + 1) % m_VertexBuffers.size();
+		updateCmdBuffers = true;
+	}
+
+	UIBuffer& vertexBuffer = m_VertexBuffers[m_BufferIndex];
+	UIBuffer& indexBuffer  = m_IndexBuffers[m_BufferIndex];
+	int32& vertexCount     = m_VertexCounts[m_BufferIndex];
+	int32& indexCount      = m_IndexCounts[m_BufferIndex];
+
+	// grow only, the slot is already retired so recreating it needs no wait.
+	bool recreateVertex = (vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount < imDrawData->TotalVtxCount);
+	bool recreateIndex  = (indexBuffer.buffer  == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount);
+
+	// draw commands change with the geometry, callers re-record on true.
+	if (m_DrawVertexCount != imDrawData->TotalVtxCount || m_DrawIndexCount != imDrawData->TotalIdxCount) {
+		m_DrawVertexCount = imDrawData->TotalVtxCount;
+		m_DrawIndexCount  = imDrawData->TotalIdxCount;
+		updateCmdBuffers  = true;
+	}
 	
 	// Vertex buffer
-	if ((m_VertexBuffer.buffer == VK_NULL_HANDLE) || (m_VertexCount != imDrawData->TotalVtxCount)) {
-		m_VertexCount = imDrawData->TotalVtxCount;
-		m_VertexBuffer.Unmap();
-		m_VertexBuffer.Destroy();
-		CreateBuffer(m_VertexBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexBufferSize);
-		m_VertexBuffer.Map();
+	if (recreateVertex) {
+		vertexCount = imDrawData->TotalVtxCount;
+		vertexBuffer.Unmap();
+		vertexBuffer.Destroy();
+		CreateBuffer(vertexBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexBufferSize);
+		vertexBuffer.Map();
 		updateCmdBuffers = true;
 	}
     
 	// Index buffer
-	if ((m_IndexBuffer.buffer == VK_NULL_HANDLE) || (m_IndexCount < imDrawData->TotalIdxCount)) {
-		m_IndexCount = imDrawData->TotalIdxCount;
-		m_IndexBuffer.Unmap();
-		m_IndexBuffer.Destroy();
-		CreateBuffer(m_IndexBuffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indexBufferSize);
-		m_IndexBuffer.Map();
+	if (recreateIndex) {
+		indexCount = imDrawData->TotalIdxCount;
+		indexBuffer.Unmap();
+		indexBuffer.Destroy();
+		CreateBuffer(indexBuffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indexBufferSize);
+		indexBuffer.Map();
 		updateCmdBuffers = true;
 	}
 
 	// Upload data
-	ImDrawVert* vtxDst = (ImDrawVert*)m_VertexBuffer.mapped;
-	ImDrawIdx* idxDst  = (ImDrawIdx*)m_IndexBuffer.mapped;
+	ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped;
+	ImDrawIdx* idxDst  = (ImDrawIdx*)indexBuffer.mapped;
 
 	for (int n = 0; n < imDrawData->CmdListsCount; n++) {
 		const ImDrawList* cmdList = imDrawData->CmdLists[n];
@@ -681,8 +714,8 @@ bool ImageGUIContext::Update()
 		idxDst += cmdList->IdxBuffer.Size;
 	}
 
-	m_VertexBuffer.Flush();
-	m_IndexBuffer.Flush();
+	vertexBuffer.Flush();
+	indexBuffer.Flush();
 
 	return updateCmdBuffers || m_Updated;
 }
@@ -757,8 +790,8 @@ void ImageGUIContext::BindDrawCmd(const VkCommandBuffer& commandBuffer, const Vk
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline);
 	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSet, 0, nullptr);
 	vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &m_PushData);
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_VertexBuffer.buffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_VertexBuffers[m_BufferIndex].buffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffers[m_BufferIndex].buffer, 0, VK_INDEX_TYPE_UINT16);
 
 	for (int32_t i = 0; i < imDrawData->CmdListsCount; ++i)
 	{
@@ -91,7 +91,8 @@ protected:
     
 public:
 
-    void Init(const std::string& font);
+    // framesInFlight > 1 rings the vertex/index buffers, Update() must then be called once per frame after the frame slot has been acquired.
+    void Init(const std::string& font, int32 framesInFlight = 1);
     
     void Destroy();
     
@@ -126,10 +127,13 @@ protected:
     
 	VulkanDeviceRef			m_VulkanDevice;
     
-    UIBuffer                m_VertexBuffer;
-    UIBuffer                m_IndexBuffer;
-    int32                   m_VertexCount;
-    int32                   m_IndexCount;
+    std::vector<UIBuffer>   m_VertexBuffers;
+    std::vector<UIBuffer>   m_IndexBuffers;
+    std::vector<int32>      m_VertexCounts;     // buffer容量，只增不减
+    std::vector<int32>      m_IndexCounts;
+    int32                   m_BufferIndex;
+    int32                   m_DrawVertexCount = 0;
+    int32                   m_DrawIndexCount = 0;
     
     int32                   m_Subpass;
     
@@ -87,6 +87,9 @@ void EngineLoop()
 
 void EngineExit()
 {
+	// frames may still be in flight, make sure the gpu is done before tearing down resources.
+	vkDeviceWaitIdle(g_GameEngine->GetVulkanRHI()->GetDevice()->GetInstanceHandle());
+
 	g_AppModule->Exist();
     g_AppModule = nullptr;
     
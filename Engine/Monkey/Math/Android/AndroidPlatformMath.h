@@ -1,9 +1,10 @@
 ﻿#pragma once
 
 #include "Math/GenericPlatformMath.h"
+#include "Math/PlatformVectorMath.h"
 #include "Configuration/Platform.h"
 
-struct AndroidPlatformMath : public GenericPlatformMath
+struct AndroidPlatformMath : public PlatformVectorMath
 {
     
 };
@@ -1,9 +1,10 @@
 ﻿#pragma once
 
 #include "Math/GenericPlatformMath.h"
+#include "Math/PlatformVectorMath.h"
 #include "Configuration/Platform.h"
 
-struct IOSPlatformMath : public GenericPlatformMath
+struct IOSPlatformMath : public PlatformVectorMath
 {
     
 };
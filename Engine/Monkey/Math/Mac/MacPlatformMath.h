@@ -1,10 +1,11 @@
 ﻿#pragma once
 
 #include "Math/GenericPlatformMath.h"
+#include "Math/PlatformVectorMath.h"
 #include "Configuration/Platform.h"
 #include <xmmintrin.h>
 
-struct MacPlatformMath : public GenericPlatformMath
+struct MacPlatformMath : public PlatformVectorMath
 {
     static FORCEINLINE uint32 CountLeadingZeros(uint32 value)
     {
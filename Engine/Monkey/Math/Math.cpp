@@ -92,7 +92,7 @@ Vector2 MMath::RandPointInCircle(float circleRadius)
 	do
 	{
 		point.x = FRand() * 2.f - 1.f;
-		point.x = FRand() * 2.f - 1.f;
+		point.y = FRand() * 2.f - 1.f;
 		l = point.SizeSquared();
 	} while (l > 1.0f);
 
@@ -220,19 +220,46 @@ Vector3 MMath::LinePlaneIntersection(const Vector3& point1, const Vector3& point
 }
 
 Vector3 MMath::VRand()
+{
+	return VRand(RandomStream::GetThreadStream());
+}
+
+Vector3 MMath::VRand(RandomStream& stream)
 {
 	Vector3 result;
 	float l;
 	do
 	{
-		result.x = FRand() * 2.f - 1.f;
-		result.y = FRand() * 2.f - 1.f;
-		result.z = FRand() * 2.f - 1.f;
+		result.x = stream.GetFraction() * 2.f - 1.f;
+		result.y = stream.GetFraction() * 2.f - 1.f;
+		result.z = stream.GetFraction() * 2.f - 1.f;
 		l = result.SizeSquared();
 	} while (l > 1.0f || l < KINDA_SMALL_NUMBER);
 	return result * (1.0f / Sqrt(l));
 }
 
+void MMath::VRandArray(Vector3* outVectors, int32 count, RandomStream& stream)
+{
+	// 一次生成一批候选点，球外的丢掉，平均每个向量需要6/PI组
+	const int32 batchSize = 64;
+	float values[batchSize * 3];
+
+	int32 index = 0;
+	while (index < count)
+	{
+		stream.FillRange(values, batchSize * 3, -1.0f, 1.0f);
+
+		for (int32 i = 0; i < batchSize && index < count; ++i)
+		{
+			Vector3 v(values[i * 3 + 0], values[i * 3 + 1], values[i * 3 + 2]);
+			float l = v.SizeSquared();
+			if (l <= 1.0f && l >= KINDA_SMALL_NUMBER) {
+				outVectors[index++] = v * (1.0f / Sqrt(l));
+			}
+		}
+	}
+}
+
 bool MMath::LineSphereIntersection(const Vector3& start, const Vector3& dir, float length, const Vector3& origin, float radius)
 {
 	const Vector3 eo = start - origin;
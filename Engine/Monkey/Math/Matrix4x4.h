@@ -125,6 +125,14 @@ public:
 
 	FORCEINLINE Vector3 InverseTransformPosition(const Vector3 &v) const;
 
+	// 批量变换，outPositions可以和positions相同
+	FORCEINLINE void TransformPositions(Vector3* outPositions, const Vector3* positions, int32 count) const;
+
+	FORCEINLINE void TransformVector4s(Vector4* outVectors, const Vector4* vectors, int32 count) const;
+
+	// result[i] = matrices1[i] * matrices2[i]
+	FORCEINLINE static void MultiplyArray(Matrix4x4* result, const Matrix4x4* matrices1, const Matrix4x4* matrices2, int32 count);
+
 	FORCEINLINE Vector4 TransformVector(const Vector3& v) const;
 
 	FORCEINLINE Vector3 InverseTransformVector(const Vector3 &v) const;
@@ -915,6 +923,21 @@ FORCEINLINE Vector4 Matrix4x4::TransformPosition(const Vector3 &v) const
 	return TransformVector4(Vector4(v.x, v.y, v.z, 1.0f));
 }
 
+FORCEINLINE void Matrix4x4::TransformPositions(Vector3* outPositions, const Vector3* positions, int32 count) const
+{
+	MMath::VectorTransformPositions(outPositions, positions, count, this);
+}
+
+FORCEINLINE void Matrix4x4::TransformVector4s(Vector4* outVectors, const Vector4* vectors, int32 count) const
+{
+	MMath::VectorTransformVectorArray(outVectors, vectors, count, this);
+}
+
+FORCEINLINE void Matrix4x4::MultiplyArray(Matrix4x4* result, const Matrix4x4* matrices1, const Matrix4x4* matrices2, int32 count)
+{
+	MMath::VectorMatrixMultiplyArray(result, matrices1, matrices2, count);
+}
+
 FORCEINLINE Vector3 Matrix4x4::InverseTransformPosition(const Vector3 &v) const
 {
 	Matrix4x4 invSelf = this->InverseFast();
@@ -0,0 +1,20 @@
+﻿#pragma once
+
+#include "Math/GenericPlatformMath.h"
+
+// 按编译目标的指令集选择矩阵运算的实现，定义MONKEY_MATH_SCALAR可以强制使用标量版本
+// ARM暂时使用标量版本，NEON实现需要在ARM工具链上验证之后再加入
+#if defined(MONKEY_MATH_SCALAR)
+    #define PLATFORM_MATH_SSE  0
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PLATFORM_MATH_SSE  1
+#else
+    #define PLATFORM_MATH_SSE  0
+#endif
+
+#if PLATFORM_MATH_SSE
+    #include "Math/VectorMathSSE.h"
+    typedef VectorMathSSE PlatformVectorMath;
+#else
+    typedef GenericPlatformMath PlatformVectorMath;
+#endif
@@ -0,0 +1,24 @@
+﻿#include "RandomStream.h"
+
+#include <atomic>
+
+static std::atomic<uint64> G_GlobalSeed(0x853c49e6748fea9bull);
+static std::atomic<uint64> G_ThreadOrdinal(0);
+
+void RandomStream::SetGlobalSeed(uint64 seed)
+{
+	// 调用线程用0号序列，之后初始化的线程从1开始编号
+	G_GlobalSeed.store(seed, std::memory_order_relaxed);
+	G_ThreadOrdinal.store(1, std::memory_order_relaxed);
+	GetThreadStream().Initialize(seed, 0);
+}
+
+uint64 RandomStream::GetGlobalSeed()
+{
+	return G_GlobalSeed.load(std::memory_order_relaxed);
+}
+
+uint64 RandomStream::NextThreadOrdinal()
+{
+	return G_ThreadOrdinal.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,204 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+/**
+ * xoshiro128** generator, 128 bit state, period 2^128 - 1. No locks and no shared state,
+ * every thread owns its streams, so sampling from many threads does not serialize like rand().
+ *
+ * Streams created with the same seed and different stream indices are seeded through SplitMix64
+ * and are independent in practice. Jump()/Split() give sequences that are guaranteed not to overlap.
+ */
+class RandomStream
+{
+public:
+	RandomStream()
+	{
+		Initialize(0, 0);
+	}
+
+	explicit RandomStream(uint64 seed, uint64 stream = 0)
+	{
+		Initialize(seed, stream);
+	}
+
+	// 同一个seed不同的stream得到不同的序列，用tile或者任务编号做stream结果和线程调度无关
+	void Initialize(uint64 seed, uint64 stream = 0)
+	{
+		uint64 x = seed;
+		uint64 s = SplitMix64(x) ^ stream;
+		uint64 a = SplitMix64(s);
+		uint64 b = SplitMix64(s);
+		m_State[0] = (uint32)(a);
+		m_State[1] = (uint32)(a >> 32);
+		m_State[2] = (uint32)(b);
+		m_State[3] = (uint32)(b >> 32);
+		// 全0是不动点
+		if ((m_State[0] | m_State[1] | m_State[2] | m_State[3]) == 0) {
+			m_State[0] = 1;
+		}
+	}
+
+	// 相当于调用2^64次GetUInt32
+	void Jump()
+	{
+		static const uint32 jump[4] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+
+		uint32 s0 = 0;
+		uint32 s1 = 0;
+		uint32 s2 = 0;
+		uint32 s3 = 0;
+
+		for (int32 i = 0; i < 4; ++i)
+		{
+			for (int32 b = 0; b < 32; ++b)
+			{
+				if (jump[i] & (1u << b))
+				{
+					s0 ^= m_State[0];
+					s1 ^= m_State[1];
+					s2 ^= m_State[2];
+					s3 ^= m_State[3];
+				}
+				GetUInt32();
+			}
+		}
+
+		m_State[0] = s0;
+		m_State[1] = s1;
+		m_State[2] = s2;
+		m_State[3] = s3;
+	}
+
+	// 返回当前位置的序列，自己前进2^64，反复Split可以分给多个线程
+	RandomStream Split()
+	{
+		RandomStream child = *this;
+		Jump();
+		return child;
+	}
+
+	FORCEINLINE uint32 GetUInt32()
+	{
+		return Next(m_State[0], m_State[1], m_State[2], m_State[3]);
+	}
+
+	// [0, 1)
+	FORCEINLINE float GetFraction()
+	{
+		return ToFraction(GetUInt32());
+	}
+
+	FORCEINLINE float FRandRange(float inMin, float inMax)
+	{
+		return inMin + (inMax - inMin) * GetFraction();
+	}
+
+	// [inMin, inMax]
+	FORCEINLINE int32 RandRange(int32 inMin, int32 inMax)
+	{
+		const uint32 range = (uint32)(inMax - inMin) + 1;
+		return inMin + (int32)(((uint64)GetUInt32() * range) >> 32);
+	}
+
+	FORCEINLINE bool RandBool()
+	{
+		return (GetUInt32() >> 31) != 0;
+	}
+
+	// 批量接口，状态放在局部变量里整段生成，比逐个调用少了每次的读写
+	void FillUInt32(uint32* outValues, int32 count)
+	{
+		uint32 s0 = m_State[0];
+		uint32 s1 = m_State[1];
+		uint32 s2 = m_State[2];
+		uint32 s3 = m_State[3];
+
+		for (int32 i = 0; i < count; ++i) {
+			outValues[i] = Next(s0, s1, s2, s3);
+		}
+
+		m_State[0] = s0;
+		m_State[1] = s1;
+		m_State[2] = s2;
+		m_State[3] = s3;
+	}
+
+	void FillFractions(float* outValues, int32 count)
+	{
+		FillRange(outValues, count, 0.0f, 1.0f);
+	}
+
+	void FillRange(float* outValues, int32 count, float inMin, float inMax)
+	{
+		const float scale = inMax - inMin;
+
+		uint32 s0 = m_State[0];
+		uint32 s1 = m_State[1];
+		uint32 s2 = m_State[2];
+		uint32 s3 = m_State[3];
+
+		for (int32 i = 0; i < count; ++i) {
+			outValues[i] = inMin + scale * ToFraction(Next(s0, s1, s2, s3));
+		}
+
+		m_State[0] = s0;
+		m_State[1] = s1;
+		m_State[2] = s2;
+		m_State[3] = s3;
+	}
+
+	// 调用线程自己的序列，第一次使用时用全局seed和线程序号初始化
+	static FORCEINLINE RandomStream& GetThreadStream()
+	{
+		static thread_local RandomStream stream(GetGlobalSeed(), NextThreadOrdinal());
+		return stream;
+	}
+
+	// 重新初始化调用线程的序列，之后才第一次使用随机数的线程也会用新的seed。
+	// 已经初始化过的其他线程不受影响。
+	static void SetGlobalSeed(uint64 seed);
+
+	static uint64 GetGlobalSeed();
+
+private:
+
+	static uint64 NextThreadOrdinal();
+
+	static FORCEINLINE uint32 Rotl(uint32 x, int32 k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	static FORCEINLINE float ToFraction(uint32 x)
+	{
+		// 高24位正好填满float的尾数
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	static FORCEINLINE uint32 Next(uint32& s0, uint32& s1, uint32& s2, uint32& s3)
+	{
+		const uint32 result = Rotl(s1 * 5, 7) * 9;
+		const uint32 t = s1 << 9;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3  = Rotl(s3, 11);
+
+		return result;
+	}
+
+	static FORCEINLINE uint64 SplitMix64(uint64& x)
+	{
+		uint64 z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+private:
+	uint32	m_State[4];
+};
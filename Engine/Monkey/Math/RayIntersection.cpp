@@ -0,0 +1,472 @@
+﻿#include "Math/RayIntersection.h"
+#include "Math/VectorRegister.h"
+#include "Math/Math.h"
+
+#include <float.h>
+
+#define TRIANGLE_DET_EPSILON 1e-12f
+
+static FORCEINLINE int32 PaddedSize(int32 count)
+{
+	return (count + 3) & ~3;
+}
+
+// 4个lane里距离最近的一个，距离相同时取序号小的，和逐个测试时的结果一致
+static FORCEINLINE int32 SelectClosestLane(const VectorRegister& dist, const VectorRegister& index, float& outDist)
+{
+	float dists[4];
+	float indices[4];
+	VectorStore(dist,  dists);
+	VectorStore(index, indices);
+
+	int32 best = -1;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (indices[i] < 0.0f) {
+			continue;
+		}
+		if (best < 0 || dists[i] < dists[best] || (dists[i] == dists[best] && indices[i] < indices[best])) {
+			best = i;
+		}
+	}
+
+	if (best < 0) {
+		return -1;
+	}
+
+	outDist = dists[best];
+	return (int32)indices[best];
+}
+
+void SphereSoA::Clear()
+{
+	data.clear();
+	count = 0;
+	size  = 0;
+}
+
+int32 SphereSoA::Add(const Vector3& center, float radius)
+{
+	if ((size & 3) == 0)
+	{
+		// 新的一组先按补齐的数据初始化
+		data.resize(data.size() + BlockFloats, 0.0f);
+		float* block = &data[data.size() - BlockFloats];
+		for (int32 i = 0; i < 4; ++i) {
+			block[12 + i] = -1e30f;
+		}
+	}
+
+	float* block = &data[(size >> 2) * BlockFloats];
+	int32 lane   = size & 3;
+	block[0  + lane] = center.x;
+	block[4  + lane] = center.y;
+	block[8  + lane] = center.z;
+	block[12 + lane] = radius * radius;
+
+	count += 1;
+	size  += 1;
+
+	return size - 1;
+}
+
+void SphereSoA::Finalize()
+{
+	size = PaddedSize(size);
+}
+
+void TriangleSoA::Clear()
+{
+	data.clear();
+	count = 0;
+	size  = 0;
+}
+
+int32 TriangleSoA::Add(const Vector3& v0, const Vector3& v1, const Vector3& v2)
+{
+	if ((size & 3) == 0) {
+		data.resize(data.size() + BlockFloats, 0.0f);
+	}
+
+	Set(size, v0, v1, v2);
+
+	count += 1;
+	size  += 1;
+
+	return size - 1;
+}
+
+void TriangleSoA::Set(int32 index, const Vector3& v0, const Vector3& v1, const Vector3& v2)
+{
+	Vector3 e1 = v1 - v0;
+	Vector3 e2 = v2 - v0;
+
+	float* block = &data[(index >> 2) * BlockFloats];
+	int32 lane   = index & 3;
+	block[0  + lane] = v0.x;
+	block[4  + lane] = v0.y;
+	block[8  + lane] = v0.z;
+	block[12 + lane] = e1.x;
+	block[16 + lane] = e1.y;
+	block[20 + lane] = e1.z;
+	block[24 + lane] = e2.x;
+	block[28 + lane] = e2.y;
+	block[32 + lane] = e2.z;
+}
+
+void TriangleSoA::Finalize()
+{
+	size = PaddedSize(size);
+}
+
+void RayPacket4::Set(int32 lane, const Vector3& origin, const Vector3& direction)
+{
+	originX[lane]    = origin.x;
+	originY[lane]    = origin.y;
+	originZ[lane]    = origin.z;
+	directionX[lane] = direction.x;
+	directionY[lane] = direction.y;
+	directionZ[lane] = direction.z;
+}
+
+void PacketHit4::Reset(float maxDist)
+{
+	for (int32 i = 0; i < 4; ++i)
+	{
+		dist[i]  = maxDist;
+		index[i] = -1;
+		u[i]     = 0.0f;
+		v[i]     = 0.0f;
+	}
+}
+
+int32 RayIntersection::IntersectSpheres(const SphereSoA& spheres, const Vector3& origin, const Vector3& direction, float tMin, float& dist)
+{
+	const VectorRegister ox   = VectorSetFloat1(origin.x);
+	const VectorRegister oy   = VectorSetFloat1(origin.y);
+	const VectorRegister oz   = VectorSetFloat1(origin.z);
+	const VectorRegister dx   = VectorSetFloat1(direction.x);
+	const VectorRegister dy   = VectorSetFloat1(direction.y);
+	const VectorRegister dz   = VectorSetFloat1(direction.z);
+	const VectorRegister minT = VectorSetFloat1(tMin);
+	const VectorRegister zero = VectorZero();
+	const VectorRegister step = VectorSetFloat1(4.0f);
+
+	VectorRegister bestDist  = VectorSetFloat1(dist);
+	VectorRegister bestIndex = VectorSetFloat1(-1.0f);
+	VectorRegister index     = VectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+
+	const int32 padded = spheres.PaddedCount();
+	for (int32 i = 0; i < padded; i += 4)
+	{
+		const float* block = spheres.GetBlock(i);
+
+		VectorRegister ocx = VectorSubtract(ox, VectorLoad(block + 0));
+		VectorRegister ocy = VectorSubtract(oy, VectorLoad(block + 4));
+		VectorRegister ocz = VectorSubtract(oz, VectorLoad(block + 8));
+
+		// 方向已经归一化，a = 1
+		VectorRegister b = VectorAdd(VectorAdd(VectorMultiply(ocx, dx), VectorMultiply(ocy, dy)), VectorMultiply(ocz, dz));
+		VectorRegister c = VectorAdd(VectorAdd(VectorMultiply(ocx, ocx), VectorMultiply(ocy, ocy)), VectorMultiply(ocz, ocz));
+		c = VectorSubtract(c, VectorLoad(block + 12));
+
+		VectorRegister h = VectorSubtract(VectorMultiply(b, b), c);
+		VectorRegister t = VectorSubtract(VectorSubtract(zero, b), VectorSqrt(VectorMax(h, zero)));
+
+		VectorRegister mask = VectorCompareGE(h, zero);
+		mask = VectorBitwiseAnd(mask, VectorCompareGT(t, minT));
+		mask = VectorBitwiseAnd(mask, VectorCompareLT(t, bestDist));
+
+		bestDist  = VectorSelect(mask, t, bestDist);
+		bestIndex = VectorSelect(mask, index, bestIndex);
+		index     = VectorAdd(index, step);
+	}
+
+	return SelectClosestLane(bestDist, bestIndex, dist);
+}
+
+int32 RayIntersection::IntersectTriangles(const TriangleSoA& triangles, const Vector3& origin, const Vector3& direction, float tMin, float& dist, float& u, float& v)
+{
+	return IntersectTriangles(triangles, 0, triangles.PaddedCount(), origin, direction, tMin, dist, u, v);
+}
+
+int32 RayIntersection::IntersectTriangles(const TriangleSoA& triangles, int32 begin, int32 end, const Vector3& origin, const Vector3& direction, float tMin, float& dist, float& u, float& v)
+{
+	const VectorRegister ox   = VectorSetFloat1(origin.x);
+	const VectorRegister oy   = VectorSetFloat1(origin.y);
+	const VectorRegister oz   = VectorSetFloat1(origin.z);
+	const VectorRegister dx   = VectorSetFloat1(direction.x);
+	const VectorRegister dy   = VectorSetFloat1(direction.y);
+	const VectorRegister dz   = VectorSetFloat1(direction.z);
+	const VectorRegister minT = VectorSetFloat1(tMin);
+	const VectorRegister zero = VectorZero();
+	const VectorRegister one  = VectorSetFloat1(1.0f);
+	const VectorRegister eps  = VectorSetFloat1(TRIANGLE_DET_EPSILON);
+	const VectorRegister step = VectorSetFloat1(4.0f);
+
+	VectorRegister bestDist  = VectorSetFloat1(dist);
+	VectorRegister bestIndex = VectorSetFloat1(-1.0f);
+	VectorRegister bestU     = zero;
+	VectorRegister bestV     = zero;
+	VectorRegister index     = VectorAdd(VectorSet(0.0f, 1.0f, 2.0f, 3.0f), VectorSetFloat1((float)begin));
+
+	for (int32 i = begin; i < end; i += 4)
+	{
+		const float* block = triangles.GetBlock(i);
+
+		VectorRegister e1x = VectorLoad(block + 12);
+		VectorRegister e1y = VectorLoad(block + 16);
+		VectorRegister e1z = VectorLoad(block + 20);
+		VectorRegister e2x = VectorLoad(block + 24);
+		VectorRegister e2y = VectorLoad(block + 28);
+		VectorRegister e2z = VectorLoad(block + 32);
+
+		// p = d x e2
+		VectorRegister px = VectorSubtract(VectorMultiply(dy, e2z), VectorMultiply(dz, e2y));
+		VectorRegister py = VectorSubtract(VectorMultiply(dz, e2x), VectorMultiply(dx, e2z));
+		VectorRegister pz = VectorSubtract(VectorMultiply(dx, e2y), VectorMultiply(dy, e2x));
+
+		VectorRegister det    = VectorAdd(VectorAdd(VectorMultiply(e1x, px), VectorMultiply(e1y, py)), VectorMultiply(e1z, pz));
+		VectorRegister invDet = VectorDivide(one, det);
+
+		VectorRegister sx = VectorSubtract(ox, VectorLoad(block + 0));
+		VectorRegister sy = VectorSubtract(oy, VectorLoad(block + 4));
+		VectorRegister sz = VectorSubtract(oz, VectorLoad(block + 8));
+
+		VectorRegister bu = VectorMultiply(VectorAdd(VectorAdd(VectorMultiply(sx, px), VectorMultiply(sy, py)), VectorMultiply(sz, pz)), invDet);
+
+		// q = s x e1
+		VectorRegister qx = VectorSubtract(VectorMultiply(sy, e1z), VectorMultiply(sz, e1y));
+		VectorRegister qy = VectorSubtract(VectorMultiply(sz, e1x), VectorMultiply(sx, e1z));
+		VectorRegister qz = VectorSubtract(VectorMultiply(sx, e1y), VectorMultiply(sy, e1x));
+
+		VectorRegister bv = VectorMultiply(VectorAdd(VectorAdd(VectorMultiply(dx, qx), VectorMultiply(dy, qy)), VectorMultiply(dz, qz)), invDet);
+		VectorRegister t  = VectorMultiply(VectorAdd(VectorAdd(VectorMultiply(e2x, qx), VectorMultiply(e2y, qy)), VectorMultiply(e2z, qz)), invDet);
+
+		VectorRegister absDet = VectorMax(det, VectorSubtract(zero, det));
+
+		// 补齐的三角形det为0，u、v、t可能是NaN，比较结果都是false
+		VectorRegister mask = VectorCompareGT(absDet, eps);
+		mask = VectorBitwiseAnd(mask, VectorCompareGE(bu, zero));
+		mask = VectorBitwiseAnd(mask, VectorCompareGE(bv, zero));
+		mask = VectorBitwiseAnd(mask, VectorCompareLE(VectorAdd(bu, bv), one));
+		mask = VectorBitwiseAnd(mask, VectorCompareGT(t, minT));
+		mask = VectorBitwiseAnd(mask, VectorCompareLT(t, bestDist));
+
+		bestDist  = VectorSelect(mask, t, bestDist);
+		bestIndex = VectorSelect(mask, index, bestIndex);
+		bestU     = VectorSelect(mask, bu, bestU);
+		bestV     = VectorSelect(mask, bv, bestV);
+		index     = VectorAdd(index, step);
+	}
+
+	int32 result = SelectClosestLane(bestDist, bestIndex, dist);
+	if (result >= 0)
+	{
+		// 序号为i + lane，i是4的倍数
+		float us[4];
+		float vs[4];
+		VectorStore(bestU, us);
+		VectorStore(bestV, vs);
+		u = us[result & 3];
+		v = vs[result & 3];
+	}
+
+	return result;
+}
+
+int32 RayIntersection::IntersectSpheres(const SphereSoA& spheres, const RayPacket4& packet, float tMin, PacketHit4& hit)
+{
+	const VectorRegister ox   = VectorLoad(packet.originX);
+	const VectorRegister oy   = VectorLoad(packet.originY);
+	const VectorRegister oz   = VectorLoad(packet.originZ);
+	const VectorRegister dx   = VectorLoad(packet.directionX);
+	const VectorRegister dy   = VectorLoad(packet.directionY);
+	const VectorRegister dz   = VectorLoad(packet.directionZ);
+	const VectorRegister minT = VectorSetFloat1(tMin);
+	const VectorRegister zero = VectorZero();
+
+	VectorRegister bestDist  = VectorLoad(hit.dist);
+	VectorRegister bestIndex = VectorSetFloat1(-1.0f);
+	VectorRegister anyHit    = zero;
+
+	const int32 padded = spheres.PaddedCount();
+	for (int32 i = 0; i < padded; ++i)
+	{
+		const float* sphere = spheres.GetBlock(i) + (i & 3);
+
+		VectorRegister ocx = VectorSubtract(ox, VectorSetFloat1(sphere[0]));
+		VectorRegister ocy = VectorSubtract(oy, VectorSetFloat1(sphere[4]));
+		VectorRegister ocz = VectorSubtract(oz, VectorSetFloat1(sphere[8]));
+
+		VectorRegister b = VectorAdd(VectorAdd(VectorMultiply(ocx, dx), VectorMultiply(ocy, dy)), VectorMultiply(ocz, dz));
+		VectorRegister c = VectorAdd(VectorAdd(VectorMultiply(ocx, ocx), VectorMultiply(ocy, ocy)), VectorMultiply(ocz, ocz));
+		c = VectorSubtract(c, VectorSetFloat1(sphere[12]));
+
+		VectorRegister h = VectorSubtract(VectorMultiply(b, b), c);
+		VectorRegister t = VectorSubtract(VectorSubtract(zero, b), VectorSqrt(VectorMax(h, zero)));
+
+		VectorRegister mask = VectorCompareGE(h, zero);
+		mask = VectorBitwiseAnd(mask, VectorCompareGT(t, minT));
+		mask = VectorBitwiseAnd(mask, VectorCompareLT(t, bestDist));
+
+		bestDist  = VectorSelect(mask, t, bestDist);
+		bestIndex = VectorSelect(mask, VectorSetFloat1((float)i), bestIndex);
+		anyHit    = VectorBitwiseOr(anyHit, mask);
+	}
+
+	float indices[4];
+	VectorStore(bestDist, hit.dist);
+	VectorStore(bestIndex, indices);
+
+	int32 hitMask = VectorMaskBits(anyHit);
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (hitMask & (1 << i)) {
+			hit.index[i] = (int32)indices[i];
+		}
+	}
+
+	return hitMask;
+}
+
+int32 RayIntersection::IntersectTriangles(const TriangleSoA& triangles, const RayPacket4& packet, float tMin, PacketHit4& hit)
+{
+	const VectorRegister ox   = VectorLoad(packet.originX);
+	const VectorRegister oy   = VectorLoad(packet.originY);
+	const VectorRegister oz   = VectorLoad(packet.originZ);
+	const VectorRegister dx   = VectorLoad(packet.directionX);
+	const VectorRegister dy   = VectorLoad(packet.directionY);
+	const VectorRegister dz   = VectorLoad(packet.directionZ);
+	const VectorRegister minT = VectorSetFloat1(tMin);
+	const VectorRegister zero = VectorZero();
+	const VectorRegister one  = VectorSetFloat1(1.0f);
+	const VectorRegister eps  = VectorSetFloat1(TRIANGLE_DET_EPSILON);
+
+	VectorRegister bestDist  = VectorLoad(hit.dist);
+	VectorRegister bestIndex = VectorSetFloat1(-1.0f);
+	VectorRegister bestU     = VectorLoad(hit.u);
+	VectorRegister bestV     = VectorLoad(hit.v);
+	VectorRegister anyHit    = zero;
+
+	const int32 padded = triangles.PaddedCount();
+	for (int32 i = 0; i < padded; ++i)
+	{
+		const float* triangle = triangles.GetBlock(i) + (i & 3);
+
+		VectorRegister e1x = VectorSetFloat1(triangle[12]);
+		VectorRegister e1y = VectorSetFloat1(triangle[16]);
+		VectorRegister e1z = VectorSetFloat1(triangle[20]);
+		VectorRegister e2x = VectorSetFloat1(triangle[24]);
+		VectorRegister e2y = VectorSetFloat1(triangle[28]);
+		VectorRegister e2z = VectorSetFloat1(triangle[32]);
+
+		VectorRegister px = VectorSubtract(VectorMultiply(dy, e2z), VectorMultiply(dz, e2y));
+		VectorRegister py = VectorSubtract(VectorMultiply(dz, e2x), VectorMultiply(dx, e2z));
+		VectorRegister pz = VectorSubtract(VectorMultiply(dx, e2y), VectorMultiply(dy, e2x));
+
+		VectorRegister det    = VectorAdd(VectorAdd(VectorMultiply(e1x, px), VectorMultiply(e1y, py)), VectorMultiply(e1z, pz));
+		VectorRegister invDet = VectorDivide(one, det);
+
+		VectorRegister sx = VectorSubtract(ox, VectorSetFloat1(triangle[0]));
+		VectorRegister sy = VectorSubtract(oy, VectorSetFloat1(triangle[4]));
+		VectorRegister sz = VectorSubtract(oz, VectorSetFloat1(triangle[8]));
+
+		VectorRegister bu = VectorMultiply(VectorAdd(VectorAdd(VectorMultiply(sx, px), VectorMultiply(sy, py)), VectorMultiply(sz, pz)), invDet);
+
+		VectorRegister qx = VectorSubtract(VectorMultiply(sy, e1z), VectorMultiply(sz, e1y));
+		VectorRegister qy = VectorSubtract(VectorMultiply(sz, e1x), VectorMultiply(sx, e1z));
+		VectorRegister qz = VectorSubtract(VectorMultiply(sx, e1y), VectorMultiply(sy, e1x));
+
+		VectorRegister bv = VectorMultiply(VectorAdd(VectorAdd(VectorMultiply(dx, qx), VectorMultiply(dy, qy)), VectorMultiply(dz, qz)), invDet);
+		VectorRegister t  = VectorMultiply(VectorAdd(VectorAdd(VectorMultiply(e2x, qx), VectorMultiply(e2y, qy)), VectorMultiply(e2z, qz)), invDet);
+
+		VectorRegister absDet = VectorMax(det, VectorSubtract(zero, det));
+
+		VectorRegister mask = VectorCompareGT(absDet, eps);
+		mask = VectorBitwiseAnd(mask, VectorCompareGE(bu, zero));
+		mask = VectorBitwiseAnd(mask, VectorCompareGE(bv, zero));
+		mask = VectorBitwiseAnd(mask, VectorCompareLE(VectorAdd(bu, bv), one));
+		mask = VectorBitwiseAnd(mask, VectorCompareGT(t, minT));
+		mask = VectorBitwiseAnd(mask, VectorCompareLT(t, bestDist));
+
+		bestDist  = VectorSelect(mask, t, bestDist);
+		bestIndex = VectorSelect(mask, VectorSetFloat1((float)i), bestIndex);
+		bestU     = VectorSelect(mask, bu, bestU);
+		bestV     = VectorSelect(mask, bv, bestV);
+		anyHit    = VectorBitwiseOr(anyHit, mask);
+	}
+
+	float indices[4];
+	VectorStore(bestDist, hit.dist);
+	VectorStore(bestU, hit.u);
+	VectorStore(bestV, hit.v);
+	VectorStore(bestIndex, indices);
+
+	int32 hitMask = VectorMaskBits(anyHit);
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (hitMask & (1 << i)) {
+			hit.index[i] = (int32)indices[i];
+		}
+	}
+
+	return hitMask;
+}
+
+bool RayIntersection::IntersectSphere(const Vector3& center, float radius, const Vector3& origin, const Vector3& direction, float tMin, float& dist)
+{
+	Vector3 oc = origin - center;
+	float b = Vector3::DotProduct(oc, direction);
+	float c = Vector3::DotProduct(oc, oc) - radius * radius;
+	float h = b * b - c;
+
+	if (h < 0.0f) {
+		return false;
+	}
+
+	float t = -b - MMath::Sqrt(h);
+	if (t <= tMin || t >= dist) {
+		return false;
+	}
+
+	dist = t;
+	return true;
+}
+
+bool RayIntersection::IntersectTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Vector3& origin, const Vector3& direction, float tMin, float& dist, float& u, float& v)
+{
+	Vector3 e1 = v1 - v0;
+	Vector3 e2 = v2 - v0;
+	Vector3 p  = Vector3::CrossProduct(direction, e2);
+
+	float det = Vector3::DotProduct(e1, p);
+	if (MMath::Abs(det) <= TRIANGLE_DET_EPSILON) {
+		return false;
+	}
+
+	float invDet = 1.0f / det;
+	Vector3 s = origin - v0;
+
+	float bu = Vector3::DotProduct(s, p) * invDet;
+	if (bu < 0.0f || bu > 1.0f) {
+		return false;
+	}
+
+	Vector3 q = Vector3::CrossProduct(s, e1);
+
+	float bv = Vector3::DotProduct(direction, q) * invDet;
+	if (bv < 0.0f || bu + bv > 1.0f) {
+		return false;
+	}
+
+	float t = Vector3::DotProduct(e2, q) * invDet;
+	if (t <= tMin || t >= dist) {
+		return false;
+	}
+
+	dist = t;
+	u = bu;
+	v = bv;
+	return true;
+}
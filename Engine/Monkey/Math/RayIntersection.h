@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+
+#include <vector>
+
+// 4个一组按分量存储，一组内依次为centerX[4] centerY[4] centerZ[4] radiusSq[4]，正好一条cache line。
+// 补齐的球半径平方为负数，永远不会相交。Finalize之后可以继续Add，新的数据从下一组开始，
+// 这样可以让每组数据互不相交，比如BVH的每个叶子一组。求交返回的序号是数据里的位置。
+struct SphereSoA
+{
+	enum { BlockFloats = 16 };
+
+	std::vector<float>	data;
+	int32				count = 0;	// 不包括补齐的数据
+	int32				size = 0;	// 包括补齐的数据
+
+	void Clear();
+
+	// 返回新球体的位置
+	int32 Add(const Vector3& center, float radius);
+
+	// 数据补齐到4的倍数，Add完之后、求交之前调用
+	void Finalize();
+
+	inline int32 PaddedCount() const
+	{
+		return size;
+	}
+
+	// index所在的一组
+	inline const float* GetBlock(int32 index) const
+	{
+		return &data[(index >> 2) * BlockFloats];
+	}
+};
+
+// 三角形存v0和两条边e1=v1-v0, e2=v2-v0，Möller-Trumbore直接用，补齐的三角形边长为0。
+// 同样4个一组，一组内为v0x[4] v0y[4] v0z[4] e1x[4] ... e2z[4]，BVH叶子的三角形在连续的144字节里。
+struct TriangleSoA
+{
+	enum { BlockFloats = 36 };
+
+	std::vector<float>	data;
+	int32				count = 0;
+	int32				size = 0;
+
+	void Clear();
+
+	// 返回新三角形的位置
+	int32 Add(const Vector3& v0, const Vector3& v1, const Vector3& v2);
+
+	// 覆盖已有的三角形，用于顶点变化后更新
+	void Set(int32 index, const Vector3& v0, const Vector3& v1, const Vector3& v2);
+
+	void Finalize();
+
+	inline int32 PaddedCount() const
+	{
+		return size;
+	}
+
+	inline const float* GetBlock(int32 index) const
+	{
+		return &data[(index >> 2) * BlockFloats];
+	}
+};
+
+// 4条光线一组，适合同一个tile里相邻像素的primary ray。
+struct RayPacket4
+{
+	float	originX[4];
+	float	originY[4];
+	float	originZ[4];
+	float	directionX[4];
+	float	directionY[4];
+	float	directionZ[4];
+
+	void Set(int32 lane, const Vector3& origin, const Vector3& direction);
+};
+
+struct PacketHit4
+{
+	float	dist[4];
+	int32	index[4];
+	float	u[4];
+	float	v[4];
+
+	// dist初始化为maxDist，index为-1
+	void Reset(float maxDist);
+};
+
+/**
+ * SIMD ray intersection kernels over SoA primitives, 4 lanes wide (SSE/scalar from PlatformVectorMath).
+ * Sphere tests follow the tracer's convention: direction is normalized and only the near root counts.
+ * All functions return the index of the closest primitive with tMin < dist < tMax, or -1. dist/tMax is in-out.
+ */
+struct RayIntersection
+{
+	// 一条光线对所有球体
+	static int32 IntersectSpheres(const SphereSoA& spheres, const Vector3& origin, const Vector3& direction, float tMin, float& dist);
+
+	// 一条光线对所有三角形，u、v为命中点的重心坐标
+	static int32 IntersectTriangles(const TriangleSoA& triangles, const Vector3& origin, const Vector3& direction, float tMin, float& dist, float& u, float& v);
+
+	// 只测试[begin, end)，begin和end都是4的倍数
+	static int32 IntersectTriangles(const TriangleSoA& triangles, int32 begin, int32 end, const Vector3& origin, const Vector3& direction, float tMin, float& dist, float& u, float& v);
+
+	// 4条光线对所有球体，结果写入hit，hit需要先Reset。返回命中的lane掩码。
+	static int32 IntersectSpheres(const SphereSoA& spheres, const RayPacket4& packet, float tMin, PacketHit4& hit);
+
+	static int32 IntersectTriangles(const TriangleSoA& triangles, const RayPacket4& packet, float tMin, PacketHit4& hit);
+
+	// 标量版本，和以前逐个对象测试的代码一样，用来对比结果和性能
+	static bool IntersectSphere(const Vector3& center, float radius, const Vector3& origin, const Vector3& direction, float tMin, float& dist);
+
+	static bool IntersectTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Vector3& origin, const Vector3& direction, float tMin, float& dist, float& u, float& v);
+};
@@ -0,0 +1,198 @@
+﻿#pragma once
+
+#include "Math/GenericPlatformMath.h"
+
+#include <xmmintrin.h>
+
+#define SSE_SHUFFLE_MASK(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define SSE_SWIZZLE(vec, x, y, z, w) _mm_shuffle_ps(vec, vec, SSE_SHUFFLE_MASK(x, y, z, w))
+#define SSE_SHUFFLE(vec1, vec2, x, y, z, w) _mm_shuffle_ps(vec1, vec2, SSE_SHUFFLE_MASK(x, y, z, w))
+
+/**
+ * SSE versions of the 4x4 matrix kernels. Loads are unaligned because Matrix4x4 and Vector4 are
+ * plain float arrays shared with uniform buffer structs; on current CPUs movups on aligned data
+ * costs the same as movaps.
+ * Multiply and transform add the products in the same order as the scalar code, results are bit exact.
+ */
+struct VectorMathSSE : public GenericPlatformMath
+{
+    static FORCEINLINE void VectorMatrixMultiply(void* result, const void* matrix1, const void* matrix2)
+    {
+        const float* a = (const float*)matrix1;
+        const float* b = (const float*)matrix2;
+        float* r = (float*)result;
+        
+        const __m128 b0 = _mm_loadu_ps(b + 0);
+        const __m128 b1 = _mm_loadu_ps(b + 4);
+        const __m128 b2 = _mm_loadu_ps(b + 8);
+        const __m128 b3 = _mm_loadu_ps(b + 12);
+        
+        // result可能和输入是同一个矩阵，先全部读出来
+        const __m128 a0 = _mm_loadu_ps(a + 0);
+        const __m128 a1 = _mm_loadu_ps(a + 4);
+        const __m128 a2 = _mm_loadu_ps(a + 8);
+        const __m128 a3 = _mm_loadu_ps(a + 12);
+        
+        _mm_storeu_ps(r + 0,  LinearCombine(a0, b0, b1, b2, b3));
+        _mm_storeu_ps(r + 4,  LinearCombine(a1, b0, b1, b2, b3));
+        _mm_storeu_ps(r + 8,  LinearCombine(a2, b0, b1, b2, b3));
+        _mm_storeu_ps(r + 12, LinearCombine(a3, b0, b1, b2, b3));
+    }
+    
+    static FORCEINLINE void VectorTransformVector(void* result, const void* vec, const void* matrix)
+    {
+        const float* m = (const float*)matrix;
+        
+        const __m128 v = _mm_loadu_ps((const float*)vec);
+        _mm_storeu_ps((float*)result, LinearCombine(v, _mm_loadu_ps(m + 0), _mm_loadu_ps(m + 4), _mm_loadu_ps(m + 8), _mm_loadu_ps(m + 12)));
+    }
+    
+    // 分块求逆，把4x4矩阵看作4个2x2矩阵
+    // M = | A B |, M^-1 = 1/|M| * | X# Y# |
+    //     | C D |                  | Z# W# |
+    static FORCEINLINE void VectorMatrixInverse(void* dstMatrix, const void* srcMatrix)
+    {
+        const float* src = (const float*)srcMatrix;
+        float* dst = (float*)dstMatrix;
+        
+        const __m128 r0 = _mm_loadu_ps(src + 0);
+        const __m128 r1 = _mm_loadu_ps(src + 4);
+        const __m128 r2 = _mm_loadu_ps(src + 8);
+        const __m128 r3 = _mm_loadu_ps(src + 12);
+        
+        const __m128 A = _mm_movelh_ps(r0, r1);
+        const __m128 B = _mm_movehl_ps(r1, r0);
+        const __m128 C = _mm_movelh_ps(r2, r3);
+        const __m128 D = _mm_movehl_ps(r3, r2);
+        
+        // (|A|, |B|, |C|, |D|)
+        const __m128 detSub = _mm_sub_ps(
+            _mm_mul_ps(SSE_SHUFFLE(r0, r2, 0, 2, 0, 2), SSE_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+            _mm_mul_ps(SSE_SHUFFLE(r0, r2, 1, 3, 1, 3), SSE_SHUFFLE(r1, r3, 0, 2, 0, 2))
+        );
+        const __m128 detA = SSE_SWIZZLE(detSub, 0, 0, 0, 0);
+        const __m128 detB = SSE_SWIZZLE(detSub, 1, 1, 1, 1);
+        const __m128 detC = SSE_SWIZZLE(detSub, 2, 2, 2, 2);
+        const __m128 detD = SSE_SWIZZLE(detSub, 3, 3, 3, 3);
+        
+        const __m128 D_C = Mat2AdjMul(D, C);
+        const __m128 A_B = Mat2AdjMul(A, B);
+        
+        __m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, D_C));
+        __m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, A_B));
+        __m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, A_B));
+        __m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, D_C));
+        
+        // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+        __m128 tr = _mm_mul_ps(A_B, SSE_SWIZZLE(D_C, 0, 2, 1, 3));
+        tr = _mm_add_ps(tr, SSE_SWIZZLE(tr, 2, 3, 0, 1));
+        tr = _mm_add_ps(tr, SSE_SWIZZLE(tr, 1, 0, 3, 2));
+        
+        __m128 detM = _mm_mul_ps(detA, detD);
+        detM = _mm_add_ps(detM, _mm_mul_ps(detB, detC));
+        detM = _mm_sub_ps(detM, tr);
+        
+        const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+        
+        X_ = _mm_mul_ps(X_, rDetM);
+        Y_ = _mm_mul_ps(Y_, rDetM);
+        Z_ = _mm_mul_ps(Z_, rDetM);
+        W_ = _mm_mul_ps(W_, rDetM);
+        
+        // 伴随矩阵的转置和写回的排列合在一起
+        _mm_storeu_ps(dst + 0,  SSE_SHUFFLE(X_, Y_, 3, 1, 3, 1));
+        _mm_storeu_ps(dst + 4,  SSE_SHUFFLE(X_, Y_, 2, 0, 2, 0));
+        _mm_storeu_ps(dst + 8,  SSE_SHUFFLE(Z_, W_, 3, 1, 3, 1));
+        _mm_storeu_ps(dst + 12, SSE_SHUFFLE(Z_, W_, 2, 0, 2, 0));
+    }
+    
+    static FORCEINLINE void VectorMatrixMultiplyArray(void* result, const void* matrices1, const void* matrices2, int32 count)
+    {
+        float* r = (float*)result;
+        const float* a = (const float*)matrices1;
+        const float* b = (const float*)matrices2;
+        
+        for (int32 i = 0; i < count; ++i) {
+            VectorMatrixMultiply(r + i * 16, a + i * 16, b + i * 16);
+        }
+    }
+    
+    static FORCEINLINE void VectorTransformVectorArray(void* result, const void* vecs, int32 count, const void* matrix)
+    {
+        const float* m = (const float*)matrix;
+        const float* v = (const float*)vecs;
+        float* r = (float*)result;
+        
+        const __m128 m0 = _mm_loadu_ps(m + 0);
+        const __m128 m1 = _mm_loadu_ps(m + 4);
+        const __m128 m2 = _mm_loadu_ps(m + 8);
+        const __m128 m3 = _mm_loadu_ps(m + 12);
+        
+        for (int32 i = 0; i < count; ++i) {
+            _mm_storeu_ps(r + i * 4, LinearCombine(_mm_loadu_ps(v + i * 4), m0, m1, m2, m3));
+        }
+    }
+    
+    static FORCEINLINE void VectorTransformPositions(void* result, const void* positions, int32 count, const void* matrix)
+    {
+        const float* m = (const float*)matrix;
+        const float* p = (const float*)positions;
+        float* r = (float*)result;
+        
+        const __m128 m0 = _mm_loadu_ps(m + 0);
+        const __m128 m1 = _mm_loadu_ps(m + 4);
+        const __m128 m2 = _mm_loadu_ps(m + 8);
+        const __m128 m3 = _mm_loadu_ps(m + 12);
+        
+        for (int32 i = 0; i < count; ++i)
+        {
+            const float* src = p + i * 3;
+            
+            __m128 v = _mm_mul_ps(_mm_set1_ps(src[0]), m0);
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(src[1]), m1));
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(src[2]), m2));
+            v = _mm_add_ps(v, m3);
+            
+            // 只写3个float，不能越界写到下一个位置
+            float* dst = r + i * 3;
+            _mm_storel_pi((__m64*)dst, v);
+            _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+        }
+    }
+    
+private:
+    
+    // v.x * m0 + v.y * m1 + v.z * m2 + v.w * m3
+    static FORCEINLINE __m128 LinearCombine(const __m128& v, const __m128& m0, const __m128& m1, const __m128& m2, const __m128& m3)
+    {
+        __m128 r = _mm_mul_ps(SSE_SWIZZLE(v, 0, 0, 0, 0), m0);
+        r = _mm_add_ps(r, _mm_mul_ps(SSE_SWIZZLE(v, 1, 1, 1, 1), m1));
+        r = _mm_add_ps(r, _mm_mul_ps(SSE_SWIZZLE(v, 2, 2, 2, 2), m2));
+        r = _mm_add_ps(r, _mm_mul_ps(SSE_SWIZZLE(v, 3, 3, 3, 3), m3));
+        return r;
+    }
+    
+    // 2x2矩阵按(m00, m01, m10, m11)存储
+    
+    // A * B
+    static FORCEINLINE __m128 Mat2Mul(const __m128& vec1, const __m128& vec2)
+    {
+        return _mm_add_ps(_mm_mul_ps(vec1, SSE_SWIZZLE(vec2, 0, 3, 0, 3)), _mm_mul_ps(SSE_SWIZZLE(vec1, 1, 0, 3, 2), SSE_SWIZZLE(vec2, 2, 1, 2, 1)));
+    }
+    
+    // A# * B
+    static FORCEINLINE __m128 Mat2AdjMul(const __m128& vec1, const __m128& vec2)
+    {
+        return _mm_sub_ps(_mm_mul_ps(SSE_SWIZZLE(vec1, 3, 3, 0, 0), vec2), _mm_mul_ps(SSE_SWIZZLE(vec1, 1, 1, 2, 2), SSE_SWIZZLE(vec2, 2, 3, 0, 1)));
+    }
+    
+    // A * B#
+    static FORCEINLINE __m128 Mat2MulAdj(const __m128& vec1, const __m128& vec2)
+    {
+        return _mm_sub_ps(_mm_mul_ps(vec1, SSE_SWIZZLE(vec2, 3, 0, 3, 0)), _mm_mul_ps(SSE_SWIZZLE(vec1, 1, 0, 3, 2), SSE_SWIZZLE(vec2, 2, 1, 2, 1)));
+    }
+};
+
+#undef SSE_SHUFFLE_MASK
+#undef SSE_SWIZZLE
+#undef SSE_SHUFFLE
@@ -0,0 +1,179 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/PlatformVectorMath.h"
+
+// 4个float的SIMD寄存器和基本运算，按PlatformVectorMath选出的指令集实现，用来写SoA的批量算法。
+// 比较运算返回每个分量全1或全0的掩码，配合VectorSelect/VectorMaskBits使用。
+
+#if PLATFORM_MATH_SSE
+
+#include <xmmintrin.h>
+
+typedef __m128 VectorRegister;
+
+FORCEINLINE VectorRegister VectorLoad(const float* ptr)                          { return _mm_loadu_ps(ptr); }
+FORCEINLINE void VectorStore(const VectorRegister& v, float* ptr)                { _mm_storeu_ps(ptr, v); }
+FORCEINLINE VectorRegister VectorSetFloat1(float f)                              { return _mm_set1_ps(f); }
+FORCEINLINE VectorRegister VectorSet(float x, float y, float z, float w)        { return _mm_setr_ps(x, y, z, w); }
+FORCEINLINE VectorRegister VectorZero()                                          { return _mm_setzero_ps(); }
+
+FORCEINLINE VectorRegister VectorAdd(const VectorRegister& a, const VectorRegister& b)      { return _mm_add_ps(a, b); }
+FORCEINLINE VectorRegister VectorSubtract(const VectorRegister& a, const VectorRegister& b) { return _mm_sub_ps(a, b); }
+FORCEINLINE VectorRegister VectorMultiply(const VectorRegister& a, const VectorRegister& b) { return _mm_mul_ps(a, b); }
+FORCEINLINE VectorRegister VectorDivide(const VectorRegister& a, const VectorRegister& b)   { return _mm_div_ps(a, b); }
+FORCEINLINE VectorRegister VectorMin(const VectorRegister& a, const VectorRegister& b)      { return _mm_min_ps(a, b); }
+FORCEINLINE VectorRegister VectorMax(const VectorRegister& a, const VectorRegister& b)      { return _mm_max_ps(a, b); }
+FORCEINLINE VectorRegister VectorSqrt(const VectorRegister& a)                              { return _mm_sqrt_ps(a); }
+
+FORCEINLINE VectorRegister VectorCompareGT(const VectorRegister& a, const VectorRegister& b) { return _mm_cmpgt_ps(a, b); }
+FORCEINLINE VectorRegister VectorCompareGE(const VectorRegister& a, const VectorRegister& b) { return _mm_cmpge_ps(a, b); }
+FORCEINLINE VectorRegister VectorCompareLT(const VectorRegister& a, const VectorRegister& b) { return _mm_cmplt_ps(a, b); }
+FORCEINLINE VectorRegister VectorCompareLE(const VectorRegister& a, const VectorRegister& b) { return _mm_cmple_ps(a, b); }
+
+FORCEINLINE VectorRegister VectorBitwiseAnd(const VectorRegister& a, const VectorRegister& b) { return _mm_and_ps(a, b); }
+FORCEINLINE VectorRegister VectorBitwiseOr(const VectorRegister& a, const VectorRegister& b)  { return _mm_or_ps(a, b); }
+
+// mask ? a : b
+FORCEINLINE VectorRegister VectorSelect(const VectorRegister& mask, const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// 每个分量的符号位拼成4位整数
+FORCEINLINE int32 VectorMaskBits(const VectorRegister& mask)
+{
+	return _mm_movemask_ps(mask);
+}
+
+#else
+
+#include <math.h>
+#include <string.h>
+
+struct VectorRegister
+{
+	float v[4];
+};
+
+FORCEINLINE VectorRegister VectorLoad(const float* ptr)
+{
+	VectorRegister r;
+	memcpy(r.v, ptr, 4 * sizeof(float));
+	return r;
+}
+
+FORCEINLINE void VectorStore(const VectorRegister& v, float* ptr)
+{
+	memcpy(ptr, v.v, 4 * sizeof(float));
+}
+
+FORCEINLINE VectorRegister VectorSet(float x, float y, float z, float w)
+{
+	VectorRegister r = { { x, y, z, w } };
+	return r;
+}
+
+FORCEINLINE VectorRegister VectorSetFloat1(float f) { return VectorSet(f, f, f, f); }
+FORCEINLINE VectorRegister VectorZero()             { return VectorSet(0.0f, 0.0f, 0.0f, 0.0f); }
+
+#define VECTOR_REGISTER_BINARY(name, expr) \
+	FORCEINLINE VectorRegister name(const VectorRegister& a, const VectorRegister& b) \
+	{ \
+		VectorRegister r; \
+		for (int32 i = 0; i < 4; ++i) { \
+			const float x = a.v[i]; \
+			const float y = b.v[i]; \
+			r.v[i] = (expr); \
+		} \
+		return r; \
+	}
+
+#define VECTOR_REGISTER_COMPARE(name, op) \
+	FORCEINLINE VectorRegister name(const VectorRegister& a, const VectorRegister& b) \
+	{ \
+		VectorRegister r; \
+		for (int32 i = 0; i < 4; ++i) { \
+			const uint32 bits = (a.v[i] op b.v[i]) ? 0xFFFFFFFF : 0; \
+			memcpy(&r.v[i], &bits, sizeof(float)); \
+		} \
+		return r; \
+	}
+
+VECTOR_REGISTER_BINARY(VectorAdd,      x + y)
+VECTOR_REGISTER_BINARY(VectorSubtract, x - y)
+VECTOR_REGISTER_BINARY(VectorMultiply, x * y)
+VECTOR_REGISTER_BINARY(VectorDivide,   x / y)
+VECTOR_REGISTER_BINARY(VectorMin,      x < y ? x : y)
+VECTOR_REGISTER_BINARY(VectorMax,      x > y ? x : y)
+
+VECTOR_REGISTER_COMPARE(VectorCompareGT, >)
+VECTOR_REGISTER_COMPARE(VectorCompareGE, >=)
+VECTOR_REGISTER_COMPARE(VectorCompareLT, <)
+VECTOR_REGISTER_COMPARE(VectorCompareLE, <=)
+
+#undef VECTOR_REGISTER_BINARY
+#undef VECTOR_REGISTER_COMPARE
+
+FORCEINLINE VectorRegister VectorSqrt(const VectorRegister& a)
+{
+	VectorRegister r;
+	for (int32 i = 0; i < 4; ++i) {
+		r.v[i] = sqrtf(a.v[i]);
+	}
+	return r;
+}
+
+FORCEINLINE VectorRegister VectorBitwiseAnd(const VectorRegister& a, const VectorRegister& b)
+{
+	uint32 x[4];
+	uint32 y[4];
+	memcpy(x, a.v, sizeof(x));
+	memcpy(y, b.v, sizeof(y));
+	for (int32 i = 0; i < 4; ++i) {
+		x[i] &= y[i];
+	}
+	VectorRegister r;
+	memcpy(r.v, x, sizeof(x));
+	return r;
+}
+
+FORCEINLINE VectorRegister VectorBitwiseOr(const VectorRegister& a, const VectorRegister& b)
+{
+	uint32 x[4];
+	uint32 y[4];
+	memcpy(x, a.v, sizeof(x));
+	memcpy(y, b.v, sizeof(y));
+	for (int32 i = 0; i < 4; ++i) {
+		x[i] |= y[i];
+	}
+	VectorRegister r;
+	memcpy(r.v, x, sizeof(x));
+	return r;
+}
+
+FORCEINLINE VectorRegister VectorSelect(const VectorRegister& mask, const VectorRegister& a, const VectorRegister& b)
+{
+	VectorRegister r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		uint32 bits;
+		memcpy(&bits, &mask.v[i], sizeof(uint32));
+		r.v[i] = bits ? a.v[i] : b.v[i];
+	}
+	return r;
+}
+
+FORCEINLINE int32 VectorMaskBits(const VectorRegister& mask)
+{
+	int32 result = 0;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		uint32 bits;
+		memcpy(&bits, &mask.v[i], sizeof(uint32));
+		result |= (bits >> 31) << i;
+	}
+	return result;
+}
+
+#endif
@@ -1,11 +1,12 @@
 ﻿#pragma once
 
 #include "Math/GenericPlatformMath.h"
+#include "Math/PlatformVectorMath.h"
 #include "Configuration/Platform.h"
 
 #include <xmmintrin.h>
 
-struct WindowsPlatformMath : public GenericPlatformMath
+struct WindowsPlatformMath : public PlatformVectorMath
 {
 
 	static FORCEINLINE int32 TruncToInt(float f)
@@ -13,6 +13,7 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice physicalDevice)
     , m_PresentQueue(nullptr)
     , m_FenceManager(nullptr)
     , m_MemoryManager(nullptr)
+    , m_ResourceHeapManager(nullptr)
 	, m_PhysicalDeviceFeatures2(nullptr)
 {
     
@@ -43,6 +44,11 @@ void VulkanDevice::CreateDevice()
 			MLOG("* %s", m_AppDeviceExtensions[i]);
 		}
 	}
+
+	m_EnabledExtensions.clear();
+	for (int32 i = 0; i < deviceExtensions.size(); ++i) {
+		m_EnabledExtensions.push_back(deviceExtensions[i]);
+	}
 	
     VkDeviceCreateInfo deviceInfo;
     ZeroVulkanStruct(deviceInfo, VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
@@ -416,6 +422,9 @@ void VulkanDevice::InitGPU(int32 deviceIndex)
     m_MemoryManager = new VulkanDeviceMemoryManager();
     m_MemoryManager->Init(this);
     
+    m_ResourceHeapManager = new VulkanResourceHeapManager(this);
+    m_ResourceHeapManager->Init();
+    
     m_FenceManager = new VulkanFenceManager();
 	m_FenceManager->Init(this);
 }
@@ -425,6 +434,9 @@ void VulkanDevice::Destroy()
 	m_FenceManager->Destory();
 	delete m_FenceManager;
 
+	m_ResourceHeapManager->Destory();
+	delete m_ResourceHeapManager;
+
 	m_MemoryManager->Destory();
 	delete m_MemoryManager;
 
@@ -432,6 +444,17 @@ void VulkanDevice::Destroy()
 	m_Device = VK_NULL_HANDLE;
 }
 
+bool VulkanDevice::IsExtensionEnabled(const char* name) const
+{
+	for (int32 i = 0; i < m_EnabledExtensions.size(); ++i)
+	{
+		if (m_EnabledExtensions[i] == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
 bool VulkanDevice::IsFormatSupported(VkFormat format)
 {
 	auto ArePropertiesSupported = [](const VkFormatProperties& prop) -> bool 
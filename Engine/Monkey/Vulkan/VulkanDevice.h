@@ -10,9 +10,11 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <string>
 
 class VulkanFenceManager;
 class VulkanDeviceMemoryManager;
+class VulkanResourceHeapManager;
 
 class VulkanDevice
 {
@@ -75,11 +77,19 @@ public:
         return m_PhysicalDeviceFeatures;
     }
     
+    inline const std::vector<VkQueueFamilyProperties>& GetQueueFamilyProperties() const
+    {
+        return m_QueueFamilyProps;
+    }
+    
     inline VkDevice GetInstanceHandle() const
     {
         return m_Device;
     }
     
+    // 可选的扩展只有在设备支持时才会开启，使用前需要检查
+    bool IsExtensionEnabled(const char* name) const;
+    
     inline const VkFormatProperties* GetFormatProperties() const
     {
         return m_FormatProperties;
@@ -95,6 +105,11 @@ public:
         return *m_MemoryManager;
     }
     
+    inline VulkanResourceHeapManager& GetResourceHeapManager()
+    {
+        return *m_ResourceHeapManager;
+    }
+    
 	inline void AddAppDeviceExtensions(const char* name)
 	{
 		m_AppDeviceExtensions.push_back(name);
@@ -138,7 +153,9 @@ private:
 
     VulkanFenceManager*                     m_FenceManager;
     VulkanDeviceMemoryManager*              m_MemoryManager;
+    VulkanResourceHeapManager*              m_ResourceHeapManager;
 
 	std::vector<const char*>				m_AppDeviceExtensions;
+	std::vector<std::string>				m_EnabledExtensions;
 	VkPhysicalDeviceFeatures2*				m_PhysicalDeviceFeatures2;
 };
@@ -100,6 +100,7 @@ static const char* G_DeviceExtensions[] =
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	VK_KHR_SAMPLER_MIRROR_CLAMP_TO_EDGE_EXTENSION_NAME,
 	"VK_KHR_maintenance1",
+	"VK_EXT_conditional_rendering",
 
 #if PLATFORM_WINDOWS
 
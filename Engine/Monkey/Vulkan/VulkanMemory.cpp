@@ -23,15 +23,7 @@ void VulkanRange::JoinConsecutiveRanges(std::vector<VulkanRange>& ranges)
     }
     
     std::sort(ranges.begin(), ranges.end(), [](const VulkanRange& a, const VulkanRange& b) {
-        if (a.offset > b.offset) {
-            return 1;
-        }
-        else if (a.offset == b.offset) {
-            return 0;
-        }
-        else {
-            return -1;
-        }
+        return a.offset < b.offset;
     });
     
     for (int32 index = (int32)ranges.size() - 1; index > 0; --index)
@@ -110,6 +102,7 @@ VulkanDeviceMemoryManager::VulkanDeviceMemoryManager()
     , m_HasUnifiedMemory(false)
     , m_NumAllocations(0)
     , m_PeakNumAllocations(0)
+    , m_TotalAllocateCalls(0)
 {
     memset(&m_MemoryProperties, 0, sizeof(VkPhysicalDeviceMemoryProperties));
 }
@@ -124,6 +117,7 @@ void VulkanDeviceMemoryManager::Init(VulkanDevice* device)
     m_Device             = device;
     m_NumAllocations     = 0;
     m_PeakNumAllocations = 0;
+    m_TotalAllocateCalls = 0;
     m_DeviceHandle       = m_Device->GetInstanceHandle();
 
     vkGetPhysicalDeviceMemoryProperties(m_Device->GetPhysicalHandle(), &m_MemoryProperties);
@@ -206,6 +200,7 @@ VulkanDeviceMemoryAllocation* VulkanDeviceMemoryManager::Alloc(bool canFail, VkD
     }
     
     m_NumAllocations     += 1;
+    m_TotalAllocateCalls += 1;
     m_PeakNumAllocations = MMath::Max(m_NumAllocations, m_PeakNumAllocations);
     if (m_NumAllocations == m_Device->GetLimits().maxMemoryAllocationCount) {
         MLOGE("Hit Maximum # of allocations (%d) reported by device!", m_NumAllocations);
@@ -634,6 +629,11 @@ VulkanResourceAllocation* VulkanResourceHeap::AllocateResource(Type type, uint32
         deviceMemoryAllocation = m_Owner->GetVulkanDevice()->GetMemoryManager().Alloc(false, size, m_MemoryTypeIndex, nullptr, file, line);
     }
     
+    if (!deviceMemoryAllocation) {
+        return nullptr;
+    }
+    allocationSize = (uint32)deviceMemoryAllocation->GetSize();
+    
     VulkanResourceHeapPage* newPage = new VulkanResourceHeapPage(this, deviceMemoryAllocation, m_PageIDCounter);
     usedPages.push_back(newPage);
 
@@ -813,6 +813,8 @@ void VulkanSubBufferAllocator::Release(VulkanBufferSubAllocation* subAllocation)
 VulkanResourceHeapManager::VulkanResourceHeapManager(VulkanDevice* device)
     : m_VulkanDevice(device)
     , m_DeviceMemoryManager(&device->GetMemoryManager())
+    , m_TotalResourceAllocations(0)
+    , m_TotalBufferPools(0)
 {
     
 }
@@ -871,7 +873,7 @@ void VulkanResourceHeapManager::Init()
     {
         uint32 typeIndex = 0;
         VERIFYVULKANRESULT(memoryManager.GetMemoryTypeFromProperties(typeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &typeIndex));
-        m_ResourceTypeHeaps[typeIndex] = new VulkanResourceHeap(this, typeIndex, STAGING_HEAP_PAGE_SIZE);
+        GetOrCreateHeap(typeIndex);
     }
     
     {
@@ -889,7 +891,7 @@ void VulkanResourceHeapManager::Init()
         else {
             MLOG("No Memory Type found supporting VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT!");
         }
-        m_ResourceTypeHeaps[typeIndex] = new VulkanResourceHeap(this, typeIndex, STAGING_HEAP_PAGE_SIZE);
+        GetOrCreateHeap(typeIndex);
     }
 }
 
@@ -904,6 +906,43 @@ void VulkanResourceHeapManager::Destory()
     m_ResourceTypeHeaps.clear();
 }
 
+uint32 VulkanResourceHeapManager::GetTotalPageAllocations() const
+{
+    uint32 numPages = m_TotalBufferPools;
+    for (int32 index = 0; index < m_ResourceTypeHeaps.size(); ++index)
+    {
+        if (m_ResourceTypeHeaps[index]) {
+            numPages += m_ResourceTypeHeaps[index]->m_PageIDCounter;
+        }
+    }
+    return numPages;
+}
+
+VulkanResourceHeap* VulkanResourceHeapManager::GetOrCreateHeap(uint32 typeIndex)
+{
+    if (m_ResourceTypeHeaps[typeIndex]) {
+        return m_ResourceTypeHeaps[typeIndex];
+    }
+    
+    // Init only creates heaps for the common memory types, others are created on first use.
+    const VkPhysicalDeviceMemoryProperties& memoryProperties = m_DeviceMemoryManager->GetMemoryProperties();
+    const VkMemoryPropertyFlags propertyFlags = memoryProperties.memoryTypes[typeIndex].propertyFlags;
+    
+    uint32 pageSize = STAGING_HEAP_PAGE_SIZE;
+    if ((propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0)
+    {
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[typeIndex].heapIndex].size;
+        pageSize = uint32(MMath::Min<VkDeviceSize>(heapSize / 8, GPU_ONLY_HEAP_PAGE_SIZE));
+    }
+    
+    VulkanResourceHeap* heap = new VulkanResourceHeap(this, typeIndex, pageSize);
+    heap->m_IsHostCachedSupported      = ((propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)      == VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    heap->m_IsLazilyAllocatedSupported = ((propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) == VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    m_ResourceTypeHeaps[typeIndex] = heap;
+    
+    return heap;
+}
+
 VulkanResourceAllocation* VulkanResourceHeapManager::AllocateBufferMemory(const VkMemoryRequirements& memoryReqs, VkMemoryPropertyFlags memoryPropertyFlags, const char* file, uint32 line)
 {
     uint32 typeIndex = 0;
@@ -911,7 +950,9 @@ VulkanResourceAllocation* VulkanResourceHeapManager::AllocateBufferMemory(const
     
     bool canMapped = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
     
-    if (!m_ResourceTypeHeaps[typeIndex])
+    VulkanResourceAllocation* allocation = GetOrCreateHeap(typeIndex)->AllocateResource(VulkanResourceHeap::Type::Buffer, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
+    
+    if (!allocation)
     {
         if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) == VK_MEMORY_PROPERTY_HOST_CACHED_BIT) {
             memoryPropertyFlags = memoryPropertyFlags & ~VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
@@ -922,27 +963,21 @@ VulkanResourceAllocation* VulkanResourceHeapManager::AllocateBufferMemory(const
         }
         
         uint32 originalTypeIndex = typeIndex;
-        if (m_DeviceMemoryManager->GetMemoryTypeFromPropertiesExcluding(memoryReqs.memoryTypeBits, memoryPropertyFlags, typeIndex, &typeIndex) != VK_SUCCESS)
+        if (m_DeviceMemoryManager->GetMemoryTypeFromPropertiesExcluding(memoryReqs.memoryTypeBits, memoryPropertyFlags, originalTypeIndex, &typeIndex) != VK_SUCCESS)
         {
-            MLOG("Unable to find alternate type for index %d, MemSize %d, MemPropTypeBits %u, MemPropertyFlags %u, %s(%d)", originalTypeIndex, (uint32)memoryReqs.size, (uint32)memoryReqs.memoryTypeBits, (uint32)memoryPropertyFlags, file, line);
-        }
-        
+            MLOGE("Unable to find alternate type for index %d, MemSize %d, MemPropTypeBits %u, MemPropertyFlags %u, %s(%d)", originalTypeIndex, (uint32)memoryReqs.size, (uint32)memoryReqs.memoryTypeBits, (uint32)memoryPropertyFlags, file, line);
 #if MONKEY_DEBUG
-        DumpMemory();
+            DumpMemory();
 #endif
-        MLOG("Missing memory type index %d (originally requested %d), MemSize %d, MemPropTypeBits %u, MemPropertyFlags %u, %s(%d)", typeIndex, originalTypeIndex, (uint32)memoryReqs.size, (uint32)memoryReqs.memoryTypeBits, (uint32)memoryPropertyFlags, file, line);
+            return nullptr;
+        }
+        
+        canMapped  = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        allocation = GetOrCreateHeap(typeIndex)->AllocateResource(VulkanResourceHeap::Type::Buffer, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
     }
     
-    VulkanResourceAllocation* allocation = m_ResourceTypeHeaps[typeIndex]->AllocateResource(VulkanResourceHeap::Type::Buffer, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
-    
-    if (!allocation)
-    {
-        VERIFYVULKANRESULT(m_DeviceMemoryManager->GetMemoryTypeFromPropertiesExcluding(memoryReqs.memoryTypeBits, memoryPropertyFlags, typeIndex, &typeIndex));
-        canMapped = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-        if (!m_ResourceTypeHeaps[typeIndex]) {
-            MLOG("Missing memory type index %d, MemSize %d, MemPropTypeBits %u, MemPropertyFlags %u, %s(%d)", typeIndex, (uint32)memoryReqs.size, (uint32)memoryReqs.memoryTypeBits, (uint32)memoryPropertyFlags, file, line);
-        }
-        allocation = m_ResourceTypeHeaps[typeIndex]->AllocateResource(VulkanResourceHeap::Type::Buffer, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
+    if (allocation) {
+        m_TotalResourceAllocations += 1;
     }
 
     return allocation;
@@ -955,17 +990,24 @@ VulkanResourceAllocation* VulkanResourceHeapManager::AllocateImageMemory(const V
     
     bool canMapped = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
     
-    if (!m_ResourceTypeHeaps[typeIndex]) {
-        MLOG("Missing memory type index %d, MemSize %d, MemPropTypeBits %u, MemPropertyFlags %u, %s(%d)", typeIndex, (uint32)memoryReqs.size, (uint32)memoryReqs.memoryTypeBits, (uint32)memoryPropertyFlags, file, line);
-    }
-    
-    VulkanResourceAllocation* allocation = m_ResourceTypeHeaps[typeIndex]->AllocateResource(VulkanResourceHeap::Type::Image, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
+    VulkanResourceAllocation* allocation = GetOrCreateHeap(typeIndex)->AllocateResource(VulkanResourceHeap::Type::Image, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
     
     if (!allocation)
     {
-        VERIFYVULKANRESULT(m_DeviceMemoryManager->GetMemoryTypeFromPropertiesExcluding(memoryReqs.memoryTypeBits, memoryPropertyFlags, typeIndex, &typeIndex));
-        canMapped  = (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-        allocation = m_ResourceTypeHeaps[typeIndex]->AllocateResource(VulkanResourceHeap::Type::Image, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
+        uint32 originalTypeIndex = typeIndex;
+        if (m_DeviceMemoryManager->GetMemoryTypeFromPropertiesExcluding(memoryReqs.memoryTypeBits, memoryPropertyFlags, originalTypeIndex, &typeIndex) != VK_SUCCESS)
+        {
+            MLOGE("Unable to find alternate type for index %d, MemSize %d, MemPropTypeBits %u, MemPropertyFlags %u, %s(%d)", originalTypeIndex, (uint32)memoryReqs.size, (uint32)memoryReqs.memoryTypeBits, (uint32)memoryPropertyFlags, file, line);
+#if MONKEY_DEBUG
+            DumpMemory();
+#endif
+            return nullptr;
+        }
+        allocation = GetOrCreateHeap(typeIndex)->AllocateResource(VulkanResourceHeap::Type::Image, uint32(memoryReqs.size), uint32(memoryReqs.alignment), canMapped, file, line);
+    }
+    
+    if (allocation) {
+        m_TotalResourceAllocations += 1;
     }
     
     return allocation;
@@ -1046,6 +1088,7 @@ VulkanBufferSubAllocation* VulkanResourceHeapManager::AllocateBuffer(uint32 size
     
     VulkanSubBufferAllocator* bufferAllocation = new VulkanSubBufferAllocator(this, deviceMemoryAllocation, memoryTypeIndex, memoryPropertyFlags, uint32(memReqs.alignment), buffer, bufferUsageFlags, poolSize);
     m_UsedBufferAllocations[poolSize].push_back(bufferAllocation);
+    m_TotalBufferPools += 1;
     
     return (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateNoLocking(size, alignment, file, line);
 }
@@ -157,6 +157,22 @@ public:
     
     uint64 GetTotalMemory(bool gpu) const;
     
+    inline uint32 GetNumAllocations() const
+    {
+        return m_NumAllocations;
+    }
+    
+    inline uint32 GetPeakNumAllocations() const
+    {
+        return m_PeakNumAllocations;
+    }
+    
+    // vkAllocateMemory calls since Init, never decremented by Free.
+    inline uint32 GetTotalAllocateCalls() const
+    {
+        return m_TotalAllocateCalls;
+    }
+    
     inline bool HasUnifiedMemory() const
     {
         return m_HasUnifiedMemory;
@@ -242,6 +258,7 @@ protected:
     bool                             m_HasUnifiedMemory;
     uint32                           m_NumAllocations;
     uint32                           m_PeakNumAllocations;
+    uint32                           m_TotalAllocateCalls;
     std::vector<HeapInfo>            m_HeapInfos;
 };
 
@@ -564,8 +581,19 @@ public:
     {
         return m_VulkanDevice;
     }
+    
+    // Sub-allocations handed out through AllocateBufferMemory/AllocateImageMemory since Init.
+    inline uint32 GetTotalResourceAllocations() const
+    {
+        return m_TotalResourceAllocations;
+    }
+    
+    // Heap pages and sub buffer pools created since Init, each one backed by a single vkAllocateMemory.
+    uint32 GetTotalPageAllocations() const;
 
 protected:
+    VulkanResourceHeap* GetOrCreateHeap(uint32 typeIndex);
+    
     void ReleaseFreedResources(bool immediately);
     
     void DestroyResourceAllocations();
@@ -637,6 +665,8 @@ protected:
     VulkanDevice*							m_VulkanDevice;
     VulkanDeviceMemoryManager*              m_DeviceMemoryManager;
     std::vector<VulkanResourceHeap*>        m_ResourceTypeHeaps;
+    uint32                                  m_TotalResourceAllocations;
+    uint32                                  m_TotalBufferPools;
     std::vector<VulkanSubBufferAllocator*>  m_UsedBufferAllocations[(int32)PoolSizes::SizesCount + 1];
     std::vector<VulkanSubBufferAllocator*>  m_FreeBufferAllocations[(int32)PoolSizes::SizesCount + 1];
 };
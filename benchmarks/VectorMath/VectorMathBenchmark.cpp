@@ -0,0 +1,128 @@
+﻿#include "Common/Common.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Matrix4x4.h"
+#include "Math/RandomStream.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cfloat>
+#include <vector>
+
+// 求逆允许的最大误差，按结果中最大元素的ULP计算
+static const float MaxInverseULP = 16.0f;
+
+// 用随机的仿射矩阵对比PlatformVectorMath和标量实现：乘法和变换必须逐位一致，
+// 求逆的误差超过MaxInverseULP时返回非0。同时输出两者每次调用的耗时。
+int main(int argc, char* argv[])
+{
+	const int32 count = 4096;
+	const int32 loops = 64;
+
+	RandomStream random(54);
+	std::vector<Matrix4x4> matrices(count);
+	std::vector<Vector3> positions(count);
+	for (int32 i = 0; i < count; ++i)
+	{
+		matrices[i].AppendScale(Vector3(random.FRandRange(0.5f, 2.0f), random.FRandRange(0.5f, 2.0f), random.FRandRange(0.5f, 2.0f)));
+		matrices[i].AppendRotation(random.FRandRange(-180.0f, 180.0f), MMath::VRand(random));
+		matrices[i].AppendTranslation(Vector3(random.FRandRange(-10.0f, 10.0f), random.FRandRange(-10.0f, 10.0f), random.FRandRange(-10.0f, 10.0f)));
+		positions[i] = Vector3(random.FRandRange(-10.0f, 10.0f), random.FRandRange(-10.0f, 10.0f), random.FRandRange(-10.0f, 10.0f));
+	}
+
+	std::vector<Matrix4x4> scalarMatrices(count);
+	std::vector<Matrix4x4> simdMatrices(count);
+	std::vector<Vector3> scalarPositions(count);
+	std::vector<Vector3> simdPositions(count);
+
+	// correctness
+	int32 multiplyMismatches = 0;
+	float inverseError = 0.0f;
+	for (int32 i = 0; i < count; ++i)
+	{
+		const Matrix4x4& other = matrices[(i + 1) % count];
+		GenericPlatformMath::VectorMatrixMultiply(&scalarMatrices[i], &matrices[i], &other);
+		MMath::VectorMatrixMultiply(&simdMatrices[i], &matrices[i], &other);
+		multiplyMismatches += memcmp(&scalarMatrices[i], &simdMatrices[i], sizeof(Matrix4x4)) != 0 ? 1 : 0;
+
+		GenericPlatformMath::VectorMatrixInverse(&scalarMatrices[i], &matrices[i]);
+		MMath::VectorMatrixInverse(&simdMatrices[i], &matrices[i]);
+
+		float maxValue = 0.0f;
+		float maxDiff  = 0.0f;
+		for (int32 row = 0; row < 4; ++row)
+		{
+			for (int32 col = 0; col < 4; ++col)
+			{
+				maxValue = MMath::Max(maxValue, MMath::Abs(scalarMatrices[i].m[row][col]));
+				maxDiff  = MMath::Max(maxDiff,  MMath::Abs(scalarMatrices[i].m[row][col] - simdMatrices[i].m[row][col]));
+			}
+		}
+		inverseError = MMath::Max(inverseError, maxDiff / (maxValue * FLT_EPSILON));
+	}
+
+	GenericPlatformMath::VectorTransformPositions(scalarPositions.data(), positions.data(), count, &matrices[0]);
+	matrices[0].TransformPositions(simdPositions.data(), positions.data(), count);
+	int32 transformMismatches = 0;
+	for (int32 i = 0; i < count; ++i) {
+		transformMismatches += memcmp(&scalarPositions[i], &simdPositions[i], sizeof(Vector3)) != 0 ? 1 : 0;
+	}
+
+	// benchmark
+	double scalarMultiply = GenericPlatformTime::Seconds();
+	for (int32 loop = 0; loop < loops; ++loop) {
+		GenericPlatformMath::VectorMatrixMultiplyArray(scalarMatrices.data(), matrices.data(), scalarMatrices.data(), count);
+	}
+	scalarMultiply = GenericPlatformTime::Seconds() - scalarMultiply;
+
+	double simdMultiply = GenericPlatformTime::Seconds();
+	for (int32 loop = 0; loop < loops; ++loop) {
+		Matrix4x4::MultiplyArray(simdMatrices.data(), matrices.data(), simdMatrices.data(), count);
+	}
+	simdMultiply = GenericPlatformTime::Seconds() - simdMultiply;
+
+	double scalarInverse = GenericPlatformTime::Seconds();
+	for (int32 loop = 0; loop < loops; ++loop) {
+		for (int32 i = 0; i < count; ++i) {
+			GenericPlatformMath::VectorMatrixInverse(&scalarMatrices[i], &matrices[i]);
+		}
+	}
+	scalarInverse = GenericPlatformTime::Seconds() - scalarInverse;
+
+	double simdInverse = GenericPlatformTime::Seconds();
+	for (int32 loop = 0; loop < loops; ++loop) {
+		for (int32 i = 0; i < count; ++i) {
+			MMath::VectorMatrixInverse(&simdMatrices[i], &matrices[i]);
+		}
+	}
+	simdInverse = GenericPlatformTime::Seconds() - simdInverse;
+
+	double scalarTransform = GenericPlatformTime::Seconds();
+	for (int32 loop = 0; loop < loops; ++loop) {
+		GenericPlatformMath::VectorTransformPositions(scalarPositions.data(), positions.data(), count, &matrices[loop]);
+	}
+	scalarTransform = GenericPlatformTime::Seconds() - scalarTransform;
+
+	double simdTransform = GenericPlatformTime::Seconds();
+	for (int32 loop = 0; loop < loops; ++loop) {
+		matrices[loop].TransformPositions(simdPositions.data(), positions.data(), count);
+	}
+	simdTransform = GenericPlatformTime::Seconds() - simdTransform;
+
+	const char* backend = PLATFORM_MATH_SSE ? "SSE" : "Scalar";
+	const double scale  = 1e9 / (count * loops);
+	printf("Backend: %s\n", backend);
+	printf("Multiply           %8.2fns %8.2fns (scalar/%s)\n", scalarMultiply  * scale, simdMultiply  * scale, backend);
+	printf("Inverse            %8.2fns %8.2fns (scalar/%s)\n", scalarInverse   * scale, simdInverse   * scale, backend);
+	printf("TransformPositions %8.2fns %8.2fns (scalar/%s)\n", scalarTransform * scale, simdTransform * scale, backend);
+	printf("Inverse error %.1f ULP (max %.1f), %d multiply mismatches, %d transform mismatches\n", inverseError, MaxInverseULP, multiplyMismatches, transformMismatches);
+
+	if (multiplyMismatches > 0 || transformMismatches > 0 || inverseError > MaxInverseULP)
+	{
+		fprintf(stderr, "Vector math check failed.\n");
+		return 1;
+	}
+
+	return 0;
+}
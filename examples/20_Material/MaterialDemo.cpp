@@ -438,6 +438,9 @@ private:
 				}
 			}
 			
+			vk_demo::DVKRingBufferStats ringStats = vk_demo::DVKMaterial::GetRingBufferStats();
+			ImGui::Text("RingBuffer %.1fKB/frame, peak %.1fKB, %d blocks, %d stalls", ringStats.bytesPerFrame / 1024.0f, ringStats.highWaterMark / 1024.0f, ringStats.numBlocks, ringStats.stallCount);
+			
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
 		}
@@ -7,6 +7,8 @@
 #include "Math/Matrix4x4.h"
 #include "Math/Quat.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 #include <vector>
 
 class SkeletonMatrix4x4Demo : public DemoBase
@@ -85,6 +87,7 @@ private:
 		m_MVPData.projection = m_ViewCamera.GetProjection();
         
 		UpdateAnimation(time, delta);
+		UpdatePick();
         
 		// 设置Room参数
         // m_RoleModel->rootNode->localMatrix.AppendRotation(delta * 90.0f, Vector3::UpVector);
@@ -131,6 +134,61 @@ private:
         else {
             m_RoleModel->GotoAnimation(m_AnimTime);
         }
+
+		// 动画之后更新BVH，拾取和CPU光线查询才能对上当前的姿势
+		m_BVH->Refit(m_MaxCostRatio);
+	}
+
+	// 鼠标位置的光线和角色求交
+	void UpdatePick()
+	{
+		Matrix4x4 invProj = m_ViewCamera.GetProjection();
+		invProj.SetInverse();
+		Matrix4x4 invView = m_ViewCamera.GetView();
+		invView.SetInverse();
+		Vector2 mousePos  = InputManager::GetMousePosition();
+
+		Vector3 clipPos;
+		clipPos.x = (mousePos.x / GetWidth() * 2.0f - 1.0f);
+		clipPos.y = -(mousePos.y / GetHeight() * 2.0f - 1.0f);
+		clipPos.z = 1.0f;
+
+		Vector3 ray = invProj.TransformPosition(clipPos);
+		ray.x = ray.x * ray.z;
+		ray.y = ray.y * ray.z;
+		ray = invView.DeltaTransformVector(ray);
+		ray = ray.GetSafeNormal();
+
+		m_PickHit = vk_demo::DVKRayHit();
+		m_BVH->Intersect(m_ViewCamera.GetTransform().GetOrigin(), ray, 0.0f, m_PickHit);
+	}
+
+	// 整个动画采样一遍，对比每帧refit和重新构建的耗时，以及refit之后树的质量
+	void BenchmarkRefit()
+	{
+		const int32 numFrames = 60;
+		const float duration  = m_RoleModel->GetAnimation().duration;
+		const float animTime  = m_RoleModel->GetAnimation().time;
+
+		double refitTime = 0.0;
+		float maxCostRatio = 1.0f;
+		for (int32 i = 0; i < numFrames; ++i)
+		{
+			m_RoleModel->GotoAnimation(duration * i / numFrames);
+			m_BVH->Refit(MAX_flt);
+			refitTime   += m_BVH->GetRefitTime();
+			maxCostRatio = MMath::Max(maxCostRatio, m_BVH->GetCostRatio());
+		}
+
+		double buildTime = GenericPlatformTime::Seconds();
+		vk_demo::DVKBVH* bvh = vk_demo::DVKBVH::Create(m_RoleModel);
+		buildTime = GenericPlatformTime::Seconds() - buildTime;
+		delete bvh;
+
+		m_RoleModel->GotoAnimation(animTime);
+		m_BVH->Refit(m_MaxCostRatio);
+
+		MLOG("BVH %d triangles: refit %.3fms/frame, rebuild %.3fms, max SAH cost ratio without rebuild %.2f", m_BVH->GetNumTriangles(), refitTime * 1000.0 / numFrames, buildTime * 1000.0, maxCostRatio);
 	}
     
 	bool UpdateUI(float time, float delta)
@@ -153,6 +211,24 @@ private:
             if (!m_AutoAnimation) {
                 ImGui::SliderFloat("Time", &m_AnimTime, 0.0f, m_AnimDuration);
             }
+
+			ImGui::SliderFloat("Rebuild Ratio", &m_MaxCostRatio, 1.0f, 4.0f);
+			ImGui::Text("BVH refit:%.3fms cost:%.2f rebuilds:%d", m_BVH->GetRefitTime() * 1000.0, m_BVH->GetCostRatio(), m_BVH->GetNumRebuilds());
+
+			if (ImGui::Button("Benchmark Refit")) {
+				BenchmarkRefit();
+			}
+
+			if (ImGui::Button("Benchmark Poses")) {
+				BenchmarkPoses();
+			}
+
+			if (m_PickHit.mesh >= 0) {
+				ImGui::Text("Pick mesh:%d triangle:%d dist:%.2f", m_PickHit.mesh, m_PickHit.triangle, m_PickHit.dist);
+			}
+			else {
+				ImGui::Text("Pick none");
+			}
             
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 			ImGui::End();
@@ -174,6 +250,114 @@ private:
         m_AnimIndex    = index;
     }
     
+	// 按名字查表、逐帧从头扫描关键帧、递归计算global矩阵，即以前GotoAnimation的做法，作为对比和校验
+	void EvaluateReference(float time, std::vector<Matrix4x4>& outBones)
+	{
+		vk_demo::DVKAnimation& animation = m_RoleModel->GetAnimation();
+		for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+		{
+			vk_demo::DVKAnimationClip& clip = it->second;
+			vk_demo::DVKNode* node = m_RoleModel->nodesMap[clip.nodeName];
+
+			float alpha = 0.0f;
+			Quat prevRot(0, 0, 0, 1);
+			Quat nextRot(0, 0, 0, 1);
+			clip.rotations.GetValue(time, prevRot, nextRot, alpha);
+			Quat retRot = MMath::Lerp(prevRot, nextRot, alpha);
+
+			Vector3 prevPos(0, 0, 0);
+			Vector3 nextPos(0, 0, 0);
+			clip.positions.GetValue(time, prevPos, nextPos, alpha);
+			Vector3 retPos = MMath::Lerp(prevPos, nextPos, alpha);
+
+			Vector3 prevScale(1, 1, 1);
+			Vector3 nextScale(1, 1, 1);
+			clip.scales.GetValue(time, prevScale, nextScale, alpha);
+			Vector3 retScale = MMath::Lerp(prevScale, nextScale, alpha);
+
+			node->localMatrix.SetIdentity();
+			node->localMatrix.AppendScale(retScale);
+			node->localMatrix.Append(retRot.ToMatrix());
+			node->localMatrix.AppendTranslation(retPos);
+		}
+
+		outBones.resize(m_RoleModel->bones.size());
+		for (int32 i = 0; i < m_RoleModel->bones.size(); ++i)
+		{
+			vk_demo::DVKBone* bone = m_RoleModel->bones[i];
+			outBones[i] = bone->inverseBindPose;
+			outBones[i].Append(m_RoleModel->nodesMap[bone->name]->GetGlobalMatrix());
+		}
+	}
+
+	// 1000个时间错开的实例，对比以前的做法、单线程EvaluatePose以及JobSystem并行更新
+	void BenchmarkPoses()
+	{
+		const int32 numInstances = 1000;
+		const int32 numFrames    = 10;
+		const float frameDelta   = 1.0f / 60.0f;
+		const float duration     = m_RoleModel->GetAnimation().duration;
+		const float animTime     = m_RoleModel->GetAnimation().time;
+
+		std::vector<vk_demo::DVKAnimPose> poses(numInstances);
+		for (int32 i = 0; i < numInstances; ++i)
+		{
+			m_RoleModel->InitPose(poses[i], m_AnimIndex);
+			poses[i].time = duration * i / numInstances;
+		}
+
+		std::vector<float> times(numInstances);
+		for (int32 i = 0; i < numInstances; ++i) {
+			times[i] = poses[i].time;
+		}
+
+		std::vector<Matrix4x4> reference;
+		double referenceTime = GenericPlatformTime::Seconds();
+		for (int32 frame = 0; frame < numFrames; ++frame)
+		{
+			for (int32 i = 0; i < numInstances; ++i)
+			{
+				times[i] += frameDelta;
+				if (times[i] >= duration) {
+					times[i] -= duration;
+				}
+				EvaluateReference(times[i], reference);
+			}
+		}
+		referenceTime = GenericPlatformTime::Seconds() - referenceTime;
+
+		double serialTime = GenericPlatformTime::Seconds();
+		for (int32 frame = 0; frame < numFrames; ++frame)
+		{
+			for (int32 i = 0; i < numInstances; ++i) {
+				m_RoleModel->UpdatePose(poses[i], frameDelta);
+			}
+		}
+		serialTime = GenericPlatformTime::Seconds() - serialTime;
+
+		double parallelTime = GenericPlatformTime::Seconds();
+		for (int32 frame = 0; frame < numFrames; ++frame) {
+			m_RoleModel->UpdatePoses(poses.data(), numInstances, frameDelta);
+		}
+		parallelTime = GenericPlatformTime::Seconds() - parallelTime;
+
+		// 抽几个实例和以前的做法对比
+		float maxError = 0.0f;
+		for (int32 i = 0; i < numInstances; i += 97)
+		{
+			EvaluateReference(poses[i].time, reference);
+			for (int32 j = 0; j < reference.size(); ++j) {
+				for (int32 k = 0; k < 16; ++k) {
+					maxError = MMath::Max(maxError, MMath::Abs(reference[j].m[k / 4][k % 4] - poses[i].boneMatrices[j].m[k / 4][k % 4]));
+				}
+			}
+		}
+
+		m_RoleModel->GotoAnimation(animTime);
+
+		MLOG("Animate %d instances x %d bones: reference %.3fms/frame, EvaluatePose %.3fms/frame, UpdatePoses %.3fms/frame, max error %f", numInstances, (int32)m_RoleModel->bones.size(), referenceTime * 1000.0 / numFrames, serialTime * 1000.0 / numFrames, parallelTime * 1000.0 / numFrames, maxError);
+	}
+    
 	void LoadAssets()
 	{
 		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
@@ -194,6 +378,9 @@ private:
 		m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
         
         SetAnimation(0);
+		m_RoleModel->GotoAnimation(0.0f);
+
+		m_BVH = vk_demo::DVKBVH::Create(m_RoleModel);
         
 		// shader
 		m_RoleShader = vk_demo::DVKShader::Create(
@@ -225,6 +412,7 @@ private:
 
 	void DestroyAssets()
 	{
+		delete m_BVH;
 		delete m_RoleShader;
         delete m_RoleDiffuse;
         delete m_RoleMaterial;
@@ -323,6 +511,10 @@ private:
 	vk_demo::DVKShader*			m_RoleShader = nullptr;
 	vk_demo::DVKTexture*		m_RoleDiffuse = nullptr;
     vk_demo::DVKMaterial*       m_RoleMaterial = nullptr;
+
+	vk_demo::DVKBVH*			m_BVH = nullptr;
+	vk_demo::DVKRayHit			m_PickHit;
+	float						m_MaxCostRatio = 1.5f;
     
 	ImageGUIContext*			m_GUI = nullptr;
     
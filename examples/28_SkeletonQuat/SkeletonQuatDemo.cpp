@@ -171,6 +171,9 @@ private:
 
 			ImGui::SliderFloat("Speed", &(m_RoleModel->GetAnimation().speed), 0.0f, 10.0f);
 
+			ImGui::Checkbox("Compressed", &(m_RoleModel->useCompressedAnimation));
+			ImGui::Text("Anim memory:%.1f%%", m_CompressRatio * 100.0f);
+
             ImGui::Checkbox("AutoPlay", &m_AutoAnimation);
             
             if (!m_AutoAnimation) {
@@ -215,6 +218,9 @@ private:
 		);
 		m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
 
+		// 每个clip的压缩率和误差会输出到日志
+		m_CompressRatio = m_RoleModel->CompressAnimations();
+
         SetAnimation(0);
         
 		// shader
@@ -350,6 +356,7 @@ private:
     float                       m_AnimDuration = 0.0f;
     float                       m_AnimTime = 0.0f;
     int32                       m_AnimIndex = 0;
+	float						m_CompressRatio = 1.0f;
 };
 
 std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
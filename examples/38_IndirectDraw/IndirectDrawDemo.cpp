@@ -6,6 +6,8 @@
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 #include <vector>
 
 #define SHADOW_TEX_SIZE 2048
@@ -36,11 +38,15 @@ public:
 		DemoBase::Setup();
 		DemoBase::Prepare();
 
+		double initTime = GenericPlatformTime::Seconds();
+
         CreateRenderTarget();
 		CreateGUI();
 		LoadAssets();
 		InitParmas();
 
+		MLOG("Init assets in %.2fms", (GenericPlatformTime::Seconds() - initTime) * 1000.0);
+
 		m_Ready = true;
 
 		return true;
@@ -622,15 +628,65 @@ private:
 		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
         
         m_Quad = vk_demo::DVKDefaultRes::fullQuad;
-        
-        // depth
-		m_DepthShader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
+
+		// 模型导入和shader反射同时在工作线程上进行
+		vk_demo::DVKAssetLoader* loader = vk_demo::DVKAssetLoader::Create(m_VulkanDevice);
+
+		vk_demo::DVKAssetHandle depthShader = loader->LoadShader(
 			true,
 			"assets/shaders/38_IndirectDraw/Depth.vert.spv",
 			"assets/shaders/38_IndirectDraw/Depth.frag.spv"
 		);
 
+		vk_demo::DVKAssetHandle pcfShadowShader = loader->LoadShader(
+			true,
+			"assets/shaders/38_IndirectDraw/PCFShadow.vert.spv",
+			"assets/shaders/38_IndirectDraw/PCFShadow.frag.spv"
+		);
+
+		vk_demo::DVKAssetHandle debugShader = loader->LoadShader(
+			true,
+			"assets/shaders/38_IndirectDraw/Debug.vert.spv",
+			"assets/shaders/38_IndirectDraw/Debug.frag.spv"
+		);
+
+		vk_demo::DVKAssetHandle groundModel = loader->LoadModel(
+			"assets/models/plane_circle.fbx",
+			{ 
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_Color,
+				VertexAttribute::VA_Normal
+			}
+		);
+
+		vk_demo::DVKAssetHandle groundShader = loader->LoadShader(
+			true,
+			"assets/shaders/38_IndirectDraw/Ground.vert.spv",
+			"assets/shaders/38_IndirectDraw/Ground.frag.spv"
+		);
+
+		// 只用CPU端的顶点数据拼成大buffer
+		vk_demo::DVKAssetHandle plantsModel = loader->LoadModel(
+			"assets/models/low_poly_tree.fbx",
+			{ 
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_Color,
+				VertexAttribute::VA_Normal
+			},
+			false
+		);
+
+		vk_demo::DVKAssetHandle plantsShader = loader->LoadShader(
+			true,
+			"assets/shaders/38_IndirectDraw/Obj.vert.spv",
+			"assets/shaders/38_IndirectDraw/Obj.frag.spv"
+		);
+
+		loader->WaitAll();
+        
+        // depth
+		m_DepthShader = loader->GetShader(depthShader);
+
 		m_DepthMaterial = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
 			m_ShadowRTT,
@@ -641,12 +697,7 @@ private:
 		m_DepthMaterial->PreparePipeline();
         
 		// pcf shadow
-		m_PCFShadowShader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
-			true,
-			"assets/shaders/38_IndirectDraw/PCFShadow.vert.spv",
-			"assets/shaders/38_IndirectDraw/PCFShadow.frag.spv"
-		);
+		m_PCFShadowShader = loader->GetShader(pcfShadowShader);
 
 		m_PCFShadowMaterial = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
@@ -658,12 +709,7 @@ private:
 		m_PCFShadowMaterial->SetTexture("shadowMap", m_ShadowMap);
 		
 		// debug
-		m_DebugShader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
-			true,
-			"assets/shaders/38_IndirectDraw/Debug.vert.spv",
-			"assets/shaders/38_IndirectDraw/Debug.frag.spv"
-		);
+		m_DebugShader = loader->GetShader(debugShader);
 
 		m_DebugMaterial = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
@@ -676,26 +722,12 @@ private:
 		m_DebugMaterial->SetTexture("depthTexture", m_ShadowMap);
 		
 		// ground model
-		m_GroundModel = vk_demo::DVKModel::LoadFromFile(
-			"assets/models/plane_circle.fbx",
-			m_VulkanDevice,
-			cmdBuffer,
-			{ 
-				VertexAttribute::VA_Position,
-				VertexAttribute::VA_Color,
-				VertexAttribute::VA_Normal
-			}
-		);
+		m_GroundModel = loader->GetModel(groundModel);
 		m_GroundModel->rootNode->localMatrix.AppendScale(Vector3(GROUND_RADIUS, GROUND_RADIUS, GROUND_RADIUS));
 		m_GroundModel->rootNode->localMatrix.AppendRotation(270.0f, Vector3::RightVector);
 		m_GroundModel->rootNode->localMatrix.AppendTranslation(Vector3(0, -0.0f, 0));
 
-		m_GroundShader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
-			true,
-			"assets/shaders/38_IndirectDraw/Ground.vert.spv",
-			"assets/shaders/38_IndirectDraw/Ground.frag.spv"
-		);
+		m_GroundShader = loader->GetShader(groundShader);
 
 		m_GroundMaterial = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
@@ -707,23 +739,10 @@ private:
         m_GroundMaterial->SetTexture("shadowMap", m_ShadowMap);
         
 		// plants model
-		m_PlantsModel = vk_demo::DVKModel::LoadFromFile(
-			"assets/models/low_poly_tree.fbx",
-			m_VulkanDevice,
-			nullptr,
-			{ 
-				VertexAttribute::VA_Position,
-				VertexAttribute::VA_Color,
-				VertexAttribute::VA_Normal
-			}
-		);
+		m_PlantsModel  = loader->GetModel(plantsModel);
+		m_PlantsShader = loader->GetShader(plantsShader);
 
-		m_PlantsShader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
-			true,
-			"assets/shaders/38_IndirectDraw/Obj.vert.spv",
-			"assets/shaders/38_IndirectDraw/Obj.frag.spv"
-		);
+		delete loader;
 
 		m_PlantsMaterial = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
@@ -11,6 +11,8 @@
 #include <vector>
 
 #define OBJECT_COUNT 1024
+#define CLUSTER_GRID 4
+#define CLUSTER_COUNT (CLUSTER_GRID * CLUSTER_GRID)
 
 class OcclusionQueryDemo : public DemoBase
 {
@@ -34,6 +36,7 @@ public:
 	virtual bool Init() override
 	{
 		DemoBase::Setup();
+		DemoBase::SetFramesInFlight(2);
 		DemoBase::Prepare();
 
 		CreateGUI();
@@ -81,13 +84,6 @@ private:
 			m_ViewCamera.Update(time, delta);
 		}
 
-		vkGetQueryPoolResults(
-			m_Device, 
-			m_QueryPool, 
-			0, OBJECT_COUNT, sizeof(uint64) * OBJECT_COUNT, m_QuerySamples, sizeof(uint64), 
-			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
-		);
-
 		SetupCommandBuffers(bufferIndex);
 
 		DemoBase::Present(bufferIndex);
@@ -103,8 +99,17 @@ private:
 			ImGui::Begin("OcclusionQueryDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
 			ImGui::Checkbox("EnableQuery", &m_EnableQuery);
+			ImGui::Checkbox("Hierarchy", &m_EnableHierarchy);
+			if (m_OcclusionQuery->IsConditionalRenderingSupported()) {
+				ImGui::Checkbox("ConditionalRendering", &m_ConditionalRendering);
+			}
+
+			ImGui::Text("Latency:%d frames", m_OcclusionQuery->GetLatency());
+			ImGui::Text("Occluded:%d Missing:%d", m_OcclusionQuery->GetNumOccluded(), m_OcclusionQuery->GetNumMissing());
+			ImGui::Text("Queries:%d Draws:%d", m_NumQueries, m_NumDraws);
 
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::Text("Fence wait %.3f ms/frame, %d frames in flight", GetFenceWaitTime(), GetFramesInFlight());
 			ImGui::End();
 		}
 
@@ -120,12 +125,6 @@ private:
 	{
 		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
 
-		VkQueryPoolCreateInfo queryPoolCreateInfo;
-		ZeroVulkanStruct(queryPoolCreateInfo, VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO);
-		queryPoolCreateInfo.queryType  = VK_QUERY_TYPE_OCCLUSION;
-		queryPoolCreateInfo.queryCount = OBJECT_COUNT;
-		VERIFYVULKANRESULT(vkCreateQueryPool(m_Device, &queryPoolCreateInfo, VULKAN_CPU_ALLOCATOR, &m_QueryPool));
-
 		m_ModelSphere = vk_demo::DVKModel::LoadFromFile(
 			"assets/models/sphere.obj",
 			m_VulkanDevice,
@@ -148,6 +147,16 @@ private:
 		m_ModelGround->rootNode->localMatrix.AppendRotation(270.0f, Vector3::RightVector);
 		m_ModelGround->rootNode->localMatrix.AppendScale(Vector3(500, 500, 500));
 
+		m_ModelCube = vk_demo::DVKModel::LoadFromFile(
+			"assets/models/cube.obj",
+			m_VulkanDevice,
+			cmdBuffer,
+			{ 
+				VertexAttribute::VA_Position, 
+				VertexAttribute::VA_Normal
+			}
+		);
+
 		vk_demo::DVKBoundingBox bounds = m_ModelSphere->rootNode->GetBounds();
 		Vector3 boundSize   = bounds.max - bounds.min;
 		Vector3 boundCenter = bounds.min + boundSize * 0.5f;
@@ -166,6 +175,8 @@ private:
 			));
 		}
 
+		CreateQueries();
+
 		m_Shader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
 			true,
@@ -194,6 +205,17 @@ private:
 			m_SimpleShader
 		);
 		m_SimpleMaterial->PreparePipeline();
+
+		// 包围盒只做测试，不能遮挡里面的物体
+		m_BoundsMaterial = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_RenderPass,
+			m_PipelineCache,
+			m_SimpleShader
+		);
+		m_BoundsMaterial->pipelineInfo.depthStencilState.depthWriteEnable = VK_FALSE;
+		m_BoundsMaterial->pipelineInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		m_BoundsMaterial->PreparePipeline();
         
 		delete cmdBuffer;
 	}
@@ -202,14 +224,75 @@ private:
 	{
 		delete m_ModelGround;
 		delete m_ModelSphere;
+		delete m_ModelCube;
         
+		delete m_BoundsMaterial;
 		delete m_SimpleMaterial;
 		delete m_SimpleShader;
 		
 		delete m_Material;
 		delete m_Shader;
 
-		vkDestroyQueryPool(m_Device, m_QueryPool, VULKAN_CPU_ALLOCATOR);
+		delete m_OcclusionQuery;
+	}
+
+	void CreateQueries()
+	{
+		// 按网格把物体分成CLUSTER_COUNT组，每组一个包围盒query作为父节点
+		m_OcclusionQuery = vk_demo::DVKOcclusionQuery::Create(m_VulkanDevice, CLUSTER_COUNT + OBJECT_COUNT, GetFramesInFlight());
+		m_OcclusionQuery->SetSampleThreshold(50); // precise: 0
+
+		vk_demo::DVKBoundingBox sphereBounds = m_ModelSphere->rootNode->GetBounds();
+		Vector3 sphereExtent = (sphereBounds.max - sphereBounds.min) * 0.5f;
+		sphereExtent.x = sphereExtent.z = MMath::Max(sphereExtent.x, sphereExtent.z);
+
+		for (int32 i = 0; i < CLUSTER_COUNT; ++i) 
+		{
+			m_ClusterQueries[i] = m_OcclusionQuery->AddQuery();
+			m_ClusterBounds[i].min = Vector3(MAX_flt, MAX_flt, MAX_flt);
+			m_ClusterBounds[i].max = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+		}
+
+		for (int32 i = 0; i < OBJECT_COUNT; ++i)
+		{
+			Vector3 center = m_ObjModels[i].GetOrigin() + m_SphereCenter;
+			int32 cx = MMath::Clamp((int32)((center.x + 250.0f) / 500.0f * CLUSTER_GRID), 0, CLUSTER_GRID - 1);
+			int32 cz = MMath::Clamp((int32)((center.z + 250.0f) / 500.0f * CLUSTER_GRID), 0, CLUSTER_GRID - 1);
+			int32 cluster = cz * CLUSTER_GRID + cx;
+
+			m_ObjClusters[i]  = cluster;
+			m_SphereQueries[i] = m_OcclusionQuery->AddQuery(m_ClusterQueries[cluster]);
+
+			vk_demo::DVKBoundingBox& bounds = m_ClusterBounds[cluster];
+			bounds.min = Vector3::Min(bounds.min, center - sphereExtent);
+			bounds.max = Vector3::Max(bounds.max, center + sphereExtent);
+		}
+
+		vk_demo::DVKBoundingBox cubeBounds = m_ModelCube->rootNode->GetBounds();
+		Vector3 cubeSize   = cubeBounds.max - cubeBounds.min;
+		Vector3 cubeCenter = (cubeBounds.max + cubeBounds.min) * 0.5f;
+		for (int32 i = 0; i < CLUSTER_COUNT; ++i)
+		{
+			Vector3 size   = m_ClusterBounds[i].max - m_ClusterBounds[i].min;
+			Vector3 center = (m_ClusterBounds[i].max + m_ClusterBounds[i].min) * 0.5f;
+			Vector3 scale  = size / cubeSize;
+			m_ClusterMatrices[i].SetIdentity();
+			m_ClusterMatrices[i].AppendTranslation(-cubeCenter);
+			m_ClusterMatrices[i].AppendScale(scale);
+			m_ClusterMatrices[i].AppendTranslation(center);
+		}
+	}
+
+	bool IsSphereVisible(int32 index)
+	{
+		if (!m_EnableQuery) {
+			return true;
+		}
+		if (m_EnableHierarchy) {
+			return m_OcclusionQuery->IsVisible(m_SphereQueries[index]);
+		}
+		// 不使用父节点的结果
+		return m_OcclusionQuery->GetSamples(m_SphereQueries[index]) > 50;
 	}
 
 	void RenderOcclusions(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
@@ -220,6 +303,9 @@ private:
 		// bind only
 		m_ModelSphere->meshes[0]->BindOnly(commandBuffer);
 
+		m_NumQueries = 0;
+
+		// 所有物体都写入深度，父节点不可见时不需要单独测试
 		for (int32 i = 0; i < OBJECT_COUNT; ++i)
 		{
 			m_MVPParam.model = m_ObjModels[i];
@@ -230,15 +316,54 @@ private:
 			m_SimpleMaterial->SetLocalUniform("uboMVP",      &m_MVPParam,         sizeof(ModelViewProjectionBlock));
 			m_SimpleMaterial->EndObject();
 
-			vkCmdBeginQuery(commandBuffer, m_QueryPool, i, VK_QUERY_CONTROL_PRECISE_BIT);
+			int32 query = m_SphereQueries[i];
+			bool needsQuery = !m_EnableHierarchy || m_OcclusionQuery->NeedsQuery(query);
+			if (needsQuery) {
+				m_OcclusionQuery->BeginQuery(commandBuffer, query);
+				m_NumQueries += 1;
+			}
 
 			m_SimpleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
 			m_ModelSphere->meshes[0]->DrawOnly(commandBuffer);
 
-			vkCmdEndQuery(commandBuffer, m_QueryPool, i);
+			if (needsQuery) {
+				m_OcclusionQuery->EndQuery(commandBuffer, query);
+			}
 		}
 
 		m_SimpleMaterial->EndFrame();
+
+		if (!m_EnableHierarchy) {
+			return;
+		}
+
+		// 一个包围盒query覆盖整组物体
+		m_BoundsMaterial->BeginFrame();
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_BoundsMaterial->GetPipeline());
+		m_ModelCube->meshes[0]->BindOnly(commandBuffer);
+
+		for (int32 i = 0; i < CLUSTER_COUNT; ++i)
+		{
+			m_MVPParam.model = m_ClusterMatrices[i];
+			m_MVPParam.view  = camera.GetView();
+			m_MVPParam.proj  = camera.GetProjection();
+
+			m_BoundsMaterial->BeginObject();
+			m_BoundsMaterial->SetLocalUniform("uboMVP",      &m_MVPParam,         sizeof(ModelViewProjectionBlock));
+			m_BoundsMaterial->EndObject();
+
+			m_OcclusionQuery->BeginQuery(commandBuffer, m_ClusterQueries[i]);
+
+			m_BoundsMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
+			m_ModelCube->meshes[0]->DrawOnly(commandBuffer);
+
+			m_OcclusionQuery->EndQuery(commandBuffer, m_ClusterQueries[i]);
+
+			m_NumQueries += 1;
+		}
+
+		m_BoundsMaterial->EndFrame();
 	}
 
 	void RenderGround(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
@@ -268,11 +393,19 @@ private:
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
 		m_ModelSphere->meshes[0]->BindOnly(commandBuffer);
 		
+		// 条件渲染时由GPU根据自身的结果跳过，父节点的结果依然在CPU端处理
+		bool conditional = m_EnableQuery && m_ConditionalRendering && m_OcclusionQuery->IsConditionalRenderingSupported();
+
 		int32 count = 0;
 		for (int32 i = 0; i < OBJECT_COUNT; ++i)
 		{
-			bool occluded = m_QuerySamples[i] <= 50; // precise: m_QuerySamples[i] == 0
-			if (occluded && m_EnableQuery) {
+			if (conditional)
+			{
+				if (m_EnableHierarchy && !m_OcclusionQuery->IsVisible(m_ClusterQueries[m_ObjClusters[i]])) {
+					continue;
+				}
+			}
+			else if (!IsSphereVisible(i)) {
 				continue;
 			}
 
@@ -285,11 +418,22 @@ private:
 			m_Material->EndObject();
 
 			m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, count);
+
+			if (conditional) {
+				m_OcclusionQuery->BeginConditionalRendering(commandBuffer, m_SphereQueries[i]);
+			}
+
 			m_ModelSphere->meshes[0]->DrawOnly(commandBuffer);
 
+			if (conditional) {
+				m_OcclusionQuery->EndConditionalRendering(commandBuffer);
+			}
+
 			count++;
 		}
 
+		m_NumDraws = count;
+
 		m_Material->EndFrame();
 	}
 
@@ -334,7 +478,8 @@ private:
 		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
 		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
-		vkCmdResetQueryPool(commandBuffer, m_QueryPool, 0, OBJECT_COUNT);
+		// 读取这个slot之前的结果，不等待GPU
+		m_OcclusionQuery->BeginFrame(commandBuffer, m_FrameIndex);
 
 		BeginMainPass(commandBuffer, backBufferIndex);
 
@@ -404,14 +549,12 @@ private:
 		m_TopCamera.SetPosition(-500, 1500, 0);
 		m_TopCamera.LookAt(0, 0, 0);
 		m_TopCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight() * 0.5f, 1.0f, 3000.0f);
-
-		memset(m_QuerySamples, 65535, sizeof(uint64) * OBJECT_COUNT);
 	}
 
 	void CreateGUI()
 	{
 		m_GUI = new ImageGUIContext();
-		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf", GetFramesInFlight());
 	}
 
 	void DestroyGUI()
@@ -428,20 +571,30 @@ private:
 
 	bool 						m_Ready = false;
 
-	VkQueryPool					m_QueryPool;
+	vk_demo::DVKOcclusionQuery*	m_OcclusionQuery = nullptr;
 
 	vk_demo::DVKModel*			m_ModelSphere = nullptr;
 	vk_demo::DVKModel*			m_ModelGround = nullptr;
+	vk_demo::DVKModel*			m_ModelCube = nullptr;
 	vk_demo::DVKMaterial*		m_Material = nullptr;
 	vk_demo::DVKShader*			m_Shader = nullptr;
 	vk_demo::DVKMaterial*		m_SimpleMaterial = nullptr;
+	vk_demo::DVKMaterial*		m_BoundsMaterial = nullptr;
 	vk_demo::DVKShader*			m_SimpleShader = nullptr;
 
 	Matrix4x4					m_ObjModels[OBJECT_COUNT];
-	uint64						m_QuerySamples[OBJECT_COUNT];
+	int32						m_ObjClusters[OBJECT_COUNT];
+	int32						m_SphereQueries[OBJECT_COUNT];
+	int32						m_ClusterQueries[CLUSTER_COUNT];
+	vk_demo::DVKBoundingBox		m_ClusterBounds[CLUSTER_COUNT];
+	Matrix4x4					m_ClusterMatrices[CLUSTER_COUNT];
 	Vector3						m_SphereCenter;
 	float						m_SphereRadius;
 	bool						m_EnableQuery = true;
+	bool						m_EnableHierarchy = true;
+	bool						m_ConditionalRendering = false;
+	int32						m_NumQueries = 0;
+	int32						m_NumDraws = 0;
 
 	vk_demo::DVKCamera		    m_ViewCamera;
 	vk_demo::DVKCamera			m_TopCamera;
@@ -5,6 +5,7 @@
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
+#include "GenericPlatform/GenericPlatformTime.h"
 
 #include <vector>
 
@@ -79,6 +80,34 @@ private:
 			m_ViewCamera.Update(time, delta);
 		}
 
+		// 只有根节点变化，脏标记传给整棵树
+		if (m_Rotate)
+		{
+			m_RotateAngle += delta * 15.0f;
+			Matrix4x4 rootMatrix = m_RootMatrix;
+			rootMatrix.AppendRotation(m_RotateAngle, Vector3::UpVector);
+			m_SceneGraph->SetLocalMatrix(0, rootMatrix);
+		}
+		m_SceneGraph->Update();
+
+		double cullTime = GenericPlatformTime::Seconds();
+		if (m_CullMode == 0)
+		{
+			m_Visible.resize(m_Model->meshes.size());
+			for (int32 i = 0; i < m_Visible.size(); ++i) {
+				m_Visible[i] = i;
+			}
+		}
+		else if (m_CullMode == 1)
+		{
+			m_SceneGraph->CullLinear(m_ViewCamera.GetViewProjection(), m_Visible);
+		}
+		else
+		{
+			m_SceneGraph->Cull(m_ViewCamera.GetViewProjection(), m_Visible);
+		}
+		m_CullTime = GenericPlatformTime::Seconds() - cullTime;
+
 		vkGetQueryPoolResults(
 			m_Device, 
 			m_QueryPool, 
@@ -105,6 +134,14 @@ private:
 				ImGui::Text("%s : %d", m_StatNames[i], m_QueryStats[i]);
 			}
 
+			ImGui::Separator();
+
+			const char* modes[3] = { "None", "Linear SIMD", "BVH" };
+			ImGui::Combo("Culling", &m_CullMode, modes, 3);
+			ImGui::Checkbox("Rotate", &m_Rotate);
+			ImGui::Text("Visible meshes : %d/%d", (int32)m_Visible.size(), (int32)m_Model->meshes.size());
+			ImGui::Text("Cull : %.3f ms", m_CullTime * 1000.0);
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -171,11 +208,15 @@ private:
 		);
 		m_Material->PreparePipeline();
 
+		m_RootMatrix = m_Model->rootNode->localMatrix;
+		m_SceneGraph = vk_demo::DVKSceneGraph::Create(m_Model);
+
 		delete cmdBuffer;
 	}
 
 	void DestroyAssets()
 	{
+		delete m_SceneGraph;
 		delete m_Model;
 		
 		delete m_Material;
@@ -231,9 +272,10 @@ private:
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
 
 		m_Material->BeginFrame();
-		for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+		for (int32 i = 0; i < m_Visible.size(); ++i)
 		{
-			m_MVPParam.model = m_Model->meshes[i]->linkNode->GetGlobalMatrix();
+			const int32 meshIndex = m_Visible[i];
+			m_MVPParam.model = m_SceneGraph->GetMeshMatrix(meshIndex);
 			m_MVPParam.view  = m_ViewCamera.GetView();
 			m_MVPParam.proj  = m_ViewCamera.GetProjection();
 
@@ -242,7 +284,7 @@ private:
 			m_Material->EndObject();
 
 			m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
-			m_Model->meshes[i]->BindDrawCmd(commandBuffer);
+			m_Model->meshes[meshIndex]->BindDrawCmd(commandBuffer);
 		}
 		m_Material->EndFrame();
 		vkCmdEndQuery(commandBuffer, m_QueryPool, 0);
@@ -280,6 +322,13 @@ private:
 	VkQueryPool					m_QueryPool;
 
 	vk_demo::DVKModel*			m_Model = nullptr;
+	vk_demo::DVKSceneGraph*		m_SceneGraph = nullptr;
+	std::vector<int32>			m_Visible;
+	int32						m_CullMode = 2;
+	double						m_CullTime = 0.0;
+	bool						m_Rotate = false;
+	float						m_RotateAngle = 0.0f;
+	Matrix4x4					m_RootMatrix;
 	vk_demo::DVKMaterial*		m_Material = nullptr;
 	vk_demo::DVKShader*			m_Shader = nullptr;
 
@@ -5,6 +5,8 @@
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
+#include "Math/RandomStream.h"
+#include "GenericPlatform/GenericPlatformTime.h"
 
 #include <vector>
 
@@ -142,6 +144,16 @@ private:
 			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
 			ImGui::Begin("PickDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
+			if (m_BVH) {
+				ImGui::Text("BVH:%d tris %d nodes, build %.2fms", m_BVH->GetNumTriangles(), m_BVH->GetNumNodes(), m_BVH->GetBuildTime() * 1000.0);
+			}
+			ImGui::Checkbox("BruteForce", &m_BruteForce);
+			ImGui::Text("Pick:%.3fms", m_PickTime * 1000.0);
+
+			if (m_BVH && ImGui::Button("Benchmark Pick")) {
+				BenchmarkPick();
+			}
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -200,33 +212,9 @@ private:
 		return true;
 	}
 
-	void UpdateLine(float time, float delta)
+	// 逐个三角形测试，顶点变换到世界空间，只用来和BVH对比
+	bool PickBruteForce(const Vector3& pos, const Vector3& ray, Vector3& triV0, Vector3& triV1, Vector3& triV2)
 	{
-		Matrix4x4 invProj = m_ViewCamera.GetProjection();
-		invProj.SetInverse();
-		Matrix4x4 invView = m_ViewCamera.GetView();
-		invView.SetInverse();
-		Vector2 mousePos  = InputManager::GetMousePosition();
-
-		// calc clip space position
-		Vector3 clipPos;
-		clipPos.x = (mousePos.x / GetWidth() * 2.0f - 1.0f);  //  2D:[0, width]  Clip:[-1,  1]
-		clipPos.y = -(mousePos.y / GetHeight() * 2.0f - 1.0f); // 2D:[0, height] Clip:[ 1, -1]
-		clipPos.z = 1.0f;
-
-		// clip space to view space
-		Vector3 ray = invProj.TransformPosition(clipPos);
-		ray.x = ray.x * ray.z;
-		ray.y = ray.y * ray.z;
-
-		// view space to world space
-		ray = invView.DeltaTransformVector(ray);
-		ray = ray.GetSafeNormal();
-
-		// camera position
-		Vector3 pos = m_ViewCamera.GetTransform().GetOrigin();
-
-		// collision info
 		Vector3 v0;
 		Vector3 v1;
 		Vector3 v2;
@@ -236,14 +224,12 @@ private:
 		float v = 0;
 
 		bool found = false;
-		Vector3 triV0;
-		Vector3 triV1;
-		Vector3 triV2;
 
-		// collision test
 		for (int32 meshID = 0; meshID < m_Model->meshes.size(); ++meshID)
 		{
 			auto mesh = m_Model->meshes[meshID];
+			const Matrix4x4& matrix = mesh->linkNode->GetGlobalMatrix();
+
 			for (int32 primitiveID = 0; primitiveID < mesh->primitives.size(); ++primitiveID)
 			{
 				auto pritimive = mesh->primitives[primitiveID];
@@ -256,25 +242,121 @@ private:
 					int32 index1 = pritimive->indices[idx + 1] * stride;
 					int32 index2 = pritimive->indices[idx + 2] * stride;
 
-					v0.Set(pritimive->vertices[index0 + 0], pritimive->vertices[index0 + 1], pritimive->vertices[index0 + 2]);
-					v1.Set(pritimive->vertices[index1 + 0], pritimive->vertices[index1 + 1], pritimive->vertices[index1 + 2]);
-					v2.Set(pritimive->vertices[index2 + 0], pritimive->vertices[index2 + 1], pritimive->vertices[index2 + 2]);
+					v0 = matrix.TransformPosition(Vector3(pritimive->vertices[index0 + 0], pritimive->vertices[index0 + 1], pritimive->vertices[index0 + 2]));
+					v1 = matrix.TransformPosition(Vector3(pritimive->vertices[index1 + 0], pritimive->vertices[index1 + 1], pritimive->vertices[index1 + 2]));
+					v2 = matrix.TransformPosition(Vector3(pritimive->vertices[index2 + 0], pritimive->vertices[index2 + 1], pritimive->vertices[index2 + 2]));
 
-					if (IntersectTriangle(pos, ray, v0, v1, v2, &t, &u, &v))
+					if (IntersectTriangle(pos, ray, v0, v1, v2, &t, &u, &v) && t > 0.0f && t <= dist)
 					{
-						if (t <= dist)
-						{
-							dist  = t;
-							found = true;
-							triV0 = v0;
-							triV1 = v1;
-							triV2 = v2;
-						}
+						dist  = t;
+						found = true;
+						triV0 = v0;
+						triV1 = v1;
+						triV2 = v2;
 					}
 				}
 			}
 		}
 
+		return found;
+	}
+
+	bool PickBVH(const Vector3& pos, const Vector3& ray, Vector3& triV0, Vector3& triV1, Vector3& triV2)
+	{
+		vk_demo::DVKRayHit hit;
+		if (!m_BVH->Intersect(pos, ray, 0.0f, hit)) {
+			return false;
+		}
+		m_BVH->GetTriangle(hit, triV0, triV1, triV2);
+		return true;
+	}
+
+	// 从相机位置朝模型包围盒内随机点发射光线，对比BVH和逐个三角形测试的吞吐
+	void BenchmarkPick()
+	{
+		const int32 numRays      = 64 * 1024;
+		const int32 numBruteRays = 64;
+
+		vk_demo::DVKBoundingBox bounds = m_Model->rootNode->GetBounds();
+		Vector3 pos = m_ViewCamera.GetTransform().GetOrigin();
+
+		RandomStream random(1);
+		std::vector<Vector3> rays(numRays);
+		for (int32 i = 0; i < numRays; ++i)
+		{
+			Vector3 target;
+			target.x = random.FRandRange(bounds.min.x, bounds.max.x);
+			target.y = random.FRandRange(bounds.min.y, bounds.max.y);
+			target.z = random.FRandRange(bounds.min.z, bounds.max.z);
+			rays[i] = (target - pos).GetSafeNormal();
+		}
+
+		Vector3 v0;
+		Vector3 v1;
+		Vector3 v2;
+
+		int32 bvhHits = 0;
+		double bvhTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numRays; ++i) {
+			bvhHits += PickBVH(pos, rays[i], v0, v1, v2) ? 1 : 0;
+		}
+		bvhTime = GenericPlatformTime::Seconds() - bvhTime;
+
+		int32 bvhSubsetHits   = 0;
+		int32 bruteSubsetHits = 0;
+		double bruteTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numBruteRays; ++i) {
+			bruteSubsetHits += PickBruteForce(pos, rays[i], v0, v1, v2) ? 1 : 0;
+		}
+		bruteTime = GenericPlatformTime::Seconds() - bruteTime;
+
+		for (int32 i = 0; i < numBruteRays; ++i) {
+			bvhSubsetHits += PickBVH(pos, rays[i], v0, v1, v2) ? 1 : 0;
+		}
+
+		if (bvhSubsetHits != bruteSubsetHits) {
+			MLOGE("Pick mismatch: bvh %d, brute force %d hits", bvhSubsetHits, bruteSubsetHits);
+		}
+
+		MLOG("BVH %d triangles, %d nodes, build %.2fms", m_BVH->GetNumTriangles(), m_BVH->GetNumNodes(), m_BVH->GetBuildTime() * 1000.0);
+		MLOG("Pick %d rays: BVH %.3f MRays/s (%d hits), brute force %.3f KRays/s", numRays, numRays / bvhTime / 1000000.0, bvhHits, numBruteRays / bruteTime / 1000.0);
+	}
+
+	void UpdateLine(float time, float delta)
+	{
+		Matrix4x4 invProj = m_ViewCamera.GetProjection();
+		invProj.SetInverse();
+		Matrix4x4 invView = m_ViewCamera.GetView();
+		invView.SetInverse();
+		Vector2 mousePos  = InputManager::GetMousePosition();
+
+		// calc clip space position
+		Vector3 clipPos;
+		clipPos.x = (mousePos.x / GetWidth() * 2.0f - 1.0f);  //  2D:[0, width]  Clip:[-1,  1]
+		clipPos.y = -(mousePos.y / GetHeight() * 2.0f - 1.0f); // 2D:[0, height] Clip:[ 1, -1]
+		clipPos.z = 1.0f;
+
+		// clip space to view space
+		Vector3 ray = invProj.TransformPosition(clipPos);
+		ray.x = ray.x * ray.z;
+		ray.y = ray.y * ray.z;
+
+		// view space to world space
+		ray = invView.DeltaTransformVector(ray);
+		ray = ray.GetSafeNormal();
+
+		// camera position
+		Vector3 pos = m_ViewCamera.GetTransform().GetOrigin();
+
+		// collision test, 三角形为世界空间
+		Vector3 triV0;
+		Vector3 triV1;
+		Vector3 triV2;
+
+		double pickTime = GenericPlatformTime::Seconds();
+		bool found = (m_BruteForce || !m_BVH) ? PickBruteForce(pos, ray, triV0, triV1, triV2) : PickBVH(pos, ray, triV0, triV1, triV2);
+		m_PickTime = GenericPlatformTime::Seconds() - pickTime;
+
 		m_SimpleLine.Clear();
 
 		if (found)
@@ -322,6 +404,8 @@ private:
 		);
 		m_Material->PreparePipeline();
 
+		m_BVH = vk_demo::DVKBVH::Create(m_Model);
+
 		m_SimpleLine.Resize(6 * 128);
 		m_ModelLine = vk_demo::DVKBuffer::CreateBuffer(
 			m_VulkanDevice, 
@@ -357,6 +441,7 @@ private:
 
 	void DestroyAssets()
 	{
+		delete m_BVH;
 		delete m_Model;
 		delete m_Material;
 		delete m_Shader;
@@ -478,6 +563,7 @@ private:
 	vk_demo::DVKShader*			m_ShaderLine = nullptr;
 
 	vk_demo::DVKModel*			m_Model = nullptr;
+	vk_demo::DVKBVH*			m_BVH = nullptr;
 	vk_demo::DVKMaterial*		m_Material = nullptr;
 	vk_demo::DVKShader*			m_Shader = nullptr;
 
@@ -485,6 +571,9 @@ private:
 
 	ModelViewProjectionBlock	m_MVPParam;
 
+	bool						m_BruteForce = false;
+	double						m_PickTime = 0.0;
+
 	ImageGUIContext*			m_GUI = nullptr;
 };
 
@@ -111,6 +111,10 @@ private:
 			ImGui::SliderFloat("Rejection Falloff",			&m_RejectionFalloff,		1.0f,   10.0f);
 			ImGui::SliderFloat("Accentuation",				&m_Accentuation,			0.0f,   1.0f);
 
+			ImGui::Separator();
+
+			m_Profiler->DrawGUI();
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -359,10 +363,14 @@ private:
 		LoadCombineRes(cmdBuffer);
 		
 		delete cmdBuffer;
+
+		// 每个backbuffer的command buffer对应一个slot
+		m_Profiler = vk_demo::DVKGPUProfiler::Create(m_VulkanDevice, m_CommandBuffers.size());
 	}
 
 	void DestroyAssets()
 	{
+		delete m_Profiler;
 		delete m_SceneModel;
 		delete m_SceneShader;
 
@@ -498,7 +506,10 @@ private:
 		}
 
 		// ui pass
-		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+		{
+			vk_demo::DVKGPUScope scope(m_Profiler, commandBuffer, "UI");
+			m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+		}
 
 		vkCmdEndRenderPass(commandBuffer);
 	}
@@ -511,11 +522,34 @@ private:
 		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
 		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
-		ScenePass(commandBuffer);
-		PrepareDepthPass(commandBuffer);
-		ComputeAoPass(commandBuffer);
-		BlurAndUpsamplePass(commandBuffer);
-		CombinePass(commandBuffer, backBufferIndex);
+		m_Profiler->BeginFrame(commandBuffer, backBufferIndex);
+
+		{
+			vk_demo::DVKGPUScope scope(m_Profiler, commandBuffer, "Scene");
+			ScenePass(commandBuffer);
+		}
+
+		{
+			vk_demo::DVKGPUScope scope(m_Profiler, commandBuffer, "DepthPrepare");
+			PrepareDepthPass(commandBuffer);
+		}
+
+		{
+			vk_demo::DVKGPUScope scope(m_Profiler, commandBuffer, "AO");
+			ComputeAoPass(commandBuffer);
+		}
+
+		{
+			vk_demo::DVKGPUScope scope(m_Profiler, commandBuffer, "BlurUpsample");
+			BlurAndUpsamplePass(commandBuffer);
+		}
+
+		{
+			vk_demo::DVKGPUScope scope(m_Profiler, commandBuffer, "Combine");
+			CombinePass(commandBuffer, backBufferIndex);
+		}
+
+		m_Profiler->EndFrame(commandBuffer);
 
 		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
 	}
@@ -661,6 +695,8 @@ private:
 
 	vk_demo::DVKModel*			m_Quad = nullptr;
 
+	vk_demo::DVKGPUProfiler*	m_Profiler = nullptr;
+
 	// scene
 	vk_demo::DVKModel*			m_SceneModel = nullptr;
 	vk_demo::DVKShader*			m_SceneShader = nullptr;
@@ -2,18 +2,23 @@
 #include "Common/Log.h"
 
 #include "Demo/DVKCommon.h"
+#include "GenericPlatform/GenericPlatformTime.h"
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
 
 #include <vector>
 #include <thread>
+#include <functional>
 #include <mutex>
 #include <condition_variable>
 
 // less than m_VulkanDevice->GetLimits().maxUniformBufferRange
 #define INSTANCE_COUNT 512
 
+// frames averaged per record time sample
+#define RECORD_SAMPLE_FRAMES 60
+
 struct InstanceData
 {
 	Matrix4x4	transforms[INSTANCE_COUNT];
@@ -53,7 +58,7 @@ public:
 
 	}
 
-	void Draw(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
+	void Draw(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera, int32 context)
 	{
 		vk_demo::DVKPrimitive* primitive = m_Model->meshes[0]->primitives[0];
 
@@ -63,20 +68,17 @@ public:
 		m_MVPParam.view  = camera.GetView();
 		m_MVPParam.proj  = camera.GetProjection();
 
-		{
-			std::lock_guard<std::mutex> lockGuard(writeMutex);
-
-			m_Material->BeginFrame();
+		// every thread records with its own context, no lock needed
+		m_Material->BeginFrame(context);
 
-			m_Material->BeginObject();
-			m_Material->SetLocalUniform("uboMVP",		&m_MVPParam,		sizeof(ModelViewProjectionBlock));
-			m_Material->SetLocalUniform("uboTransform", &m_InstanceData,	sizeof(InstanceData));
-			m_Material->EndObject();
+		m_Material->BeginObject(context);
+		m_Material->SetLocalUniform("uboMVP",		&m_MVPParam,		sizeof(ModelViewProjectionBlock),	context);
+		m_Material->SetLocalUniform("uboTransform", &m_InstanceData,	sizeof(InstanceData),				context);
+		m_Material->EndObject(context);
 
-			m_Material->EndFrame();
+		m_Material->EndFrame(context);
 
-			m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-		}
+		m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0, context);
 		
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
 		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(primitive->instanceBuffer->dvkBuffer->buffer), &(primitive->instanceBuffer->offset));
@@ -119,6 +121,9 @@ public:
 		int32 vertEnd   = (m_BaseIndex + m_Count) * stride;
 		int32 objIndex  = m_UpdateIndex;
 
+		// 每个工作线程用自己的序列，不再在rand()的全局锁上排队
+		RandomStream& random = RandomStream::GetThreadStream();
+
 		for (int32 index = vertBegin; index < vertEnd; index += stride)
 		{
 			Vector3 position(
@@ -149,14 +154,17 @@ public:
 			matrix.SetPosition(finalPos);
 			matrix.LookAt(camera.GetTransform().GetOrigin());
 
-			m_InstanceData.colors[objIndex]     = Vector4(MMath::FRandRange(0, 1.0f), MMath::FRandRange(0, 1.0f), MMath::FRandRange(0, 1.0f), 1.0f);
+			float values[12];
+			random.FillFractions(values, 12);
+
+			m_InstanceData.colors[objIndex]     = Vector4(values[0], values[1], values[2], 1.0f);
 			m_InstanceData.transforms[objIndex] = matrix;
 
 			m_ParticleDatas[objIndex].position  = finalPos;
-			m_ParticleDatas[objIndex].direction = Vector3(MMath::FRandRange(0, 1.0f), MMath::FRandRange(0, 1.0f), MMath::FRandRange(0, 1.0f)).GetSafeNormal();
-			m_ParticleDatas[objIndex].velocity  = Vector3(MMath::FRandRange(0, 1.0f), MMath::FRandRange(0, 1.0f), MMath::FRandRange(0, 1.0f)).GetSafeNormal() * MMath::FRandRange(5.0f, 15.0f);
-			m_ParticleDatas[objIndex].grivity   = MMath::FRandRange(0, -5.0f);
-			m_ParticleDatas[objIndex].lifeTime  = MMath::FRandRange(0.25f, 0.50f);
+			m_ParticleDatas[objIndex].direction = Vector3(values[3], values[4], values[5]).GetSafeNormal();
+			m_ParticleDatas[objIndex].velocity  = Vector3(values[6], values[7], values[8]).GetSafeNormal() * MMath::Lerp(5.0f, 15.0f, values[9]);
+			m_ParticleDatas[objIndex].grivity   = -5.0f * values[10];
+			m_ParticleDatas[objIndex].lifeTime  = MMath::Lerp(0.25f, 0.50f, values[11]);
 			m_ParticleDatas[objIndex].time      = 0;
 
 			objIndex += 1;
@@ -183,7 +191,6 @@ struct ThreadData
 	int32 index;
 	int32 frameID;
 	VkCommandPool commandPool;
-	std::vector<ParticleModel*> particles;
 	std::vector<vk_demo::DVKCommandBuffer*> threadCommandBuffers;
 };
 
@@ -283,10 +290,14 @@ private:
 
 		UpdateAnimation(time, delta);
 
+		double recordStart = GenericPlatformTime::Seconds();
+
 		// notify fram start
+		// 线程数每帧只取一次，录制和vkCmdExecuteCommands都用它，UI/benchmark修改的m_ActiveThreads下一帧才生效
 		{
 			std::lock_guard<std::mutex> lockGuard(m_FrameStartLock);
 			m_ThreadDoneCount  = 0;
+			m_FrameThreads     = m_ActiveThreads;
 			m_MainFrameID     += 1;
 			m_FrameStartCV.notify_all();
 		}
@@ -299,6 +310,8 @@ private:
 			}
 		}
 
+		UpdateRecordTime((GenericPlatformTime::Seconds() - recordStart) * 1000.0);
+
 		SetupCommandBuffers(bufferIndex);
 
 		DemoBase::Present(bufferIndex);
@@ -313,6 +326,25 @@ private:
 			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
 			ImGui::Begin("ThreadedRenderingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
+			if (m_BenchmarkThreads == 0) {
+				ImGui::SliderInt("Threads", &m_ActiveThreads, 1, m_Threads.size());
+			}
+
+			ImGui::Text("Record %.3fms, %.1f draws/ms", m_LastRecordTime, m_Particles.size() / MMath::Max(m_LastRecordTime, 0.001f));
+
+			if (m_BenchmarkThreads == 0 && ImGui::Button("Benchmark"))
+			{
+				m_BenchmarkResults.clear();
+				m_BenchmarkThreads = 1;
+				m_ActiveThreads    = 1;
+				m_RecordTime       = 0;
+				m_RecordFrames     = 0;
+			}
+
+			for (int32 i = 0; i < m_BenchmarkResults.size(); ++i) {
+				ImGui::Text("%d threads: %.3fms x%.2f", i + 1, m_BenchmarkResults[i], m_BenchmarkResults[0] / m_BenchmarkResults[i]);
+			}
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -325,6 +357,36 @@ private:
 		return hovered;
 	}
 
+	void UpdateRecordTime(double recordTime)
+	{
+		m_RecordTime   += recordTime;
+		m_RecordFrames += 1;
+		if (m_RecordFrames < RECORD_SAMPLE_FRAMES) {
+			return;
+		}
+
+		m_LastRecordTime = m_RecordTime / m_RecordFrames;
+		m_RecordTime     = 0;
+		m_RecordFrames   = 0;
+
+		if (m_BenchmarkThreads == 0) {
+			return;
+		}
+
+		// scaling benchmark, one sample per thread count
+		m_BenchmarkResults.push_back(m_LastRecordTime);
+		MLOG("Record threads=%d, %.3fms, %.1f draws/ms", m_BenchmarkThreads, m_LastRecordTime, m_Particles.size() / m_LastRecordTime);
+
+		m_BenchmarkThreads += 1;
+		if (m_BenchmarkThreads > m_Threads.size()) {
+			m_BenchmarkThreads = 0;
+			m_ActiveThreads    = m_Threads.size();
+		}
+		else {
+			m_ActiveThreads = m_BenchmarkThreads;
+		}
+	}
+
 	void UpdateAnimation(float time, float delta)
 	{
 		m_RoleModel->Update(time, delta);
@@ -522,7 +584,7 @@ private:
 
 		RenderUI(cmdBufferInheritanceInfo, backBufferIndex);
 
-		for (int32 i = 0; i < m_ThreadDatas.size(); ++i) {
+		for (int32 i = 0; i < m_FrameThreads; ++i) {
 			vkCmdExecuteCommands(commandBuffer, 1, &(m_ThreadDatas[i]->threadCommandBuffers[backBufferIndex]->cmdBuffer));
 		}
 		vkCmdExecuteCommands(commandBuffer, 1, &(m_UICommandBuffers[backBufferIndex]->cmdBuffer));
@@ -619,10 +681,11 @@ private:
 		// thread task
 		m_MainFrameID      = 0;
 		m_ThreadRunning    = true;
+		m_ActiveThreads    = numThreads;
+		m_FrameThreads     = numThreads;
 
-		perThread = m_Particles.size() / numThreads;
-		remainNum = m_Particles.size() - perThread * numThreads;
-		dataIndex = 0;
+		// one record context per thread
+		m_ParticleMaterial->SetRecordContexts(numThreads);
 
 		m_ThreadDatas.resize(numThreads);
 		m_Threads.resize(numThreads);
@@ -632,16 +695,6 @@ private:
 			// prepare thread data
 			m_ThreadDatas[i] = new ThreadData();
 
-			// thread particles
-			int32 count = remainNum > 0 ? perThread + 1 : perThread;
-			remainNum -= 1;
-
-			for (int32 index = dataIndex; index < dataIndex + count; ++index) {
-				m_ThreadDatas[i]->particles.push_back(m_Particles[index]);
-			}
-
-			dataIndex += count;
-
 			// command pool per thread
 			VkCommandPoolCreateInfo cmdPoolInfo;
 			ZeroVulkanStruct(cmdPoolInfo, VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO);
@@ -663,6 +716,57 @@ private:
 		}
 	}
 
+	void ThreadRecord(ThreadData* threadData, int32 numActive)
+	{
+		// update particles
+		for (int32 i = threadData->index; i < m_Particles.size(); i += numActive) {
+			m_Particles[i]->Update(m_BonesData, m_ViewCamera, m_FrameTime, m_FrameDelta);
+		}
+
+		// record commands
+		VkCommandBuffer commandBuffer = threadData->threadCommandBuffers[m_bufferIndex]->cmdBuffer;
+
+		VkCommandBufferInheritanceInfo cmdBufferInheritanceInfo;
+		ZeroVulkanStruct(cmdBufferInheritanceInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO);
+		cmdBufferInheritanceInfo.renderPass  = m_RenderPass;
+		cmdBufferInheritanceInfo.framebuffer = m_FrameBuffers[m_bufferIndex];
+
+		VkCommandBufferBeginInfo cmdBufferBeginInfo;
+		ZeroVulkanStruct(cmdBufferBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cmdBufferBeginInfo.pInheritanceInfo = &cmdBufferInheritanceInfo;
+
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufferBeginInfo));
+
+		float w  = m_FrameWidth;
+		float h  = m_FrameHeight;
+		float tx = 0;
+		float ty = 0;
+
+		VkViewport viewport = {};
+		viewport.x        = tx;
+		viewport.y        = m_FrameHeight - ty;
+		viewport.width    = w;
+		viewport.height   = -h;    // flip y axis
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.extent.width  = w;
+		scissor.extent.height = h;
+		scissor.offset.x = tx;
+		scissor.offset.y = ty;
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		for (int32 i = threadData->index; i < m_Particles.size(); i += numActive) {
+			m_Particles[i]->Draw(commandBuffer, m_ViewCamera, threadData->index);
+		}
+
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
 	void ThreadRendering(void* param)
 	{
 		ThreadData* threadData = (ThreadData*)param;
@@ -670,67 +774,25 @@ private:
 
 		while (true)
 		{
+			int32 numActive = 0;
 			{
 				std::unique_lock<std::mutex> guardLock(m_FrameStartLock);
 				if (threadData->frameID == m_MainFrameID) {
 					m_FrameStartCV.wait(guardLock);
 				}
+				threadData->frameID = m_MainFrameID;
+				numActive = m_FrameThreads;
 			}
 
-			threadData->frameID = m_MainFrameID;
-
 			if (!m_ThreadRunning) {
 				break;
 			}
 
-			// update particles
-			for (int32 i = 0; i < threadData->particles.size(); ++i) {
-				threadData->particles[i]->Update(m_BonesData, m_ViewCamera, m_FrameTime, m_FrameDelta);
+			// inactive threads only report done
+			if (threadData->index < numActive) {
+				ThreadRecord(threadData, numActive);
 			}
 
-			// record commands
-			VkCommandBuffer commandBuffer = threadData->threadCommandBuffers[m_bufferIndex]->cmdBuffer;
-
-			VkCommandBufferInheritanceInfo cmdBufferInheritanceInfo;
-			ZeroVulkanStruct(cmdBufferInheritanceInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO);
-			cmdBufferInheritanceInfo.renderPass  = m_RenderPass;
-			cmdBufferInheritanceInfo.framebuffer = m_FrameBuffers[m_bufferIndex];
-
-			VkCommandBufferBeginInfo cmdBufferBeginInfo;
-			ZeroVulkanStruct(cmdBufferBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
-			cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-			cmdBufferBeginInfo.pInheritanceInfo = &cmdBufferInheritanceInfo;
-
-			VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufferBeginInfo));
-
-			float w  = m_FrameWidth;
-			float h  = m_FrameHeight;
-			float tx = 0;
-			float ty = 0;
-
-			VkViewport viewport = {};
-			viewport.x        = tx;
-			viewport.y        = m_FrameHeight - ty;
-			viewport.width    = w;
-			viewport.height   = -h;    // flip y axis
-			viewport.minDepth = 0.0f;
-			viewport.maxDepth = 1.0f;
-
-			VkRect2D scissor = {};
-			scissor.extent.width  = w;
-			scissor.extent.height = h;
-			scissor.offset.x = tx;
-			scissor.offset.y = ty;
-
-			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-			for (int32 i = 0; i < threadData->particles.size(); ++i) {
-				threadData->particles[i]->Draw(commandBuffer, m_ViewCamera);
-			}
-
-			VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
-
 			// notify thread done
 			{
 				std::lock_guard<std::mutex> lockGuard(m_ThreadDoneLock);
@@ -790,6 +852,14 @@ private:
 	std::vector<MyThread*>		m_Threads;
 	bool						m_ThreadRunning;
 	int32						m_MainFrameID;
+	int32						m_ActiveThreads;
+	int32						m_FrameThreads;		// 当前帧录制用的线程数
+
+	double						m_RecordTime = 0;
+	int32						m_RecordFrames = 0;
+	float						m_LastRecordTime = 0;
+	int32						m_BenchmarkThreads = 0;
+	std::vector<float>			m_BenchmarkResults;
 
 	float						m_FrameTime;
 	float						m_FrameDelta;
@@ -6,6 +6,8 @@
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 #include <vector>
 
 // http://yangwc.com/2019/07/21/ImageBasedLighting/
@@ -33,6 +35,9 @@ public:
 		DemoBase::Setup();
 		DemoBase::Prepare();
 
+		double initTime = GenericPlatformTime::Seconds();
+
+		LoadAssetsAsync();
 		CreateGUI();
 		LoadEnvAssets();
 		GenEnvIrradiance();
@@ -41,6 +46,8 @@ public:
 		LoadModelAssets();
 		InitParmas();
 
+		MLOG("Init assets in %.2fms", (GenericPlatformTime::Seconds() - initTime) * 1000.0);
+
 		m_Ready = true;
 		return true;
 	}
@@ -144,20 +151,19 @@ private:
 		return hovered;
 	}
 
-	void LoadEnvAssets()
+	// 所有文件的解码在工作线程上同时进行，用到时再取
+	void LoadAssetsAsync()
 	{
-		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+		m_Loader = vk_demo::DVKAssetLoader::Create(m_VulkanDevice);
 
-		m_EnvModel = vk_demo::DVKModel::LoadFromFile(
+		m_EnvModelHandle = m_Loader->LoadModel(
 			"assets/models/cube.obj",
-			m_VulkanDevice,
-			cmdBuffer,
 			{ 
 				VertexAttribute::VA_Position
 			}
 		);
 
-		m_EnvTexture = vk_demo::DVKTexture::CreateCube(
+		m_EnvTextureHandle = m_Loader->LoadTextureCube(
 			{
 				"assets/textures/cubemap/output_skybox_posx.hdr",
 				"assets/textures/cubemap/output_skybox_negx.hdr",
@@ -165,18 +171,45 @@ private:
 				"assets/textures/cubemap/output_skybox_negy.hdr",
 				"assets/textures/cubemap/output_skybox_posz.hdr",
 				"assets/textures/cubemap/output_skybox_negz.hdr"
-			},
-			m_VulkanDevice,
-			cmdBuffer
+			}
 		);
 
-		m_EnvShader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
+		m_EnvShaderHandle = m_Loader->LoadShader(
 			true,
 			"assets/shaders/56_PBR_IBL/skybox.vert.spv",
 			"assets/shaders/56_PBR_IBL/skybox.frag.spv"
 		);
 
+		m_ModelHandle = m_Loader->LoadModel(
+			"assets/models/leather-shoes/model.fbx",
+			{ 
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_UV0,
+				VertexAttribute::VA_Normal,
+				VertexAttribute::VA_Tangent
+			}
+		);
+
+		m_TexAlbedoHandle   = m_Loader->LoadTexture2D("assets/models/leather-shoes/RootNode_baseColor.jpg");
+		m_TexNormalHandle   = m_Loader->LoadTexture2D("assets/models/leather-shoes/RootNode_normal.jpg");
+		m_TexORMParamHandle = m_Loader->LoadTexture2D("assets/models/leather-shoes/RootNode_occlusionRoughnessMetallic.jpg");
+
+		m_ShaderHandle = m_Loader->LoadShader(
+			true,
+			"assets/shaders/56_PBR_IBL/obj.vert.spv",
+			"assets/shaders/56_PBR_IBL/obj.frag.spv"
+		);
+
+		// 所有上传合并到一个批次
+		m_Loader->WaitAll();
+	}
+
+	void LoadEnvAssets()
+	{
+		m_EnvModel   = m_Loader->GetModel(m_EnvModelHandle);
+		m_EnvTexture = m_Loader->GetTexture(m_EnvTextureHandle);
+		m_EnvShader  = m_Loader->GetShader(m_EnvShaderHandle);
+
 		m_EnvMaterial = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
 			m_RenderPass,
@@ -190,51 +223,17 @@ private:
 		m_EnvMaterial->pipelineInfo.depthStencilState.stencilTestEnable = VK_FALSE;
 		m_EnvMaterial->PreparePipeline();
 		m_EnvMaterial->SetTexture("diffuseMap", m_EnvTexture);
-
-		delete cmdBuffer;
 	}
 
 	void LoadModelAssets()
 	{
-		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
-
-		m_Model = vk_demo::DVKModel::LoadFromFile(
-			"assets/models/leather-shoes/model.fbx",
-			m_VulkanDevice,
-			cmdBuffer,
-			{ 
-				VertexAttribute::VA_Position,
-				VertexAttribute::VA_UV0,
-				VertexAttribute::VA_Normal,
-				VertexAttribute::VA_Tangent
-			}
-		);
+		m_Model = m_Loader->GetModel(m_ModelHandle);
 		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
 
-		m_TexAlbedo = vk_demo::DVKTexture::Create2D(
-			"assets/models/leather-shoes/RootNode_baseColor.jpg",
-			m_VulkanDevice,
-			cmdBuffer
-		);
-
-		m_TexNormal = vk_demo::DVKTexture::Create2D(
-			"assets/models/leather-shoes/RootNode_normal.jpg",
-			m_VulkanDevice,
-			cmdBuffer
-		);
-
-		m_TexORMParam = vk_demo::DVKTexture::Create2D(
-			"assets/models/leather-shoes/RootNode_occlusionRoughnessMetallic.jpg",
-			m_VulkanDevice,
-			cmdBuffer
-		);
-
-		m_Shader = vk_demo::DVKShader::Create(
-			m_VulkanDevice,
-			true,
-			"assets/shaders/56_PBR_IBL/obj.vert.spv",
-			"assets/shaders/56_PBR_IBL/obj.frag.spv"
-		);
+		m_TexAlbedo   = m_Loader->GetTexture(m_TexAlbedoHandle);
+		m_TexNormal   = m_Loader->GetTexture(m_TexNormalHandle);
+		m_TexORMParam = m_Loader->GetTexture(m_TexORMParamHandle);
+		m_Shader      = m_Loader->GetShader(m_ShaderHandle);
 
 		m_Material = vk_demo::DVKMaterial::Create(
 			m_VulkanDevice,
@@ -250,7 +249,8 @@ private:
 		m_Material->SetTexture("envBRDFLut", m_EnvBRDFLut);
 		m_Material->SetTexture("envPrefiltered", m_EnvPrefiltered);
 
-		delete cmdBuffer;
+		delete m_Loader;
+		m_Loader = nullptr;
 	}
 
 	void GenEnvPrefiltered()
@@ -827,6 +827,16 @@ private:
 
 	bool 						m_Ready = false;
 
+	vk_demo::DVKAssetLoader*	m_Loader = nullptr;
+	vk_demo::DVKAssetHandle		m_EnvModelHandle = -1;
+	vk_demo::DVKAssetHandle		m_EnvTextureHandle = -1;
+	vk_demo::DVKAssetHandle		m_EnvShaderHandle = -1;
+	vk_demo::DVKAssetHandle		m_ModelHandle = -1;
+	vk_demo::DVKAssetHandle		m_TexAlbedoHandle = -1;
+	vk_demo::DVKAssetHandle		m_TexNormalHandle = -1;
+	vk_demo::DVKAssetHandle		m_TexORMParamHandle = -1;
+	vk_demo::DVKAssetHandle		m_ShaderHandle = -1;
+
 	vk_demo::DVKModel*			m_EnvModel = nullptr;
 	vk_demo::DVKTexture*		m_EnvTexture = nullptr;
 	vk_demo::DVKShader*			m_EnvShader = nullptr;
@@ -7,6 +7,8 @@
 #include "Math/Matrix4x4.h"
 
 #include "Loader/ImageLoader.h"
+#include "Core/JobSystem.h"
+#include "GenericPlatform/GenericPlatformTime.h"
 
 #include "TaskThread.h"
 #include "ThreadTask.h"
@@ -15,11 +17,16 @@
 
 #include <vector>
 #include <thread>
+#include <atomic>
 
 #define WIDTH   1400
 #define HEIGHT  900
 #define EPSILON 0.0001
 
+#define TILE_SIZE   16
+#define MAX_SAMPLES 1024
+#define NUM_SCENES  2
+
 class CPURayTracingDemo : public DemoBase
 {
 public:
@@ -46,6 +53,7 @@ public:
 
 		CPURayTracing();
 		LoadAssets();
+		CreateGUI();
 		InitParmas();
 
 		m_Ready = true;
@@ -56,6 +64,7 @@ public:
 	virtual void Exist() override
 	{
 		DestroyAssets();
+		DestroyGUI();
 		DemoBase::Release();
 	}
 
@@ -69,99 +78,480 @@ public:
 
 private:
 
-	uint8 ToUint8(float f)
+	void CPURayTracing()
+	{
+		// scene
+		Scene* scene = new Scene();
+		scene->materials.push_back(new DiffuseMaterial(Vector4(0.8f, 0.3f, 0.3f, 1.0f)));
+		scene->materials.push_back(new MetalMaterial(Vector4(0.8f, 0.8f, 0.0f, 1.0f), 0.0f));
+		scene->materials.push_back(new MetalMaterial(Vector4(0.8f, 0.8f, 0.8f, 1.0f), 0.2f));
+		scene->materials.push_back(new MetalMaterial(Vector4(0.8f, 0.6f, 0.2f, 1.0f), 0.2f));
+		scene->spheres.push_back(Sphere(Vector3(0, 0, 5), 0.5f, scene->materials[0]));
+		scene->spheres.push_back(Sphere(Vector3(0, -100.5f, 5), 100.0f, scene->materials[1]));
+		scene->spheres.push_back(Sphere(Vector3(-1, 0, 5), 0.5f, scene->materials[2]));
+		scene->spheres.push_back(Sphere(Vector3(1, 0, 5), 0.5f, scene->materials[3]));
+		m_Scenes[0] = scene;
+
+		CreateTracer(0);
+
+		// 每帧把累积结果上传到m_Texture，只用一级mip
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		m_Texture = vk_demo::DVKTexture::Create2D(
+			m_VulkanDevice,
+			cmdBuffer,
+			VK_FORMAT_R8G8B8A8_UNORM,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			WIDTH, HEIGHT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+			VK_SAMPLE_COUNT_1_BIT,
+			ImageLayoutBarrier::PixelShaderRead
+		);
+		m_Texture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+		// 第一个pass完成之前显示背景色
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = 1;
+		subresourceRange.layerCount = 1;
+
+		VkClearColorValue clearColor = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+
+		cmdBuffer->Begin();
+		vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, m_Texture->image, ImageLayoutBarrier::PixelShaderRead, ImageLayoutBarrier::TransferDest, subresourceRange);
+		vkCmdClearColorImage(cmdBuffer->cmdBuffer, m_Texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &subresourceRange);
+		vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, m_Texture->image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::PixelShaderRead, subresourceRange);
+		cmdBuffer->Submit();
+
+		delete cmdBuffer;
+
+		// 每个backbuffer一个staging，AcquireBackbufferIndex返回时它上一次的拷贝已经完成
+		m_StagingBuffers.resize(m_CommandBuffers.size());
+		for (int32 i = 0; i < m_StagingBuffers.size(); ++i)
+		{
+			m_StagingBuffers[i] = vk_demo::DVKBuffer::CreateBuffer(
+				m_VulkanDevice,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				WIDTH * HEIGHT * 4
+			);
+			m_StagingBuffers[i]->Map();
+		}
+	}
+
+	// simplescene.obj是一个封闭的盒子，天花板发光，里面的钻石用金属材质，再放两个球
+	Scene* CreateMeshScene()
 	{
-		if (f < 0.0f) {
-			f = 0.0f;
+		Scene* scene = new Scene();
+		scene->bvh = vk_demo::DVKBVH::Create(m_SceneModel);
+		if (!scene->bvh)
+		{
+			MLOGE("Failed create bvh for simplescene.");
+			delete scene;
+			return nullptr;
 		}
-		if (f >= 1.0f) {
-			f = 1.0f;
+
+		Material* light   = new LightMaterial(Vector4(1.5f, 1.5f, 1.5f, 1.0f));
+		Material* wall    = new DiffuseMaterial(Vector4(0.73f, 0.73f, 0.73f, 1.0f));
+		Material* redWall = new DiffuseMaterial(Vector4(0.65f, 0.05f, 0.05f, 1.0f));
+		Material* diamond = new MetalMaterial(Vector4(0.9f, 0.9f, 0.9f, 1.0f), 0.05f);
+		Material* ball    = new DiffuseMaterial(Vector4(0.12f, 0.45f, 0.15f, 1.0f));
+		Material* gold    = new MetalMaterial(Vector4(0.8f, 0.6f, 0.2f, 1.0f), 0.3f);
+		scene->materials.push_back(light);
+		scene->materials.push_back(wall);
+		scene->materials.push_back(redWall);
+		scene->materials.push_back(diamond);
+		scene->materials.push_back(ball);
+		scene->materials.push_back(gold);
+
+		for (int32 i = 0; i < m_SceneModel->meshes.size(); ++i)
+		{
+			const std::string& name = m_SceneModel->meshes[i]->linkNode->name;
+			if (name == "Plane (5)") {
+				scene->meshMaterials.push_back(light);
+			}
+			else if (name == "Plane (2)") {
+				scene->meshMaterials.push_back(redWall);
+			}
+			else if (name.find("Plane") != std::string::npos) {
+				scene->meshMaterials.push_back(wall);
+			}
+			else {
+				scene->meshMaterials.push_back(diamond);
+			}
 		}
-		return 255 * f;
+
+		scene->spheres.push_back(Sphere(Vector3(-2.5f, 1.0f, 1.5f), 1.0f, ball));
+		scene->spheres.push_back(Sphere(Vector3( 2.5f, 1.0f, 1.0f), 1.0f, gold));
+
+		MLOG("simplescene bvh: %d triangles, %d nodes, build %.2fms", scene->bvh->GetNumTriangles(), scene->bvh->GetNumNodes(), scene->bvh->GetBuildTime() * 1000.0);
+
+		return scene;
 	}
 
-	Vector4 ToGammaSpace(Vector4 color)
+	void SetupCamera(vk_demo::DVKCamera& camera)
 	{
-		Vector4 ret;
-		ret.x = MMath::Pow(color.x, 1.0f / 2.2f);
-		ret.y = MMath::Pow(color.y, 1.0f / 2.2f);
-		ret.z = MMath::Pow(color.z, 1.0f / 2.2f);
-		ret.w = MMath::Pow(color.w, 1.0f / 2.2f);
-		return ret;
+		if (m_SceneIndex == 1)
+		{
+			camera.SetPosition(0, 4.0f, -4.8f);
+			camera.LookAt(0, 2.5f, 0);
+		}
+		camera.Perspective(PI / 4, WIDTH, HEIGHT, 0.01f, 100.0f);
 	}
 
-	void CPURayTracing()
+	// 切换场景时重新创建PathTracer，保留求交方式
+	void CreateTracer(int32 sceneIndex)
 	{
-		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+		if (sceneIndex == 1 && !m_Scenes[1]) {
+			m_Scenes[1] = CreateMeshScene();
+		}
+		if (!m_Scenes[sceneIndex]) {
+			return;
+		}
 
-		// camera
+		IntersectMode mode = IntersectMode::SoA;
+		if (m_Tracer)
+		{
+			mode = m_Tracer->GetIntersectMode();
+			delete m_Tracer;
+		}
+
+		m_SceneIndex = sceneIndex;
+		m_Tracer = new PathTracer(m_Scenes[m_SceneIndex], WIDTH, HEIGHT, TILE_SIZE);
+		m_Tracer->SetIntersectMode(mode);
+
+		ResetTracing();
+	}
+
+	void ResetTracing()
+	{
 		vk_demo::DVKCamera camera;
-		camera.Perspective(PI / 4, WIDTH, HEIGHT, 0.01f, 100.0f);
-		
-		// tracing
-		std::vector<Raytracing*> raytracings;
-		raytracings.resize(WIDTH * HEIGHT);
-		
-		// scene
-		Scene scene;
-		scene.spheres.push_back(Sphere(Vector3(0, 0, 5), 0.5f, new DiffuseMaterial(Vector4(0.8f, 0.3f, 0.3f, 1.0f))));
-		scene.spheres.push_back(Sphere(Vector3(0, -100.5f, 5), 100.0f, new MetalMaterial(Vector4(0.8f, 0.8f, 0.0f, 1.0f), 0.0f)));
-		scene.spheres.push_back(Sphere(Vector3(-1, 0, 5), 0.5f, new MetalMaterial(Vector4(0.8f, 0.8f, 0.8f, 1.0f), 0.2f)));
-		scene.spheres.push_back(Sphere(Vector3(1, 0, 5), 0.5f, new MetalMaterial(Vector4(0.8f, 0.6f, 0.2f, 1.0f), 0.2f)));
-
-		// prepare work
-		for (int32 h = 0; h < HEIGHT; ++h)
+		SetupCamera(camera);
+
+		m_Tracer->Reset(camera);
+		m_Tracer->Kick();
+
+		m_TraceTime  = 0.0;
+		m_TotalRays  = 0;
+		m_NumSamples = 0;
+	}
+
+	// pass完成时把结果写进这一帧的staging并开始下一个pass，不阻塞渲染线程
+	bool UpdateTracing(int32 bufferIndex)
+	{
+		if (!m_Tracer->IsPassComplete()) {
+			return false;
+		}
+
+		bool upload = false;
+
+		if (m_Tracer->GetNumSamples() != m_NumSamples)
 		{
-			for (int32 w = 0; w < WIDTH; ++w)
-			{
-				int32 index = (h * WIDTH + w);
-				raytracings[index] = new Raytracing(&scene, &camera, w, h, index * 4, WIDTH, HEIGHT);
-			}
+			m_NumSamples = m_Tracer->GetNumSamples();
+			m_PassRays   = m_Tracer->GetLastPassRays();
+			m_PassTime   = m_Tracer->GetLastPassTime();
+			m_TraceTime += m_PassTime;
+			m_TotalRays += m_PassRays;
+
+			m_Tracer->Resolve((uint8*)m_StagingBuffers[bufferIndex]->mapped);
+			upload = true;
+		}
+
+		if (!m_Paused && m_NumSamples < MAX_SAMPLES) {
+			m_Tracer->Kick();
+		}
+
+		return upload;
+	}
+
+	class EmptyTask : public ThreadTask
+	{
+	public:
+		EmptyTask(std::atomic<int32>* inCounter)
+			: counter(inCounter)
+		{
+
+		}
+
+		virtual void DoThreadedWork() override
+		{
+			counter->fetch_add(1, std::memory_order_relaxed);
+		}
+
+		virtual void Abandon() override
+		{
+
+		}
+
+		std::atomic<int32>* counter;
+	};
+
+	// 分别用原来的TaskThreadPool和JobSystem执行一批空任务，对比每个任务的调度开销
+	void BenchmarkTaskOverhead()
+	{
+		const int32 numTasks = 100000;
+		int32 numThreads = JobSystem::Get().GetNumWorkers();
+
+		std::atomic<int32> finished(0);
+		std::vector<EmptyTask*> tasks(numTasks);
+		for (int32 i = 0; i < numTasks; ++i) {
+			tasks[i] = new EmptyTask(&finished);
 		}
 
-		// start work
 		TaskThreadPool* taskPool = new TaskThreadPool();
-		taskPool->Create(MMath::Max<int32>(std::thread::hardware_concurrency(), 8));
-		
-		for (int32 i = 0; i < raytracings.size(); ++i) {
-			taskPool->AddTask(raytracings[i]);
+		taskPool->Create(numThreads);
+
+		double poolTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numTasks; ++i) {
+			taskPool->AddTask(tasks[i]);
+		}
+		while (finished.load() != numTasks) {
+			std::this_thread::yield();
+		}
+		poolTime = GenericPlatformTime::Seconds() - poolTime;
+
+		taskPool->Destroy();
+		delete taskPool;
+
+		for (int32 i = 0; i < numTasks; ++i) {
+			delete tasks[i];
+		}
+
+		finished = 0;
+		JobCounter counter;
+
+		double jobTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numTasks; ++i) {
+			JobSystem::Get().Run([&finished]() {
+				finished.fetch_add(1, std::memory_order_relaxed);
+			}, &counter);
 		}
+		JobSystem::Get().Wait(&counter);
+		jobTime = GenericPlatformTime::Seconds() - jobTime;
 
-		while (taskPool->GetNumQueuedJobs() != 0) {
-			// wait
+		finished = 0;
+
+		double forTime = GenericPlatformTime::Seconds();
+		JobSystem::Get().ParallelFor(numTasks, 1, [&finished](int32 begin, int32 end) {
+			finished.fetch_add(end - begin, std::memory_order_relaxed);
+		});
+		forTime = GenericPlatformTime::Seconds() - forTime;
+
+		MLOG("Per task overhead with %d threads: TaskThreadPool %.0fns, JobSystem::Run %.0fns, JobSystem::ParallelFor %.0fns", numThreads, poolTime * 1e9 / numTasks, jobTime * 1e9 / numTasks, forTime * 1e9 / numTasks);
+	}
+
+	// rand()和RandomStream生成随机数的吞吐，单线程以及所有工作线程同时生成
+	void BenchmarkRandom()
+	{
+		const int32 count = 4 * 1024 * 1024;
+		std::vector<float> values(count);
+
+		double randTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < count; ++i) {
+			values[i] = rand() / (float)RAND_MAX;
+		}
+		randTime = GenericPlatformTime::Seconds() - randTime;
+
+		double streamTime = GenericPlatformTime::Seconds();
+		RandomStream& random = RandomStream::GetThreadStream();
+		for (int32 i = 0; i < count; ++i) {
+			values[i] = random.GetFraction();
+		}
+		streamTime = GenericPlatformTime::Seconds() - streamTime;
+
+		double batchTime = GenericPlatformTime::Seconds();
+		random.FillFractions(values.data(), count);
+		batchTime = GenericPlatformTime::Seconds() - batchTime;
+
+		double parallelRandTime = GenericPlatformTime::Seconds();
+		JobSystem::Get().ParallelFor(count, 64 * 1024, [&values](int32 begin, int32 end) {
+			for (int32 i = begin; i < end; ++i) {
+				values[i] = rand() / (float)RAND_MAX;
+			}
+		});
+		parallelRandTime = GenericPlatformTime::Seconds() - parallelRandTime;
+
+		double parallelStreamTime = GenericPlatformTime::Seconds();
+		JobSystem::Get().ParallelFor(count, 64 * 1024, [&values](int32 begin, int32 end) {
+			for (int32 i = begin; i < end; ++i) {
+				values[i] = MMath::FRand();
+			}
+		});
+		parallelStreamTime = GenericPlatformTime::Seconds() - parallelStreamTime;
+
+		MLOG("Random %d floats: rand() %.2fns, RandomStream %.2fns, FillFractions %.2fns", count, randTime * 1e9 / count, streamTime * 1e9 / count, batchTime * 1e9 / count);
+		MLOG("Random %d floats on %d threads: rand() %.2fns, MMath::FRand %.2fns", count, JobSystem::Get().GetNumWorkers() + 1, parallelRandTime * 1e9 / count, parallelStreamTime * 1e9 / count);
+	}
+
+	// 单线程一条光线对64个球的吞吐：逐个Sphere::HitTest、SoA一次4个球、4条光线一组
+	void BenchmarkIntersection()
+	{
+		const int32 numSpheres = 64;
+		const int32 numRays    = 256 * 1024;
+
+		RandomStream random(1);
+
+		std::vector<Sphere> spheres;
+		SphereSoA sphereSoA;
+		for (int32 i = 0; i < numSpheres; ++i)
+		{
+			Vector3 center(random.FRandRange(-10.0f, 10.0f), random.FRandRange(-10.0f, 10.0f), random.FRandRange(10.0f, 30.0f));
+			float radius = random.FRandRange(0.2f, 2.0f);
+			spheres.push_back(Sphere(center, radius, nullptr));
+			sphereSoA.Add(center, radius);
+		}
+		sphereSoA.Finalize();
+
+		// 从原点出发朝+z的一簇光线，和primary ray类似
+		std::vector<Ray> rays(numRays);
+		for (int32 i = 0; i < numRays; ++i)
+		{
+			rays[i].start     = Vector3(0, 0, 0);
+			rays[i].direction = Vector3(random.FRandRange(-0.5f, 0.5f), random.FRandRange(-0.5f, 0.5f), 1.0f);
+			rays[i].direction.Normalize();
 		}
 
-		// output color
-		uint8* rgba = new uint8[WIDTH * HEIGHT * 4];
+		int32 scalarHits = 0;
+		double scalarTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numRays; ++i)
+		{
+			float dist  = MAX_flt;
+			int32 index = -1;
+			for (int32 j = 0; j < numSpheres; ++j)
+			{
+				HitInfo hitInfo = spheres[j].HitTest(rays[i]);
+				if (hitInfo.hit && hitInfo.dist < dist)
+				{
+					dist  = hitInfo.dist;
+					index = j;
+				}
+			}
+			scalarHits += index >= 0 ? 1 : 0;
+		}
+		scalarTime = GenericPlatformTime::Seconds() - scalarTime;
 
-		for (int32 i = 0; i < raytracings.size(); ++i)
+		int32 soaHits = 0;
+		double soaTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numRays; ++i)
 		{
-			Raytracing* tracing = raytracings[i];
-			tracing->color = ToGammaSpace(tracing->color);
+			float dist = MAX_flt;
+			soaHits += RayIntersection::IntersectSpheres(sphereSoA, rays[i].start, rays[i].direction, EPSILON, dist) >= 0 ? 1 : 0;
+		}
+		soaTime = GenericPlatformTime::Seconds() - soaTime;
 
-			rgba[tracing->index + 0] = ToUint8(tracing->color.x);
-			rgba[tracing->index + 1] = ToUint8(tracing->color.y);
-			rgba[tracing->index + 2] = ToUint8(tracing->color.z);
-			rgba[tracing->index + 3] = ToUint8(tracing->color.w);
+		int32 packetHits = 0;
+		double packetTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < numRays; i += 4)
+		{
+			RayPacket4 packet;
+			for (int32 lane = 0; lane < 4; ++lane) {
+				packet.Set(lane, rays[i + lane].start, rays[i + lane].direction);
+			}
 
-			delete tracing;
+			PacketHit4 hit;
+			hit.Reset(MAX_flt);
+			int32 mask = RayIntersection::IntersectSpheres(sphereSoA, packet, EPSILON, hit);
+			for (int32 lane = 0; lane < 4; ++lane) {
+				packetHits += (mask >> lane) & 1;
+			}
 		}
+		packetTime = GenericPlatformTime::Seconds() - packetTime;
 
-		m_Texture = vk_demo::DVKTexture::Create2D(rgba, WIDTH * HEIGHT * 4, VK_FORMAT_R8G8B8A8_UNORM, WIDTH, HEIGHT, m_VulkanDevice, cmdBuffer);
-		m_Texture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+		if (scalarHits != soaHits || scalarHits != packetHits) {
+			MLOGE("Intersection mismatch: scalar %d, SoA %d, packet %d hits", scalarHits, soaHits, packetHits);
+		}
 
-		delete[] rgba;
-		delete cmdBuffer;
+		MLOG("Intersect %d rays x %d spheres: scalar %.2f MRays/s, SoA %.2f MRays/s, packet %.2f MRays/s", numRays, numSpheres, numRays / scalarTime / 1000000.0, numRays / soaTime / 1000000.0, numRays / packetTime / 1000000.0);
 	}
 
 	void Draw(float time, float delta)
 	{
 		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
 
-		SetupGfxCommand(bufferIndex);
+		bool upload = UpdateTracing(bufferIndex);
+
+		UpdateFPS(time, delta);
+		UpdateUI(time, delta);
+
+		SetupGfxCommand(bufferIndex, upload);
 
 		DemoBase::Present(bufferIndex);
 	}
+
+	bool UpdateUI(float time, float delta)
+	{
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("CPURayTracingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			ImGui::Text("%dx%d, %d tiles, %d workers", WIDTH, HEIGHT, m_Tracer->GetNumTiles(), JobSystem::Get().GetNumWorkers());
+			ImGui::Text("Samples:%d/%d", m_NumSamples, MAX_SAMPLES);
+
+			if (m_PassTime > 0.0)
+			{
+				ImGui::Text("Pass:%.2fms %.2f MRays/s", m_PassTime * 1000.0, m_PassRays / m_PassTime / 1000000.0);
+				ImGui::Text("Total:%.2fs %.2f MRays/s", m_TraceTime, m_TotalRays / m_TraceTime / 1000000.0);
+			}
+
+			const char* scenes[] = { "Spheres", "Mesh BVH" };
+			int32 sceneIndex = m_SceneIndex;
+			if (ImGui::Combo("Scene", &sceneIndex, scenes, NUM_SCENES) && sceneIndex != m_SceneIndex) {
+				CreateTracer(sceneIndex);
+			}
+
+			if (m_Scenes[m_SceneIndex]->bvh)
+			{
+				vk_demo::DVKBVH* bvh = m_Scenes[m_SceneIndex]->bvh;
+				ImGui::Text("BVH:%d tris %d nodes, build %.2fms", bvh->GetNumTriangles(), bvh->GetNumNodes(), bvh->GetBuildTime() * 1000.0);
+			}
+
+			const char* modes[] = { "Scalar", "SIMD SoA", "SIMD Packet" };
+			int32 mode = (int32)m_Tracer->GetIntersectMode();
+			if (ImGui::Combo("Intersect", &mode, modes, (int32)IntersectMode::Count))
+			{
+				m_Tracer->SetIntersectMode((IntersectMode)mode);
+				ResetTracing();
+			}
+
+			ImGui::Checkbox("Pause", &m_Paused);
+
+			if (ImGui::Button("Reset")) {
+				ResetTracing();
+			}
+
+			// 等当前pass结束，避免和光追任务抢工作线程
+			if (ImGui::Button("Benchmark Task Overhead")) 
+			{
+				m_Tracer->Wait();
+				BenchmarkTaskOverhead();
+			}
+
+			if (ImGui::Button("Benchmark Random")) 
+			{
+				m_Tracer->Wait();
+				BenchmarkRandom();
+			}
+
+			if (ImGui::Button("Benchmark Intersection")) 
+			{
+				m_Tracer->Wait();
+				BenchmarkIntersection();
+			}
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::End();
+		}
+
+		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		return hovered;
+	}
     
 	void LoadAssets()
 	{
@@ -201,13 +591,23 @@ private:
 
 	void DestroyAssets()
 	{
+		delete m_Tracer;
+		for (int32 i = 0; i < NUM_SCENES; ++i) {
+			delete m_Scenes[i];
+		}
+
+		for (int32 i = 0; i < m_StagingBuffers.size(); ++i) {
+			delete m_StagingBuffers[i];
+		}
+		m_StagingBuffers.clear();
+
 		delete m_Texture;
 		delete m_Material;
 		delete m_Shader;
 		delete m_SceneModel;
 	}
 
-	void SetupGfxCommand(int32 backBufferIndex)
+	void SetupGfxCommand(int32 backBufferIndex, bool upload)
 	{
 		VkViewport viewport = {};
 		viewport.x        = 0;
@@ -229,6 +629,25 @@ private:
 		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
 		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+		if (upload)
+		{
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.levelCount = 1;
+			subresourceRange.layerCount = 1;
+
+			VkBufferImageCopy copyRegion = {};
+			copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copyRegion.imageSubresource.layerCount = 1;
+			copyRegion.imageExtent.width  = WIDTH;
+			copyRegion.imageExtent.height = HEIGHT;
+			copyRegion.imageExtent.depth  = 1;
+
+			vk_demo::ImagePipelineBarrier(commandBuffer, m_Texture->image, ImageLayoutBarrier::PixelShaderRead, ImageLayoutBarrier::TransferDest, subresourceRange);
+			vkCmdCopyBufferToImage(commandBuffer, m_StagingBuffers[backBufferIndex]->buffer, m_Texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+			vk_demo::ImagePipelineBarrier(commandBuffer, m_Texture->image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::PixelShaderRead, subresourceRange);
+		}
+
 		VkClearValue clearValues[2];
 		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
 		clearValues[1].depthStencil = { 1.0f, 0 };
@@ -255,6 +674,8 @@ private:
 		m_Quad->meshes[0]->BindDrawCmd(commandBuffer);
 		m_Material->EndFrame();
 
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
 		vkCmdEndRenderPass(commandBuffer);
 		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
 	}
@@ -267,6 +688,18 @@ private:
 		camera.Perspective(PI / 4, GetWidth(), GetHeight(), 1.0f, 1500.0f);
 	}
 
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
 private:
 
 	bool 						    m_Ready = false;
@@ -277,6 +710,20 @@ private:
 	vk_demo::DVKModel*				m_Quad = nullptr;
 	vk_demo::DVKMaterial*		    m_Material = nullptr;
 	vk_demo::DVKShader*			    m_Shader = nullptr;
+
+	Scene*							m_Scenes[NUM_SCENES] = { nullptr };
+	int32							m_SceneIndex = 0;
+	PathTracer*						m_Tracer = nullptr;
+	std::vector<vk_demo::DVKBuffer*>	m_StagingBuffers;
+
+	bool							m_Paused = false;
+	int32							m_NumSamples = 0;
+	uint64							m_PassRays = 0;
+	double							m_PassTime = 0.0;
+	uint64							m_TotalRays = 0;
+	double							m_TraceTime = 0.0;
+
+	ImageGUIContext*				m_GUI = nullptr;
 };
 
 std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
@@ -3,6 +3,7 @@
 #include "Common/Common.h"
 #include "Math/Vector3.h"
 #include "Math/Vector4.h"
+#include "Math/RandomStream.h"
 
 struct Ray;
 struct HitInfo;
@@ -11,17 +12,39 @@ class Material
 {
 public:
 
-	virtual bool Scatter(const Ray& ray, const HitInfo& hitInfo, Vector4& attenuation, Ray& reflect) const = 0;
+	virtual bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const = 0;
 
-protected:
+	// Scatter返回false时光线结束，返回这个颜色
+	virtual Vector4 Emitted() const
+	{
+		return Vector4(0.1f, 0.1f, 0.1f, 1.0f);
+	}
+
+};
+
+// 不反射，只发光
+class LightMaterial : public Material
+{
+public:
 
-	const Vector3 RandomUnit() const
+	LightMaterial(const Vector4& inEmission)
+		: emission(inEmission)
 	{
-		Vector3 vec3(MMath::FRandRange(-1.0f, 1.0f), MMath::FRandRange(-1.0f, 1.0f), MMath::FRandRange(-1.0f, 1.0f));
-		vec3 = vec3.GetSafeNormal();
-		return vec3;
+
+	}
+
+	bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const override
+	{
+		return false;
 	}
 
+	Vector4 Emitted() const override
+	{
+		return emission;
+	}
+
+	Vector4 emission;
+
 };
 
 class DiffuseMaterial : public Material
@@ -34,7 +57,7 @@ public:
 
 	}
 
-	bool Scatter(const Ray& ray, const HitInfo& hitInfo, Vector4& attenuation, Ray& reflect) const override;
+	bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const override;
 
 	Vector4 albedo;
 
@@ -54,7 +77,7 @@ public:
 
 	}
 
-	bool Scatter(const Ray& ray, const HitInfo& hitInfo, Vector4& attenuation, Ray& reflect) const override;
+	bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const override;
 
 	Vector4 albedo;
 
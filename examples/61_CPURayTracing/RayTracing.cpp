@@ -1,6 +1,11 @@
 #include "RayTracing.h"
 
-HitInfo Sphere::HitTest(const Ray& ray)
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#define MAX_DEPTH 25
+#define TILE_MAX_SIZE 64
+
+HitInfo Sphere::HitTest(const Ray& ray) const
 {
 	Vector3 oc = ray.start - center;
 	float b = 2.0f * Vector3::DotProduct(oc, ray.direction);
@@ -26,89 +31,312 @@ HitInfo Sphere::HitTest(const Ray& ray)
 	return hitInfo;
 }
 
-Vector4 Raytracing::HitScene()
+void TraceCamera::Setup(vk_demo::DVKCamera& camera, int32 width, int32 height)
 {
-	color.Set(0, 0, 0, 0);
-
-	// inv transform
-	Matrix4x4 invProj = camera->GetProjection();
+	invProj = camera.GetProjection();
 	invProj.SetInverse();
-	Matrix4x4 invView = camera->GetView();
+	invView = camera.GetView();
 	invView.SetInverse();
 
-	int32 sample = 10;
+	origin    = camera.GetTransform().GetOrigin();
+	invWidth  = 1.0f / width;
+	invHeight = 1.0f / height;
+}
+
+Ray TraceCamera::GenerateRay(float x, float y) const
+{
+	// clip space
+	Vector2 clip = Vector2(x * invWidth, y * invHeight);
+	// clip space ray
+	Vector3 dir  = Vector3(clip.x * 2.0 - 1.0, -(clip.y * 2.0 - 1.0), 1.0);
+	// clip space to viewspace
+	dir = invProj.TransformPosition(dir);
+	dir.x = dir.x * dir.z;
+	dir.y = dir.y * dir.z;
+	// view space to world space
+	dir = invView.DeltaTransformVector(dir);
+	dir.Normalize();
+
+	Ray ray;
+	ray.start     = origin;
+	ray.direction = dir;
+	return ray;
+}
+
+PathTracer::PathTracer(Scene* inScene, int32 inWidth, int32 inHeight, int32 inTileSize)
+	: m_Scene(inScene)
+	, m_Width(inWidth)
+	, m_Height(inHeight)
+	, m_PassRays(0)
+{
+	inTileSize = MMath::Clamp(inTileSize, 1, TILE_MAX_SIZE);
 
-	for (int32 i = 0; i < sample; ++i)
+	for (int32 y = 0; y < m_Height; y += inTileSize)
 	{
-		// clip space
-		Vector2 clip = Vector2((w + MMath::FRandRange(0.0f, 1.0f)) / width, (h + MMath::FRandRange(0.0f, 1.0f)) / height);
-		// camera position
-		Vector3 pos  = camera->GetTransform().GetOrigin();
-		// clip space ray
-		Vector3 dir  = Vector3(clip.x * 2.0 - 1.0, -(clip.y * 2.0 - 1.0), 1.0);
-		// clip space to viewspace
-		dir = invProj.TransformPosition(dir);
-		dir.x = dir.x * dir.z;
-		dir.y = dir.y * dir.z;
-		// view space to world space
-		dir = invView.TransformVector(dir);
-		dir.Normalize();
-
-		Ray ray;
-		ray.start = pos;
-		ray.direction = dir;
-		
-		color += RayHitScene(ray, 25);
+		for (int32 x = 0; x < m_Width; x += inTileSize)
+		{
+			TraceTile tile;
+			tile.x      = x;
+			tile.y      = y;
+			tile.width  = MMath::Min(inTileSize, m_Width  - x);
+			tile.height = MMath::Min(inTileSize, m_Height - y);
+			m_Tiles.push_back(tile);
+		}
+	}
+
+	m_Accumulation.resize(m_Width * m_Height, Vector4(0, 0, 0, 0));
+
+	for (int32 i = 0; i < m_Scene->spheres.size(); ++i) {
+		m_Spheres.Add(m_Scene->spheres[i].center, m_Scene->spheres[i].radius);
+	}
+	m_Spheres.Finalize();
+}
+
+PathTracer::~PathTracer()
+{
+	Wait();
+}
+
+void PathTracer::Reset(vk_demo::DVKCamera& camera)
+{
+	Wait();
+
+	m_Camera.Setup(camera, m_Width, m_Height);
+
+	for (int32 i = 0; i < m_Accumulation.size(); ++i) {
+		m_Accumulation[i].Set(0, 0, 0, 0);
 	}
 
-	color = color / 15;
+	m_NumSamples   = 0;
+	m_LastPassRays = 0;
+	m_LastPassTime = 0.0;
+}
 
-	return color;
+void PathTracer::SetIntersectMode(IntersectMode mode)
+{
+	Wait();
+	m_Mode = mode;
 }
 
-HitInfo Raytracing::IntersectScene(Scene* scene, const Ray& ray)
+void PathTracer::Kick()
 {
-	HitInfo info;
-	info.dist = MAX_int32;
-	info.hit  = false;
+	m_PassStart = GenericPlatformTime::Seconds();
+	m_PassRays.store(0, std::memory_order_relaxed);
+
+	// 每个tile每个sample一个独立的序列，结果和哪个线程执行无关
+	uint64 streamBase = (uint64)m_NumSamples * m_Tiles.size();
 
-	for (int32 i = 0; i < scene->spheres.size(); ++i)
+	for (int32 i = 0; i < m_Tiles.size(); ++i)
 	{
-		Sphere& sphere  = scene->spheres[i];
-		HitInfo tempHit = sphere.HitTest(ray);
+		const TraceTile* tile = &m_Tiles[i];
+		uint64 stream = streamBase + i;
+		JobSystem::Get().Run([this, tile, stream]() {
+			RandomStream random(m_Seed, stream);
+			TraceTileSample(*tile, random);
+		}, &m_TileCounter);
+	}
+
+	// 所有tile完成后才执行，m_PassCounter归零即整个pass完成
+	JobSystem::Get().RunAfter(&m_TileCounter, [this]() {
+		m_LastPassTime = GenericPlatformTime::Seconds() - m_PassStart;
+		m_LastPassRays = m_PassRays.load(std::memory_order_relaxed);
+		m_NumSamples  += 1;
+	}, &m_PassCounter);
+}
+
+void PathTracer::Wait()
+{
+	JobSystem::Get().Wait(&m_PassCounter);
+}
+
+void PathTracer::Resolve(uint8* rgba)
+{
+	if (m_NumSamples == 0) {
+		return;
+	}
 
-		if (tempHit.hit && tempHit.dist < info.dist)
+	float invSamples = 1.0f / m_NumSamples;
+
+	JobSystem::Get().ParallelFor(m_Height, 16, [this, rgba, invSamples](int32 begin, int32 end) {
+		for (int32 y = begin; y < end; ++y)
 		{
-			info = tempHit;
+			const Vector4* src = &m_Accumulation[y * m_Width];
+			uint8* dst = rgba + y * m_Width * 4;
+
+			for (int32 x = 0; x < m_Width; ++x)
+			{
+				Vector4 color = src[x] * invSamples;
+				dst[x * 4 + 0] = 255 * MMath::Clamp(MMath::Pow(color.x, 1.0f / 2.2f), 0.0f, 1.0f);
+				dst[x * 4 + 1] = 255 * MMath::Clamp(MMath::Pow(color.y, 1.0f / 2.2f), 0.0f, 1.0f);
+				dst[x * 4 + 2] = 255 * MMath::Clamp(MMath::Pow(color.z, 1.0f / 2.2f), 0.0f, 1.0f);
+				dst[x * 4 + 3] = 255 * MMath::Clamp(MMath::Pow(color.w, 1.0f / 2.2f), 0.0f, 1.0f);
+			}
+		}
+	});
+}
+
+void PathTracer::TraceTileSample(const TraceTile& tile, RandomStream& random)
+{
+	uint32 numRays = 0;
+
+	// 一次生成整行的像素抖动
+	float jitter[2 * TILE_MAX_SIZE];
+
+	for (int32 y = tile.y; y < tile.y + tile.height; ++y)
+	{
+		Vector4* dst = &m_Accumulation[y * m_Width];
+
+		random.FillFractions(jitter, tile.width * 2);
+
+		int32 x = tile.x;
+
+		if (m_Mode == IntersectMode::Packet)
+		{
+			for (; x + 4 <= tile.x + tile.width; x += 4)
+			{
+				Ray rays[4];
+				RayPacket4 packet;
+				for (int32 lane = 0; lane < 4; ++lane)
+				{
+					const float* offset = jitter + (x + lane - tile.x) * 2;
+					rays[lane] = m_Camera.GenerateRay(x + lane + offset[0], y + offset[1]);
+					packet.Set(lane, rays[lane].start, rays[lane].direction);
+				}
+
+				PacketHit4 packetHit;
+				packetHit.Reset(MAX_flt);
+				RayIntersection::IntersectSpheres(m_Spheres, packet, EPSILON, packetHit);
+
+				for (int32 lane = 0; lane < 4; ++lane)
+				{
+					SceneHit hit;
+					hit.dist   = packetHit.dist[lane];
+					hit.sphere = packetHit.index[lane];
+
+					// 网格只有单条光线的遍历
+					if (m_Scene->bvh)
+					{
+						hit.mesh.dist = hit.dist;
+						if (m_Scene->bvh->Intersect(rays[lane].start, rays[lane].direction, EPSILON, hit.mesh))
+						{
+							hit.dist   = hit.mesh.dist;
+							hit.sphere = -1;
+						}
+					}
+
+					dst[x + lane] += RayHitScene(rays[lane], hit, MAX_DEPTH, random, numRays);
+				}
+			}
+		}
+
+		// tile宽度不是4的倍数时剩下的像素
+		for (; x < tile.x + tile.width; ++x)
+		{
+			const float* offset = jitter + (x - tile.x) * 2;
+			Ray ray = m_Camera.GenerateRay(x + offset[0], y + offset[1]);
+
+			SceneHit hit;
+			IntersectScene(ray, hit);
+			dst[x] += RayHitScene(ray, hit, MAX_DEPTH, random, numRays);
 		}
 	}
 
-	return info;
+	m_PassRays.fetch_add(numRays, std::memory_order_relaxed);
 }
 
-Vector4 Raytracing::RayHitScene(const Ray& ray, int32 depth)
+void PathTracer::IntersectScene(const Ray& ray, SceneHit& hit) const
 {
-	HitInfo hitInfo = IntersectScene(scene, ray);
+	if (m_Mode != IntersectMode::Scalar)
+	{
+		hit.sphere = RayIntersection::IntersectSpheres(m_Spheres, ray.start, ray.direction, EPSILON, hit.dist);
+	}
+	else
+	{
+		for (int32 i = 0; i < m_Scene->spheres.size(); ++i)
+		{
+			const Sphere& sphere = m_Scene->spheres[i];
+			HitInfo tempHit = sphere.HitTest(ray);
+
+			if (tempHit.hit && tempHit.dist < hit.dist)
+			{
+				hit.dist   = tempHit.dist;
+				hit.sphere = i;
+			}
+		}
+	}
 
-	if (hitInfo.hit)
+	if (m_Scene->bvh)
 	{
+		hit.mesh.dist = hit.dist;
+		if (m_Scene->bvh->Intersect(ray.start, ray.direction, EPSILON, hit.mesh))
+		{
+			hit.dist   = hit.mesh.dist;
+			hit.sphere = -1;
+		}
+	}
+}
+
+HitInfo PathTracer::MakeHitInfo(const Ray& ray, const SceneHit& hit) const
+{
+	HitInfo hitInfo;
+	hitInfo.hit  = true;
+	hitInfo.dist = hit.dist;
+	hitInfo.pos  = ray.start + ray.direction * hit.dist;
+
+	if (hit.sphere >= 0)
+	{
+		const Sphere& sphere = m_Scene->spheres[hit.sphere];
+		hitInfo.inside   = false;
+		hitInfo.normal   = (hitInfo.pos - sphere.center) / sphere.radius;
+		hitInfo.material = sphere.material;
+	}
+	else
+	{
+		// 三角形没有内外，法线翻到光线来的一侧
+		hitInfo.normal   = m_Scene->bvh->GetNormal(hit.mesh);
+		hitInfo.inside   = Vector3::DotProduct(hitInfo.normal, ray.direction) > 0.0f;
+		hitInfo.material = m_Scene->meshMaterials[hit.mesh.mesh];
+		if (hitInfo.inside) {
+			hitInfo.normal = -hitInfo.normal;
+		}
+	}
+
+	return hitInfo;
+}
+
+Vector4 PathTracer::RayHitScene(Ray ray, SceneHit hit, int32 maxDepth, RandomStream& random, uint32& numRays) const
+{
+	// 原来的递归展开成循环，throughput为沿途衰减的乘积
+	Vector4 throughput(1.0f, 1.0f, 1.0f, 1.0f);
+
+	for (int32 depth = maxDepth; ; --depth)
+	{
+		numRays += 1;
+
+		if (!hit.IsHit())
+		{
+			float t = (ray.direction.y + 1.0f) * 0.5f;
+			return throughput * ((1.0f - t) * Vector4(1.0f, 1.0f, 1.0f, 1.0f) + t * Vector4(0.5f, 0.7f, 1.0f, 1.0f));
+		}
+
 		if (depth <= 0) {
-			return Vector4(0, 0, 0, 1.0);
+			return throughput * Vector4(0, 0, 0, 1.0);
 		}
 
+		// 只给最近的交点生成HitInfo
+		HitInfo hitInfo = MakeHitInfo(ray, hit);
+
 		Vector4 attenuation;
 		Ray reflect;
 
-		if (hitInfo.material->Scatter(ray, hitInfo, attenuation, reflect)) {
-			return attenuation * RayHitScene(reflect, depth - 1);
-		}
-		else {
-			return Vector4(0.1, 0.1, 0.1, 1.0);
+		if (!hitInfo.material->Scatter(ray, hitInfo, random, attenuation, reflect)) {
+			return throughput * hitInfo.material->Emitted();
 		}
+
+		throughput = throughput * attenuation;
+		ray = reflect;
+
+		hit = SceneHit();
+		IntersectScene(ray, hit);
 	}
-	else 
-	{
-		float t = (ray.direction.y + 1.0f) * 0.5f;
-		return (1.0f - t) * Vector4(1.0f, 1.0f, 1.0f, 1.0f) + t * Vector4(0.5f, 0.7f, 1.0f, 1.0f);
-	}
-}
\ No newline at end of file
+}
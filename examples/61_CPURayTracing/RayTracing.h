@@ -2,10 +2,17 @@
 
 #include "Common/Common.h"
 #include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Math/RayIntersection.h"
 #include "Demo/DVKCamera.h"
-#include "ThreadTask.h"
+#include "Demo/DVKBVH.h"
+#include "Core/JobSystem.h"
 #include "Material.h"
 
+#include <vector>
+#include <atomic>
+
 #define EPSILON 0.0001
 
 struct HitInfo;
@@ -41,61 +48,167 @@ struct Sphere
 
 	}
 
-	HitInfo HitTest(const Ray& ray);
+	HitInfo HitTest(const Ray& ray) const;
 };
 
 struct Scene
 {
-	std::vector<Sphere> spheres;
+	std::vector<Sphere>		spheres;
+	std::vector<Material*>	materials;
+
+	// 可选的三角形网格，meshMaterials和DVKModel::meshes一一对应
+	vk_demo::DVKBVH*		bvh = nullptr;
+	std::vector<Material*>	meshMaterials;
+
+	~Scene()
+	{
+		for (int32 i = 0; i < materials.size(); ++i) {
+			delete materials[i];
+		}
+		materials.clear();
+
+		delete bvh;
+		bvh = nullptr;
+	}
 };
 
-class Raytracing : public ThreadTask
+// 场景求交的结果，sphere和mesh最多一个有效
+struct SceneHit
 {
-public:
+	float				dist = MAX_flt;
+	int32				sphere = -1;
+	vk_demo::DVKRayHit	mesh;
 
-	Raytracing(Scene* inScene, vk_demo::DVKCamera* inCamera, float iw, float ih, int32 idx, int32 inWidth, int32 inHeight)
-		: scene(inScene)
-		, w(iw)
-		, h(ih)
-		, index(idx)
-		, camera(inCamera)
-		, width(inWidth)
-		, height(inHeight)
+	inline bool IsHit() const
 	{
+		return sphere >= 0 || mesh.mesh >= 0;
+	}
+};
+
+// 所有tile共用的相机数据，Reset时算一次，不再每个像素对投影和视图矩阵求逆。
+struct TraceCamera
+{
+	Matrix4x4	invProj;
+	Matrix4x4	invView;
+	Vector3		origin;
+	float		invWidth = 1.0f;
+	float		invHeight = 1.0f;
+
+	void Setup(vk_demo::DVKCamera& camera, int32 width, int32 height);
+
+	// (x, y)为像素坐标，可以带小数做抖动
+	Ray GenerateRay(float x, float y) const;
+};
+
+// 场景求交的方式，结果相同，只是速度不同
+enum class IntersectMode
+{
+	Scalar = 0,	// 逐个Sphere::HitTest，以前的实现
+	SoA,		// 一条光线一次测试4个球
+	Packet,		// 同一行相邻4个像素的primary ray一起测试，反弹的光线走SoA
+	Count
+};
+
+struct TraceTile
+{
+	int32	x;
+	int32	y;
+	int32	width;
+	int32	height;
+};
+
+/**
+ * Progressive path tracer. The image is split into tileSize x tileSize tiles, every pass traces
+ * one sample per pixel with one job per tile and adds it to a float accumulation buffer.
+ * Kick() returns right after submitting the tiles, Resolve()/Kick()/Reset() may only be called
+ * once IsPassComplete() returns true.
+ */
+class PathTracer
+{
+public:
+
+	PathTracer(Scene* inScene, int32 inWidth, int32 inHeight, int32 inTileSize = 16);
+
+	~PathTracer();
+
+	// 清空累积的结果，换相机后需要调用
+	void Reset(vk_demo::DVKCamera& camera);
+
+	void Kick();
 
+	inline bool IsPassComplete() const
+	{
+		return m_PassCounter.IsDone();
 	}
 
-	~Raytracing()
+	void Wait();
+
+	// 累积结果取平均并转到gamma空间，写入width * height * 4的rgba8
+	void Resolve(uint8* rgba);
+
+	inline int32 GetNumSamples() const
 	{
+		return m_NumSamples;
+	}
 
+	inline int32 GetNumTiles() const
+	{
+		return m_Tiles.size();
 	}
 
-	Vector4 HitScene();
+	// 会等待当前的pass完成，切换后需要Reset
+	void SetIntersectMode(IntersectMode mode);
 
-	virtual void DoThreadedWork() override
+	inline IntersectMode GetIntersectMode() const
 	{
-		HitScene();
+		return m_Mode;
 	}
 
-	virtual void Abandon() override
+	// 上一个pass追踪的光线数量，包括每次反弹
+	inline uint64 GetLastPassRays() const
 	{
+		return m_LastPassRays;
+	}
 
+	// 上一个pass从Kick到最后一个tile完成的时间，单位秒
+	inline double GetLastPassTime() const
+	{
+		return m_LastPassTime;
 	}
 
 private:
 
-	HitInfo IntersectScene(Scene* scene, const Ray& ray);
+	void TraceTileSample(const TraceTile& tile, RandomStream& random);
 
-	Vector4 RayHitScene(const Ray& ray, int32 depth);
+	// 球体按m_Mode求交，网格走BVH，hit.dist为输入的最大距离
+	void IntersectScene(const Ray& ray, SceneHit& hit) const;
 
-public:
+	HitInfo MakeHitInfo(const Ray& ray, const SceneHit& hit) const;
+
+	// hit为ray的求交结果，primary ray可以用packet提前算好
+	Vector4 RayHitScene(Ray ray, SceneHit hit, int32 maxDepth, RandomStream& random, uint32& numRays) const;
+
+private:
+
+	Scene*					m_Scene;
+	int32					m_Width;
+	int32					m_Height;
+
+	// 构造时从m_Scene生成，之后场景不能再修改
+	SphereSoA				m_Spheres;
+	IntersectMode			m_Mode = IntersectMode::SoA;
+
+	TraceCamera				m_Camera;
+	std::vector<TraceTile>	m_Tiles;
+	std::vector<Vector4>	m_Accumulation;
+
+	uint64					m_Seed = 0;
+	int32					m_NumSamples = 0;
+	double					m_PassStart = 0.0;
+	double					m_LastPassTime = 0.0;
+	uint64					m_LastPassRays = 0;
+	std::atomic<uint64>		m_PassRays;
 
-	Scene* scene;
-	float w;
-	float h;
-	int32 index;
-	vk_demo::DVKCamera* camera;
-	int32 width;
-	int32 height;
-	Vector4 color;
+	JobCounter				m_TileCounter;
+	JobCounter				m_PassCounter;
 };
@@ -4,6 +4,7 @@
 #include "ThreadEvent.h"
 
 #include <string>
+#include <thread>
 
 class Runnable;
 class ThreadManager;
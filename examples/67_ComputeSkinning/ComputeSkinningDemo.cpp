@@ -0,0 +1,442 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Math/RandomStream.h"
+
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#include <vector>
+
+#define MAX_INSTANCES 100
+
+class ComputeSkinningDemo : public DemoBase
+{
+public:
+	ComputeSkinningDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~ComputeSkinningDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::SetFramesInFlight(2);
+		DemoBase::Prepare();
+
+		CreateRenderTarget();
+		CreateGUI();
+		LoadAssets();
+		InitParmas();
+
+		m_Ready = true;
+
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DemoBase::Release();
+
+		DestroyRenderTarget();
+		DestroyAssets();
+		DestroyGUI();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	struct ModelViewProjectionBlock
+	{
+		Matrix4x4 model;
+		Matrix4x4 view;
+		Matrix4x4 projection;
+	};
+
+	struct DirectionalLightBlock
+	{
+		Matrix4x4 model;
+		Matrix4x4 view;
+		Matrix4x4 projection;
+		Vector4 direction;
+	};
+
+	void UpdateAnimation(float time, float delta)
+	{
+		double poseTime = GenericPlatformTime::Seconds();
+		if (m_Animate) {
+			m_RoleModel->UpdatePoses(m_Poses.data(), m_NumInstances, delta);
+		}
+		m_PoseTime = (GenericPlatformTime::Seconds() - poseTime) * 1000.0;
+
+		// 只拷贝骨骼矩阵，蒙皮全部交给compute shader
+		double uploadTime = GenericPlatformTime::Seconds();
+		m_SkinCompute->UpdateBones(m_Poses.data(), m_NumInstances, m_FrameIndex);
+		m_UploadTime = (GenericPlatformTime::Seconds() - uploadTime) * 1000.0;
+	}
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+
+		bool hovered = UpdateUI(time, delta);
+		if (!hovered) {
+			m_ViewCamera.Update(time, delta);
+		}
+
+		UpdateAnimation(time, delta);
+
+		m_MVPData.view = m_ViewCamera.GetView();
+		m_MVPData.projection = m_ViewCamera.GetProjection();
+
+		// 输出的顶点已经在模型空间，每个实例只需要自己的位置
+		// depth
+		m_DepthMaterial->BeginFrame();
+		for (int32 i = 0; i < m_NumInstances; ++i) {
+			m_LightCamera.model = m_Transforms[i];
+			m_DepthMaterial->BeginObject();
+			m_DepthMaterial->SetLocalUniform("uboMVP", &m_LightCamera, sizeof(DirectionalLightBlock));
+			m_DepthMaterial->EndObject();
+		}
+		m_DepthMaterial->EndFrame();
+
+		// shade
+		m_ShadeMaterial->BeginFrame();
+		for (int32 i = 0; i < m_NumInstances; ++i) {
+			m_MVPData.model = m_Transforms[i];
+			m_ShadeMaterial->BeginObject();
+			m_ShadeMaterial->SetLocalUniform("uboMVP", &m_MVPData, sizeof(ModelViewProjectionBlock));
+			m_ShadeMaterial->SetLocalUniform("lightMVP", &m_LightCamera, sizeof(DirectionalLightBlock));
+			m_ShadeMaterial->EndObject();
+		}
+		m_ShadeMaterial->EndFrame();
+
+		SetupCommandBuffers(bufferIndex);
+
+		DemoBase::Present(bufferIndex);
+	}
+
+	bool UpdateUI(float time, float delta)
+	{
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("ComputeSkinningDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			ImGui::SliderInt("Instances", &m_NumInstances, 1, MAX_INSTANCES);
+			ImGui::Checkbox("Animate", &m_Animate);
+
+			ImGui::Text("Vertices:%d x %d", m_SkinCompute->GetNumVertices(), m_NumInstances);
+			ImGui::Text("Pose:%.3fms Bones:%.3fms", m_PoseTime, m_UploadTime);
+			ImGui::Text("ShadowMap:%dx%d", m_ShadowMap->width, m_ShadowMap->height);
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::Text("Fence wait %.3f ms/frame, %d frames in flight", GetFenceWaitTime(), GetFramesInFlight());
+			ImGui::End();
+		}
+
+		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		return hovered;
+	}
+
+	void CreateRenderTarget()
+	{
+		m_ShadowMap = vk_demo::DVKTexture::CreateRenderTarget(
+			m_VulkanDevice,
+			PixelFormatToVkFormat(m_DepthFormat, false),
+			VK_IMAGE_ASPECT_DEPTH_BIT,
+			2048, 2048,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+		);
+
+		vk_demo::DVKRenderPassInfo passInfo(m_ShadowMap, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
+		m_ShadowRTT = vk_demo::DVKRenderTarget::Create(m_VulkanDevice, passInfo);
+	}
+
+	void DestroyRenderTarget()
+	{
+		delete m_ShadowRTT;
+		delete m_ShadowMap;
+	}
+
+	void LoadAssets()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		// model
+		m_RoleModel = vk_demo::DVKModel::LoadFromFile(
+			"assets/models/xiaonan/nvhai.fbx",
+			m_VulkanDevice,
+			cmdBuffer,
+			{
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_Normal,
+				VertexAttribute::VA_SkinPack,
+			}
+		);
+		m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+
+		// 每个实例一个pose，时间和速度错开
+		RandomStream randomStream(1024);
+		const float duration = m_RoleModel->animations[0].duration;
+		m_Poses.resize(MAX_INSTANCES);
+		for (int32 i = 0; i < MAX_INSTANCES; ++i)
+		{
+			m_RoleModel->InitPose(m_Poses[i], 0);
+			m_Poses[i].speed = randomStream.FRandRange(0.8f, 1.2f);
+			m_RoleModel->EvaluatePose(m_Poses[i], randomStream.FRandRange(0.0f, duration));
+		}
+
+		// skin compute
+		m_SkinShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			"assets/shaders/67_ComputeSkinning/Skinning.comp.spv"
+		);
+
+		m_SkinCompute = vk_demo::DVKSkinCompute::Create(
+			m_VulkanDevice,
+			m_PipelineCache,
+			m_SkinShader,
+			m_RoleModel,
+			MAX_INSTANCES,
+			GetFramesInFlight()
+		);
+
+		// depth
+		m_DepthShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/67_ComputeSkinning/Depth.vert.spv",
+			"assets/shaders/67_ComputeSkinning/Depth.frag.spv"
+		);
+
+		m_DepthMaterial = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_ShadowRTT,
+			m_PipelineCache,
+			m_DepthShader
+		);
+		m_DepthMaterial->pipelineInfo.colorAttachmentCount = 0;
+		m_DepthMaterial->PreparePipeline();
+
+		// shade
+		m_ShadeShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/67_ComputeSkinning/obj.vert.spv",
+			"assets/shaders/67_ComputeSkinning/obj.frag.spv"
+		);
+
+		m_ShadeMaterial = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_RenderPass,
+			m_PipelineCache,
+			m_ShadeShader
+		);
+		m_ShadeMaterial->PreparePipeline();
+		m_ShadeMaterial->SetTexture("shadowMap", m_ShadowMap);
+
+		delete cmdBuffer;
+	}
+
+	void DestroyAssets()
+	{
+		delete m_SkinCompute;
+		delete m_SkinShader;
+
+		delete m_RoleModel;
+
+		delete m_DepthShader;
+		delete m_DepthMaterial;
+
+		delete m_ShadeShader;
+		delete m_ShadeMaterial;
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkViewport viewport = {};
+		viewport.x        = 0;
+		viewport.y        = m_FrameHeight;
+		viewport.width    = m_FrameWidth;
+		viewport.height   = -(float)m_FrameHeight;    // flip y axis
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.extent.width  = m_FrameWidth;
+		scissor.extent.height = m_FrameHeight;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		// 所有实例一次蒙皮，后面的pass都直接读取结果
+		m_SkinCompute->Dispatch(commandBuffer);
+
+		// shadow pass
+		{
+			m_ShadowRTT->BeginRenderPass(commandBuffer);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthMaterial->GetPipeline());
+			for (int32 i = 0; i < m_NumInstances; ++i) {
+				m_DepthMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
+				m_SkinCompute->BindDrawCmd(commandBuffer, i);
+			}
+
+			m_ShadowRTT->EndRenderPass(commandBuffer);
+		}
+
+		// shade pass
+		{
+			VkClearValue clearValues[2];
+			clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+			clearValues[1].depthStencil = { 1.0f, 0 };
+
+			VkRenderPassBeginInfo renderPassBeginInfo;
+			ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+			renderPassBeginInfo.renderPass               = m_RenderPass;
+			renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+			renderPassBeginInfo.clearValueCount          = 2;
+			renderPassBeginInfo.pClearValues             = clearValues;
+			renderPassBeginInfo.renderArea.offset.x      = 0;
+			renderPassBeginInfo.renderArea.offset.y      = 0;
+			renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+			renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadeMaterial->GetPipeline());
+			for (int32 i = 0; i < m_NumInstances; ++i) {
+				m_ShadeMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
+				m_SkinCompute->BindDrawCmd(commandBuffer, i);
+			}
+
+			m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+			vkCmdEndRenderPass(commandBuffer);
+		}
+
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void InitParmas()
+	{
+		vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
+		Vector3 boundSize   = bounds.max - bounds.min;
+		Vector3 boundCenter = bounds.min + boundSize * 0.5f;
+
+		// 10x10的网格，按行填满
+		const int32 gridSize = 10;
+		float spacing = MMath::Max(boundSize.x, boundSize.z) * 1.5f;
+		float extent  = spacing * gridSize;
+
+		m_Transforms.resize(MAX_INSTANCES);
+		for (int32 i = 0; i < MAX_INSTANCES; ++i)
+		{
+			int32 x = i % gridSize;
+			int32 z = i / gridSize;
+			m_Transforms[i].SetIdentity();
+			m_Transforms[i].SetOrigin(Vector3((x - gridSize * 0.5f + 0.5f) * spacing, 0, (z - gridSize * 0.5f + 0.5f) * spacing));
+		}
+
+		m_ViewCamera.SetPosition(boundCenter.x, boundCenter.y + extent * 0.5f, boundCenter.z - extent);
+		m_ViewCamera.LookAt(boundCenter.x, boundCenter.y, boundCenter.z);
+		m_ViewCamera.Perspective(PI / 4, GetWidth(), GetHeight(), 1.0f, extent * 4.0f);
+
+		m_LightCamera.view.SetIdentity();
+		m_LightCamera.view.SetOrigin(Vector3(extent * 0.3f, extent * 0.8f, -extent * 0.6f));
+		m_LightCamera.view.LookAt(Vector3(0, 0, 0));
+		m_LightCamera.direction = -m_LightCamera.view.GetForward().GetSafeNormal();
+		m_LightCamera.view.SetInverse();
+
+		m_LightCamera.projection.SetIdentity();
+		m_LightCamera.projection.Perspective(MMath::DegreesToRadians(75.0f), (float)GetWidth(), (float)GetHeight(), extent * 0.1f, extent * 2.5f);
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf", GetFramesInFlight());
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 							m_Ready = false;
+	vk_demo::DVKCamera				m_ViewCamera;
+
+	// Shadow Rendertarget
+	vk_demo::DVKRenderTarget*		m_ShadowRTT = nullptr;
+	vk_demo::DVKTexture*			m_ShadowMap = nullptr;
+
+	// depth 
+	vk_demo::DVKShader*				m_DepthShader = nullptr;
+	vk_demo::DVKMaterial*			m_DepthMaterial = nullptr;
+
+	// obj render
+	vk_demo::DVKShader*				m_ShadeShader = nullptr;
+	vk_demo::DVKMaterial*			m_ShadeMaterial = nullptr;
+
+	// skin
+	vk_demo::DVKModel*				m_RoleModel = nullptr;
+	vk_demo::DVKShader*				m_SkinShader = nullptr;
+	vk_demo::DVKSkinCompute*		m_SkinCompute = nullptr;
+
+	std::vector<vk_demo::DVKAnimPose>	m_Poses;
+	std::vector<Matrix4x4>			m_Transforms;
+	int32							m_NumInstances = 25;
+	bool							m_Animate = true;
+	float							m_PoseTime = 0.0f;
+	float							m_UploadTime = 0.0f;
+
+	ModelViewProjectionBlock		m_MVPData;
+	DirectionalLightBlock			m_LightCamera;
+
+	ImageGUIContext*				m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<ComputeSkinningDemo>(1400, 900, "ComputeSkinningDemo", cmdLine);
+}
@@ -0,0 +1,347 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Math/RandomStream.h"
+
+#include <vector>
+
+#define MAX_INSTANCES 400
+
+class AnimTextureInstancesDemo : public DemoBase
+{
+public:
+	AnimTextureInstancesDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~AnimTextureInstancesDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::Prepare();
+
+		LoadAssets();
+		InitParmas();
+		CreateGUI();
+
+		m_Ready = true;
+
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DemoBase::Release();
+		DestroyAssets();
+		DestroyGUI();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	struct ParamDataBlock
+	{
+		Matrix4x4 model;
+		Matrix4x4 view;
+		Matrix4x4 projection;
+		Vector4 animParam;
+		Vector4 meshParam;
+	};
+
+	// 每个实例只有播放状态，骨骼动画全部在烘焙好的纹理里
+	struct InstanceInfo
+	{
+		Matrix4x4	transform;
+		int32		animIndex = 0;
+		float		time = 0.0f;
+		float		speed = 1.0f;
+	};
+
+	void UpdateAnimation(float time, float delta)
+	{
+		if (!m_AutoAnimation) {
+			return;
+		}
+
+		for (int32 i = 0; i < m_NumInstances; ++i)
+		{
+			InstanceInfo& instance = m_Instances[i];
+			float duration = m_AnimTexture->GetClip(instance.animIndex).duration;
+			instance.time += delta * instance.speed;
+			if (duration > 0.0f && instance.time > duration) {
+				instance.time = MMath::Fmod(instance.time, duration);
+			}
+		}
+	}
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+
+		bool hovered = UpdateUI(time, delta);
+		if (!hovered) {
+			m_ViewCamera.Update(time, delta);
+		}
+
+		m_ParamData.view = m_ViewCamera.GetView();
+		m_ParamData.projection = m_ViewCamera.GetProjection();
+
+		UpdateAnimation(time, delta);
+
+		m_RoleMaterial->BeginFrame();
+		for (int32 i = 0; i < m_NumInstances; ++i)
+		{
+			const InstanceInfo& instance = m_Instances[i];
+			m_ParamData.model     = instance.transform;
+			m_ParamData.animParam = m_AnimTexture->GetClipParam(instance.animIndex, instance.time);
+
+			for (int32 j = 0; j < m_RoleModel->meshes.size(); ++j)
+			{
+				m_ParamData.meshParam = m_AnimTexture->GetMeshParam(j);
+				m_RoleMaterial->BeginObject();
+				m_RoleMaterial->SetLocalUniform("paramData", &m_ParamData, sizeof(ParamDataBlock));
+				m_RoleMaterial->EndObject();
+			}
+		}
+		m_RoleMaterial->EndFrame();
+
+		SetupCommandBuffers(bufferIndex);
+
+		DemoBase::Present(bufferIndex);
+	}
+
+	bool UpdateUI(float time, float delta)
+	{
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("AnimTextureInstancesDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			ImGui::SliderInt("Instances", &m_NumInstances, 1, MAX_INSTANCES);
+			ImGui::Checkbox("AutoPlay", &m_AutoAnimation);
+
+			ImGui::Text("Clips:%d Frames:%d", m_AnimTexture->GetNumClips(), m_AnimTexture->GetNumFrames());
+			ImGui::Text("Texture:%dx%dx%d %.2fKB", m_AnimTexture->GetWidth(), m_AnimTexture->GetLayerHeight(), m_AnimTexture->GetNumLayers(), m_AnimTexture->GetMemorySize() / 1024.0f);
+			ImGui::Text("Bake:%.2fms Error:%f", m_AnimTexture->GetBakeTime() * 1000.0f, m_AnimTexture->GetMaxTranslationError());
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::End();
+		}
+
+		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		return hovered;
+	}
+
+	void LoadAssets()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		// model
+		m_RoleModel = vk_demo::DVKModel::LoadFromFile(
+			"assets/models/xiaonan/nvhai.fbx",
+			m_VulkanDevice,
+			cmdBuffer,
+			{
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_UV0,
+				VertexAttribute::VA_Normal,
+				VertexAttribute::VA_SkinPack,
+			}
+		);
+		m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+
+		// 烘焙所有动画，挂接的装备也一起烘焙
+		m_AnimTexture = vk_demo::DVKAnimTexture::Create(m_VulkanDevice, cmdBuffer, m_RoleModel);
+
+		// shader
+		m_RoleShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/68_AnimTextureInstances/obj.vert.spv",
+			"assets/shaders/68_AnimTextureInstances/obj.frag.spv"
+		);
+
+		// texture
+		m_RoleDiffuse = vk_demo::DVKTexture::Create2D(
+			"assets/models/xiaonan/b001.jpg",
+			m_VulkanDevice,
+			cmdBuffer
+		);
+
+		// material
+		m_RoleMaterial = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_RenderPass,
+			m_PipelineCache,
+			m_RoleShader
+		);
+		m_RoleMaterial->PreparePipeline();
+		m_RoleMaterial->SetTexture("diffuseMap", m_RoleDiffuse);
+		m_RoleMaterial->SetTexture("animMap", m_AnimTexture->GetTexture());
+
+		delete cmdBuffer;
+	}
+
+	void DestroyAssets()
+	{
+		delete m_RoleShader;
+		delete m_RoleDiffuse;
+		delete m_RoleMaterial;
+		delete m_AnimTexture;
+		delete m_RoleModel;
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkViewport viewport = {};
+		viewport.x        = 0;
+		viewport.y        = m_FrameHeight;
+		viewport.width    = m_FrameWidth;
+		viewport.height   = -(float)m_FrameHeight;    // flip y axis
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.extent.width  = m_FrameWidth;
+		scissor.extent.height = m_FrameHeight;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		VkClearValue clearValues[2];
+		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo;
+		ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+		renderPassBeginInfo.renderPass               = m_RenderPass;
+		renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+		renderPassBeginInfo.clearValueCount          = 2;
+		renderPassBeginInfo.pClearValues             = clearValues;
+		renderPassBeginInfo.renderArea.offset.x      = 0;
+		renderPassBeginInfo.renderArea.offset.y      = 0;
+		renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+		renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_RoleMaterial->GetPipeline());
+		for (int32 i = 0; i < m_NumInstances; ++i)
+		{
+			for (int32 j = 0; j < m_RoleModel->meshes.size(); ++j) 
+			{
+				m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i * m_RoleModel->meshes.size() + j);
+				m_RoleModel->meshes[j]->BindDrawCmd(commandBuffer);
+			}
+		}
+
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void InitParmas()
+	{
+		vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
+		Vector3 boundSize   = bounds.max - bounds.min;
+		Vector3 boundCenter = bounds.min + boundSize * 0.5f;
+
+		// 20x20的网格，每个实例随机动画、起始时间和速度
+		const int32 gridSize = 20;
+		float spacing = MMath::Max(boundSize.x, boundSize.z) * 1.5f;
+		float extent  = spacing * gridSize;
+
+		RandomStream randomStream(1024);
+		m_Instances.resize(MAX_INSTANCES);
+		for (int32 i = 0; i < MAX_INSTANCES; ++i)
+		{
+			InstanceInfo& instance = m_Instances[i];
+			int32 x = i % gridSize;
+			int32 z = i / gridSize;
+			instance.transform.SetIdentity();
+			instance.transform.SetOrigin(Vector3((x - gridSize * 0.5f + 0.5f) * spacing, 0, (z - gridSize * 0.5f + 0.5f) * spacing));
+			instance.animIndex = randomStream.RandRange(0, m_AnimTexture->GetNumClips() - 1);
+			instance.time      = randomStream.FRandRange(0.0f, m_AnimTexture->GetClip(instance.animIndex).duration);
+			instance.speed     = randomStream.FRandRange(0.8f, 1.2f);
+		}
+
+		m_ViewCamera.SetPosition(boundCenter.x, boundCenter.y + extent * 0.3f, boundCenter.z - extent * 0.6f);
+		m_ViewCamera.LookAt(boundCenter.x, boundCenter.y, boundCenter.z);
+		m_ViewCamera.Perspective(PI / 4, GetWidth(), GetHeight(), 1.0f, extent * 4.0f);
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 						m_Ready = false;
+	vk_demo::DVKCamera			m_ViewCamera;
+
+	ParamDataBlock				m_ParamData;
+
+	vk_demo::DVKModel*			m_RoleModel = nullptr;
+	vk_demo::DVKShader*			m_RoleShader = nullptr;
+	vk_demo::DVKTexture*		m_RoleDiffuse = nullptr;
+	vk_demo::DVKMaterial*		m_RoleMaterial = nullptr;
+	vk_demo::DVKAnimTexture*	m_AnimTexture = nullptr;
+
+	std::vector<InstanceInfo>	m_Instances;
+	int32						m_NumInstances = 100;
+	bool						m_AutoAnimation = true;
+
+	ImageGUIContext*			m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<AnimTextureInstancesDemo>(1400, 900, "AnimTextureInstancesDemo", cmdLine);
+}
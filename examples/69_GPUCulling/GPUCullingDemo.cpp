@@ -0,0 +1,396 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+#include "Math/RandomStream.h"
+
+#include <vector>
+
+#define INSTANCE_COUNT 1024 * 64
+
+class GPUCullingDemo : public DemoBase
+{
+public:
+	GPUCullingDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~GPUCullingDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::SetFramesInFlight(2);
+		DemoBase::Prepare();
+
+		CreateGUI();
+		InitParmas();
+		LoadAssets();
+
+		m_Ready = true;
+
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DemoBase::Release();
+		DestroyAssets();
+		DestroyGUI();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	struct ViewProjectionBlock
+	{
+		Matrix4x4 view;
+		Matrix4x4 proj;
+	};
+
+	// 和Solid.vert的实例属性一致
+	struct InstancePayload
+	{
+		Vector4 posScale;
+		Vector4 color;
+	};
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+
+		bool hovered = UpdateUI(time, delta);
+		if (!hovered) {
+			m_ViewCamera.Update(time, delta);
+		}
+
+		// 冻结之后可以移动相机观察剔除的结果
+		if (!m_FreezeCulling) {
+			m_CullViewProj = m_ViewCamera.GetViewProjection();
+		}
+
+		m_ViewProjParam.view = m_ViewCamera.GetView();
+		m_ViewProjParam.proj = m_ViewCamera.GetProjection();
+
+		m_Material->BeginFrame();
+		m_Material->BeginObject();
+		m_Material->SetLocalUniform("uboViewProj", &m_ViewProjParam, sizeof(ViewProjectionBlock));
+		m_Material->EndObject();
+		m_Material->EndFrame();
+
+		SetupCommandBuffers(bufferIndex);
+
+		DemoBase::Present(bufferIndex);
+	}
+
+	bool UpdateUI(float time, float delta)
+	{
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("GPUCullingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			ImGui::Checkbox("Freeze Culling", &m_FreezeCulling);
+			ImGui::Text("Visible:%d/%d", m_Culling->GetNumVisible(), m_Culling->GetNumInstances());
+			ImGui::Text("Draws:%d MultiDrawIndirect:%s", m_Culling->GetNumDraws(), m_VulkanDevice->GetPhysicalFeatures().multiDrawIndirect ? "True" : "False");
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::Text("Fence wait %.3f ms/frame, %d frames in flight", GetFenceWaitTime(), GetFramesInFlight());
+			ImGui::End();
+		}
+
+		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		return hovered;
+	}
+
+	void LoadAssets()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		const char* modelPaths[] = {
+			"assets/models/sphere.obj",
+			"assets/models/cube.obj",
+			"assets/models/suzanne.obj",
+		};
+		const int32 numModels = sizeof(modelPaths) / sizeof(modelPaths[0]);
+
+		// 所有模型合并到一份vertex/index buffer，每个模型一个indirect draw
+		std::vector<float>  vertices;
+		std::vector<uint32> indices;
+		std::vector<vk_demo::DVKCullDraw> draws(numModels);
+		std::vector<vk_demo::DVKBoundingBox> localBounds(numModels);
+
+		for (int32 i = 0; i < numModels; ++i)
+		{
+			vk_demo::DVKModel* model = vk_demo::DVKModel::LoadFromFile(
+				modelPaths[i],
+				m_VulkanDevice,
+				cmdBuffer,
+				{ 
+					VertexAttribute::VA_Position, 
+					VertexAttribute::VA_Normal
+				}
+			);
+
+			// 归一化到单位大小，缩放放在实例数据里
+			vk_demo::DVKBoundingBox bounds = model->rootNode->GetBounds();
+			Vector3 center = (bounds.min + bounds.max) * 0.5f;
+			Vector3 extent = bounds.max - bounds.min;
+			float invSize  = 1.0f / MMath::Max(extent.x, MMath::Max(extent.y, extent.z));
+
+			localBounds[i].min = (bounds.min - center) * invSize;
+			localBounds[i].max = (bounds.max - center) * invSize;
+
+			draws[i].firstIndex   = indices.size();
+			draws[i].vertexOffset = 0;
+
+			for (int32 m = 0; m < model->meshes.size(); ++m)
+			{
+				for (int32 p = 0; p < model->meshes[m]->primitives.size(); ++p)
+				{
+					vk_demo::DVKPrimitive* primitive = model->meshes[m]->primitives[p];
+					uint32 vertexBase = vertices.size() / 6;
+
+					for (int32 n = 0; n < primitive->vertexCount; ++n)
+					{
+						const float* vertex = primitive->vertices.data() + n * 6;
+						vertices.push_back((vertex[0] - center.x) * invSize);
+						vertices.push_back((vertex[1] - center.y) * invSize);
+						vertices.push_back((vertex[2] - center.z) * invSize);
+						vertices.push_back(vertex[3]);
+						vertices.push_back(vertex[4]);
+						vertices.push_back(vertex[5]);
+					}
+
+					for (int32 n = 0; n < primitive->indices.size(); ++n) {
+						indices.push_back(primitive->indices[n] + vertexBase);
+					}
+				}
+			}
+
+			draws[i].indexCount = indices.size() - draws[i].firstIndex;
+
+			delete model;
+		}
+
+		delete cmdBuffer;
+
+		m_VertexBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertices.size() * sizeof(float)
+		);
+
+		m_IndexBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indices.size() * sizeof(uint32)
+		);
+
+		vk_demo::DVKUploadQueue* uploadQueue = vk_demo::DVKUploadQueue::Create(m_VulkanDevice, m_VertexBuffer->size + m_IndexBuffer->size);
+		uploadQueue->UploadBuffer(m_VertexBuffer, vertices.data(), m_VertexBuffer->size);
+		uploadQueue->UploadBuffer(m_IndexBuffer,  indices.data(),  m_IndexBuffer->size);
+		uploadQueue->Flush();
+		uploadQueue->WaitIdle();
+		delete uploadQueue;
+
+		// 随机散布的静态实例，只有一小部分在视锥内
+		RandomStream randomStream(2048);
+		std::vector<vk_demo::DVKCullInstance> instances(INSTANCE_COUNT);
+		std::vector<InstancePayload> payloads(INSTANCE_COUNT);
+		for (int32 i = 0; i < INSTANCE_COUNT; ++i)
+		{
+			int32 drawIndex = randomStream.RandRange(0, numModels - 1);
+			float scale     = randomStream.FRandRange(2.0f, 8.0f);
+			Vector3 position(
+				randomStream.FRandRange(-2000.0f, 2000.0f),
+				randomStream.FRandRange(-100.0f, 100.0f),
+				randomStream.FRandRange(-2000.0f, 2000.0f)
+			);
+
+			instances[i].boundsMin = localBounds[drawIndex].min * scale + position;
+			instances[i].boundsMax = localBounds[drawIndex].max * scale + position;
+			instances[i].drawIndex = drawIndex;
+
+			payloads[i].posScale = Vector4(position, scale);
+			payloads[i].color    = Vector4(randomStream.FRandRange(0.2f, 1.0f), randomStream.FRandRange(0.2f, 1.0f), randomStream.FRandRange(0.2f, 1.0f), 1.0f);
+		}
+
+		m_CullShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice, 
+			"assets/shaders/69_GPUCulling/Cull.comp.spv"
+		);
+
+		m_Culling = vk_demo::DVKGPUCulling::Create(
+			m_VulkanDevice,
+			m_PipelineCache,
+			m_CullShader,
+			draws,
+			instances,
+			payloads.data(),
+			sizeof(InstancePayload),
+			GetFramesInFlight()
+		);
+
+		m_Shader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/69_GPUCulling/Solid.vert.spv",
+			"assets/shaders/69_GPUCulling/Solid.frag.spv"
+		);
+
+		m_Material = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_RenderPass,
+			m_PipelineCache,
+			m_Shader
+		);
+		m_Material->PreparePipeline();
+	}
+
+	void DestroyAssets()
+	{
+		delete m_Culling;
+		delete m_CullShader;
+
+		delete m_VertexBuffer;
+		delete m_IndexBuffer;
+
+		delete m_Material;
+		delete m_Shader;
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkViewport viewport = {};
+		viewport.x        = 0;
+		viewport.y        = m_FrameHeight;
+		viewport.width    = m_FrameWidth;
+		viewport.height   = -(float)m_FrameHeight;    // flip y axis
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.extent.width  = m_FrameWidth;
+		scissor.extent.height = m_FrameHeight;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		// 剔除必须在render pass之外
+		m_Culling->Cull(commandBuffer, m_CullViewProj, m_FrameIndex);
+
+		VkClearValue clearValues[2];
+		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo;
+		ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+		renderPassBeginInfo.renderPass               = m_RenderPass;
+		renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+		renderPassBeginInfo.clearValueCount          = 2;
+		renderPassBeginInfo.pClearValues             = clearValues;
+		renderPassBeginInfo.renderArea.offset.x      = 0;
+		renderPassBeginInfo.renderArea.offset.y      = 0;
+		renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+		renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
+		m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(m_VertexBuffer->buffer), offsets);
+		vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+		m_Culling->BindInstanceBuffer(commandBuffer, 1);
+		m_Culling->DrawIndirect(commandBuffer, 0, m_Culling->GetNumDraws());
+
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void InitParmas()
+	{
+		m_ViewCamera.SetPosition(0, 50.0f, -400.0f);
+		m_ViewCamera.LookAt(0, 0, 0);
+		m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 1.0f, 2500.0f);
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf", GetFramesInFlight());
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 						m_Ready = false;
+
+	vk_demo::DVKBuffer*			m_VertexBuffer = nullptr;
+	vk_demo::DVKBuffer*			m_IndexBuffer = nullptr;
+
+	vk_demo::DVKShader*			m_CullShader = nullptr;
+	vk_demo::DVKGPUCulling*		m_Culling = nullptr;
+
+	vk_demo::DVKMaterial*		m_Material = nullptr;
+	vk_demo::DVKShader*			m_Shader = nullptr;
+
+	vk_demo::DVKCamera			m_ViewCamera;
+	Matrix4x4					m_CullViewProj;
+	bool						m_FreezeCulling = false;
+
+	ViewProjectionBlock			m_ViewProjParam;
+
+	ImageGUIContext*			m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<GPUCullingDemo>(1400, 900, "GPUCullingDemo", cmdLine);
+}
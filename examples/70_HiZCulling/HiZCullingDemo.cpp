@@ -0,0 +1,562 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+
+#define MESH_SIZE 11
+#define SKY_INDEX 8
+#define GRID_SIZE 16
+
+class HiZCullingDemo : public DemoBase
+{
+public:
+	HiZCullingDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~HiZCullingDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::SetFramesInFlight(2);
+		DemoBase::Prepare();
+
+		CreateGUI();
+		CreateDepthRT();
+		LoadAssets();
+		InitParmas();
+
+		m_Ready = true;
+
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DemoBase::Release();
+		DestroyAssets();
+		DestroyGUI();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	struct ViewProjectionBlock
+	{
+		Matrix4x4 view;
+		Matrix4x4 proj;
+	};
+
+	// 和obj.vert的实例属性一致，顶点已经变换到模型空间，实例只有平移
+	struct InstancePayload
+	{
+		Vector4 offset;
+	};
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+
+		bool hovered = UpdateUI(time, delta);
+		if (!hovered) {
+			m_ViewCamera.Update(time, delta);
+		}
+
+		m_ViewProjParam.view = m_ViewCamera.GetView();
+		m_ViewProjParam.proj = m_ViewCamera.GetProjection();
+
+		m_DepthMaterial->BeginFrame();
+		m_DepthMaterial->BeginObject();
+		m_DepthMaterial->SetLocalUniform("uboViewProj", &m_ViewProjParam, sizeof(ViewProjectionBlock));
+		m_DepthMaterial->EndObject();
+		m_DepthMaterial->EndFrame();
+
+		for (int32 i = 0; i < MESH_SIZE; ++i)
+		{
+			m_Materials[i]->BeginFrame();
+			m_Materials[i]->BeginObject();
+			m_Materials[i]->SetLocalUniform("uboViewProj", &m_ViewProjParam, sizeof(ViewProjectionBlock));
+			m_Materials[i]->EndObject();
+			m_Materials[i]->EndFrame();
+		}
+
+		SetupCommandBuffers(bufferIndex);
+
+		DemoBase::Present(bufferIndex);
+	}
+
+	bool UpdateUI(float time, float delta)
+	{
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("HiZCullingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			const char* modes[3] = { "Frustum", "Hi-Z (Last Frame)", "Hi-Z (Two Phase)" };
+			ImGui::Combo("Mode", &m_CullMode, modes, 3);
+
+			ImGui::Text("Visible:%d/%d", m_Culling->GetNumVisible(), m_Culling->GetNumInstances());
+			if (m_CullMode == 2) {
+				ImGui::Text("FirstPhase:%d", m_Culling->GetNumFirstPhase());
+			}
+			ImGui::Text("HiZLevels:%d", m_Culling->GetNumHiZLevels());
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::Text("Fence wait %.3f ms/frame, %d frames in flight", GetFenceWaitTime(), GetFramesInFlight());
+			ImGui::End();
+		}
+
+		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		return hovered;
+	}
+
+	void CreateDepthRT()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		// 非线性深度写入R32，Hi-Z以storage image读取
+		m_TexDepthColor = vk_demo::DVKTexture::Create2D(
+			m_VulkanDevice,
+			cmdBuffer,
+			VK_FORMAT_R32_SFLOAT,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			m_FrameWidth, m_FrameHeight,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			VK_SAMPLE_COUNT_1_BIT,
+			ImageLayoutBarrier::ComputeGeneralRW
+		);
+
+		m_TexDepth = vk_demo::DVKTexture::CreateRenderTarget(
+			m_VulkanDevice,
+			PixelFormatToVkFormat(m_DepthFormat, false),
+			VK_IMAGE_ASPECT_DEPTH_BIT,
+			m_FrameWidth, m_FrameHeight,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+		);
+
+		vk_demo::DVKRenderPassInfo rttInfo(
+			m_TexDepthColor, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+			m_TexDepth, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE
+		);
+		m_RTDepth = vk_demo::DVKRenderTarget::Create(m_VulkanDevice, rttInfo, Vector4(1.0f, 1.0f, 1.0f, 1.0f));
+		m_RTDepth->colorLayout = ImageLayoutBarrier::ComputeGeneralRW;
+
+		delete cmdBuffer;
+	}
+
+	void LoadAssets()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		vk_demo::DVKModel* model = vk_demo::DVKModel::LoadFromFile(
+			"assets/models/Papercraft Windmills/Papercraft Windmills.obj",
+			m_VulkanDevice,
+			cmdBuffer,
+			{ 
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_UV0,
+				VertexAttribute::VA_Normal
+			}
+		);
+
+		// 所有mesh合并到一份vertex/index buffer，每个mesh一个indirect draw
+		std::vector<float>  vertices;
+		std::vector<uint32> indices;
+		std::vector<vk_demo::DVKCullDraw> draws(MESH_SIZE);
+
+		for (int32 i = 0; i < MESH_SIZE; ++i)
+		{
+			vk_demo::DVKMesh* mesh = model->meshes[i];
+			const Matrix4x4& matrix = mesh->linkNode->GetGlobalMatrix();
+
+			draws[i].firstIndex   = indices.size();
+			draws[i].vertexOffset = 0;
+
+			for (int32 p = 0; p < mesh->primitives.size(); ++p)
+			{
+				vk_demo::DVKPrimitive* primitive = mesh->primitives[p];
+				uint32 vertexBase = vertices.size() / 8;
+
+				for (int32 n = 0; n < primitive->vertexCount; ++n)
+				{
+					const float* vertex = primitive->vertices.data() + n * 8;
+					Vector4 position = matrix.TransformPosition(Vector3(vertex[0], vertex[1], vertex[2]));
+					Vector4 normal   = matrix.TransformVector(Vector3(vertex[5], vertex[6], vertex[7]));
+					vertices.push_back(position.x);
+					vertices.push_back(position.y);
+					vertices.push_back(position.z);
+					vertices.push_back(vertex[3]);
+					vertices.push_back(vertex[4]);
+					vertices.push_back(normal.x);
+					vertices.push_back(normal.y);
+					vertices.push_back(normal.z);
+				}
+
+				for (int32 n = 0; n < primitive->indices.size(); ++n) {
+					indices.push_back(primitive->indices[n] + vertexBase);
+				}
+			}
+
+			draws[i].indexCount = indices.size() - draws[i].firstIndex;
+		}
+
+		m_VertexBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertices.size() * sizeof(float)
+		);
+
+		m_IndexBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indices.size() * sizeof(uint32)
+		);
+
+		vk_demo::DVKUploadQueue* uploadQueue = vk_demo::DVKUploadQueue::Create(m_VulkanDevice, m_VertexBuffer->size + m_IndexBuffer->size);
+		uploadQueue->UploadBuffer(m_VertexBuffer, vertices.data(), m_VertexBuffer->size);
+		uploadQueue->UploadBuffer(m_IndexBuffer,  indices.data(),  m_IndexBuffer->size);
+		uploadQueue->Flush();
+		uploadQueue->WaitIdle();
+		delete uploadQueue;
+
+		// 场景复制成GRID_SIZE x GRID_SIZE的网格，地形的起伏和风车互相遮挡。天空盒不复制。
+		vk_demo::DVKBoundingBox bounds = model->meshes[0]->bounding;
+		Vector3 extent = bounds.max - bounds.min;
+		m_GridSpacing  = MMath::Max(extent.x, extent.z);
+
+		std::vector<vk_demo::DVKCullInstance> instances;
+		std::vector<InstancePayload> payloads;
+		for (int32 z = 0; z < GRID_SIZE; ++z)
+		{
+			for (int32 x = 0; x < GRID_SIZE; ++x)
+			{
+				Vector3 offset((x - GRID_SIZE / 2) * m_GridSpacing, 0, (z - GRID_SIZE / 2) * m_GridSpacing);
+
+				for (int32 i = 0; i < MESH_SIZE; ++i)
+				{
+					if (i == SKY_INDEX) {
+						continue;
+					}
+
+					Matrix4x4 matrix = model->meshes[i]->linkNode->GetGlobalMatrix();
+					matrix.AppendTranslation(offset);
+
+					InstancePayload payload;
+					payload.offset = Vector4(offset, 0.0f);
+
+					instances.push_back(vk_demo::DVKCullInstance(model->meshes[i]->bounding, matrix, i));
+					payloads.push_back(payload);
+				}
+			}
+		}
+
+		delete model;
+
+		m_CullShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice, 
+			"assets/shaders/70_HiZCulling/Cull.comp.spv"
+		);
+
+		m_Culling = vk_demo::DVKGPUCulling::Create(
+			m_VulkanDevice,
+			m_PipelineCache,
+			m_CullShader,
+			draws,
+			instances,
+			payloads.data(),
+			sizeof(InstancePayload),
+			GetFramesInFlight()
+		);
+
+		m_HiZBuildShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice, 
+			"assets/shaders/70_HiZCulling/HiZBuild.comp.spv"
+		);
+
+		m_HiZCullShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice, 
+			"assets/shaders/70_HiZCulling/CullHiZ.comp.spv"
+		);
+
+		m_Culling->CreateHiZ(cmdBuffer, m_PipelineCache, m_HiZBuildShader, m_HiZCullShader, m_TexDepthColor);
+
+		// depth prepass
+		m_DepthShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/70_HiZCulling/Depth.vert.spv",
+			"assets/shaders/70_HiZCulling/Depth.frag.spv"
+		);
+
+		m_DepthMaterial = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_RTDepth->GetRenderPass(),
+			m_PipelineCache,
+			m_DepthShader
+		);
+		m_DepthMaterial->PreparePipeline();
+
+		// scene
+		m_Shader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/70_HiZCulling/obj.vert.spv",
+			"assets/shaders/70_HiZCulling/obj.frag.spv"
+		);
+
+		const char* textures[MESH_SIZE] = {
+			"assets/models/Papercraft Windmills/terrain.jpg",
+			"assets/models/Papercraft Windmills/rocks.jpg",
+			"assets/models/Papercraft Windmills/stolbiki.jpg",
+			"assets/models/Papercraft Windmills/animals.jpg",
+			"assets/models/Papercraft Windmills/mill1day.jpg",
+			"assets/models/Papercraft Windmills/wingl1day.png",
+			"assets/models/Papercraft Windmills/trees.jpg",
+			"assets/models/Papercraft Windmills/telega.jpg",
+			"assets/models/Papercraft Windmills/sky_clear.jpg",
+			"assets/models/Papercraft Windmills/wingl2day.png",
+			"assets/models/Papercraft Windmills/mill2day.jpg"
+		};
+
+		for (int32 i = 0; i < MESH_SIZE; ++i)
+		{
+			m_Textures[i] = vk_demo::DVKTexture::Create2D(
+				textures[i],
+				m_VulkanDevice,
+				cmdBuffer
+			);
+
+			m_Materials[i] = vk_demo::DVKMaterial::Create(
+				m_VulkanDevice,
+				m_RenderPass,
+				m_PipelineCache,
+				m_Shader
+			);
+			m_Materials[i]->PreparePipeline();
+			m_Materials[i]->SetTexture("diffuseMap", m_Textures[i]);
+		}
+
+		delete cmdBuffer;
+	}
+
+	void DestroyAssets()
+	{
+		delete m_Culling;
+		delete m_CullShader;
+		delete m_HiZBuildShader;
+		delete m_HiZCullShader;
+
+		delete m_VertexBuffer;
+		delete m_IndexBuffer;
+
+		delete m_DepthMaterial;
+		delete m_DepthShader;
+
+		delete m_RTDepth;
+		delete m_TexDepthColor;
+		delete m_TexDepth;
+
+		for (int32 i = 0; i < MESH_SIZE; ++i)
+		{
+			delete m_Materials[i];
+			delete m_Textures[i];
+		}
+		delete m_Shader;
+	}
+
+	void BindGeometry(VkCommandBuffer commandBuffer)
+	{
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(m_VertexBuffer->buffer), offsets);
+		vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+		m_Culling->BindInstanceBuffer(commandBuffer, 1);
+	}
+
+	// 只写入深度，结果用于构建Hi-Z
+	void DepthPass(VkCommandBuffer commandBuffer)
+	{
+		m_RTDepth->BeginRenderPass(commandBuffer);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthMaterial->GetPipeline());
+		m_DepthMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+		BindGeometry(commandBuffer);
+		m_Culling->DrawIndirect(commandBuffer, 0, m_Culling->GetNumDraws());
+
+		m_RTDepth->EndRenderPass(commandBuffer);
+	}
+
+	void ScenePass(VkCommandBuffer commandBuffer, int32 backBufferIndex)
+	{
+		VkViewport viewport = {};
+		viewport.x        = 0;
+		viewport.y        = m_FrameHeight;
+		viewport.width    = m_FrameWidth;
+		viewport.height   = -(float)m_FrameHeight;    // flip y axis
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.extent.width  = m_FrameWidth;
+		scissor.extent.height = m_FrameHeight;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		VkClearValue clearValues[2];
+		clearValues[0].color        = { { 0.55f, 0.75f, 0.95f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo;
+		ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+		renderPassBeginInfo.renderPass               = m_RenderPass;
+		renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+		renderPassBeginInfo.clearValueCount          = 2;
+		renderPassBeginInfo.pClearValues             = clearValues;
+		renderPassBeginInfo.renderArea.offset.x      = 0;
+		renderPassBeginInfo.renderArea.offset.y      = 0;
+		renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+		renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+		BindGeometry(commandBuffer);
+
+		for (int32 i = 0; i < MESH_SIZE; ++i)
+		{
+			if (i == SKY_INDEX) {
+				continue;
+			}
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Materials[i]->GetPipeline());
+			m_Materials[i]->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+			m_Culling->DrawIndirect(commandBuffer, i, 1);
+		}
+
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		Matrix4x4 viewProj = m_ViewCamera.GetViewProjection();
+
+		if (m_CullMode == 0)
+		{
+			m_Culling->Cull(commandBuffer, viewProj, m_FrameIndex, vk_demo::DVKCullMode::Frustum);
+		}
+		else if (m_CullMode == 1)
+		{
+			// 使用上一帧的Hi-Z，可见的实例写入深度给下一帧使用
+			m_Culling->Cull(commandBuffer, viewProj, m_FrameIndex, vk_demo::DVKCullMode::HiZ);
+			DepthPass(commandBuffer);
+			m_Culling->BuildHiZ(commandBuffer, viewProj);
+		}
+		else
+		{
+			// 先绘制上一帧可见的实例，用这一帧的Hi-Z重新测试所有实例
+			m_Culling->Cull(commandBuffer, viewProj, m_FrameIndex, vk_demo::DVKCullMode::HiZFirstPhase);
+			DepthPass(commandBuffer);
+			m_Culling->BuildHiZ(commandBuffer, viewProj);
+			m_Culling->Cull(commandBuffer, viewProj, m_FrameIndex, vk_demo::DVKCullMode::HiZSecondPhase);
+		}
+
+		ScenePass(commandBuffer, backBufferIndex);
+
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void InitParmas()
+	{
+		m_ViewCamera.SetPosition(0, 600.0f, -m_GridSpacing * 2.0f);
+		m_ViewCamera.LookAt(0, 300.0f, 0);
+		m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 10.0f, m_GridSpacing * GRID_SIZE);
+		m_ViewCamera.speed = 500.0f;
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf", GetFramesInFlight());
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 						m_Ready = false;
+
+	vk_demo::DVKBuffer*			m_VertexBuffer = nullptr;
+	vk_demo::DVKBuffer*			m_IndexBuffer = nullptr;
+
+	vk_demo::DVKShader*			m_CullShader = nullptr;
+	vk_demo::DVKShader*			m_HiZBuildShader = nullptr;
+	vk_demo::DVKShader*			m_HiZCullShader = nullptr;
+	vk_demo::DVKGPUCulling*		m_Culling = nullptr;
+	int32						m_CullMode = 2;
+	float						m_GridSpacing = 1.0f;
+
+	vk_demo::DVKTexture*		m_TexDepthColor = nullptr;
+	vk_demo::DVKTexture*		m_TexDepth = nullptr;
+	vk_demo::DVKRenderTarget*	m_RTDepth = nullptr;
+	vk_demo::DVKShader*			m_DepthShader = nullptr;
+	vk_demo::DVKMaterial*		m_DepthMaterial = nullptr;
+
+	vk_demo::DVKShader*			m_Shader = nullptr;
+	vk_demo::DVKTexture*		m_Textures[MESH_SIZE];
+	vk_demo::DVKMaterial*		m_Materials[MESH_SIZE];
+
+	vk_demo::DVKCamera			m_ViewCamera;
+
+	ViewProjectionBlock			m_ViewProjParam;
+
+	ImageGUIContext*			m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<HiZCullingDemo>(1400, 900, "HiZCullingDemo", cmdLine);
+}
@@ -7,6 +7,8 @@
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 #include <vector>
 
 class LoadMeshModule : public DemoBase
@@ -107,6 +109,19 @@ private:
 				ImGui::Text("%-20s Tri:%d", mesh->linkNode->name.c_str(), mesh->triangleCount);
 			}
             
+			if (ImGui::Button("Benchmark fread/ReadFile/MapFile")) {
+				BenchmarkFileRead();
+			}
+
+			if (m_ReadFileTime > 0.0)
+			{
+				double megaBytes = m_BenchmarkBytes / (1024.0 * 1024.0);
+				ImGui::Text("%d files, %.1f MB", m_BenchmarkFiles, megaBytes);
+				ImGui::Text("fread   :%.2fms %.0fMB/s", m_FreadTime    * 1000.0, megaBytes / m_FreadTime);
+				ImGui::Text("ReadFile:%.2fms %.0fMB/s", m_ReadFileTime * 1000.0, megaBytes / m_ReadFileTime);
+				ImGui::Text("MapFile :%.2fms %.0fMB/s", m_MapFileTime  * 1000.0, megaBytes / m_MapFileTime);
+			}
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
 		}
@@ -122,6 +137,98 @@ private:
 		return hovered;
 	}
 
+	// 以前ReadFile的实现：fopen/fread拷贝到new出来的内存，作为对比的基准
+	static bool ReadFileLegacy(const std::string& filepath, uint8*& dataPtr, uint32& dataSize)
+	{
+		std::string finalPath = FileManager::GetFilePath(filepath);
+
+		FILE* file = fopen(finalPath.c_str(), "rb");
+		if (!file) {
+			return false;
+		}
+
+		fseek(file, 0, SEEK_END);
+		dataSize = (uint32)ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		if (dataSize <= 0) {
+			fclose(file);
+			return false;
+		}
+
+		dataPtr = new uint8[dataSize];
+		fread(dataPtr, 1, dataSize, file);
+		fclose(file);
+
+		return true;
+	}
+
+	// 分别用fread、ReadFile和MapFile读一遍assets下的所有文件，每个字节都读取一次，模拟解析时的访问。
+	// ReadFile现在是MapFile加一次拷贝，fread是以前的实现。
+	// 先跑的一方会把文件读进page cache，所以计时前先完整读一遍预热。
+	void BenchmarkFileRead()
+	{
+		std::vector<std::string> files;
+		FileManager::ListFiles("assets", files);
+
+		uint64 checksum = 0;
+		for (int32 i = 0; i < files.size(); ++i) {
+			FileViewRef view = FileManager::MapFile(files[i]);
+			checksum += view ? SumBytes(view->GetData(), view->GetSize()) : 0;
+		}
+
+		m_BenchmarkFiles = files.size();
+		m_BenchmarkBytes = 0;
+
+		double beginTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < files.size(); ++i)
+		{
+			uint8* dataPtr  = nullptr;
+			uint32 dataSize = 0;
+			if (ReadFileLegacy(files[i], dataPtr, dataSize))
+			{
+				checksum += SumBytes(dataPtr, dataSize);
+				m_BenchmarkBytes += dataSize;
+				delete[] dataPtr;
+			}
+		}
+		m_FreadTime = GenericPlatformTime::Seconds() - beginTime;
+
+		beginTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < files.size(); ++i)
+		{
+			uint8* dataPtr  = nullptr;
+			uint32 dataSize = 0;
+			if (FileManager::ReadFile(files[i], dataPtr, dataSize))
+			{
+				checksum += SumBytes(dataPtr, dataSize);
+				delete[] dataPtr;
+			}
+		}
+		m_ReadFileTime = GenericPlatformTime::Seconds() - beginTime;
+
+		beginTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < files.size(); ++i)
+		{
+			FileViewRef view = FileManager::MapFile(files[i]);
+			if (view) {
+				checksum += SumBytes(view->GetData(), view->GetSize());
+			}
+		}
+		m_MapFileTime = GenericPlatformTime::Seconds() - beginTime;
+
+		MLOG("Read %d files %llu bytes, fread:%.2fms ReadFile:%.2fms MapFile:%.2fms checksum:%llu", m_BenchmarkFiles, m_BenchmarkBytes, m_FreadTime * 1000.0, m_ReadFileTime * 1000.0, m_MapFileTime * 1000.0, checksum);
+	}
+
+	static uint64 SumBytes(const uint8* data, uint32 size)
+	{
+		uint64 sum = 0;
+		for (uint32 i = 0; i < size; ++i) {
+			sum += data[i];
+		}
+		return sum;
+	}
+
 	void LoadAssets()
 	{
 		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
@@ -460,6 +567,12 @@ private:
 
 	bool							m_AutoRotate = false;
 	bool 							m_Ready = false;
+
+	int32							m_BenchmarkFiles = 0;
+	uint64							m_BenchmarkBytes = 0;
+	double							m_FreadTime = 0.0;
+	double							m_ReadFileTime = 0.0;
+	double							m_MapFileTime = 0.0;
     
 	std::vector<UBOData> 			m_MVPDatas;
 	DVKBuffers						m_MVPBuffers;
@@ -0,0 +1,6 @@
+#version 450
+
+void main() 
+{
+
+}
\ No newline at end of file
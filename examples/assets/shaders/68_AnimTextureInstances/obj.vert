@@ -0,0 +1,156 @@
+#version 450
+
+layout (location = 0) in vec3  inPosition;
+layout (location = 1) in vec2  inUV0;
+layout (location = 2) in vec3  inNormal;
+layout (location = 3) in vec3  inSkinPack;
+
+layout (binding = 0) uniform MVPBlock 
+{
+	mat4 modelMatrix;
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+
+	// x: startFrame y: numFrames z: frameRate w: time
+	vec4 animParam;
+	// x: column y: numBones，为0时是挂接在节点上的非蒙皮mesh
+	vec4 meshParam;
+} paramData;
+
+layout (binding = 1) uniform sampler2DArray animMap;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec4 outColor;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+ivec4 UnPackUInt32To4Byte(uint packIndex)
+{
+	uint idx0 = (packIndex >> 24) & 0xFF;
+	uint idx1 = (packIndex >> 16) & 0xFF;
+	uint idx2 = (packIndex >> 8)  & 0xFF;
+	uint idx3 = (packIndex >> 0)  & 0xFF;
+	return ivec4(idx0, idx1, idx2, idx3);
+}
+
+ivec2 UnPackUInt32To2Short(uint packIndex)
+{
+	uint idx0 = (packIndex >> 16) & 0xFFFF;
+	uint idx1 = (packIndex >> 0)  & 0xFFFF;
+	return ivec2(idx0, idx1);
+}
+
+vec3 DualQuatTransformPosition(mat2x4 dualQuat, vec3 position)
+{
+	float len = length(dualQuat[0]);
+	dualQuat /= len;
+	
+	vec3 result = position.xyz + 2.0 * cross(dualQuat[0].xyz, cross(dualQuat[0].xyz, position.xyz) + dualQuat[0].w * position.xyz);
+	vec3 trans  = 2.0 * (dualQuat[0].w * dualQuat[1].xyz - dualQuat[1].w * dualQuat[0].xyz + cross(dualQuat[0].xyz, dualQuat[1].xyz));
+	result += trans;
+
+	return result;
+}
+
+vec3 DualQuatTransformVector(mat2x4 dualQuat, vec3 vector)
+{
+	dualQuat[0] /= length(dualQuat[0]);
+	return vector + 2.0 * cross(dualQuat[0].xyz, cross(dualQuat[0].xyz, vector) + dualQuat[0].w * vector);
+}
+
+// 帧在所有层中连续编号
+mat2x4 ReadFrame(int frame, int column, int layerHeight)
+{
+	ivec3 coord = ivec3(column, frame % layerHeight, frame / layerHeight);
+
+	mat2x4 animData;
+	animData[0] = texelFetch(animMap, coord, 0);
+	animData[1] = texelFetch(animMap, coord + ivec3(1, 0, 0), 0);
+	return animData;
+}
+
+// 前后两帧插值
+mat2x4 ReadBoneAnim(int boneIndex)
+{
+	int layerHeight = textureSize(animMap, 0).y;
+	int startFrame  = int(paramData.animParam.x);
+	int numFrames   = int(paramData.animParam.y);
+	int column      = int(paramData.meshParam.x) + boneIndex * 2;
+
+	float frame = paramData.animParam.w * paramData.animParam.z;
+	int frame0  = min(int(frame), numFrames - 1);
+	int frame1  = min(frame0 + 1, numFrames - 1);
+	float alpha = frame - float(frame0);
+
+	mat2x4 dualQuat0 = ReadFrame(startFrame + frame0, column, layerHeight);
+	mat2x4 dualQuat1 = ReadFrame(startFrame + frame1, column, layerHeight);
+
+	if (dot(dualQuat0[0], dualQuat1[0]) < 0.0) {
+		dualQuat1 *= -1.0;
+	}
+
+	return dualQuat0 * (1.0 - alpha) + dualQuat1 * alpha;
+}
+
+mat2x4 CalcDualQuat(ivec4 skinIndex, vec4 skinWeight)
+{
+	mat2x4 dualQuat0 = ReadBoneAnim(skinIndex.x);
+	mat2x4 dualQuat1 = ReadBoneAnim(skinIndex.y);
+	mat2x4 dualQuat2 = ReadBoneAnim(skinIndex.z);
+	mat2x4 dualQuat3 = ReadBoneAnim(skinIndex.w);
+
+	if (dot(dualQuat0[0], dualQuat1[0]) < 0.0) {
+		dualQuat1 *= -1.0;
+	}
+	if (dot(dualQuat0[0], dualQuat2[0]) < 0.0) {
+		dualQuat2 *= -1.0;
+	}
+	if (dot(dualQuat0[0], dualQuat3[0]) < 0.0) {
+		dualQuat3 *= -1.0;
+	}
+
+	mat2x4 blendDualQuat = dualQuat0 * skinWeight.x;
+	blendDualQuat += dualQuat1 * skinWeight.y;
+	blendDualQuat += dualQuat2 * skinWeight.z;
+	blendDualQuat += dualQuat3 * skinWeight.w;
+
+	return blendDualQuat;
+}
+
+void main() 
+{
+	mat2x4 dualQuat;
+
+	if (paramData.meshParam.y > 0)
+	{
+		// skin info
+		ivec4 skinIndex   = UnPackUInt32To4Byte(uint(inSkinPack.x));
+		ivec2 skinWeight0 = UnPackUInt32To2Short(uint(inSkinPack.y));
+		ivec2 skinWeight1 = UnPackUInt32To2Short(uint(inSkinPack.z));
+		vec4  skinWeight  = vec4(skinWeight0 / 65535.0, skinWeight1 / 65535.0);
+
+		dualQuat = CalcDualQuat(skinIndex, skinWeight);
+	}
+	else
+	{
+		// 挂接的mesh烘焙的是节点的global矩阵
+		dualQuat = ReadBoneAnim(0);
+	}
+
+	vec4 position = vec4(DualQuatTransformPosition(dualQuat, inPosition.xyz), 1.0);
+	vec3 normal   = DualQuatTransformVector(dualQuat, inNormal);
+
+	// 转换法线
+	mat3 normalMatrix = transpose(inverse(mat3(paramData.modelMatrix)));
+	normal = normalize(normalMatrix * normal);
+
+	outUV     = inUV0;
+	outNormal = normal;
+	outColor  = vec4(1.0);
+	
+	gl_Position = paramData.projectionMatrix * paramData.viewMatrix * paramData.modelMatrix * position;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	vec3 lightDir = normalize(vec3(0.5, 1.0, -0.3));
+	float diffuse = max(dot(normalize(inNormal), lightDir), 0.0) * 0.8 + 0.2;
+	outFragColor = vec4(inColor * diffuse, 1.0);
+}
\ No newline at end of file
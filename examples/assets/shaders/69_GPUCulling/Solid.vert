@@ -0,0 +1,30 @@
+#version 450
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec4 inInstancePosScale;
+layout (location = 3) in vec4 inInstanceColor;
+
+layout (binding = 0) uniform ViewProjBlock 
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} uboViewProj;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+void main() 
+{
+	// 实例只有平移和统一缩放，法线不需要变换
+	vec3 position = inPosition * inInstancePosScale.w + inInstancePosScale.xyz;
+	outNormal = normalize(inNormal);
+	outColor  = inInstanceColor.rgb;
+	
+	gl_Position = uboViewProj.projectionMatrix * uboViewProj.viewMatrix * vec4(position, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 450
+
+layout (location = 0) out float outDepth;
+
+void main() 
+{
+	outDepth = gl_FragCoord.z;
+}
\ No newline at end of file
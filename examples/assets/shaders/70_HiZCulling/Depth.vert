@@ -0,0 +1,23 @@
+#version 450
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec2 inUV0;
+layout (location = 2) in vec3 inNormal;
+layout (location = 3) in vec4 inInstanceOffset;
+
+layout (binding = 0) uniform ViewProjBlock 
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} uboViewProj;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+void main() 
+{
+	vec3 position = inPosition + inInstanceOffset.xyz;
+	gl_Position = uboViewProj.projectionMatrix * uboViewProj.viewMatrix * vec4(position, 1.0);
+}
\ No newline at end of file
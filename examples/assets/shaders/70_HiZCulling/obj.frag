@@ -0,0 +1,15 @@
+#version 450
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec3 inNormal;
+
+layout (binding = 1) uniform sampler2D diffuseMap;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	vec3 lightDir = normalize(vec3(0.5, 1.0, 0.3));
+	float NdotL   = max(dot(normalize(inNormal), lightDir), 0.0) * 0.6 + 0.4;
+	outFragColor  = vec4(texture(diffuseMap, inUV).rgb * NdotL, 1.0);
+}
\ No newline at end of file
@@ -1,7 +1,7 @@
 #ifndef ASSIMP_REVISION_H_INC
 #define ASSIMP_REVISION_H_INC
 
-#define GitVersion 0x69d8eec3
-#define GitBranch "dev"
+#define GitVersion 0x30ac3a32
+#define GitBranch "master"
 
 #endif // ASSIMP_REVISION_H_INC